@@ -37,6 +37,19 @@ typedef struct _DOSDATE
     WORD Year:5;
 } DOSDATE, *PDOSDATE;
 
+
+/* An uncompressed data block */
+typedef struct _CAB_BLOCK_BUFFER
+{
+    PCFFOLDER Folder;       // Folder of the block, NULL if the buffer is empty
+    PCFDATA CFData;         // Compressed block
+    ULONG Index;            // Index of the block in the folder
+    ULONG Offset;           // Uncompressed offset of the block in the folder
+    ULONG Size;             // Number of uncompressed bytes
+    ULONG Status;           // Status of the codec
+    UCHAR Data[CAB_BLOCKSIZE];
+} CAB_BLOCK_BUFFER, *PCAB_BLOCK_BUFFER;
+
 static WCHAR CabinetName[256];          // Filename of current cabinet
 static WCHAR CabinetPrev[256];          // Filename of previous cabinet
 static WCHAR DiskPrev[256];             // Label of cabinet in file CabinetPrev
@@ -66,6 +79,15 @@ static PCABINET_DISK_CHANGE DiskChangeHandler = NULL;
 static z_stream ZStream;
 static PVOID CabinetReservedArea = NULL;
 
+/* Blocks are uncompressed by a worker thread one block ahead of the extraction */
+static PCAB_BLOCK_BUFFER CurrentBlock = NULL;   // Block the extraction copies from
+static PCAB_BLOCK_BUFFER NextBlock = NULL;      // Block the worker thread uncompresses
+static BOOLEAN NextBlockPending = FALSE;
+static BOOLEAN InflateShutdown = FALSE;
+static HANDLE InflateThread = NULL;
+static HANDLE InflateRequestEvent = NULL;
+static HANDLE InflateDoneEvent = NULL;
+
 
 /* Needed by zlib, but we don't want the dependency on msvcrt.dll */
 void *__cdecl
@@ -368,6 +390,297 @@ SetAttributesOnFile(PCFFILE File,
     return NT_SUCCESS(NtStatus);
 }
 
+/*
+ * FUNCTION: Uncompresses a data block
+ * ARGUMENTS:
+ *     Block = Pointer to buffer that describes the block
+ * NOTES:
+ *     The pages of the block after it are touched, so that they are read
+ *     from disk while this block is copied to the destination file
+ */
+static VOID
+InflateBlock(PCAB_BLOCK_BUFFER Block)
+{
+    PUCHAR Data = (PUCHAR)(Block->CFData + 1) + DataReserved;
+    PCFDATA Next;
+    LONG InputLength, OutputLength;
+    ULONG_PTR Page;
+
+    if ((Data > FileBuffer + FileSize) ||
+        (Block->CFData->UncompSize == 0) ||
+        (Block->CFData->UncompSize > CAB_BLOCKSIZE) ||
+        (Block->CFData->CompSize > (ULONG)(FileBuffer + FileSize - Data)))
+    {
+        DPRINT1("Invalid data block at 0x%X\n", (UINT)((PUCHAR)Block->CFData - FileBuffer));
+        Block->Status = CS_BADSTREAM;
+        return;
+    }
+
+    InputLength = Block->CFData->CompSize;
+    OutputLength = Block->CFData->UncompSize;
+    Block->Status = CodecUncompress(Block->Data, Data, &InputLength, &OutputLength);
+    Block->Size = OutputLength;
+
+    if ((Block->Status == CS_SUCCESS) && (Block->Size != Block->CFData->UncompSize))
+    {
+        DPRINT1("Block uncompressed to %u bytes, expected %u\n",
+                (UINT)Block->Size, (UINT)Block->CFData->UncompSize);
+        Block->Status = CS_BADSTREAM;
+    }
+
+    /* Read ahead the next block of the folder */
+    if (Block->Index + 1 < Block->Folder->DataBlockCount)
+    {
+        Next = (PCFDATA)(Data + Block->CFData->CompSize);
+        Data = (PUCHAR)(Next + 1) + DataReserved;
+        if (Data <= FileBuffer + FileSize &&
+            Next->CompSize <= (ULONG)(FileBuffer + FileSize - Data))
+        {
+            for (Page = (ULONG_PTR)Next & ~(PAGE_SIZE - 1);
+                 Page < (ULONG_PTR)(Data + Next->CompSize);
+                 Page += PAGE_SIZE)
+            {
+                (VOID)*(volatile UCHAR *)max(Page, (ULONG_PTR)Next);
+            }
+        }
+    }
+}
+
+/*
+ * FUNCTION: Worker thread that uncompresses blocks ahead of the extraction
+ */
+static DWORD WINAPI
+InflateThreadRoutine(LPVOID lpParameter)
+{
+    for (;;)
+    {
+        NtWaitForSingleObject(InflateRequestEvent, FALSE, NULL);
+        if (InflateShutdown)
+            break;
+
+        InflateBlock(NextBlock);
+        NtSetEvent(InflateDoneEvent, NULL);
+    }
+
+    NtTerminateThread(NtCurrentThread(), STATUS_SUCCESS);
+    return 0;
+}
+
+/*
+ * FUNCTION: Waits until the worker thread has uncompressed the next block
+ */
+static VOID
+WaitForNextBlock(VOID)
+{
+    if (NextBlockPending)
+    {
+        NtWaitForSingleObject(InflateDoneEvent, FALSE, NULL);
+        NextBlockPending = FALSE;
+    }
+}
+
+/*
+ * FUNCTION: Starts uncompressing the block that follows the current block
+ */
+static VOID
+RequestNextBlock(VOID)
+{
+    PCFDATA CFData = CurrentBlock->CFData;
+
+    ASSERT(!NextBlockPending);
+
+    NextBlock->Folder = NULL;
+    if (CurrentBlock->Index + 1 >= CurrentBlock->Folder->DataBlockCount)
+        return;
+
+    NextBlock->Folder = CurrentBlock->Folder;
+    NextBlock->CFData = (PCFDATA)((PUCHAR)(CFData + 1) + DataReserved + CFData->CompSize);
+    NextBlock->Index = CurrentBlock->Index + 1;
+    NextBlock->Offset = CurrentBlock->Offset + CurrentBlock->Size;
+
+    if (InflateThread != NULL)
+    {
+        NextBlockPending = TRUE;
+        NtSetEvent(InflateRequestEvent, NULL);
+    }
+    else
+    {
+        InflateBlock(NextBlock);
+    }
+}
+
+/*
+ * FUNCTION: Returns the uncompressed block that contains an offset
+ * ARGUMENTS:
+ *     Folder = Pointer to the folder
+ *     Offset = Uncompressed offset in the folder
+ * RETURNS:
+ *     Pointer to the block, or NULL if the block cannot be uncompressed
+ */
+static PCAB_BLOCK_BUFFER
+GetBlock(PCFFOLDER Folder,
+         ULONG Offset)
+{
+    PCAB_BLOCK_BUFFER Block;
+    PCFDATA CFData;
+    ULONG Index;
+    ULONG BlockOffset;
+
+    if (CurrentBlock->Folder == Folder &&
+        Offset >= CurrentBlock->Offset &&
+        Offset < CurrentBlock->Offset + CurrentBlock->Size)
+    {
+        return CurrentBlock;
+    }
+
+    WaitForNextBlock();
+
+    if (NextBlock->Folder == Folder &&
+        NextBlock->Status == CS_SUCCESS &&
+        Offset >= NextBlock->Offset &&
+        Offset < NextBlock->Offset + NextBlock->Size)
+    {
+        /* The usual case, the extraction continues in the next block */
+        Block = CurrentBlock;
+        CurrentBlock = NextBlock;
+        NextBlock = Block;
+        RequestNextBlock();
+        return CurrentBlock;
+    }
+
+    /* Walk the data blocks until we reach the one containing the offset */
+    if (CurrentBlock->Folder == Folder && Offset >= CurrentBlock->Offset)
+    {
+        CFData = CurrentBlock->CFData;
+        Index = CurrentBlock->Index;
+        BlockOffset = CurrentBlock->Offset;
+    }
+    else
+    {
+        CFData = (PCFDATA)(FileBuffer + Folder->DataOffset);
+        Index = 0;
+        BlockOffset = 0;
+    }
+
+    for (;;)
+    {
+        if (Index >= Folder->DataBlockCount ||
+            (PUCHAR)(CFData + 1) > FileBuffer + FileSize)
+        {
+            DPRINT1("Offset 0x%X is not in the folder\n", (UINT)Offset);
+            return NULL;
+        }
+
+        if (BlockOffset + CFData->UncompSize > Offset)
+            break;
+
+        BlockOffset += CFData->UncompSize;
+        CFData = (PCFDATA)((PUCHAR)(CFData + 1) + DataReserved + CFData->CompSize);
+        Index++;
+    }
+
+    CurrentBlock->Folder = Folder;
+    CurrentBlock->CFData = CFData;
+    CurrentBlock->Index = Index;
+    CurrentBlock->Offset = BlockOffset;
+    InflateBlock(CurrentBlock);
+
+    if (CurrentBlock->Status != CS_SUCCESS)
+    {
+        CurrentBlock->Folder = NULL;
+        return NULL;
+    }
+
+    RequestNextBlock();
+    return CurrentBlock;
+}
+
+/*
+ * FUNCTION: Allocates the block buffers and starts the worker thread
+ * RETURNS:
+ *     Status of operation
+ */
+static ULONG
+StartInflateThread(VOID)
+{
+    NTSTATUS NtStatus;
+
+    CurrentBlock = RtlAllocateHeap(ProcessHeap, HEAP_ZERO_MEMORY, sizeof(CAB_BLOCK_BUFFER));
+    NextBlock = RtlAllocateHeap(ProcessHeap, HEAP_ZERO_MEMORY, sizeof(CAB_BLOCK_BUFFER));
+    if (CurrentBlock == NULL || NextBlock == NULL)
+        return CAB_STATUS_NOMEMORY;
+
+    NextBlockPending = FALSE;
+    InflateShutdown = FALSE;
+
+    NtStatus = NtCreateEvent(&InflateRequestEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (NT_SUCCESS(NtStatus))
+        NtStatus = NtCreateEvent(&InflateDoneEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (NT_SUCCESS(NtStatus))
+    {
+        NtStatus = RtlCreateUserThread(NtCurrentProcess(),
+                                       NULL,
+                                       FALSE,
+                                       0,
+                                       0,
+                                       0,
+                                       InflateThreadRoutine,
+                                       NULL,
+                                       &InflateThread,
+                                       NULL);
+    }
+
+    if (!NT_SUCCESS(NtStatus))
+    {
+        /* Blocks are uncompressed by the extraction itself then */
+        DPRINT1("Cannot start the inflate thread (%x)\n", NtStatus);
+        InflateThread = NULL;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Stops the worker thread and frees the block buffers
+ */
+static VOID
+StopInflateThread(VOID)
+{
+    if (InflateThread != NULL)
+    {
+        WaitForNextBlock();
+        InflateShutdown = TRUE;
+        NtSetEvent(InflateRequestEvent, NULL);
+        NtWaitForSingleObject(InflateThread, FALSE, NULL);
+        NtClose(InflateThread);
+        InflateThread = NULL;
+    }
+
+    if (InflateRequestEvent != NULL)
+    {
+        NtClose(InflateRequestEvent);
+        InflateRequestEvent = NULL;
+    }
+
+    if (InflateDoneEvent != NULL)
+    {
+        NtClose(InflateDoneEvent);
+        InflateDoneEvent = NULL;
+    }
+
+    if (CurrentBlock != NULL)
+    {
+        RtlFreeHeap(ProcessHeap, 0, CurrentBlock);
+        CurrentBlock = NULL;
+    }
+
+    if (NextBlock != NULL)
+    {
+        RtlFreeHeap(ProcessHeap, 0, NextBlock);
+        NextBlock = NULL;
+    }
+}
+
 /*
  * FUNCTION: Closes the current cabinet
  * RETURNS:
@@ -376,6 +689,8 @@ SetAttributesOnFile(PCFFILE File,
 static ULONG
 CloseCabinet(VOID)
 {
+    StopInflateThread();
+
     if (FileBuffer)
     {
         NtUnmapViewOfSection(NtCurrentProcess(), FileBuffer);
@@ -658,6 +973,13 @@ CabinetOpen(VOID)
             wcscpy(DiskNext, L"");
         }
         CabinetFolders = (PCFFOLDER)Buffer;
+
+        if (StartInflateThread() != CAB_STATUS_SUCCESS)
+        {
+            CloseCabinet();
+            DPRINT1("Cannot allocate block buffers\n");
+            return CAB_STATUS_NOMEMORY;
+        }
     }
 
     DPRINT("CabinetOpen returning SUCCESS\n");
@@ -821,15 +1143,14 @@ Validate(VOID)
 ULONG
 CabinetExtractFile(PCAB_SEARCH Search)
 {
-    ULONG Size;                 // remaining file bytes to decompress
+    ULONG Size;                 // remaining file bytes to copy
     ULONG CurrentOffset;        // current uncompressed offset within the folder
-    PUCHAR CurrentBuffer;       // current pointer to compressed data in the block
-    LONG RemainingBlock;        // remaining comp data in the block
+    ULONG Length;               // bytes to copy from the current block
+    PCAB_BLOCK_BUFFER Block;    // uncompressed block containing CurrentOffset
     HANDLE DestFile;
     HANDLE DestFileSection;
     PVOID DestFileBuffer;       // mapped view of dest file
     PVOID CurrentDestBuffer;    // pointer to the current position in the dest view
-    PCFDATA CFData;             // current data block
     ULONG Status;
     FILETIME FileTime;
     WCHAR DestName[MAX_PATH];
@@ -841,8 +1162,6 @@ CabinetExtractFile(PCAB_SEARCH Search)
     FILE_BASIC_INFORMATION FileBasic;
     PCFFOLDER CurrentFolder;
     LARGE_INTEGER MaxDestFileSize;
-    LONG InputLength, OutputLength;
-    char Junk[512];
 
     if (wcscmp(Search->Cabinet, CabinetName) != 0)
     {
@@ -1020,94 +1339,32 @@ CabinetExtractFile(PCAB_SEARCH Search)
         ExtractHandler(Search->File, DestName);
     }
 
-    if (Search->CFData)
-        CFData = Search->CFData;
-    else
-        CFData = (PCFDATA)(CabinetFolders[Search->File->FolderIndex].DataOffset + FileBuffer);
-
-    CurrentOffset = Search->Offset;
-    while (CurrentOffset + CFData->UncompSize <= Search->File->FileOffset)
-    {
-        /* walk the data blocks until we reach
-           the one containing the start of the file */
-        CurrentOffset += CFData->UncompSize;
-        CFData = (PCFDATA)((char *)(CFData + 1) + DataReserved + CFData->CompSize);
-    }
-    
-    Search->CFData = CFData;
-    Search->Offset = CurrentOffset;
-
-    /* now decompress and discard any data in
-       the block before the start of the file */
-
-    /* start of comp data */
-    CurrentBuffer = ((unsigned char *)(CFData + 1)) + DataReserved;
-    RemainingBlock = CFData->CompSize;
-    InputLength = RemainingBlock;
-
-    while (CurrentOffset < Search->File->FileOffset)
-    {
-        /* compute remaining uncomp bytes to start
-           of file, bounded by sizeof junk */
-        OutputLength = Search->File->FileOffset - CurrentOffset;
-        if (OutputLength > (LONG)sizeof(Junk))
-            OutputLength = sizeof (Junk);
-
-        /* negate to signal NOT end of block */
-        OutputLength = -OutputLength;
-        CodecUncompress(Junk, CurrentBuffer, &InputLength, &OutputLength);
-        /* add the uncomp bytes extracted to current folder offset */
-        CurrentOffset += OutputLength;
-        /* add comp bytes consumed to CurrentBuffer */
-        CurrentBuffer += InputLength;
-        /* subtract bytes consumed from bytes remaining in block */
-        RemainingBlock -= InputLength;
-        /* neg for resume decompression of the same block */
-        InputLength = -RemainingBlock;
-    }
-
-    /* now CurrentBuffer points to the first comp byte
-       of the file, so we can begin decompressing */
-
-    /* Size = remaining uncomp bytes of the file to decompress */
+    /* Copy the file from the uncompressed blocks. While a block is copied,
+       the worker thread uncompresses the block after it */
+    CurrentOffset = Search->File->FileOffset;
     Size = Search->File->FileSize;
     while (Size > 0)
     {
-        OutputLength = Size;
-        DPRINT("Decompressing block at %x with RemainingBlock = %d, Size = %d\n",
-               CurrentBuffer, RemainingBlock, Size);
-
-        Status = CodecUncompress(CurrentDestBuffer,
-                                 CurrentBuffer,
-                                 &InputLength,
-                                 &OutputLength);
-
-        if (Status != CS_SUCCESS)
+        Block = GetBlock(CurrentFolder, CurrentOffset);
+        if (Block == NULL)
         {
             DPRINT("Cannot uncompress block\n");
-            if (Status == CS_NOMEMORY)
-                Status = CAB_STATUS_NOMEMORY;
             Status = CAB_STATUS_INVALID_CAB;
             goto UnmapDestFile;
         }
 
-        /* advance dest buffer by bytes produced */
-        CurrentDestBuffer = (PVOID)((ULONG_PTR)CurrentDestBuffer + OutputLength);
-        /* advance src buffer by bytes consumed */
-        CurrentBuffer += InputLength;
-        /* reduce remaining file bytes by bytes produced */
-        Size -= OutputLength;
-        /* reduce remaining block size by bytes consumed */
-        RemainingBlock -= InputLength;
-        if (Size > 0 && RemainingBlock == 0)
-        {
-            /* used up this block, move on to the next */
-            DPRINT("Out of block data\n");
-            CFData = (PCFDATA)CurrentBuffer;
-            RemainingBlock = CFData->CompSize;
-            CurrentBuffer = (unsigned char *)(CFData + 1) + DataReserved;
-            InputLength = RemainingBlock;
-        }
+        Search->CFData = Block->CFData;
+        Search->Offset = Block->Offset;
+
+        Length = min(Size, Block->Offset + Block->Size - CurrentOffset);
+        DPRINT("Copying %u bytes from block at 0x%X\n",
+               (UINT)Length, (UINT)((PUCHAR)Block->CFData - FileBuffer));
+
+        memcpy(CurrentDestBuffer, Block->Data + (CurrentOffset - Block->Offset), Length);
+
+        CurrentDestBuffer = (PVOID)((ULONG_PTR)CurrentDestBuffer + Length);
+        CurrentOffset += Length;
+        Size -= Length;
     }
 
     Status = CAB_STATUS_SUCCESS;
@@ -1140,6 +1397,9 @@ CabinetSelectCodec(ULONG Id)
         CodecSelected = FALSE;
     }
 
+    /* The worker thread must not use the codec while it is changed */
+    WaitForNextBlock();
+
     switch (Id)
     {
         case CAB_CODEC_RAW:
@@ -58,13 +58,25 @@ RegImportBinaryHive(
     _In_ ULONG ChunkSize)
 {
     NTSTATUS Status;
+    PHBASE_BLOCK BaseBlock = ChunkBase;
     TRACE("RegImportBinaryHive(%p, 0x%lx)\n", ChunkBase, ChunkSize);
 
+    /*
+     * The hive is used flat, straight from the loaded file: all the cells
+     * are reached by pointer arithmetic, so all the bins must be there.
+     */
+    if (ChunkSize < sizeof(HBASE_BLOCK) ||
+        BaseBlock->Length > ChunkSize - sizeof(HBASE_BLOCK))
+    {
+        ERR("Truncated hive %p, size 0x%lx!\n", ChunkBase, ChunkSize);
+        return FALSE;
+    }
+
     /* Allocate and initialize the hive */
     CmHive = CmpAllocate(sizeof(CMHIVE), FALSE, 'eviH');
     Status = HvInitialize(&CmHive->Hive,
                           HINIT_FLAT, // HINIT_MEMORY_INPLACE
-                          0,
+                          HIVE_SUBKEY_INDEX,
                           0,
                           ChunkBase,
                           CmpAllocate,
@@ -86,7 +86,7 @@ WinLdrLoadSystemHive(IN OUT PLOADER_PARAMETER_BLOCK LoaderBlock,
 
     /* Finally read from file to the memory */
     Status = ArcRead(FileId, (PVOID)HiveDataPhysical, HiveFileSize, &BytesRead);
-    if (Status != ESUCCESS)
+    if (Status != ESUCCESS || BytesRead != HiveFileSize)
     {
         ArcClose(FileId);
         UiMessageBox("Unable to read from hive file!");
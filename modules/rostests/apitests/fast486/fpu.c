@@ -0,0 +1,130 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test the precision modes of the Fast486 FPU emulation
+ */
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#include <windef.h>
+#include <fast486.h>
+
+#define MEMORY_SIZE     0x100000
+#define CODE_SEGMENT    0x1000
+#define CODE_ADDRESS    (CODE_SEGMENT << 4)
+#define RESULT_ADDRESS  0x100
+#define CONTROL_ADDRESS 0x200
+#define MAX_STEPS       100000
+
+/* Rounding control is truncate, everything else is the default */
+#define CONTROL_TRUNCATE 0x0F7F
+
+/* The precision exception is unmasked, everything else is the default */
+#define CONTROL_UNMASK_PE 0x035F
+
+static const UCHAR Program[] =
+{
+    0xDB, 0xE3,                 /* FNINIT */
+    0x90, 0x90, 0x90, 0x90,     /* NOPs, replaced with FLDCW [CONTROL_ADDRESS] */
+    0xD9, 0xEC,                 /* FLDLG2 */
+    0xD9, 0xEA,                 /* FLDL2E */
+    0xD9, 0xEB,                 /* FLDPI */
+    0xD9, 0xE8,                 /* FLD1 */
+    0xB9, 0xE8, 0x03,           /* MOV CX, 1000 */
+    0xD8, 0xC1,                 /* FADD ST0, ST1 */
+    0xD8, 0xCB,                 /* FMUL ST0, ST3 */
+    0xD8, 0xF2,                 /* FDIV ST0, ST2 */
+    0xD8, 0xE3,                 /* FSUB ST0, ST3 */
+    0xD8, 0xC8,                 /* FMUL ST0, ST0 */
+    0xD8, 0xF9,                 /* FDIVR ST0, ST1 */
+    0xE2, 0xF2,                 /* LOOP back to the FADD */
+    0xDD, 0x1E,                 /* FSTP QWORD [RESULT_ADDRESS] */
+    LOBYTE(RESULT_ADDRESS), HIBYTE(RESULT_ADDRESS),
+    0xF4                        /* HLT */
+};
+
+static UCHAR Memory[MEMORY_SIZE];
+
+static VOID
+FASTCALL
+MemReadCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    RtlCopyMemory(Buffer, &Memory[Address & (MEMORY_SIZE - 1)], Size);
+}
+
+static VOID
+FASTCALL
+MemWriteCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    RtlCopyMemory(&Memory[Address & (MEMORY_SIZE - 1)], Buffer, Size);
+}
+
+static ULONGLONG
+RunProgram(FAST486_FPU_PRECISION Precision, USHORT Control)
+{
+    static FAST486_STATE State;
+    ULONG Steps = 0;
+
+    RtlZeroMemory(Memory, sizeof(Memory));
+    RtlCopyMemory(&Memory[CODE_ADDRESS], Program, sizeof(Program));
+
+    if (Control != 0)
+    {
+        /* FLDCW [CONTROL_ADDRESS] */
+        Memory[CODE_ADDRESS + 2] = 0xD9;
+        Memory[CODE_ADDRESS + 3] = 0x2E;
+        Memory[CODE_ADDRESS + 4] = LOBYTE(CONTROL_ADDRESS);
+        Memory[CODE_ADDRESS + 5] = HIBYTE(CONTROL_ADDRESS);
+
+        *(PUSHORT)&Memory[CONTROL_ADDRESS] = Control;
+    }
+
+    Fast486Initialize(&State,
+                      MemReadCallback,
+                      MemWriteCallback,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL);
+
+    Fast486SetFpuPrecision(&State, Precision);
+    Fast486ExecuteAt(&State, CODE_SEGMENT, 0);
+
+    while (!State.Halted && (Steps < MAX_STEPS))
+    {
+        Steps += Fast486ExecuteBatch(&State, MAX_STEPS - Steps);
+    }
+
+    ok(State.Halted, "The program did not halt\n");
+    return *(PULONGLONG)&Memory[RESULT_ADDRESS];
+}
+
+START_TEST(FpuPrecision)
+{
+    ULONGLONG Exact, Host;
+    double ExactValue, HostValue;
+
+    /* The host arithmetic must give nearly the same result */
+    Exact = RunProgram(FAST486_FPU_EXACT, 0);
+    Host = RunProgram(FAST486_FPU_HOST, 0);
+
+    RtlCopyMemory(&ExactValue, &Exact, sizeof(ExactValue));
+    RtlCopyMemory(&HostValue, &Host, sizeof(HostValue));
+
+    ok(ExactValue > 0.1 && ExactValue < 0.2, "Exact result: %I64x\n", Exact);
+    ok((HostValue - ExactValue) < 1e-12 && (ExactValue - HostValue) < 1e-12,
+       "Host result: %I64x, exact result: %I64x\n", Host, Exact);
+
+    /* The host only rounds to nearest, other modes must stay bit-exact */
+    Exact = RunProgram(FAST486_FPU_EXACT, CONTROL_TRUNCATE);
+    Host = RunProgram(FAST486_FPU_HOST, CONTROL_TRUNCATE);
+    ok(Host == Exact, "Host result: %I64x, exact result: %I64x\n", Host, Exact);
+
+    /* So must an unmasked precision exception */
+    Exact = RunProgram(FAST486_FPU_EXACT, CONTROL_UNMASK_PE);
+    Host = RunProgram(FAST486_FPU_HOST, CONTROL_UNMASK_PE);
+    ok(Host == Exact, "Host result: %I64x, exact result: %I64x\n", Host, Exact);
+}
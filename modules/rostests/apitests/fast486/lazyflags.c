@@ -0,0 +1,462 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test the lazy flags of the Fast486 CPU emulator against the eager ones
+ */
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#include <windef.h>
+#include <fast486.h>
+
+#define MEMORY_SIZE     0x100000
+#define CODE_SEGMENT    0x1000
+#define CODE_ADDRESS    (CODE_SEGMENT << 4)
+#define CODE_SIZE       0x8000
+#define MAX_STEPS       100000
+
+#define PROGRAM_COUNT   200
+#define SNIPPET_COUNT   300
+
+#define FLAG_CF         0x0001
+#define FLAG_PF         0x0004
+#define FLAG_AF         0x0010
+#define FLAG_ZF         0x0040
+#define FLAG_SF         0x0080
+#define FLAG_OF         0x0800
+#define FLAGS_MASK      (FLAG_CF | FLAG_PF | FLAG_AF | FLAG_ZF | FLAG_SF | FLAG_OF)
+
+typedef enum
+{
+    RUN_EAGER,
+    RUN_LAZY,
+    RUN_LAZY_BATCH,
+    RUN_LAZY_CACHED,
+    RUN_COUNT
+} RUN_MODE;
+
+static const char *ModeNames[RUN_COUNT] =
+{
+    "eager",
+    "lazy",
+    "lazy batch",
+    "lazy cached"
+};
+
+typedef struct
+{
+    ULONG Regs[FAST486_NUM_GEN_REGS];
+    ULONG Flags;
+    ULONG Ip;
+    ULONG Steps;
+} RUN_RESULT;
+
+static UCHAR Program[CODE_SIZE];
+static ULONG ProgramSize;
+static ULONG Seed;
+
+static UCHAR Memory[RUN_COUNT][MEMORY_SIZE];
+static PUCHAR CurrentMemory;
+
+static FAST486_STATE State;
+static FAST486_BLOCK_CACHE BlockCache;
+
+static VOID
+FASTCALL
+MemReadCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+    {
+        ((PUCHAR)Buffer)[i] = CurrentMemory[(Address + i) & (MEMORY_SIZE - 1)];
+    }
+}
+
+static VOID
+FASTCALL
+MemWriteCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+    {
+        CurrentMemory[(Address + i) & (MEMORY_SIZE - 1)] = ((PUCHAR)Buffer)[i];
+    }
+}
+
+static ULONG
+Random(VOID)
+{
+    /* xorshift32, so that every run generates the same programs */
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+static UCHAR
+RandomRegister(VOID)
+{
+    UCHAR Register;
+
+    /* Leave the stack pointer alone */
+    do Register = Random() % FAST486_NUM_GEN_REGS;
+    while (Register == FAST486_REG_ESP);
+
+    return Register;
+}
+
+static VOID
+Emit(UCHAR Byte)
+{
+    Program[ProgramSize++] = Byte;
+}
+
+static VOID
+EmitWord(USHORT Word)
+{
+    Emit(LOBYTE(Word));
+    Emit(HIBYTE(Word));
+}
+
+static VOID
+EmitSnippet(VOID)
+{
+    /* Prefer the values that make the flags interesting */
+    static const USHORT Interesting[] =
+    {
+        0x0000, 0x0001, 0x000F, 0x0010, 0x007F, 0x0080,
+        0x00FF, 0x7FFF, 0x8000, 0x8001, 0xFFFF, 0xFFFE
+    };
+
+    UCHAR Operation = Random() % 8;
+    UCHAR Condition = Random() % 16;
+    UCHAR Dest = RandomRegister();
+    UCHAR Source = RandomRegister();
+    USHORT Immediate = (Random() & 1) ? Interesting[Random() % _countof(Interesting)]
+                                      : (USHORT)Random();
+
+    switch (Random() % 16)
+    {
+        case 0:
+        {
+            /* MOV reg16, imm16 */
+            Emit(0xB8 + Dest);
+            EmitWord(Immediate);
+            break;
+        }
+
+        case 1:
+        {
+            /* MOV reg32, imm32 */
+            Emit(0x66);
+            Emit(0xB8 + Dest);
+            EmitWord(Immediate);
+            EmitWord((Random() & 1) ? Immediate : (USHORT)Random());
+            break;
+        }
+
+        case 2:
+        {
+            /* ALU reg16/32, reg16/32 in both directions */
+            if (Random() & 1) Emit(0x66);
+            Emit((Operation << 3) | 1 | ((Random() & 1) << 1));
+            Emit(0xC0 | (Source << 3) | Dest);
+            break;
+        }
+
+        case 3:
+        {
+            /* ALU reg8, reg8 */
+            Emit((Operation << 3) | ((Random() & 1) << 1));
+            Emit(0xC0 | ((Random() % 8) << 3) | (Random() % 8));
+            break;
+        }
+
+        case 4:
+        {
+            /* ALU reg16, imm8 and ALU reg8, imm8 */
+            Emit((Random() & 1) ? 0x83 : 0x80);
+            Emit(0xC0 | (Operation << 3) | Dest);
+            Emit(LOBYTE(Immediate));
+            break;
+        }
+
+        case 5:
+        {
+            /* ALU AL, imm8 and ALU AX, imm16 */
+            if (Random() & 1)
+            {
+                Emit((Operation << 3) | 4);
+                Emit(LOBYTE(Immediate));
+            }
+            else
+            {
+                Emit((Operation << 3) | 5);
+                EmitWord(Immediate);
+            }
+
+            break;
+        }
+
+        case 6:
+        {
+            /* TEST */
+            switch (Random() % 3)
+            {
+                case 0:
+                    Emit(0x84);
+                    Emit(0xC0 | ((Random() % 8) << 3) | (Random() % 8));
+                    break;
+
+                case 1:
+                    Emit(0x85);
+                    Emit(0xC0 | (Source << 3) | Dest);
+                    break;
+
+                default:
+                    Emit(0xA8);
+                    Emit(LOBYTE(Immediate));
+                    break;
+            }
+
+            break;
+        }
+
+        case 7:
+        {
+            /* INC/DEC keep the carry flag */
+            Emit(((Random() & 1) ? 0x40 : 0x48) + Dest);
+            break;
+        }
+
+        case 8:
+        {
+            /* PUSHF, POP reg16 */
+            Emit(0x9C);
+            Emit(0x58 + Dest);
+            break;
+        }
+
+        case 9:
+        {
+            /* LAHF or SAHF */
+            Emit((Random() & 1) ? 0x9F : 0x9E);
+            break;
+        }
+
+        case 10:
+        {
+            /* SETcc reg8 */
+            Emit(0x0F);
+            Emit(0x90 + Condition);
+            Emit(0xC0 | (Random() % 8));
+            break;
+        }
+
+        case 11:
+        {
+            /* Jcc short over an INC AX */
+            Emit(0x70 + Condition);
+            Emit(0x01);
+            Emit(0x40);
+            break;
+        }
+
+        case 12:
+        {
+            /* Jcc near over an INC CX */
+            Emit(0x0F);
+            Emit(0x80 + Condition);
+            EmitWord(0x0001);
+            Emit(0x41);
+            break;
+        }
+
+        case 13:
+        {
+            /* SHL, RCL, RCR reg16, 1 */
+            static const UCHAR Shifts[] = { 0xE0, 0xD0, 0xD8 };
+
+            Emit(0xD1);
+            Emit(Shifts[Random() % _countof(Shifts)] | Dest);
+            break;
+        }
+
+        case 14:
+        {
+            /* CLC, STC or CMC */
+            static const UCHAR CarryOps[] = { 0xF8, 0xF9, 0xF5 };
+
+            Emit(CarryOps[Random() % _countof(CarryOps)]);
+            break;
+        }
+
+        default:
+        {
+            /* CMP followed by a conditional jump, the common case */
+            Emit(0x39);
+            Emit(0xC0 | (Source << 3) | Dest);
+            Emit(0x70 + Condition);
+            Emit(0x01);
+            Emit(0x42);
+            break;
+        }
+    }
+}
+
+static VOID
+GenerateProgram(VOID)
+{
+    ULONG i;
+
+    ProgramSize = 0;
+    for (i = 0; i < SNIPPET_COUNT; i++) EmitSnippet();
+
+    /* HLT */
+    Emit(0xF4);
+}
+
+static VOID
+RunProgram(RUN_MODE Mode, RUN_RESULT *Result)
+{
+    ULONG i;
+
+    CurrentMemory = Memory[Mode];
+    RtlZeroMemory(CurrentMemory, MEMORY_SIZE);
+    RtlCopyMemory(&CurrentMemory[CODE_ADDRESS], Program, ProgramSize);
+
+    Fast486Initialize(&State,
+                      MemReadCallback,
+                      MemWriteCallback,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL);
+
+    Fast486SetBlockCache(&State, (Mode == RUN_LAZY_CACHED) ? &BlockCache : NULL);
+    Fast486EnableLazyFlags(&State, Mode != RUN_EAGER);
+    Fast486ExecuteAt(&State, CODE_SEGMENT, 0);
+
+    Result->Steps = 0;
+
+    if ((Mode == RUN_LAZY_BATCH) || (Mode == RUN_LAZY_CACHED))
+    {
+        while (!State.Halted && (Result->Steps < MAX_STEPS))
+        {
+            /* Uneven batches, so that they end in random places */
+            Result->Steps += Fast486ExecuteBatch(&State, 1 + Random() % 64);
+        }
+    }
+    else
+    {
+        while (!State.Halted && (Result->Steps < MAX_STEPS))
+        {
+            Fast486StepInto(&State);
+            Result->Steps++;
+        }
+    }
+
+    for (i = 0; i < FAST486_NUM_GEN_REGS; i++) Result->Regs[i] = State.GeneralRegs[i].Long;
+    Result->Flags = State.Flags.Long;
+    Result->Ip = State.InstPtr.Long;
+}
+
+static ULONG
+RunSnippet(const UCHAR *Code, ULONG Size, ULONG Steps)
+{
+    ULONG i;
+
+    CurrentMemory = Memory[RUN_LAZY];
+    RtlZeroMemory(&CurrentMemory[CODE_ADDRESS], CODE_SIZE);
+    RtlCopyMemory(&CurrentMemory[CODE_ADDRESS], Code, Size);
+
+    Fast486Initialize(&State,
+                      MemReadCallback,
+                      MemWriteCallback,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL);
+
+    Fast486EnableLazyFlags(&State, TRUE);
+    Fast486ExecuteAt(&State, CODE_SEGMENT, 0);
+
+    for (i = 0; i < Steps; i++) Fast486StepInto(&State);
+    return State.Flags.Long & FLAGS_MASK;
+}
+
+static VOID
+TestKnownFlags(VOID)
+{
+    /* MOV AX, 7FFFh; ADD AX, 1 */
+    static const UCHAR AddOverflow[] = { 0xB8, 0xFF, 0x7F, 0x05, 0x01, 0x00 };
+    /* XOR AX, AX */
+    static const UCHAR XorZero[] = { 0x31, 0xC0 };
+    /* MOV AL, 0; SUB AL, 1 */
+    static const UCHAR SubBorrow[] = { 0xB0, 0x00, 0x2C, 0x01 };
+    /* MOV AX, 8000h; CMP AX, 1 */
+    static const UCHAR CmpOverflow[] = { 0xB8, 0x00, 0x80, 0x3D, 0x01, 0x00 };
+    /* STC; MOV AL, 0FFh; INC AL */
+    static const UCHAR IncCarry[] = { 0xF9, 0xB0, 0xFF, 0xFE, 0xC0 };
+    ULONG Flags;
+
+    Flags = RunSnippet(AddOverflow, sizeof(AddOverflow), 2);
+    ok(Flags == (FLAG_PF | FLAG_AF | FLAG_SF | FLAG_OF),
+       "ADD: Flags = 0x%lx\n", Flags);
+
+    Flags = RunSnippet(XorZero, sizeof(XorZero), 1);
+    ok(Flags == (FLAG_PF | FLAG_ZF), "XOR: Flags = 0x%lx\n", Flags);
+
+    Flags = RunSnippet(SubBorrow, sizeof(SubBorrow), 2);
+    ok(Flags == (FLAG_CF | FLAG_PF | FLAG_AF | FLAG_SF),
+       "SUB: Flags = 0x%lx\n", Flags);
+
+    Flags = RunSnippet(CmpOverflow, sizeof(CmpOverflow), 2);
+    ok(Flags == (FLAG_PF | FLAG_AF | FLAG_OF), "CMP: Flags = 0x%lx\n", Flags);
+
+    Flags = RunSnippet(IncCarry, sizeof(IncCarry), 3);
+    ok(Flags == (FLAG_CF | FLAG_PF | FLAG_AF | FLAG_ZF),
+       "INC: Flags = 0x%lx\n", Flags);
+}
+
+START_TEST(LazyFlags)
+{
+    RUN_RESULT Results[RUN_COUNT];
+    ULONG Index, Mode;
+
+    TestKnownFlags();
+
+    for (Index = 0; Index < PROGRAM_COUNT; Index++)
+    {
+        Seed = 0x1F2E3D4C + Index;
+        GenerateProgram();
+
+        for (Mode = 0; Mode < RUN_COUNT; Mode++) RunProgram(Mode, &Results[Mode]);
+
+        ok(Results[RUN_EAGER].Steps < MAX_STEPS, "Program %lu did not halt\n", Index);
+
+        for (Mode = RUN_LAZY; Mode < RUN_COUNT; Mode++)
+        {
+            ok(RtlEqualMemory(Results[Mode].Regs, Results[RUN_EAGER].Regs, sizeof(Results[Mode].Regs)),
+               "Program %lu: registers differ in %s mode\n", Index, ModeNames[Mode]);
+            ok(Results[Mode].Flags == Results[RUN_EAGER].Flags,
+               "Program %lu: Flags = 0x%lx in %s mode, expected 0x%lx\n",
+               Index, Results[Mode].Flags, ModeNames[Mode], Results[RUN_EAGER].Flags);
+            ok(Results[Mode].Ip == Results[RUN_EAGER].Ip,
+               "Program %lu: IP = 0x%lx in %s mode, expected 0x%lx\n",
+               Index, Results[Mode].Ip, ModeNames[Mode], Results[RUN_EAGER].Ip);
+            ok(Results[Mode].Steps == Results[RUN_EAGER].Steps,
+               "Program %lu: %lu steps in %s mode, expected %lu\n",
+               Index, Results[Mode].Steps, ModeNames[Mode], Results[RUN_EAGER].Steps);
+            ok(RtlEqualMemory(Memory[Mode], Memory[RUN_EAGER], MEMORY_SIZE),
+               "Program %lu: memory differs in %s mode\n", Index, ModeNames[Mode]);
+        }
+    }
+}
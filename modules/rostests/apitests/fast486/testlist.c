@@ -0,0 +1,12 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_FpuPrecision(void);
+extern void func_LazyFlags(void);
+
+const struct test winetest_testlist[] =
+{
+    { "FpuPrecision", func_FpuPrecision },
+    { "LazyFlags", func_LazyFlags },
+    { 0, 0 }
+};
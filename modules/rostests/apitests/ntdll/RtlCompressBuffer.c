@@ -0,0 +1,151 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for RtlCompressBuffer
+ */
+
+#include "precomp.h"
+
+#define TEST_SIZE   0x5000
+
+static UCHAR Uncompressed[TEST_SIZE];
+static UCHAR Compressed[TEST_SIZE + TEST_SIZE / 8 + 0x200];
+static UCHAR Decompressed[TEST_SIZE];
+
+static BOOLEAN
+IsAllZeros(ULONG Size)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+    {
+        if (Uncompressed[i] != 0) return FALSE;
+    }
+
+    return TRUE;
+}
+
+static ULONG
+CompressAndCheck(USHORT FormatAndEngine, ULONG Size)
+{
+    NTSTATUS Status, ExpectedStatus;
+    ULONG WorkSpaceSize, FragmentSize, CompressedSize, FinalSize;
+    PVOID WorkSpace;
+
+    Status = RtlGetCompressionWorkSpaceSize(FormatAndEngine, &WorkSpaceSize, &FragmentSize);
+    ok(Status == STATUS_SUCCESS, "RtlGetCompressionWorkSpaceSize returned %lx\n", Status);
+
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+    ok(WorkSpace != NULL, "Failed to allocate %lu bytes\n", WorkSpaceSize);
+    if (WorkSpace == NULL) return 0;
+
+    /* Zeroes are still compressed, but reported with a success status of their own */
+    ExpectedStatus = IsAllZeros(Size) ? STATUS_BUFFER_ALL_ZEROS : STATUS_SUCCESS;
+
+    CompressedSize = 0xdeadbeef;
+    Status = RtlCompressBuffer(FormatAndEngine,
+                               Uncompressed,
+                               Size,
+                               Compressed,
+                               sizeof(Compressed),
+                               4096,
+                               &CompressedSize,
+                               WorkSpace);
+    ok(Status == ExpectedStatus, "RtlCompressBuffer returned %lx, expected %lx\n", Status, ExpectedStatus);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+    if (!NT_SUCCESS(Status)) return 0;
+
+    FinalSize = 0xdeadbeef;
+    RtlFillMemory(Decompressed, sizeof(Decompressed), 0x55);
+    Status = RtlDecompressBuffer(FormatAndEngine & 0xFF,
+                                 Decompressed,
+                                 Size,
+                                 Compressed,
+                                 CompressedSize,
+                                 &FinalSize);
+    ok(Status == STATUS_SUCCESS, "RtlDecompressBuffer returned %lx\n", Status);
+    ok(FinalSize == Size, "FinalSize = %lu, expected %lu\n", FinalSize, Size);
+    ok(RtlEqualMemory(Decompressed, Uncompressed, Size), "Decompressed data differs\n");
+
+    return CompressedSize;
+}
+
+START_TEST(RtlCompressBuffer)
+{
+    ULONG i, Seed, Standard, Maximum;
+    ULONG WorkSpaceSize, FragmentSize, CompressedSize;
+    UCHAR Small[4];
+    PVOID WorkSpace;
+    NTSTATUS Status;
+
+    /* Text-like data with repetitions at many distances */
+    for (i = 0; i < TEST_SIZE; i++)
+        Uncompressed[i] = "The quick brown fox jumps over the lazy dog. "[(i * 7 / 5) % 45] + (i / 1024) % 3;
+
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    Maximum = CompressAndCheck(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM, TEST_SIZE);
+    ok(Standard < TEST_SIZE / 2, "Standard engine: %lu bytes\n", Standard);
+    ok(Maximum <= Standard, "Maximum engine: %lu bytes, standard engine: %lu bytes\n", Maximum, Standard);
+
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    Maximum = CompressAndCheck(COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM, TEST_SIZE);
+    ok(Standard < TEST_SIZE / 2, "XPRESS standard engine: %lu bytes\n", Standard);
+    ok(Maximum <= Standard, "XPRESS maximum engine: %lu bytes, standard engine: %lu bytes\n", Maximum, Standard);
+    CompressAndCheck(COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_HIBER, TEST_SIZE);
+
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    Maximum = CompressAndCheck(COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM, TEST_SIZE);
+    ok(Standard < TEST_SIZE / 2, "XPRESS_HUFF standard engine: %lu bytes\n", Standard);
+    ok(Maximum <= Standard, "XPRESS_HUFF maximum engine: %lu bytes, standard engine: %lu bytes\n", Maximum, Standard);
+
+    /* A partial last chunk */
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, TEST_SIZE - 123);
+    ok(Standard < TEST_SIZE / 2, "Standard engine: %lu bytes\n", Standard);
+
+    /* Zeroes compress to a few bytes per chunk */
+    RtlZeroMemory(Uncompressed, sizeof(Uncompressed));
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    ok(Standard < 0x100, "Standard engine: %lu bytes\n", Standard);
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    ok(Standard < 0x100, "XPRESS standard engine: %lu bytes\n", Standard);
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    ok(Standard < 0x200, "XPRESS_HUFF standard engine: %lu bytes\n", Standard);
+
+    /* Incompressible data is stored with two bytes of overhead per chunk */
+    for (i = 0, Seed = 1; i < TEST_SIZE; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Uncompressed[i] = (UCHAR)(Seed >> 16);
+    }
+
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    ok(Standard == TEST_SIZE + 2 * (TEST_SIZE / 0x1000), "Standard engine: %lu bytes\n", Standard);
+
+    /* The Huffman variant codes literals in 8 bits, there is only the table and the end marker */
+    Standard = CompressAndCheck(COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD, TEST_SIZE);
+    ok(Standard > TEST_SIZE && Standard < TEST_SIZE + 0x200, "XPRESS_HUFF standard engine: %lu bytes\n", Standard);
+
+    /* Only the plain XPRESS format knows the hibernation engine */
+    Status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_HIBER, &WorkSpaceSize, &FragmentSize);
+    ok(Status == STATUS_NOT_SUPPORTED, "RtlGetCompressionWorkSpaceSize returned %lx\n", Status);
+
+    /* The output buffer is too small */
+    Status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_LZNT1, &WorkSpaceSize, &FragmentSize);
+    ok(Status == STATUS_SUCCESS, "RtlGetCompressionWorkSpaceSize returned %lx\n", Status);
+
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+    ok(WorkSpace != NULL, "Failed to allocate %lu bytes\n", WorkSpaceSize);
+    if (WorkSpace == NULL) return;
+
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1,
+                               Uncompressed,
+                               TEST_SIZE,
+                               Small,
+                               sizeof(Small),
+                               4096,
+                               &CompressedSize,
+                               WorkSpace);
+    ok(Status == STATUS_BUFFER_TOO_SMALL, "RtlCompressBuffer returned %lx\n", Status);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+}
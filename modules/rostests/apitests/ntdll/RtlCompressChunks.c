@@ -0,0 +1,116 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for RtlCompressChunks and RtlDecompressChunks
+ */
+
+#include "precomp.h"
+
+#define CHUNK_SHIFT     12
+#define CHUNK_SIZE      (1 << CHUNK_SHIFT)
+#define NUMBER_OF_CHUNKS 40
+#define TEST_SIZE       (NUMBER_OF_CHUNKS * CHUNK_SIZE - 100)
+
+static UCHAR Uncompressed[NUMBER_OF_CHUNKS * CHUNK_SIZE];
+static UCHAR Compressed[NUMBER_OF_CHUNKS * CHUNK_SIZE];
+static UCHAR Decompressed[NUMBER_OF_CHUNKS * CHUNK_SIZE];
+static UCHAR Tail[NUMBER_OF_CHUNKS * CHUNK_SIZE];
+
+START_TEST(RtlCompressChunks)
+{
+    ULONG InfoLength = FIELD_OFFSET(COMPRESSED_DATA_INFO, CompressedChunkSizes[NUMBER_OF_CHUNKS]);
+    PCOMPRESSED_DATA_INFO Info;
+    ULONG i, Seed, WorkSpaceSize, FragmentSize, Total, Split;
+    PVOID WorkSpace;
+    NTSTATUS Status;
+
+    Status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_LZNT1, &WorkSpaceSize, &FragmentSize);
+    ok(Status == STATUS_SUCCESS, "RtlGetCompressionWorkSpaceSize returned %lx\n", Status);
+
+    WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+    Info = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, InfoLength);
+    ok(WorkSpace != NULL && Info != NULL, "Allocation failed\n");
+    if (WorkSpace == NULL || Info == NULL) return;
+
+    /* Compressible, zero and incompressible chunks */
+    for (i = 0, Seed = 1; i < TEST_SIZE; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+
+        if ((i / CHUNK_SIZE) % 5 == 1)
+            Uncompressed[i] = 0;
+        else if ((i / CHUNK_SIZE) % 5 == 3)
+            Uncompressed[i] = (UCHAR)(Seed >> 16);
+        else
+            Uncompressed[i] = "ReactOS compression "[i % 20] + (i / 4000) % 3;
+    }
+
+    Info->CompressionFormatAndEngine = COMPRESSION_FORMAT_LZNT1;
+    Info->ChunkShift = CHUNK_SHIFT;
+
+    Status = RtlCompressChunks(Uncompressed,
+                               TEST_SIZE,
+                               Compressed,
+                               sizeof(Compressed),
+                               Info,
+                               InfoLength,
+                               WorkSpace);
+    ok(Status == STATUS_SUCCESS, "RtlCompressChunks returned %lx\n", Status);
+    ok(Info->NumberOfChunks == NUMBER_OF_CHUNKS, "NumberOfChunks = %u\n", Info->NumberOfChunks);
+
+    for (i = 0, Total = 0; i < NUMBER_OF_CHUNKS; i++)
+    {
+        if (i % 5 == 1)
+            ok(Info->CompressedChunkSizes[i] == 0, "Chunk %lu: %lu\n", i, Info->CompressedChunkSizes[i]);
+        else if (i % 5 == 3)
+            ok(Info->CompressedChunkSizes[i] == CHUNK_SIZE, "Chunk %lu: %lu\n", i, Info->CompressedChunkSizes[i]);
+        else
+            ok(Info->CompressedChunkSizes[i] < CHUNK_SIZE / 2, "Chunk %lu: %lu\n", i, Info->CompressedChunkSizes[i]);
+
+        Total += Info->CompressedChunkSizes[i];
+    }
+
+    RtlFillMemory(Decompressed, sizeof(Decompressed), 0x55);
+    Status = RtlDecompressChunks(Decompressed,
+                                 TEST_SIZE,
+                                 Compressed,
+                                 Total,
+                                 NULL,
+                                 0,
+                                 Info);
+    ok(Status == STATUS_SUCCESS, "RtlDecompressChunks returned %lx\n", Status);
+    ok(RtlEqualMemory(Decompressed, Uncompressed, TEST_SIZE), "Decompressed data differs\n");
+    ok(Decompressed[TEST_SIZE] == 0x55, "Too many bytes written\n");
+
+    /* The chunks that don't fit in the first buffer are in the tail */
+    for (i = 0, Split = 0; i < NUMBER_OF_CHUNKS / 2; i++)
+        Split += Info->CompressedChunkSizes[i];
+
+    RtlCopyMemory(Tail, Compressed + Split, Total - Split);
+    RtlFillMemory(Compressed + Split, Total - Split, 0xCC);
+
+    RtlFillMemory(Decompressed, sizeof(Decompressed), 0x55);
+    Status = RtlDecompressChunks(Decompressed,
+                                 TEST_SIZE,
+                                 Compressed,
+                                 Split + 1,
+                                 Tail,
+                                 Total - Split,
+                                 Info);
+    ok(Status == STATUS_SUCCESS, "RtlDecompressChunks returned %lx\n", Status);
+    ok(RtlEqualMemory(Decompressed, Uncompressed, TEST_SIZE), "Decompressed data differs\n");
+
+    /* A chunk can't be larger than the chunk size */
+    Info->CompressedChunkSizes[2] = CHUNK_SIZE + 1;
+    Status = RtlDecompressChunks(Decompressed,
+                                 TEST_SIZE,
+                                 Compressed,
+                                 Total,
+                                 NULL,
+                                 0,
+                                 Info);
+    ok(Status == STATUS_BAD_COMPRESSION_BUFFER, "RtlDecompressChunks returned %lx\n", Status);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Info);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+}
@@ -409,7 +409,7 @@ typedef struct _MMFREE_POOL_ENTRY
 /* Paged pool information */
 typedef struct _MM_PAGED_POOL_INFO
 {
-    PRTL_BITMAP PagedPoolAllocationMap;
+    PRTL_SUMMARY_BITMAP PagedPoolAllocationMap;
     PRTL_BITMAP EndOfPagedPoolBitmap;
     PMMPTE FirstPteForPagedPool;
     PMMPTE LastPteForPagedPool;
@@ -1755,8 +1755,9 @@ MiBuildPagedPool(VOID)
     MMPDE TempPde = ValidKernelPde;
     PFN_NUMBER PageFrameIndex;
     KIRQL OldIrql;
-    SIZE_T Size;
+    SIZE_T Size, AllocationMapSize;
     ULONG BitMapSize;
+    PULONG AllocationMapBuffer;
 #if (_MI_PAGING_LEVELS >= 3)
     MMPPE TempPpe = ValidKernelPpe;
     PMMPPE PointerPpe;
@@ -1928,10 +1929,14 @@ MiBuildPagedPool(VOID)
 
     //
     // Allocate the allocation bitmap, which tells us which regions have not yet
-    // been mapped into memory
+    // been mapped into memory. It has a summary with a bit for each of its
+    // ULONGs, so that searching a nearly full paged pool skips the used parts.
     //
+    AllocationMapSize = sizeof(RTL_SUMMARY_BITMAP) +
+                        (((BitMapSize + 31) / 32) * sizeof(ULONG)) +
+                        (((BitMapSize + 1023) / 1024) * sizeof(ULONG));
     MmPagedPoolInfo.PagedPoolAllocationMap = ExAllocatePoolWithTag(NonPagedPool,
-                                                                   Size,
+                                                                   AllocationMapSize,
                                                                    TAG_MM);
     ASSERT(MmPagedPoolInfo.PagedPoolAllocationMap);
 
@@ -1939,11 +1944,13 @@ MiBuildPagedPool(VOID)
     // Initialize it such that at first, only the first page's worth of PTEs is
     // marked as allocated (incidentially, the first PDE we allocated earlier).
     //
-    RtlInitializeBitMap(MmPagedPoolInfo.PagedPoolAllocationMap,
-                        (PULONG)(MmPagedPoolInfo.PagedPoolAllocationMap + 1),
-                        BitMapSize);
-    RtlSetAllBits(MmPagedPoolInfo.PagedPoolAllocationMap);
-    RtlClearBits(MmPagedPoolInfo.PagedPoolAllocationMap, 0, 1024);
+    AllocationMapBuffer = (PULONG)(MmPagedPoolInfo.PagedPoolAllocationMap + 1);
+    RtlInitializeSummaryBitMap(MmPagedPoolInfo.PagedPoolAllocationMap,
+                               AllocationMapBuffer,
+                               AllocationMapBuffer + (BitMapSize + 31) / 32,
+                               BitMapSize);
+    RtlSummarySetBits(MmPagedPoolInfo.PagedPoolAllocationMap, 0, BitMapSize);
+    RtlSummaryClearBits(MmPagedPoolInfo.PagedPoolAllocationMap, 0, 1024);
 
     //
     // We have a second bitmap, which keeps track of where allocations end.
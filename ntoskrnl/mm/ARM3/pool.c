@@ -472,9 +472,9 @@ MiAllocatePoolPages(IN POOL_TYPE PoolType,
         //
         // Find some empty allocation space
         //
-        i = RtlFindClearBitsAndSet(MmPagedPoolInfo.PagedPoolAllocationMap,
-                                   SizeInPages,
-                                   MmPagedPoolInfo.PagedPoolHint);
+        i = RtlSummaryFindClearBitsAndSet(MmPagedPoolInfo.PagedPoolAllocationMap,
+                                          SizeInPages,
+                                          MmPagedPoolInfo.PagedPoolHint);
         if (i == 0xFFFFFFFF)
         {
             //
@@ -584,9 +584,9 @@ MiAllocatePoolPages(IN POOL_TYPE PoolType,
             EndAllocation = (ULONG)(MmPagedPoolInfo.NextPdeForPagedPoolExpansion -
                              (PMMPDE)MiAddressToPte(MmPagedPoolInfo.FirstPteForPagedPool)) *
                              PTE_COUNT;
-            RtlClearBits(MmPagedPoolInfo.PagedPoolAllocationMap,
-                         EndAllocation,
-                         PageTableCount * PTE_COUNT);
+            RtlSummaryClearBits(MmPagedPoolInfo.PagedPoolAllocationMap,
+                                EndAllocation,
+                                PageTableCount * PTE_COUNT);
 
             //
             // Update the next expansion location
@@ -601,9 +601,9 @@ MiAllocatePoolPages(IN POOL_TYPE PoolType,
             //
             // Now try consuming the pages again
             //
-            i = RtlFindClearBitsAndSet(MmPagedPoolInfo.PagedPoolAllocationMap,
-                                       SizeInPages,
-                                       0);
+            i = RtlSummaryFindClearBitsAndSet(MmPagedPoolInfo.PagedPoolAllocationMap,
+                                              SizeInPages,
+                                              0);
             if (i == 0xFFFFFFFF)
             {
                 //
@@ -953,7 +953,7 @@ MiFreePoolPages(IN PVOID StartingVa)
         // Clear the allocation and free bits
         //
         RtlClearBit(MmPagedPoolInfo.EndOfPagedPoolBitmap, End);
-        RtlClearBits(MmPagedPoolInfo.PagedPoolAllocationMap, i, NumberOfPages);
+        RtlSummaryClearBits(MmPagedPoolInfo.PagedPoolAllocationMap, i, NumberOfPages);
 
         //
         // Update the hint if we need to
@@ -1282,7 +1282,8 @@ MiInitializeSessionPool(VOID)
     PMM_SESSION_SPACE SessionGlobal;
     PMM_PAGED_POOL_INFO PagedPoolInfo;
     NTSTATUS Status;
-    ULONG Index, PoolSize, BitmapSize;
+    ULONG Index, PoolSize, BitmapSize, AllocationMapSize;
+    PULONG AllocationMapBuffer;
     PAGED_CODE();
 
     /* Lock session pool */
@@ -1348,18 +1349,23 @@ MiInitializeSessionPool(VOID)
     PoolSize = MmSessionPoolSize >> PAGE_SHIFT;
     BitmapSize = sizeof(RTL_BITMAP) + ((PoolSize + 31) / 32) * sizeof(ULONG);
 
-    /* Allocate and initialize the bitmap to track allocations */
+    /* Allocate and initialize the bitmap to track allocations, with its summary */
+    AllocationMapSize = sizeof(RTL_SUMMARY_BITMAP) +
+                        ((PoolSize + 31) / 32) * sizeof(ULONG) +
+                        ((PoolSize + 1023) / 1024) * sizeof(ULONG);
     PagedPoolInfo->PagedPoolAllocationMap = ExAllocatePoolWithTag(NonPagedPool,
-                                                                  BitmapSize,
+                                                                  AllocationMapSize,
                                                                   TAG_MM);
     ASSERT(PagedPoolInfo->PagedPoolAllocationMap != NULL);
-    RtlInitializeBitMap(PagedPoolInfo->PagedPoolAllocationMap,
-                        (PULONG)(PagedPoolInfo->PagedPoolAllocationMap + 1),
-                        PoolSize);
+    AllocationMapBuffer = (PULONG)(PagedPoolInfo->PagedPoolAllocationMap + 1);
+    RtlInitializeSummaryBitMap(PagedPoolInfo->PagedPoolAllocationMap,
+                               AllocationMapBuffer,
+                               AllocationMapBuffer + (PoolSize + 31) / 32,
+                               PoolSize);
 
     /* Set all bits, but clear the first page table's worth */
-    RtlSetAllBits(PagedPoolInfo->PagedPoolAllocationMap);
-    RtlClearBits(PagedPoolInfo->PagedPoolAllocationMap, 0, PTE_PER_PAGE);
+    RtlSummarySetBits(PagedPoolInfo->PagedPoolAllocationMap, 0, PoolSize);
+    RtlSummaryClearBits(PagedPoolInfo->PagedPoolAllocationMap, 0, PTE_PER_PAGE);
 
     /* Allocate and initialize the bitmap to track free space */
     PagedPoolInfo->EndOfPagedPoolBitmap = ExAllocatePoolWithTag(NonPagedPool,
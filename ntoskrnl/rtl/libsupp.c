@@ -780,4 +780,19 @@ RtlCallVectoredContinueHandlers(_In_ PEXCEPTION_RECORD ExceptionRecord,
     return;
 }
 
+NTSTATUS
+NTAPI
+RtlpDecompressChunksParallel(IN USHORT Format,
+                             OUT PUCHAR UncompressedBuffer,
+                             IN ULONG UncompressedBufferSize,
+                             IN ULONG ChunkSize,
+                             IN ULONG NumberOfChunks,
+                             IN PUCHAR *ChunkData,
+                             IN PULONG ChunkSizes)
+{
+    /* There is no thread pool in the kernel, RtlDecompressChunks never gets here */
+    ASSERT(FALSE);
+    return STATUS_NOT_SUPPORTED;
+}
+
 /* EOF */
@@ -813,7 +813,14 @@ function(create_registry_hives)
             ${CMAKE_BINARY_DIR}/boot/bootdata/system
             ${CMAKE_BINARY_DIR}/boot/bootdata/BCD
         COMMAND native-mkhive ${CMAKE_BINARY_DIR}/boot/bootdata ${_livecd_inf_files}
-        DEPENDS native-mkhive ${_livecd_inf_files})
+        COMMAND native-hivecheck -c
+            ${CMAKE_BINARY_DIR}/boot/bootdata/sam
+            ${CMAKE_BINARY_DIR}/boot/bootdata/default
+            ${CMAKE_BINARY_DIR}/boot/bootdata/security
+            ${CMAKE_BINARY_DIR}/boot/bootdata/software
+            ${CMAKE_BINARY_DIR}/boot/bootdata/system
+            ${CMAKE_BINARY_DIR}/boot/bootdata/BCD
+        DEPENDS native-mkhive native-hivecheck ${_livecd_inf_files})
 
     add_custom_target(livecd_hives
         DEPENDS ${CMAKE_BINARY_DIR}/boot/bootdata/sam
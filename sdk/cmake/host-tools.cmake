@@ -6,7 +6,7 @@ endif()
 string(TOUPPER ${CMAKE_BUILD_TYPE} _build_type)
 
 # List of host tools
-list(APPEND host_tools_list bin2c hpp widl gendib cabman fatten isohybrid mkhive mkisofs obj2bin spec2def geninc mkshelllink utf16le xml2sdb)
+list(APPEND host_tools_list bin2c hpp widl gendib cabman fatten hivecheck isohybrid mkhive mkisofs obj2bin spec2def geninc mkshelllink utf16le xml2sdb)
 if(NOT MSVC)
     list(APPEND host_tools_list rsym)
 endif()
@@ -28,6 +28,10 @@ if(USE_CLANG_CL)
     #set(USE_CLANG_CL_ARG "-DCMAKE_C_COMPILER=clang-cl;-DCMAKE_CXX_COMPILER=clang-cl")
 endif()
 
+if(ENABLE_HOST_BENCHMARKS)
+    set(HOST_BENCHMARKS_ARG "-DENABLE_HOST_BENCHMARKS=1")
+endif()
+
 include(ExternalProject)
 
 ExternalProject_Add(host-tools
@@ -37,6 +41,6 @@ ExternalProject_Add(host-tools
     BUILD_ALWAYS 1
     PREFIX host-tools
     EXCLUDE_FROM_ALL 1
-    CMAKE_ARGS "-DNEW_STYLE_BUILD=1;-DARCH:STRING=${ARCH};${USE_CLANG_CL_ARG}"
+    CMAKE_ARGS "-DNEW_STYLE_BUILD=1;-DARCH:STRING=${ARCH};${USE_CLANG_CL_ARG};${HOST_BENCHMARKS_ARG}"
     INSTALL_COMMAND ""
     BUILD_BYPRODUCTS ${tools_binaries})
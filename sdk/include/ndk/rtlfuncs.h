@@ -3439,6 +3439,55 @@ RtlCheckBit(
 
 #endif // NTOS_MODE_USER
 
+#ifdef __REACTOS__
+//
+// Summary Bitmap Functions, not exported
+//
+VOID
+NTAPI
+RtlInitializeSummaryBitMap(
+    _Out_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_ __drv_aliasesMem PULONG BitMapBuffer,
+    _In_ __drv_aliasesMem PULONG SummaryBuffer,
+    _In_ ULONG SizeOfBitMap
+);
+
+VOID
+NTAPI
+RtlSummaryClearBits(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - NumberToClear) ULONG StartingIndex,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - StartingIndex) ULONG NumberToClear
+);
+
+VOID
+NTAPI
+RtlSummarySetBits(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - NumberToSet) ULONG StartingIndex,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - StartingIndex) ULONG NumberToSet
+);
+
+_Success_(return != -1)
+_Must_inspect_result_
+ULONG
+NTAPI
+RtlSummaryFindClearBits(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_ ULONG NumberToFind,
+    _In_ ULONG HintIndex
+);
+
+_Success_(return != -1)
+ULONG
+NTAPI
+RtlSummaryFindClearBitsAndSet(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_ ULONG NumberToFind,
+    _In_ ULONG HintIndex
+);
+#endif
+
 
 //
 // Timer Functions
@@ -963,6 +963,18 @@ typedef struct _ACTIVATION_CONTEXT_STACK_FRAMELIST
 
 #endif /* NTOS_MODE_USER */
 
+#ifdef __REACTOS__
+//
+// Bitmap with a summary level, which has a bit set for each full ULONG of
+// the bitmap so that searches can skip them (ReactOS extension)
+//
+typedef struct _RTL_SUMMARY_BITMAP
+{
+    RTL_BITMAP BitMap;
+    RTL_BITMAP Summary;
+} RTL_SUMMARY_BITMAP, *PRTL_SUMMARY_BITMAP;
+#endif
+
 #if (NTDDI_VERSION >= NTDDI_WS03SP1)
 typedef struct _ACTIVATION_CONTEXT_STACK
 {
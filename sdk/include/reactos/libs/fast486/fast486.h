@@ -42,6 +42,7 @@
 #define FAST486_NUM_CTRL_REGS   3
 #define FAST486_NUM_DBG_REGS    6
 #define FAST486_NUM_FPU_REGS    8
+#define FAST486_NUM_TLB_ENTRIES 0x100000
 
 #define FAST486_CR0_PE  (1 << 0)
 #define FAST486_CR0_MP  (1 << 1)
@@ -107,6 +108,17 @@
 #define FAST486_PAGE_SIZE 4096
 #define FAST486_CACHE_SIZE 32
 
+#define FAST486_BLOCK_CACHE_ENTRIES 4096
+#define FAST486_BLOCK_MAX_INSTRUCTIONS 16
+
+/*
+ * The decoded block cache is slower than the plain interpreter on most code,
+ * so it is only built when FAST486_ENABLE_BLOCK_CACHE is defined.
+ */
+#ifndef FAST486_ENABLE_BLOCK_CACHE
+#define FAST486_NO_BLOCK_CACHE
+#endif
+
 /*
  * These are condiciones sine quibus non that should be respected, because
  * otherwise when fetching DWORDs you would read extra garbage bytes
@@ -244,6 +256,14 @@ VOID
     PFAST486_STATE State
 );
 
+typedef
+VOID
+(FASTCALL *FAST486_DECODED_HANDLER_PROC)
+(
+    PFAST486_STATE State,
+    UCHAR Opcode
+);
+
 typedef union _FAST486_REG
 {
     union
@@ -511,6 +531,72 @@ typedef union _FAST486_FPU_CONTROL_REG
     };
 } FAST486_FPU_CONTROL_REG, *PFAST486_FPU_CONTROL_REG;
 
+typedef enum _FAST486_FPU_PRECISION
+{
+    FAST486_FPU_EXACT,          // Bit-exact emulation of the 80-bit registers
+    FAST486_FPU_HOST            // FADD, FSUB, FMUL and FDIV use the FPU of the host
+} FAST486_FPU_PRECISION, *PFAST486_FPU_PRECISION;
+
+typedef enum _FAST486_LAZY_OPERATION
+{
+    FAST486_LAZY_NONE,          // The arithmetic flags in the EFLAGS are valid
+    FAST486_LAZY_ADD,
+    FAST486_LAZY_SUB,
+    FAST486_LAZY_LOGIC
+} FAST486_LAZY_OPERATION, *PFAST486_LAZY_OPERATION;
+
+/*
+ * The last arithmetic operation, from which CF, PF, AF, ZF, SF and OF
+ * are computed only when they are really needed.
+ */
+typedef struct _FAST486_LAZY_FLAGS
+{
+    UCHAR Operation;
+    UCHAR Bits;
+    BOOLEAN AuxCarry;       // AF before a logical operation, which keeps it
+    ULONG FirstValue;
+    ULONG SecondValue;
+    ULONG Result;
+} FAST486_LAZY_FLAGS, *PFAST486_LAZY_FLAGS;
+
+typedef enum _FAST486_DECODED_INST_TYPE
+{
+    FAST486_INST_NORMAL,        // Execution continues with the next instruction
+    FAST486_INST_END_BLOCK,     // Control transfer, the block ends here
+    FAST486_INST_BREAK_BLOCK    // The host may change the memory, leave the block
+} FAST486_DECODED_INST_TYPE, *PFAST486_DECODED_INST_TYPE;
+
+typedef struct _FAST486_DECODED_INST
+{
+    FAST486_DECODED_HANDLER_PROC Handler;
+    UCHAR Offset;           // Offset of the instruction inside the block
+    UCHAR HeaderLength;     // Length of the prefixes and the opcode bytes
+    UCHAR Opcode;
+    UCHAR PrefixFlags;
+    UCHAR SegmentOverride;
+    UCHAR Type;
+    BOOLEAN LazyFlagsAware; // The handler doesn't need the flags to be computed
+} FAST486_DECODED_INST, *PFAST486_DECODED_INST;
+
+typedef struct _FAST486_CACHED_BLOCK
+{
+    ULONG Address;          // Linear address of the first instruction
+    ULONG PhysicalAddress;  // Where it is mapped, blocks never cross a page
+    UCHAR Mode;
+    UCHAR Available;        // Number of valid bytes in the Bytes array
+    UCHAR Size;             // Number of bytes covered by the decoded instructions
+    UCHAR End;              // Offset of the next instruction to decode
+    UCHAR Count;
+    BOOLEAN Closed;
+    UCHAR Bytes[FAST486_CACHE_SIZE];
+    FAST486_DECODED_INST Instructions[FAST486_BLOCK_MAX_INSTRUCTIONS];
+} FAST486_CACHED_BLOCK, *PFAST486_CACHED_BLOCK;
+
+typedef struct _FAST486_BLOCK_CACHE
+{
+    FAST486_CACHED_BLOCK Blocks[FAST486_BLOCK_CACHE_ENTRIES];
+} FAST486_BLOCK_CACHE, *PFAST486_BLOCK_CACHE;
+
 struct _FAST486_STATE
 {
     FAST486_MEM_READ_PROC MemReadCallback;
@@ -537,8 +623,21 @@ struct _FAST486_STATE
     BOOLEAN Halted;
     BOOLEAN IntSignaled;
     BOOLEAN DoNotInterrupt;
+    ULONG BatchBudget;
+    BOOLEAN BatchStopped;
     PULONG Tlb;
     BOOLEAN TlbEmpty;
+#ifndef FAST486_NO_LAZY_FLAGS
+    BOOLEAN LazyFlagsEnabled;
+    FAST486_LAZY_FLAGS LazyFlags;
+#endif
+    PVOID *MemoryMap;
+    ULONG MemoryMapSize;
+#ifndef FAST486_NO_BLOCK_CACHE
+    PFAST486_BLOCK_CACHE BlockCache;
+    PFAST486_CACHED_BLOCK CurrentBlock;
+    ULONG CurrentInst;
+#endif
 #ifndef FAST486_NO_PREFETCH
     BOOLEAN PrefetchValid;
     ULONG PrefetchAddress;
@@ -553,6 +652,7 @@ struct _FAST486_STATE
     USHORT FpuLastCodeSel;
     FAST486_REG FpuLastOpPtr;
     USHORT FpuLastDataSel;
+    UCHAR FpuPrecision;
 #endif
 };
 
@@ -574,6 +674,22 @@ VOID
 NTAPI
 Fast486Reset(PFAST486_STATE State);
 
+VOID
+NTAPI
+Fast486SetMemoryMap(PFAST486_STATE State, PVOID *MemoryMap, ULONG NumPages);
+
+VOID
+NTAPI
+Fast486SetBlockCache(PFAST486_STATE State, PFAST486_BLOCK_CACHE BlockCache);
+
+VOID
+NTAPI
+Fast486EnableLazyFlags(PFAST486_STATE State, BOOLEAN Enable);
+
+VOID
+NTAPI
+Fast486SetFpuPrecision(PFAST486_STATE State, FAST486_FPU_PRECISION Precision);
+
 VOID
 NTAPI
 Fast486Continue(PFAST486_STATE State);
@@ -590,6 +706,14 @@ VOID
 NTAPI
 Fast486StepOut(PFAST486_STATE State);
 
+ULONG
+NTAPI
+Fast486ExecuteBatch(PFAST486_STATE State, ULONG MaxSteps);
+
+VOID
+NTAPI
+Fast486StopBatch(PFAST486_STATE State);
+
 VOID
 NTAPI
 Fast486DumpState(PFAST486_STATE State);
@@ -678,6 +678,382 @@ CmpFindSubKeyByHash(IN PHHIVE Hive,
     return HCELL_NIL;
 }
 
+/*
+ * Subkey index.
+ *
+ * Lookups in keys with many subkeys, such as CLSID, Enum or Services, do a
+ * binary search over the leaves, and every probe is a case-insensitive name
+ * compare. For hives initialized with HIVE_SUBKEY_INDEX, such keys also get
+ * an in-memory hash table of their subkeys, found by the cell of the subkey
+ * list. It is built on the first lookup and kept up to date by CmpAddSubKey
+ * and CmpRemoveSubKey. Nothing synchronizes the indexes, so only hives that
+ * are used by one thread at a time may ask for them.
+ */
+
+#define CM_SUBKEY_INDEX_MINIMUM     256
+
+typedef struct _CM_SUBKEY_ENTRY
+{
+    ULONG HashKey;
+    HCELL_INDEX Cell;           // HCELL_NIL if the slot is empty
+} CM_SUBKEY_ENTRY, *PCM_SUBKEY_ENTRY;
+
+typedef struct _CM_SUBKEY_INDEX
+{
+    struct _CM_SUBKEY_INDEX *Next;
+    HCELL_INDEX List;           // Subkey list the index belongs to
+    ULONG Count;                // Number of subkeys in the index
+    ULONG Size;                 // Number of slots, a power of two
+    CM_SUBKEY_ENTRY Entries[ANYSIZE_ARRAY];
+} CM_SUBKEY_INDEX, *PCM_SUBKEY_INDEX;
+
+static __inline
+ULONG
+CmpSubKeyIndexSlot(IN PCM_SUBKEY_INDEX SubKeyIndex,
+                   IN ULONG HashKey)
+{
+    /* The name hash is weak in the low bits, mix it first */
+    HashKey ^= HashKey >> 16;
+    HashKey *= 0x45D9F3B;
+    HashKey ^= HashKey >> 16;
+    return HashKey & (SubKeyIndex->Size - 1);
+}
+
+static
+ULONG
+NTAPI
+CmpHashKeyNodeName(IN PCM_KEY_NODE Node)
+{
+    UNICODE_STRING KeyName;
+    PUCHAR Name;
+    ULONG Hash = 0, i;
+
+    /* Unicode names can be hashed directly */
+    if (!(Node->Flags & KEY_COMP_NAME))
+    {
+        KeyName.Buffer = Node->Name;
+        KeyName.Length = Node->NameLength;
+        KeyName.MaximumLength = KeyName.Length;
+        return CmpComputeHashKey(0, &KeyName, FALSE);
+    }
+
+    /* Do what CmpComputeHashKey does, one compressed character at a time */
+    Name = (PUCHAR)Node->Name;
+    for (i = 0; i < Node->NameLength; i++)
+    {
+        Hash *= 37;
+        Hash += RtlUpcaseUnicodeChar((WCHAR)Name[i]);
+    }
+
+    return Hash;
+}
+
+static
+VOID
+NTAPI
+CmpInsertSubKeyEntry(IN PCM_SUBKEY_INDEX SubKeyIndex,
+                     IN ULONG HashKey,
+                     IN HCELL_INDEX Cell)
+{
+    ULONG Slot;
+
+    /* The table is at most half full, so there always is a free slot */
+    Slot = CmpSubKeyIndexSlot(SubKeyIndex, HashKey);
+    while (SubKeyIndex->Entries[Slot].Cell != HCELL_NIL)
+    {
+        Slot = (Slot + 1) & (SubKeyIndex->Size - 1);
+    }
+
+    SubKeyIndex->Entries[Slot].HashKey = HashKey;
+    SubKeyIndex->Entries[Slot].Cell = Cell;
+    SubKeyIndex->Count++;
+}
+
+static
+BOOLEAN
+NTAPI
+CmpRemoveSubKeyEntry(IN PCM_SUBKEY_INDEX SubKeyIndex,
+                     IN ULONG HashKey,
+                     IN HCELL_INDEX Cell)
+{
+    ULONG Mask = SubKeyIndex->Size - 1;
+    ULONG Slot, Next, Home;
+
+    /* Find the entry */
+    Slot = CmpSubKeyIndexSlot(SubKeyIndex, HashKey);
+    while (SubKeyIndex->Entries[Slot].Cell != Cell)
+    {
+        if (SubKeyIndex->Entries[Slot].Cell == HCELL_NIL) return FALSE;
+        Slot = (Slot + 1) & Mask;
+    }
+
+    /* Move back the entries behind it that would not be found past the hole */
+    for (Next = (Slot + 1) & Mask;
+         SubKeyIndex->Entries[Next].Cell != HCELL_NIL;
+         Next = (Next + 1) & Mask)
+    {
+        Home = CmpSubKeyIndexSlot(SubKeyIndex, SubKeyIndex->Entries[Next].HashKey);
+        if (((Next - Home) & Mask) >= ((Next - Slot) & Mask))
+        {
+            SubKeyIndex->Entries[Slot] = SubKeyIndex->Entries[Next];
+            Slot = Next;
+        }
+    }
+
+    SubKeyIndex->Entries[Slot].Cell = HCELL_NIL;
+    SubKeyIndex->Count--;
+    return TRUE;
+}
+
+static
+PCM_SUBKEY_INDEX*
+NTAPI
+CmpFindSubKeyIndexLink(IN PHHIVE Hive,
+                       IN HCELL_INDEX List)
+{
+    PCM_SUBKEY_INDEX *Link;
+
+    for (Link = &Hive->SubKeyIndexes; *Link; Link = &(*Link)->Next)
+    {
+        if ((*Link)->List == List) return Link;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+NTAPI
+CmpDropSubKeyIndex(IN PHHIVE Hive,
+                   IN PCM_SUBKEY_INDEX *Link)
+{
+    PCM_SUBKEY_INDEX SubKeyIndex = *Link;
+
+    *Link = SubKeyIndex->Next;
+    Hive->Free(SubKeyIndex, 0);
+}
+
+static
+BOOLEAN
+NTAPI
+CmpFillSubKeyIndex(IN PHHIVE Hive,
+                   IN PCM_SUBKEY_INDEX SubKeyIndex,
+                   IN HCELL_INDEX IndexCell,
+                   IN ULONG Count)
+{
+    PCM_KEY_INDEX Index;
+    PCM_KEY_FAST_INDEX FastIndex;
+    PCM_KEY_NODE Node;
+    HCELL_INDEX Cell;
+    BOOLEAN Result = TRUE;
+    ULONG i;
+
+    /* Get the index */
+    Index = (PCM_KEY_INDEX)HvGetCell(Hive, IndexCell);
+    if (!Index) return FALSE;
+    FastIndex = (PCM_KEY_FAST_INDEX)Index;
+
+    for (i = 0; (i < Index->Count) && Result; i++)
+    {
+        /* A root only holds leaves */
+        if (Index->Signature == CM_KEY_INDEX_ROOT)
+        {
+            Result = CmpFillSubKeyIndex(Hive, SubKeyIndex, Index->List[i], Count);
+            continue;
+        }
+
+        /* Don't overflow the table if the leaves hold more keys than the parent says */
+        if (SubKeyIndex->Count == Count)
+        {
+            Result = FALSE;
+            break;
+        }
+
+        /* Hash leaves already have the hash, the others need the name */
+        if (Index->Signature == CM_KEY_HASH_LEAF)
+        {
+            CmpInsertSubKeyEntry(SubKeyIndex,
+                                 FastIndex->List[i].HashKey,
+                                 FastIndex->List[i].Cell);
+            continue;
+        }
+
+        if (Index->Signature == CM_KEY_FAST_LEAF)
+            Cell = FastIndex->List[i].Cell;
+        else
+            Cell = Index->List[i];
+
+        Node = (PCM_KEY_NODE)HvGetCell(Hive, Cell);
+        if (!Node)
+        {
+            Result = FALSE;
+            break;
+        }
+
+        CmpInsertSubKeyEntry(SubKeyIndex, CmpHashKeyNodeName(Node), Cell);
+        HvReleaseCell(Hive, Cell);
+    }
+
+    HvReleaseCell(Hive, IndexCell);
+    return Result;
+}
+
+static
+PCM_SUBKEY_INDEX
+NTAPI
+CmpBuildSubKeyIndex(IN PHHIVE Hive,
+                    IN HCELL_INDEX List,
+                    IN ULONG Count)
+{
+    PCM_SUBKEY_INDEX SubKeyIndex;
+    ULONG Size, i;
+
+    /* Keep the table at most half full */
+    Size = CM_SUBKEY_INDEX_MINIMUM * 2;
+    while (Size < Count * 2) Size *= 2;
+
+    SubKeyIndex = Hive->Allocate(FIELD_OFFSET(CM_SUBKEY_INDEX, Entries) +
+                                 Size * sizeof(CM_SUBKEY_ENTRY),
+                                 TRUE,
+                                 TAG_CM);
+    if (!SubKeyIndex) return NULL;
+
+    SubKeyIndex->List = List;
+    SubKeyIndex->Count = 0;
+    SubKeyIndex->Size = Size;
+    for (i = 0; i < Size; i++)
+    {
+        SubKeyIndex->Entries[i].Cell = HCELL_NIL;
+    }
+
+    /* Leave the key to the normal lookup if its index is broken */
+    if (!CmpFillSubKeyIndex(Hive, SubKeyIndex, List, Count) ||
+        (SubKeyIndex->Count != Count))
+    {
+        Hive->Free(SubKeyIndex, 0);
+        return NULL;
+    }
+
+    SubKeyIndex->Next = Hive->SubKeyIndexes;
+    Hive->SubKeyIndexes = SubKeyIndex;
+    return SubKeyIndex;
+}
+
+static
+BOOLEAN
+NTAPI
+CmpFindSubKeyInIndex(IN PHHIVE Hive,
+                     IN HCELL_INDEX List,
+                     IN ULONG Count,
+                     IN PCUNICODE_STRING SearchName,
+                     OUT PHCELL_INDEX SubKey)
+{
+    PCM_SUBKEY_INDEX *Link, SubKeyIndex;
+    PCM_SUBKEY_ENTRY Entry;
+    ULONG HashKey, Slot;
+
+    /* Throw away an index that does not match the list anymore */
+    Link = CmpFindSubKeyIndexLink(Hive, List);
+    if (Link && ((*Link)->Count != Count))
+    {
+        CmpDropSubKeyIndex(Hive, Link);
+        Link = NULL;
+    }
+
+    if (Link)
+    {
+        /* Move it to the front, the same keys tend to be opened again */
+        SubKeyIndex = *Link;
+        *Link = SubKeyIndex->Next;
+        SubKeyIndex->Next = Hive->SubKeyIndexes;
+        Hive->SubKeyIndexes = SubKeyIndex;
+    }
+    else
+    {
+        SubKeyIndex = CmpBuildSubKeyIndex(Hive, List, Count);
+        if (!SubKeyIndex) return FALSE;
+    }
+
+    /* Compare the names of the subkeys with the same hash */
+    *SubKey = HCELL_NIL;
+    HashKey = CmpComputeHashKey(0, SearchName, FALSE);
+    Slot = CmpSubKeyIndexSlot(SubKeyIndex, HashKey);
+    for (Entry = &SubKeyIndex->Entries[Slot];
+         Entry->Cell != HCELL_NIL;
+         Entry = &SubKeyIndex->Entries[Slot])
+    {
+        if ((Entry->HashKey == HashKey) &&
+            !(CmpDoCompareKeyName(Hive, SearchName, Entry->Cell)))
+        {
+            *SubKey = Entry->Cell;
+            break;
+        }
+
+        Slot = (Slot + 1) & (SubKeyIndex->Size - 1);
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+NTAPI
+CmpUpdateSubKeyIndex(IN PHHIVE Hive,
+                     IN HCELL_INDEX OldList,
+                     IN ULONG OldCount,
+                     IN PCM_KEY_NODE Node,
+                     IN ULONG Type,
+                     IN HCELL_INDEX Child,
+                     IN PCUNICODE_STRING Name,
+                     IN BOOLEAN Added)
+{
+    PCM_SUBKEY_INDEX *Link, SubKeyIndex;
+    ULONG Count, HashKey;
+
+    /* Check if the key has an index */
+    if (!(Hive->HiveFlags & HIVE_SUBKEY_INDEX)) return;
+    Link = CmpFindSubKeyIndexLink(Hive, OldList);
+    if (!Link) return;
+    SubKeyIndex = *Link;
+
+    /*
+     * Drop the index if it is out of date, if the key got small, or if the
+     * table needs to grow. The next lookup builds a new one if needed.
+     */
+    Count = Node->SubKeyCounts[Type];
+    if ((SubKeyIndex->Count != OldCount) ||
+        (Count < CM_SUBKEY_INDEX_MINIMUM) ||
+        (Count * 2 > SubKeyIndex->Size))
+    {
+        CmpDropSubKeyIndex(Hive, Link);
+        return;
+    }
+
+    HashKey = CmpComputeHashKey(0, Name, FALSE);
+    if (Added)
+    {
+        CmpInsertSubKeyEntry(SubKeyIndex, HashKey, Child);
+    }
+    else if (!CmpRemoveSubKeyEntry(SubKeyIndex, HashKey, Child))
+    {
+        CmpDropSubKeyIndex(Hive, Link);
+        return;
+    }
+
+    /* Adding or removing a leaf can give the key a new list cell */
+    SubKeyIndex->List = Node->SubKeyLists[Type];
+}
+
+VOID
+NTAPI
+CmpFreeSubKeyIndexes(IN PHHIVE Hive)
+{
+    while (Hive->SubKeyIndexes)
+    {
+        CmpDropSubKeyIndex(Hive, &Hive->SubKeyIndexes);
+    }
+}
+
 HCELL_INDEX
 NTAPI
 CmpFindSubKeyByName(IN PHHIVE Hive,
@@ -695,6 +1071,19 @@ CmpFindSubKeyByName(IN PHHIVE Hive,
         /* Make sure the parent node has subkeys */
         if (Parent->SubKeyCounts[i])
         {
+            /* Large keys can use the subkey index, if the hive has one */
+            if ((Hive->HiveFlags & HIVE_SUBKEY_INDEX) &&
+                (Parent->SubKeyCounts[i] >= CM_SUBKEY_INDEX_MINIMUM) &&
+                CmpFindSubKeyInIndex(Hive,
+                                     Parent->SubKeyLists[i],
+                                     Parent->SubKeyCounts[i],
+                                     SearchName,
+                                     &SubKey))
+            {
+                if (SubKey != HCELL_NIL) return SubKey;
+                continue;
+            }
+
             /* Get the Index */
             IndexRoot = (PCM_KEY_INDEX)HvGetCell(Hive, Parent->SubKeyLists[i]);
             if (!IndexRoot) return HCELL_NIL;
@@ -1474,7 +1863,8 @@ CmpAddSubKey(IN PHHIVE Hive,
     UNICODE_STRING Name;
     HCELL_INDEX IndexCell = HCELL_NIL, CellToRelease = HCELL_NIL, LeafCell;
     PHCELL_INDEX RootPointer = NULL;
-    ULONG Type, i;
+    HCELL_INDEX OldList;
+    ULONG Type, i, OldCount;
     BOOLEAN IsCompressed;
     PAGED_CODE();
 
@@ -1535,6 +1925,8 @@ CmpAddSubKey(IN PHHIVE Hive,
 
     /* Find out the type of the cell, and check if this is the first subkey */
     Type = HvGetCellType(Child);
+    OldList = KeyNode->SubKeyLists[Type];
+    OldCount = KeyNode->SubKeyCounts[Type];
     if (!KeyNode->SubKeyCounts[Type])
     {
         /* Allocate a fast leaf */
@@ -1681,6 +2073,9 @@ CmpAddSubKey(IN PHHIVE Hive,
         KeyNode->SubKeyLists[Type] = LeafCell;
     }
 
+    /* Keep the subkey index in sync */
+    CmpUpdateSubKeyIndex(Hive, OldList, OldCount, KeyNode, Type, Child, &Name, TRUE);
+
     /* If the name was compressed, free our copy */
     if (IsCompressed) Hive->Free(Name.Buffer, 0);
 
@@ -1705,6 +2100,8 @@ CmpRemoveSubKey(IN PHHIVE Hive,
     PCM_KEY_INDEX Root = NULL, Leaf;
     PCM_KEY_FAST_INDEX Child;
     ULONG Storage, RootIndex = INVALID_INDEX, LeafIndex;
+    HCELL_INDEX OldList;
+    ULONG OldCount;
     BOOLEAN Result = FALSE;
     HCELL_INDEX CellToRelease1 = HCELL_NIL, CellToRelease2  = HCELL_NIL;
 
@@ -1772,6 +2169,8 @@ CmpRemoveSubKey(IN PHHIVE Hive,
 
     /* Get the leaf cell now */
     LeafCell = Node->SubKeyLists[Storage];
+    OldList = LeafCell;
+    OldCount = Node->SubKeyCounts[Storage];
     Leaf = (PCM_KEY_INDEX)HvGetCell(Hive, LeafCell);
     if (!Leaf) goto Exit;
 
@@ -1860,6 +2259,9 @@ CmpRemoveSubKey(IN PHHIVE Hive,
         }
     }
 
+    /* Keep the subkey index in sync */
+    CmpUpdateSubKeyIndex(Hive, OldList, OldCount, Node, Storage, TargetKey, &SearchName, FALSE);
+
     /* If we got here, now we're done */
     Result = TRUE;
 
@@ -110,6 +110,16 @@
         IN ULONG NumberToFind,
         IN ULONG HintIndex);
 
+    CCHAR NTAPI
+    RtlFindLeastSignificantBit(
+        IN ULONGLONG Set);
+
+    ULONG NTAPI
+    RtlFindNextForwardRunSet(
+        IN PRTL_BITMAP BitMapHeader,
+        IN ULONG FromIndex,
+        IN PULONG StartingRunIndex);
+
     VOID NTAPI
     RtlSetBits(
         IN PRTL_BITMAP BitMapHeader,
@@ -476,10 +486,18 @@ NTSTATUS CMAPI
 HvpCreateHiveFreeCellList(
    PHHIVE Hive);
 
+VOID CMAPI
+HvpFreeHiveFreeCellList(
+   PHHIVE Hive);
+
 ULONG CMAPI
 HvpHiveHeaderChecksum(
    PHBASE_BLOCK HiveHeader);
 
+BOOLEAN CMAPI
+HvpVerifyHiveHeader(
+   PHBASE_BLOCK BaseBlock);
+
 
 /* Old-style Public "Cmlib" functions */
 
@@ -538,6 +556,12 @@ CmpRemoveSubKey(
     IN HCELL_INDEX TargetKey
 );
 
+VOID
+NTAPI
+CmpFreeSubKeyIndexes(
+    IN PHHIVE Hive
+);
+
 BOOLEAN
 NTAPI
 CmpMarkIndexDirty(
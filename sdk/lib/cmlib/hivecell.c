@@ -171,8 +171,396 @@ HvpComputeFreeListIndex(
     return Index;
 }
 
-static NTSTATUS CMAPI
-HvpAddFree(
+/*
+ * Volatile free cell index.
+ *
+ * The FreeDisplay lists are singly linked through the free cells themselves,
+ * so finding or removing a cell means touching every cell in front of it.
+ * The index keeps one node per free cell in memory instead: cells smaller
+ * than HV_FREE_BIN_LIMIT go into exact-size bins, larger cells into a tree
+ * ordered by size and cell index, and a hash table finds the node of a cell.
+ * Allocation is best-fit. Nothing of the index is written into the hive, so
+ * the file format stays the same. If a node cannot be allocated the index is
+ * dropped and the storage goes back to the lists.
+ */
+
+#define HV_FREE_BIN_SHIFT       3
+#define HV_FREE_BIN_LIMIT       2048
+#define HV_FREE_BIN_COUNT       (HV_FREE_BIN_LIMIT >> HV_FREE_BIN_SHIFT)
+#define HV_FREE_HASH_MINIMUM    64
+#define HV_FREE_CHUNK_CELLS     127
+
+typedef struct _HV_FREE_CELL
+{
+    struct _HV_FREE_CELL *HashLink;
+    struct _HV_FREE_CELL *Left;     // Previous cell in the bin, or left subtree
+    struct _HV_FREE_CELL *Right;    // Next cell in the bin, or right subtree
+    HCELL_INDEX CellIndex;
+    ULONG Size;
+} HV_FREE_CELL, *PHV_FREE_CELL;
+
+typedef struct _HV_FREE_CHUNK
+{
+    struct _HV_FREE_CHUNK *Next;
+    HV_FREE_CELL Cells[HV_FREE_CHUNK_CELLS];
+} HV_FREE_CHUNK, *PHV_FREE_CHUNK;
+
+typedef struct _HV_FREE_INDEX
+{
+    PHV_FREE_CELL Bins[HV_FREE_BIN_COUNT];
+    ULONG BinMap[HV_FREE_BIN_COUNT / 32];
+    PHV_FREE_CELL Tree;
+    PHV_FREE_CELL *HashTable;
+    ULONG HashSize;
+    ULONG Count;
+    PHV_FREE_CELL Spare;
+    PHV_FREE_CHUNK Chunks;
+} HV_FREE_INDEX, *PHV_FREE_INDEX;
+
+static __inline ULONG
+HvpHashFreeCell(
+    HCELL_INDEX CellIndex,
+    ULONG HashSize)
+{
+    return ((CellIndex >> 3) * 2654435761U) & (HashSize - 1);
+}
+
+/* Treap priorities are derived from the cell index, so no random numbers are needed */
+static __inline ULONG
+HvpFreeCellPriority(
+    PHV_FREE_CELL Cell)
+{
+    return (Cell->CellIndex ^ (Cell->CellIndex >> 16)) * 0x45D9F3BU;
+}
+
+static __inline BOOLEAN
+HvpIsFreeCellBelow(
+    PHV_FREE_CELL Cell,
+    PHV_FREE_CELL Other)
+{
+    if (Cell->Size != Other->Size)
+        return Cell->Size < Other->Size;
+    return Cell->CellIndex < Other->CellIndex;
+}
+
+static PHV_FREE_CELL
+HvpInsertFreeTree(
+    PHV_FREE_CELL Root,
+    PHV_FREE_CELL Cell)
+{
+    PHV_FREE_CELL Child;
+
+    if (Root == NULL)
+    {
+        Cell->Left = Cell->Right = NULL;
+        return Cell;
+    }
+
+    if (HvpIsFreeCellBelow(Cell, Root))
+    {
+        Child = HvpInsertFreeTree(Root->Left, Cell);
+        Root->Left = Child;
+        if (HvpFreeCellPriority(Child) < HvpFreeCellPriority(Root))
+        {
+            Root->Left = Child->Right;
+            Child->Right = Root;
+            return Child;
+        }
+    }
+    else
+    {
+        Child = HvpInsertFreeTree(Root->Right, Cell);
+        Root->Right = Child;
+        if (HvpFreeCellPriority(Child) < HvpFreeCellPriority(Root))
+        {
+            Root->Right = Child->Left;
+            Child->Left = Root;
+            return Child;
+        }
+    }
+
+    return Root;
+}
+
+static PHV_FREE_CELL
+HvpJoinFreeTrees(
+    PHV_FREE_CELL Left,
+    PHV_FREE_CELL Right)
+{
+    if (Left == NULL)
+        return Right;
+    if (Right == NULL)
+        return Left;
+
+    if (HvpFreeCellPriority(Left) < HvpFreeCellPriority(Right))
+    {
+        Left->Right = HvpJoinFreeTrees(Left->Right, Right);
+        return Left;
+    }
+
+    Right->Left = HvpJoinFreeTrees(Left, Right->Left);
+    return Right;
+}
+
+static PHV_FREE_CELL
+HvpRemoveFreeTree(
+    PHV_FREE_CELL Root,
+    PHV_FREE_CELL Cell)
+{
+    ASSERT(Root != NULL);
+
+    if (Root == Cell)
+        return HvpJoinFreeTrees(Cell->Left, Cell->Right);
+
+    if (HvpIsFreeCellBelow(Cell, Root))
+        Root->Left = HvpRemoveFreeTree(Root->Left, Cell);
+    else
+        Root->Right = HvpRemoveFreeTree(Root->Right, Cell);
+
+    return Root;
+}
+
+static VOID
+HvpLinkFreeCell(
+    PHV_FREE_INDEX FreeIndex,
+    PHV_FREE_CELL Cell)
+{
+    ULONG Bin;
+
+    if (Cell->Size >= HV_FREE_BIN_LIMIT)
+    {
+        FreeIndex->Tree = HvpInsertFreeTree(FreeIndex->Tree, Cell);
+        return;
+    }
+
+    Bin = Cell->Size >> HV_FREE_BIN_SHIFT;
+    Cell->Left = NULL;
+    Cell->Right = FreeIndex->Bins[Bin];
+    if (Cell->Right)
+        Cell->Right->Left = Cell;
+    FreeIndex->Bins[Bin] = Cell;
+    FreeIndex->BinMap[Bin / 32] |= 1U << (Bin % 32);
+}
+
+static VOID
+HvpUnlinkFreeCell(
+    PHV_FREE_INDEX FreeIndex,
+    PHV_FREE_CELL Cell)
+{
+    PHV_FREE_CELL *Link;
+    ULONG Bin;
+
+    /* Take the cell out of its bin or the tree */
+    if (Cell->Size >= HV_FREE_BIN_LIMIT)
+    {
+        FreeIndex->Tree = HvpRemoveFreeTree(FreeIndex->Tree, Cell);
+    }
+    else
+    {
+        Bin = Cell->Size >> HV_FREE_BIN_SHIFT;
+        if (Cell->Right)
+            Cell->Right->Left = Cell->Left;
+        if (Cell->Left)
+            Cell->Left->Right = Cell->Right;
+        else
+            FreeIndex->Bins[Bin] = Cell->Right;
+
+        if (FreeIndex->Bins[Bin] == NULL)
+            FreeIndex->BinMap[Bin / 32] &= ~(1U << (Bin % 32));
+    }
+
+    /* Then out of the hash table */
+    Link = &FreeIndex->HashTable[HvpHashFreeCell(Cell->CellIndex, FreeIndex->HashSize)];
+    while (*Link != Cell)
+        Link = &(*Link)->HashLink;
+    *Link = Cell->HashLink;
+
+    /* And keep the node for the next free cell */
+    Cell->HashLink = FreeIndex->Spare;
+    FreeIndex->Spare = Cell;
+    FreeIndex->Count--;
+}
+
+static PHV_FREE_CELL
+HvpLookupFreeCell(
+    PHV_FREE_INDEX FreeIndex,
+    HCELL_INDEX CellIndex)
+{
+    PHV_FREE_CELL Cell;
+
+    Cell = FreeIndex->HashTable[HvpHashFreeCell(CellIndex, FreeIndex->HashSize)];
+    while (Cell && Cell->CellIndex != CellIndex)
+        Cell = Cell->HashLink;
+
+    return Cell;
+}
+
+static VOID
+HvpGrowFreeHash(
+    PHHIVE RegistryHive,
+    PHV_FREE_INDEX FreeIndex)
+{
+    PHV_FREE_CELL *HashTable;
+    PHV_FREE_CELL Cell, Next;
+    ULONG HashSize, i;
+
+    /* Longer chains still work, so just keep the old table if this fails */
+    HashSize = FreeIndex->HashSize * 2;
+    HashTable = RegistryHive->Allocate(HashSize * sizeof(PHV_FREE_CELL), TRUE, TAG_CM);
+    if (HashTable == NULL)
+        return;
+
+    RtlZeroMemory(HashTable, HashSize * sizeof(PHV_FREE_CELL));
+    for (i = 0; i < FreeIndex->HashSize; i++)
+    {
+        for (Cell = FreeIndex->HashTable[i]; Cell; Cell = Next)
+        {
+            Next = Cell->HashLink;
+            Cell->HashLink = HashTable[HvpHashFreeCell(Cell->CellIndex, HashSize)];
+            HashTable[HvpHashFreeCell(Cell->CellIndex, HashSize)] = Cell;
+        }
+    }
+
+    RegistryHive->Free(FreeIndex->HashTable, 0);
+    FreeIndex->HashTable = HashTable;
+    FreeIndex->HashSize = HashSize;
+}
+
+static BOOLEAN
+HvpInsertFreeCell(
+    PHHIVE RegistryHive,
+    PHV_FREE_INDEX FreeIndex,
+    HCELL_INDEX CellIndex,
+    ULONG Size)
+{
+    PHV_FREE_CHUNK Chunk;
+    PHV_FREE_CELL Cell;
+    ULONG i;
+
+    if (FreeIndex->Spare == NULL)
+    {
+        Chunk = RegistryHive->Allocate(sizeof(HV_FREE_CHUNK), TRUE, TAG_CM);
+        if (Chunk == NULL)
+            return FALSE;
+
+        Chunk->Next = FreeIndex->Chunks;
+        FreeIndex->Chunks = Chunk;
+        for (i = 0; i < HV_FREE_CHUNK_CELLS; i++)
+        {
+            Chunk->Cells[i].HashLink = FreeIndex->Spare;
+            FreeIndex->Spare = &Chunk->Cells[i];
+        }
+    }
+
+    if (FreeIndex->Count >= FreeIndex->HashSize)
+        HvpGrowFreeHash(RegistryHive, FreeIndex);
+
+    Cell = FreeIndex->Spare;
+    FreeIndex->Spare = Cell->HashLink;
+    FreeIndex->Count++;
+
+    Cell->CellIndex = CellIndex;
+    Cell->Size = Size;
+    Cell->HashLink = FreeIndex->HashTable[HvpHashFreeCell(CellIndex, FreeIndex->HashSize)];
+    FreeIndex->HashTable[HvpHashFreeCell(CellIndex, FreeIndex->HashSize)] = Cell;
+
+    HvpLinkFreeCell(FreeIndex, Cell);
+    return TRUE;
+}
+
+static PHV_FREE_CELL
+HvpFindFreeCell(
+    PHV_FREE_INDEX FreeIndex,
+    ULONG Size)
+{
+    PHV_FREE_CELL Cell, Best;
+    ULONG Bin, Word, Bits;
+
+    /* The first non-empty bin at or above the size holds the best fit */
+    Bin = Size >> HV_FREE_BIN_SHIFT;
+    if (Bin < HV_FREE_BIN_COUNT)
+    {
+        Word = Bin / 32;
+        Bits = FreeIndex->BinMap[Word] & (MAXULONG << (Bin % 32));
+        while (Bits == 0 && ++Word < HV_FREE_BIN_COUNT / 32)
+            Bits = FreeIndex->BinMap[Word];
+
+        if (Bits != 0)
+            return FreeIndex->Bins[Word * 32 + RtlFindLeastSignificantBit(Bits)];
+    }
+
+    /* Otherwise take the smallest cell of the tree that is large enough */
+    Best = NULL;
+    Cell = FreeIndex->Tree;
+    while (Cell)
+    {
+        if (Cell->Size >= Size)
+        {
+            Best = Cell;
+            Cell = Cell->Left;
+        }
+        else
+        {
+            Cell = Cell->Right;
+        }
+    }
+
+    return Best;
+}
+
+static VOID
+HvpDestroyFreeIndex(
+    PHHIVE RegistryHive,
+    HSTORAGE_TYPE Storage)
+{
+    PHV_FREE_INDEX FreeIndex = RegistryHive->Storage[Storage].FreeIndex;
+    PHV_FREE_CHUNK Chunk;
+
+    if (FreeIndex == NULL)
+        return;
+
+    while (FreeIndex->Chunks)
+    {
+        Chunk = FreeIndex->Chunks;
+        FreeIndex->Chunks = Chunk->Next;
+        RegistryHive->Free(Chunk, sizeof(HV_FREE_CHUNK));
+    }
+
+    RegistryHive->Free(FreeIndex->HashTable, 0);
+    RegistryHive->Free(FreeIndex, sizeof(HV_FREE_INDEX));
+    RegistryHive->Storage[Storage].FreeIndex = NULL;
+}
+
+static VOID
+HvpCreateFreeIndex(
+    PHHIVE RegistryHive,
+    HSTORAGE_TYPE Storage)
+{
+    PHV_FREE_INDEX FreeIndex;
+
+    ASSERT(RegistryHive->Storage[Storage].FreeIndex == NULL);
+
+    /* Without the index the FreeDisplay lists are used, so failing is fine */
+    FreeIndex = RegistryHive->Allocate(sizeof(HV_FREE_INDEX), TRUE, TAG_CM);
+    if (FreeIndex == NULL)
+        return;
+
+    RtlZeroMemory(FreeIndex, sizeof(HV_FREE_INDEX));
+    FreeIndex->HashSize = HV_FREE_HASH_MINIMUM;
+    FreeIndex->HashTable = RegistryHive->Allocate(FreeIndex->HashSize * sizeof(PHV_FREE_CELL),
+                                                  TRUE, TAG_CM);
+    if (FreeIndex->HashTable == NULL)
+    {
+        RegistryHive->Free(FreeIndex, sizeof(HV_FREE_INDEX));
+        return;
+    }
+
+    RtlZeroMemory(FreeIndex->HashTable, FreeIndex->HashSize * sizeof(PHV_FREE_CELL));
+    RegistryHive->Storage[Storage].FreeIndex = FreeIndex;
+}
+
+static VOID CMAPI
+HvpAddFreeDisplay(
     PHHIVE RegistryHive,
     PHCELL FreeBlock,
     HCELL_INDEX FreeIndex)
@@ -181,9 +569,6 @@ HvpAddFree(
     HSTORAGE_TYPE Storage;
     ULONG Index;
 
-    ASSERT(RegistryHive != NULL);
-    ASSERT(FreeBlock != NULL);
-
     Storage = HvGetCellType(FreeIndex);
     Index = HvpComputeFreeListIndex((ULONG)FreeBlock->Size);
 
@@ -192,7 +577,58 @@ HvpAddFree(
     RegistryHive->Storage[Storage].FreeDisplay[Index] = FreeIndex;
 
     /* FIXME: Eventually get rid of free bins. */
+}
 
+static VOID CMAPI
+HvpDropFreeIndex(
+    PHHIVE RegistryHive,
+    HSTORAGE_TYPE Storage)
+{
+    PHV_FREE_INDEX FreeIndex = RegistryHive->Storage[Storage].FreeIndex;
+    PHV_FREE_CELL Cell;
+    ULONG i;
+
+    DPRINT1("Out of memory, falling back to the free cell lists for storage %u\n", Storage);
+
+    for (i = 0; i < FreeIndex->HashSize; i++)
+    {
+        for (Cell = FreeIndex->HashTable[i]; Cell; Cell = Cell->HashLink)
+        {
+            HvpAddFreeDisplay(RegistryHive,
+                              HvpGetCellHeader(RegistryHive, Cell->CellIndex),
+                              Cell->CellIndex);
+        }
+    }
+
+    HvpDestroyFreeIndex(RegistryHive, Storage);
+}
+
+static NTSTATUS CMAPI
+HvpAddFree(
+    PHHIVE RegistryHive,
+    PHCELL FreeBlock,
+    HCELL_INDEX FreeIndex)
+{
+    HSTORAGE_TYPE Storage;
+
+    ASSERT(RegistryHive != NULL);
+    ASSERT(FreeBlock != NULL);
+
+    Storage = HvGetCellType(FreeIndex);
+    if (RegistryHive->Storage[Storage].FreeIndex)
+    {
+        if (HvpInsertFreeCell(RegistryHive,
+                              RegistryHive->Storage[Storage].FreeIndex,
+                              FreeIndex,
+                              (ULONG)FreeBlock->Size))
+        {
+            return STATUS_SUCCESS;
+        }
+
+        HvpDropFreeIndex(RegistryHive, Storage);
+    }
+
+    HvpAddFreeDisplay(RegistryHive, FreeBlock, FreeIndex);
     return STATUS_SUCCESS;
 }
 
@@ -204,6 +640,7 @@ HvpRemoveFree(
 {
     PHCELL_INDEX FreeCellData;
     PHCELL_INDEX pFreeCellOffset;
+    PHV_FREE_CELL Cell;
     HSTORAGE_TYPE Storage;
     ULONG Index, FreeListIndex;
 
@@ -212,6 +649,17 @@ HvpRemoveFree(
     Storage = HvGetCellType(CellIndex);
     Index = HvpComputeFreeListIndex((ULONG)CellBlock->Size);
 
+    if (RegistryHive->Storage[Storage].FreeIndex)
+    {
+        Cell = HvpLookupFreeCell(RegistryHive->Storage[Storage].FreeIndex, CellIndex);
+        if (Cell)
+        {
+            ASSERT(Cell->Size == (ULONG)CellBlock->Size);
+            HvpUnlinkFreeCell(RegistryHive->Storage[Storage].FreeIndex, Cell);
+            return;
+        }
+    }
+
     pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
     while (*pFreeCellOffset != HCELL_NIL)
     {
@@ -254,8 +702,20 @@ HvpFindFree(
     PHCELL_INDEX FreeCellData;
     HCELL_INDEX FreeCellOffset;
     PHCELL_INDEX pFreeCellOffset;
+    PHV_FREE_CELL Cell;
     ULONG Index;
 
+    if (RegistryHive->Storage[Storage].FreeIndex)
+    {
+        Cell = HvpFindFreeCell(RegistryHive->Storage[Storage].FreeIndex, Size);
+        if (Cell == NULL)
+            return HCELL_NIL;
+
+        FreeCellOffset = Cell->CellIndex;
+        HvpUnlinkFreeCell(RegistryHive->Storage[Storage].FreeIndex, Cell);
+        return FreeCellOffset;
+    }
+
     for (Index = HvpComputeFreeListIndex(Size); Index < 24; Index++)
     {
         pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
@@ -294,6 +754,13 @@ HvpCreateHiveFreeCellList(
         Hive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
     }
 
+    /* And the free cell index, unless the caller wants the lists only */
+    if (!(Hive->HiveFlags & HIVE_NO_FREE_CELL_INDEX))
+    {
+        HvpCreateFreeIndex(Hive, Stable);
+        HvpCreateFreeIndex(Hive, Volatile);
+    }
+
     BlockOffset = 0;
     BlockIndex = 0;
     while (BlockIndex < Hive->Storage[Stable].Length)
@@ -326,6 +793,14 @@ HvpCreateHiveFreeCellList(
     return STATUS_SUCCESS;
 }
 
+VOID CMAPI
+HvpFreeHiveFreeCellList(
+    PHHIVE Hive)
+{
+    HvpDestroyFreeIndex(Hive, Stable);
+    HvpDestroyFreeIndex(Hive, Volatile);
+}
+
 HCELL_INDEX CMAPI
 HvAllocateCell(
     PHHIVE RegistryHive,
@@ -489,7 +964,9 @@ HvFreeCell(
                     ((HCELL_INDEX)((ULONG_PTR)Neighbor - (ULONG_PTR)Bin +
                      Bin->FileOffset)) | (CellIndex & HCELL_TYPE_MASK);
 
-                if (HvpComputeFreeListIndex(Neighbor->Size) !=
+                /* The free cell index sorts by the exact size */
+                if (RegistryHive->Storage[CellType].FreeIndex ||
+                    HvpComputeFreeListIndex(Neighbor->Size) !=
                     HvpComputeFreeListIndex(Neighbor->Size + Free->Size))
                 {
                    HvpRemoveFree(RegistryHive, Neighbor, NeighborCellIndex);
@@ -26,6 +26,8 @@
 #define HIVE_HAS_BEEN_FREED             8
 #define HIVE_UNKNOWN                    0x10
 #define HIVE_IS_UNLOADING               0x20
+#define HIVE_NO_FREE_CELL_INDEX         0x40 // ReactOS: use the FreeDisplay lists only
+#define HIVE_SUBKEY_INDEX               0x80 // ReactOS: index large keys, single-threaded users only
 
 //
 // Hive types
@@ -275,6 +277,7 @@ typedef struct _DUAL
     HCELL_INDEX FreeDisplay[24]; // FREE_DISPLAY FreeDisplay[24];
     ULONG FreeSummary;
     LIST_ENTRY FreeBins;
+    struct _HV_FREE_INDEX *FreeIndex; // ReactOS: volatile free cell index, see hivecell.c
 } DUAL, *PDUAL;
 
 typedef struct _HHIVE
@@ -320,6 +323,7 @@ typedef struct _HHIVE
     ULONG StorageTypeCount;
     ULONG Version;
     DUAL Storage[HTYPE_COUNT];
+    struct _CM_SUBKEY_INDEX *SubKeyIndexes; // ReactOS: see cmindex.c
 } HHIVE, *PHHIVE;
 
 #define IsFreeCell(Cell)    ((Cell)->Size >= 0)
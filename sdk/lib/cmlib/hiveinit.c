@@ -57,6 +57,8 @@ HvpFreeHiveBins(
     PHBIN Bin;
     ULONG Storage;
 
+    HvpFreeHiveFreeCellList(Hive);
+
     for (Storage = 0; Storage < Hive->StorageTypeCount; Storage++)
     {
         Bin = NULL;
@@ -162,7 +164,6 @@ HvpCreateHive(
     IN PCUNICODE_STRING FileName OPTIONAL)
 {
     PHBASE_BLOCK BaseBlock;
-    ULONG Index;
 
     /* Allocate the base block */
     BaseBlock = HvpAllocBaseBlockAligned(RegistryHive, FALSE, TAG_CM);
@@ -197,11 +198,8 @@ HvpCreateHive(
     RegistryHive->BaseBlock = BaseBlock;
     RegistryHive->Version = BaseBlock->Minor; // == HSYS_MINOR
 
-    for (Index = 0; Index < 24; Index++)
-    {
-        RegistryHive->Storage[Stable].FreeDisplay[Index] = HCELL_NIL;
-        RegistryHive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
-    }
+    /* There are no bins yet, this only sets up empty free cell lists */
+    HvpCreateHiveFreeCellList(RegistryHive);
 
     HvpInitFileName(BaseBlock, FileName);
 
@@ -620,6 +618,9 @@ VOID CMAPI
 HvFree(
     PHHIVE RegistryHive)
 {
+    /* Flat hives can have subkey indexes too */
+    CmpFreeSubKeyIndexes(RegistryHive);
+
     if (!RegistryHive->ReadOnly)
     {
         /* Release hive bitmap */
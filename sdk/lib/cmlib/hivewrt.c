@@ -9,6 +9,68 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Number of scattered blocks that are gathered for one write */
+#define HV_WRITE_GATHER_BLOCKS 16
+
+/*
+ * Writes consecutive stable blocks to consecutive file offsets. Blocks that
+ * follow each other in memory are written directly, scattered blocks are
+ * copied into the gather buffer first. Without a gather buffer the scattered
+ * blocks are written one by one.
+ */
+static BOOLEAN CMAPI
+HvpWriteBlocks(
+    PHHIVE RegistryHive,
+    ULONG FileType,
+    ULONG FileOffset,
+    ULONG BlockIndex,
+    ULONG BlockCount,
+    PUCHAR GatherBuffer)
+{
+    PHMAP_ENTRY BlockList = RegistryHive->Storage[Stable].BlockList;
+    PUCHAR BlockPtr;
+    ULONG Count;
+    ULONG i;
+
+    while (BlockCount > 0)
+    {
+        BlockPtr = (PUCHAR)BlockList[BlockIndex].BlockAddress;
+
+        for (Count = 1; Count < BlockCount; Count++)
+        {
+            if (BlockList[BlockIndex + Count].BlockAddress !=
+                (ULONG_PTR)BlockPtr + Count * HBLOCK_SIZE)
+            {
+                break;
+            }
+        }
+
+        if (Count == 1 && BlockCount > 1 && GatherBuffer != NULL)
+        {
+            Count = min(BlockCount, HV_WRITE_GATHER_BLOCKS);
+            for (i = 0; i < Count; i++)
+            {
+                RtlCopyMemory(GatherBuffer + i * HBLOCK_SIZE,
+                              (PVOID)BlockList[BlockIndex + i].BlockAddress,
+                              HBLOCK_SIZE);
+            }
+            BlockPtr = GatherBuffer;
+        }
+
+        if (!RegistryHive->FileWrite(RegistryHive, FileType, &FileOffset,
+                                     BlockPtr, Count * HBLOCK_SIZE))
+        {
+            return FALSE;
+        }
+
+        FileOffset += Count * HBLOCK_SIZE;
+        BlockIndex += Count;
+        BlockCount -= Count;
+    }
+
+    return TRUE;
+}
+
 static BOOLEAN CMAPI
 HvpWriteLog(
     PHHIVE RegistryHive)
@@ -19,8 +81,8 @@ HvpWriteLog(
     PUCHAR Buffer;
     PUCHAR Ptr;
     ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID BlockPtr;
+    ULONG BlockCount;
+    PUCHAR GatherBuffer;
     BOOLEAN Success;
     static ULONG PrintCount = 0;
 
@@ -78,32 +140,39 @@ HvpWriteLog(
         return FALSE;
     }
 
-    /* Write dirty blocks */
+    /* Write dirty blocks, one write per run of dirty blocks */
+    GatherBuffer = RegistryHive->Allocate(HV_WRITE_GATHER_BLOCKS * HBLOCK_SIZE, TRUE, TAG_CM);
     FileOffset = BufferSize;
     BlockIndex = 0;
     while (BlockIndex < RegistryHive->Storage[Stable].Length)
     {
-        LastIndex = BlockIndex;
-        BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-        if (BlockIndex == ~0U || BlockIndex < LastIndex)
+        BlockCount = RtlFindNextForwardRunSet(&RegistryHive->DirtyVector,
+                                              BlockIndex,
+                                              &BlockIndex);
+        if (BlockCount == 0 || BlockIndex >= RegistryHive->Storage[Stable].Length)
         {
             break;
         }
 
-        BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
+        BlockCount = min(BlockCount, RegistryHive->Storage[Stable].Length - BlockIndex);
 
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                         &FileOffset, BlockPtr, HBLOCK_SIZE);
+        /* Write hive blocks */
+        Success = HvpWriteBlocks(RegistryHive, HFILE_TYPE_LOG, FileOffset,
+                                 BlockIndex, BlockCount, GatherBuffer);
         if (!Success)
         {
+            if (GatherBuffer != NULL)
+                RegistryHive->Free(GatherBuffer, 0);
             return FALSE;
         }
 
-        BlockIndex++;
-        FileOffset += HBLOCK_SIZE;
+        BlockIndex += BlockCount;
+        FileOffset += BlockCount * HBLOCK_SIZE;
     }
 
+    if (GatherBuffer != NULL)
+        RegistryHive->Free(GatherBuffer, 0);
+
     Success = RegistryHive->FileSetSize(RegistryHive, HFILE_TYPE_LOG, FileOffset, FileOffset);
     if (!Success)
     {
@@ -150,8 +219,8 @@ HvpWriteHive(
 {
     ULONG FileOffset;
     ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID BlockPtr;
+    ULONG BlockCount;
+    PUCHAR GatherBuffer;
     BOOLEAN Success;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
@@ -182,33 +251,45 @@ HvpWriteHive(
         return FALSE;
     }
 
+    /* Write the blocks, one write per run of dirty blocks */
+    GatherBuffer = RegistryHive->Allocate(HV_WRITE_GATHER_BLOCKS * HBLOCK_SIZE, TRUE, TAG_CM);
     BlockIndex = 0;
     while (BlockIndex < RegistryHive->Storage[Stable].Length)
     {
         if (OnlyDirty)
         {
-            LastIndex = BlockIndex;
-            BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-            if (BlockIndex == ~0U || BlockIndex < LastIndex)
+            BlockCount = RtlFindNextForwardRunSet(&RegistryHive->DirtyVector,
+                                                  BlockIndex,
+                                                  &BlockIndex);
+            if (BlockCount == 0 || BlockIndex >= RegistryHive->Storage[Stable].Length)
             {
                 break;
             }
-        }
 
-        BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
-        FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
+            BlockCount = min(BlockCount, RegistryHive->Storage[Stable].Length - BlockIndex);
+        }
+        else
+        {
+            BlockCount = RegistryHive->Storage[Stable].Length - BlockIndex;
+        }
 
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_PRIMARY,
-                                          &FileOffset, BlockPtr, HBLOCK_SIZE);
+        /* Write hive blocks */
+        Success = HvpWriteBlocks(RegistryHive, HFILE_TYPE_PRIMARY,
+                                 (BlockIndex + 1) * HBLOCK_SIZE,
+                                 BlockIndex, BlockCount, GatherBuffer);
         if (!Success)
         {
+            if (GatherBuffer != NULL)
+                RegistryHive->Free(GatherBuffer, 0);
             return FALSE;
         }
 
-        BlockIndex++;
+        BlockIndex += BlockCount;
     }
 
+    if (GatherBuffer != NULL)
+        RegistryHive->Free(GatherBuffer, 0);
+
     Success = RegistryHive->FileFlush(RegistryHive, HFILE_TYPE_PRIMARY, NULL, 0);
     if (!Success)
     {
@@ -467,6 +467,8 @@ elseif(ARCH STREQUAL "amd64")
         math/amd64/sqrt.S
         # math/amd64/sqrtf.S
         math/amd64/tan.S
+        mem/amd64/memmove.S
+        mem/amd64/memset.S
         setjmp/amd64/setjmp.s)
 
     list(APPEND CRT_SOURCE
@@ -555,9 +557,6 @@ if(NOT ARCH STREQUAL "i386")
         math/tanhf.c
         math/stubs.c
         mem/memchr.c
-        mem/memcpy.c
-        mem/memmove.c
-        mem/memset.c
         string/strcat.c
         string/strchr.c
         string/strcmp.c
@@ -580,6 +579,13 @@ if(NOT ARCH STREQUAL "i386")
         string/wcsrchr.c)
 endif()
 
+if(NOT ARCH STREQUAL "i386" AND NOT ARCH STREQUAL "amd64")
+    list(APPEND CRT_SOURCE
+        mem/memcpy.c
+        mem/memmove.c
+        mem/memset.c)
+endif()
+
 set_source_files_properties(${CRT_ASM_SOURCE} PROPERTIES COMPILE_DEFINITIONS "__MINGW_IMPORT=extern;USE_MSVCRT_PREFIX;_MSVCRT_LIB_;_MSVCRT_;_MT;CRTDLL")
 add_asm_files(crt_asm ${CRT_ASM_SOURCE})
 
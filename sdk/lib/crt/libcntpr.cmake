@@ -127,7 +127,9 @@ elseif(ARCH STREQUAL "amd64")
         math/amd64/log10.S
         math/amd64/pow.S
         math/amd64/sqrt.S
-        math/amd64/tan.S)
+        math/amd64/tan.S
+        mem/amd64/memmove.S
+        mem/amd64/memset.S)
     list(APPEND LIBCNTPR_SOURCE
         except/amd64/ehandler.c
         math/cos.c
@@ -211,9 +213,6 @@ else()
         math/sin.c
         math/sqrt.c
         mem/memchr.c
-        mem/memcpy.c
-        mem/memmove.c
-        mem/memset.c
         string/strcat.c
         string/strchr.c
         string/strcmp.c
@@ -236,6 +235,13 @@ else()
         string/wcsrchr.c)
 endif()
 
+if(NOT ARCH STREQUAL "i386" AND NOT ARCH STREQUAL "amd64")
+    list(APPEND LIBCNTPR_SOURCE
+        mem/memcpy.c
+        mem/memmove.c
+        mem/memset.c)
+endif()
+
 set_source_files_properties(${LIBCNTPR_ASM_SOURCE} PROPERTIES COMPILE_DEFINITIONS "NO_RTL_INLINES;_NTSYSTEM_;_NTDLLBUILD_;_LIBCNT_;__CRT__NO_INLINE;CRTDLL")
 add_asm_files(libcntpr_asm ${LIBCNTPR_ASM_SOURCE})
 
@@ -1,35 +1,106 @@
 #include <string.h>
 
-/* NOTE: This code is duplicated in memcpy function */
+#define WORD_SIZE sizeof(size_t)
+#define WORD_MASK (WORD_SIZE - 1)
+
+/* NOTE: memcpy.c includes this file, so memcpy handles overlapping buffers too */
 void * __cdecl memmove(void *dest,const void *src,size_t count)
 {
     char *char_dest = (char *)dest;
-    char *char_src = (char *)src;
+    const char *char_src = (const char *)src;
+    size_t *word_dest;
+    const size_t *word_src;
+    size_t w0, w1, w2, w3;
 
-    if ((char_dest <= char_src) || (char_dest >= (char_src+count)))
+    if ((size_t)(char_dest - char_src) >= count)
     {
-        /*  non-overlapping buffers */
-        while(count > 0)
-	{
-            *char_dest = *char_src;
-            char_dest++;
-            char_src++;
+        /* Copy forward, the destination does not start inside the source */
+        if (((size_t)char_dest & WORD_MASK) == ((size_t)char_src & WORD_MASK))
+        {
+            /* Copy single bytes until both are aligned */
+            while (count > 0 && ((size_t)char_dest & WORD_MASK))
+            {
+                *char_dest++ = *char_src++;
+                count--;
+            }
+
+            /* Copy 4 words at a time, then single words */
+            word_dest = (size_t *)char_dest;
+            word_src = (const size_t *)char_src;
+            while (count >= 4 * WORD_SIZE)
+            {
+                w0 = word_src[0];
+                w1 = word_src[1];
+                w2 = word_src[2];
+                w3 = word_src[3];
+                word_dest[0] = w0;
+                word_dest[1] = w1;
+                word_dest[2] = w2;
+                word_dest[3] = w3;
+                word_dest += 4;
+                word_src += 4;
+                count -= 4 * WORD_SIZE;
+            }
+            while (count >= WORD_SIZE)
+            {
+                *word_dest++ = *word_src++;
+                count -= WORD_SIZE;
+            }
+            char_dest = (char *)word_dest;
+            char_src = (const char *)word_src;
+        }
+
+        /* Copy the tail, or everything if the buffers can't both be aligned */
+        while (count > 0)
+        {
+            *char_dest++ = *char_src++;
             count--;
-	}
+        }
     }
     else
     {
-        /* overlaping buffers */
-        char_dest = (char *)dest + count - 1;
-        char_src = (char *)src + count - 1;
-
-        while(count > 0)
-	{
-           *char_dest = *char_src;
-           char_dest--;
-           char_src--;
-           count--;
-	}
+        /* Copy backward, starting at the end */
+        char_dest += count;
+        char_src += count;
+
+        if (((size_t)char_dest & WORD_MASK) == ((size_t)char_src & WORD_MASK))
+        {
+            while (count > 0 && ((size_t)char_dest & WORD_MASK))
+            {
+                *--char_dest = *--char_src;
+                count--;
+            }
+
+            word_dest = (size_t *)char_dest;
+            word_src = (const size_t *)char_src;
+            while (count >= 4 * WORD_SIZE)
+            {
+                word_dest -= 4;
+                word_src -= 4;
+                w3 = word_src[3];
+                w2 = word_src[2];
+                w1 = word_src[1];
+                w0 = word_src[0];
+                word_dest[3] = w3;
+                word_dest[2] = w2;
+                word_dest[1] = w1;
+                word_dest[0] = w0;
+                count -= 4 * WORD_SIZE;
+            }
+            while (count >= WORD_SIZE)
+            {
+                *--word_dest = *--word_src;
+                count -= WORD_SIZE;
+            }
+            char_dest = (char *)word_dest;
+            char_src = (const char *)word_src;
+        }
+
+        while (count > 0)
+        {
+            *--char_dest = *--char_src;
+            count--;
+        }
     }
 
     return dest;
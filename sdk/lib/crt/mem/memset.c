@@ -1,14 +1,43 @@
-
 #include <string.h>
 
 #ifdef _MSC_VER
 #pragma function(memset)
 #endif /* _MSC_VER */
 
+#define WORD_SIZE sizeof(size_t)
+#define WORD_MASK (WORD_SIZE - 1)
+
 void* __cdecl memset(void* src, int val, size_t count)
 {
     char *char_src = (char *)src;
+    size_t *word_src;
+    size_t word_val;
+
+    /* Set single bytes until the buffer is aligned */
+    while(count>0 && ((size_t)char_src & WORD_MASK)) {
+        *char_src = val;
+        char_src++;
+        count--;
+    }
+
+    /* Set 4 words at a time, then single words */
+    word_val = (unsigned char)val * ((size_t)-1 / 0xFF);
+    word_src = (size_t *)char_src;
+    while(count >= 4 * WORD_SIZE) {
+        word_src[0] = word_val;
+        word_src[1] = word_val;
+        word_src[2] = word_val;
+        word_src[3] = word_val;
+        word_src += 4;
+        count -= 4 * WORD_SIZE;
+    }
+    while(count >= WORD_SIZE) {
+        *word_src++ = word_val;
+        count -= WORD_SIZE;
+    }
 
+    /* And the tail */
+    char_src = (char *)word_src;
     while(count>0) {
         *char_src = val;
         char_src++;
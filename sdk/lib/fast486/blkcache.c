@@ -0,0 +1,441 @@
+/*
+ * PROJECT:     Fast486 386/486 CPU Emulation Library
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Decoded basic block cache
+ * FILE:        lib/fast486/blkcache.c
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <windef.h>
+
+// #define NDEBUG
+#include <debug.h>
+
+#include <fast486.h>
+#include "common.h"
+#include "opcodes.h"
+#include "extraops.h"
+#include "blkcache.h"
+
+#ifndef FAST486_NO_BLOCK_CACHE
+
+/*
+ * The block cache remembers, for every instruction of a straight-line run of
+ * code, which prefixes it has and which handler executes it. Replaying a block
+ * skips the prefix and opcode fetches and the dispatch through the prefix
+ * handler; the handlers themselves still fetch their operands.
+ *
+ * A block is compared against the guest memory each time it is entered from
+ * somewhere else, so changes made by the host are detected. Guest writes to
+ * the physical memory of the block being executed make the CPU leave it,
+ * whichever linear address they go through (see Fast486WritePhysicalMemory).
+ */
+
+/* PRIVATE FUNCTIONS **********************************************************/
+
+static inline UCHAR
+FASTCALL
+Fast486GetInstructionType(UCHAR Opcode, BOOLEAN Extended, ULONG PrefixFlags)
+{
+    if (Extended)
+    {
+        /* Near conditional jumps */
+        if ((Opcode & 0xF0) == 0x80) return FAST486_INST_END_BLOCK;
+
+        switch (Opcode)
+        {
+            /* System instructions can change the mode or the paging */
+            case 0x00:
+            case 0x01:
+            case 0x06:
+            case 0x08:
+            case 0x09:
+            case 0x22:
+            case 0x23:
+                return FAST486_INST_BREAK_BLOCK;
+        }
+
+        return FAST486_INST_NORMAL;
+    }
+
+    /* Short conditional jumps */
+    if ((Opcode & 0xF0) == 0x70) return FAST486_INST_END_BLOCK;
+
+    switch (Opcode)
+    {
+        /* I/O instructions and BOPs call the host, which may alter the memory */
+        case 0x6C:
+        case 0x6D:
+        case 0x6E:
+        case 0x6F:
+        case 0xC4:
+        case 0xE4:
+        case 0xE5:
+        case 0xE6:
+        case 0xE7:
+        case 0xEC:
+        case 0xED:
+        case 0xEE:
+        case 0xEF:
+            return FAST486_INST_BREAK_BLOCK;
+
+        /* Repeated string instructions jump back to themselves */
+        case 0xA4:
+        case 0xA5:
+        case 0xA6:
+        case 0xA7:
+        case 0xAA:
+        case 0xAB:
+        case 0xAC:
+        case 0xAD:
+        case 0xAE:
+        case 0xAF:
+        {
+            return (PrefixFlags & (FAST486_PREFIX_REP | FAST486_PREFIX_REPNZ))
+                   ? FAST486_INST_END_BLOCK : FAST486_INST_NORMAL;
+        }
+
+        /* Calls, jumps, returns, interrupts, loops and HLT */
+        case 0x9A:
+        case 0xC2:
+        case 0xC3:
+        case 0xCA:
+        case 0xCB:
+        case 0xCC:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+        case 0xE0:
+        case 0xE1:
+        case 0xE2:
+        case 0xE3:
+        case 0xE8:
+        case 0xE9:
+        case 0xEA:
+        case 0xEB:
+        case 0xF4:
+        case 0xFF:
+            return FAST486_INST_END_BLOCK;
+    }
+
+    return FAST486_INST_NORMAL;
+}
+
+static PFAST486_CACHED_BLOCK
+FASTCALL
+Fast486LookupBlock(PFAST486_STATE State,
+                   ULONG Offset,
+                   ULONG LinearAddress,
+                   UCHAR Mode)
+{
+    PFAST486_SEG_REG CodeSegment = &State->SegmentRegs[FAST486_REG_CS];
+    PFAST486_CACHED_BLOCK Block;
+    FAST486_PAGE_TABLE TableEntry;
+    UCHAR Buffer[FAST486_CACHE_SIZE];
+    ULONG Available, PhysicalAddress = LinearAddress;
+
+    Block = &State->BlockCache->Blocks[FAST486_BLOCK_HASH(LinearAddress)];
+
+    /*
+     * Guest writes are matched against the physical address, since the code
+     * may be reached through other mappings too. If the page isn't present,
+     * the fetch below raises the exception and the address isn't used.
+     */
+    if (State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG)
+    {
+        TableEntry.Value = Fast486GetPageTableEntry(State, PAGE_ALIGN(LinearAddress), FALSE);
+        PhysicalAddress = (TableEntry.Address << 12) | PAGE_OFFSET(LinearAddress);
+    }
+
+    /* Blocks never cross a page boundary, the segment limit or the 64 KB IP wraparound */
+    Available = min(FAST486_CACHE_SIZE, FAST486_PAGE_SIZE - PAGE_OFFSET(LinearAddress));
+    if (!CodeSegment->Size) Available = min(Available, 0x10000 - Offset);
+
+    if (Offset > CodeSegment->Limit)
+    {
+        /* Let the fetch below raise the exception */
+        Available = 1;
+    }
+    else if ((CodeSegment->Limit - Offset) < (Available - 1))
+    {
+        Available = CodeSegment->Limit - Offset + 1;
+    }
+
+    if ((Block->Address == LinearAddress)
+        && (Block->Mode == Mode)
+        && (Block->Count > 0)
+        && (Block->Size <= Available))
+    {
+        /* Make sure the code hasn't changed since the block was decoded */
+        if (!Fast486ReadMemory(State, FAST486_REG_CS, Offset, TRUE, Buffer, Block->Size))
+        {
+            /* Exception occurred */
+            return NULL;
+        }
+
+        if (RtlEqualMemory(Buffer, Block->Bytes, Block->Size))
+        {
+            Block->PhysicalAddress = PhysicalAddress;
+            return Block;
+        }
+    }
+
+    /* Start a new block in this slot */
+    Block->Address = FAST486_BLOCK_INVALID_ADDRESS;
+    Block->Count = 0;
+
+    if (!Fast486ReadMemory(State, FAST486_REG_CS, Offset, TRUE, Block->Bytes, Available))
+    {
+        /* Exception occurred */
+        return NULL;
+    }
+
+    Block->Address = LinearAddress;
+    Block->Mode = Mode;
+    Block->Available = (UCHAR)Available;
+    Block->Size = 0;
+    Block->End = 0;
+    Block->Closed = FALSE;
+    Block->PhysicalAddress = PhysicalAddress;
+
+    return Block;
+}
+
+static VOID
+FASTCALL
+Fast486RecordInstruction(PFAST486_STATE State,
+                         PFAST486_CACHED_BLOCK Block,
+                         ULONG Offset,
+                         ULONG BlockOffset)
+{
+    PFAST486_SEG_REG CodeSegment = &State->SegmentRegs[FAST486_REG_CS];
+    FAST486_OPCODE_HANDLER_PROC Handler;
+    PFAST486_DECODED_INST Inst;
+    UCHAR Opcode, Type, SegmentOverride;
+    ULONG HeaderLength = 0, Length, PrefixFlags;
+    BOOLEAN Extended = FALSE;
+    BOOLEAN LazyFlagsAware = FALSE;
+
+    /* Fetch the prefixes and the opcode, just like the interpreter does */
+    while (TRUE)
+    {
+        if (!Fast486FetchByte(State, &Opcode))
+        {
+            /* Exception occurred */
+            State->PrefixFlags = 0;
+            return;
+        }
+
+        HeaderLength++;
+        Handler = Fast486OpcodeHandlers[Opcode];
+        if (Handler != Fast486OpcodePrefix) break;
+
+        Handler(State, Opcode);
+    }
+
+    if (Handler == Fast486OpcodeExtended)
+    {
+        /* Decode the second opcode byte too */
+        if (!Fast486FetchByte(State, &Opcode))
+        {
+            /* Exception occurred */
+            State->PrefixFlags = 0;
+            return;
+        }
+
+        HeaderLength++;
+        Handler = Fast486ExtendedHandlers[Opcode];
+        Extended = TRUE;
+    }
+
+    PrefixFlags = State->PrefixFlags;
+    SegmentOverride = (UCHAR)State->SegmentOverride;
+    Type = Fast486GetInstructionType(Opcode, Extended, PrefixFlags);
+
+#ifndef FAST486_NO_LAZY_FLAGS
+    LazyFlagsAware = Extended ? FAST486_EXT_LAZY_FLAGS_AWARE(Opcode)
+                              : Fast486LazyFlagsAware[Opcode];
+
+    /* Most instructions need the real flags */
+    if (!LazyFlagsAware) Fast486MaterializeFlags(State);
+#endif
+
+    /* Execute the instruction */
+    Handler(State, Opcode);
+    State->PrefixFlags = 0;
+
+    /*
+     * Exceptions and writes to the block make the CPU leave it,
+     * the instruction is not recorded in that case.
+     */
+    if (State->CurrentBlock != Block) return;
+
+    if ((BlockOffset + HeaderLength) > Block->Available)
+    {
+        /* The instruction doesn't fit in the block */
+        Block->Closed = TRUE;
+        return;
+    }
+
+    Inst = &Block->Instructions[Block->Count++];
+    Inst->Handler = (FAST486_DECODED_HANDLER_PROC)Handler;
+    Inst->Offset = (UCHAR)BlockOffset;
+    Inst->HeaderLength = (UCHAR)HeaderLength;
+    Inst->Opcode = Opcode;
+    Inst->PrefixFlags = (UCHAR)PrefixFlags;
+    Inst->SegmentOverride = SegmentOverride;
+    Inst->Type = Type;
+    Inst->LazyFlagsAware = LazyFlagsAware;
+
+    /* Cover the bytes of the opcode in the block */
+    Block->Size = (UCHAR)(BlockOffset + HeaderLength);
+
+    if (Type == FAST486_INST_NORMAL)
+    {
+        /* Find where the next instruction starts */
+        Length = (CodeSegment->Size ? State->InstPtr.Long : State->InstPtr.LowWord) - Offset;
+
+        if ((Length >= HeaderLength) && ((BlockOffset + Length) <= Block->Available))
+        {
+            Block->Size = Block->End = (UCHAR)(BlockOffset + Length);
+        }
+        else
+        {
+            Block->Closed = TRUE;
+        }
+    }
+    else
+    {
+        Block->Closed = TRUE;
+    }
+
+    if (Block->Count == FAST486_BLOCK_MAX_INSTRUCTIONS) Block->Closed = TRUE;
+
+    if (Type == FAST486_INST_BREAK_BLOCK)
+    {
+        /* The next instruction will be looked up again */
+        State->CurrentBlock = NULL;
+    }
+    else
+    {
+        State->CurrentInst = Block->Count;
+    }
+}
+
+static inline VOID
+FASTCALL
+Fast486ReplayInstruction(PFAST486_STATE State,
+                         PFAST486_CACHED_BLOCK Block,
+                         ULONG Index)
+{
+    PFAST486_DECODED_INST Inst = &Block->Instructions[Index];
+
+    /* Restore the decoded prefixes */
+    State->PrefixFlags = Inst->PrefixFlags;
+    State->SegmentOverride = Inst->SegmentOverride;
+
+    /* Skip the prefixes and the opcode */
+    if (State->SegmentRegs[FAST486_REG_CS].Size) State->InstPtr.Long += Inst->HeaderLength;
+    else State->InstPtr.LowWord += Inst->HeaderLength;
+
+    State->CurrentInst = Index + 1;
+
+#ifndef FAST486_NO_LAZY_FLAGS
+    /* Most instructions need the real flags */
+    if (!Inst->LazyFlagsAware) Fast486MaterializeFlags(State);
+#endif
+
+    /* Call the opcode handler */
+    Inst->Handler(State, Inst->Opcode);
+    State->PrefixFlags = 0;
+
+    if (Inst->Type == FAST486_INST_BREAK_BLOCK) State->CurrentBlock = NULL;
+}
+
+/* PUBLIC FUNCTIONS ***********************************************************/
+
+VOID
+FASTCALL
+Fast486FlushBlockCache(PFAST486_STATE State)
+{
+    ULONG i;
+
+    State->CurrentBlock = NULL;
+    if (State->BlockCache == NULL) return;
+
+    for (i = 0; i < FAST486_BLOCK_CACHE_ENTRIES; i++)
+    {
+        State->BlockCache->Blocks[i].Address = FAST486_BLOCK_INVALID_ADDRESS;
+        State->BlockCache->Blocks[i].Count = 0;
+    }
+}
+
+VOID
+FASTCALL
+Fast486ExecuteCached(PFAST486_STATE State)
+{
+    PFAST486_SEG_REG CodeSegment = &State->SegmentRegs[FAST486_REG_CS];
+    PFAST486_CACHED_BLOCK Block = State->CurrentBlock;
+    ULONG Offset, LinearAddress, BlockOffset;
+    ULONG Index = State->CurrentInst;
+    UCHAR Mode = FAST486_BLOCK_MODE(State);
+
+    /* This is a new instruction */
+    State->SavedInstPtr = State->InstPtr;
+    State->SavedStackPtr = State->GeneralRegs[FAST486_REG_ESP];
+
+    Offset = CodeSegment->Size ? State->InstPtr.Long : State->InstPtr.LowWord;
+    LinearAddress = CodeSegment->Base + Offset;
+
+    if ((Block != NULL) && (Block->Mode == Mode))
+    {
+        BlockOffset = LinearAddress - Block->Address;
+
+        /* Check the next instruction first */
+        if ((Index < Block->Count) && (Block->Instructions[Index].Offset == BlockOffset))
+        {
+            Fast486ReplayInstruction(State, Block, Index);
+            return;
+        }
+
+        /* Repeated string instructions execute again */
+        if ((Index > 0) && (Block->Instructions[Index - 1].Offset == BlockOffset))
+        {
+            Fast486ReplayInstruction(State, Block, Index - 1);
+            return;
+        }
+
+        /* Loops jump back to the beginning of the block */
+        if ((BlockOffset == 0) && (Block->Count > 0))
+        {
+            Fast486ReplayInstruction(State, Block, 0);
+            return;
+        }
+
+        /* Decode the instruction following the last one */
+        if ((Index == Block->Count) && !Block->Closed && (BlockOffset == Block->End))
+        {
+            Fast486RecordInstruction(State, Block, Offset, BlockOffset);
+            return;
+        }
+    }
+
+    /* We left the current block, find the one starting here */
+    Block = Fast486LookupBlock(State, Offset, LinearAddress, Mode);
+    if (Block == NULL)
+    {
+        /* Exception occurred */
+        State->CurrentBlock = NULL;
+        return;
+    }
+
+    State->CurrentBlock = Block;
+
+    if (Block->Count > 0) Fast486ReplayInstruction(State, Block, 0);
+    else Fast486RecordInstruction(State, Block, Offset, 0);
+}
+
+#endif
+
+/* EOF */
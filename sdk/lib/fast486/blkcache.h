@@ -0,0 +1,44 @@
+/*
+ * PROJECT:     Fast486 386/486 CPU Emulation Library
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Decoded basic block cache definitions
+ * FILE:        lib/fast486/blkcache.h
+ */
+
+#ifndef _BLKCACHE_H_
+#define _BLKCACHE_H_
+
+#pragma once
+
+/* DEFINES ********************************************************************/
+
+#define FAST486_BLOCK_INVALID_ADDRESS 0xFFFFFFFF
+
+/* Blocks are keyed by their linear address and by the mode of the CPU */
+#define FAST486_BLOCK_MODE(s)                                               \
+    ((s)->SegmentRegs[FAST486_REG_CS].Size                                  \
+     | (((s)->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PE) ? 2 : 0)  \
+     | ((s)->Flags.Vm ? 4 : 0))
+
+#define FAST486_BLOCK_HASH(x) \
+    (((x) ^ ((x) >> 12)) & (FAST486_BLOCK_CACHE_ENTRIES - 1))
+
+/* FUNCTIONS ******************************************************************/
+
+VOID
+FASTCALL
+Fast486FlushBlockCache
+(
+    PFAST486_STATE State
+);
+
+VOID
+FASTCALL
+Fast486ExecuteCached
+(
+    PFAST486_STATE State
+);
+
+#endif // _BLKCACHE_H_
+
+/* EOF */
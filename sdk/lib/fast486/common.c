@@ -273,11 +273,11 @@ Fast486GetIntVector(PFAST486_STATE State,
         ULONG FarPointer;
 
         /* Paging is always disabled in real mode */
-        State->MemReadCallback(State,
-                               State->Idtr.Address
-                               + Number * sizeof(FarPointer),
-                               &FarPointer,
-                               sizeof(FarPointer));
+        Fast486ReadPhysicalMemory(State,
+                                  State->Idtr.Address
+                                  + Number * sizeof(FarPointer),
+                                  &FarPointer,
+                                  sizeof(FarPointer));
 
         /* Fill a fake IDT entry */
         IdtEntry->Offset = LOWORD(FarPointer);
@@ -535,6 +535,9 @@ Fast486PerformInterrupt(PFAST486_STATE State,
 {
     FAST486_IDT_ENTRY IdtEntry;
 
+    /* The flags are saved on the stack */
+    Fast486MaterializeFlags(State);
+
     /* Get the interrupt vector */
     if (!Fast486GetIntVector(State, Number, &IdtEntry))
     {
@@ -560,6 +563,9 @@ Fast486ExceptionWithErrorCode(PFAST486_STATE State,
 {
     FAST486_IDT_ENTRY IdtEntry;
 
+    /* The flags are saved on the stack */
+    Fast486MaterializeFlags(State);
+
     /* Increment the exception count */
     State->ExceptionCount++;
 
@@ -585,6 +591,11 @@ Fast486ExceptionWithErrorCode(PFAST486_STATE State,
     /* Clear the prefix flags */
     State->PrefixFlags = 0;
 
+#ifndef FAST486_NO_BLOCK_CACHE
+    /* Leave the current block */
+    State->CurrentBlock = NULL;
+#endif
+
     /* Restore the IP to the saved IP */
     State->InstPtr = State->SavedInstPtr;
 
@@ -632,6 +643,9 @@ Fast486TaskSwitch(PFAST486_STATE State, FAST486_TASK_SWITCH_TYPE Type, USHORT Se
     PFAST486_LEGACY_TSS NewLegacyTss = (PFAST486_LEGACY_TSS)&NewTss;
     USHORT NewLdtr, NewEs, NewCs, NewSs, NewDs;
 
+    /* The flags are saved in the TSS */
+    Fast486MaterializeFlags(State);
+
     if ((State->TaskReg.Modern && State->TaskReg.Limit < (sizeof(FAST486_TSS) - 1))
         || (!State->TaskReg.Modern && State->TaskReg.Limit < (sizeof(FAST486_LEGACY_TSS) - 1)))
     {
@@ -69,7 +69,7 @@ if (State->PrefixFlags & FAST486_PREFIX_LOCK)\
 #define GET_ADDR_PDE(x) ((x) >> 22)
 #define GET_ADDR_PTE(x) (((x) >> 12) & 0x3FF)
 #define INVALID_TLB_FIELD 0xFFFFFFFF
-#define NUM_TLB_ENTRIES 0x100000
+#define NUM_TLB_ENTRIES FAST486_NUM_TLB_ENTRIES
 
 typedef struct _FAST486_MOD_REG_RM
 {
@@ -60,6 +60,113 @@ Fast486GetCurrentPrivLevel(PFAST486_STATE State)
     return (!State->Flags.Vm) ? State->Cpl : 3;
 }
 
+FORCEINLINE
+PUCHAR
+FASTCALL
+Fast486GetHostPointer(PFAST486_STATE State,
+                      ULONG PhysicalAddress,
+                      ULONG Size)
+{
+    ULONG PageNumber = PhysicalAddress >> 12;
+
+    /* The access must not cross a page boundary */
+    if ((PAGE_OFFSET(PhysicalAddress) + Size) > FAST486_PAGE_SIZE) return NULL;
+
+    /* The page must be mapped directly */
+    if ((PageNumber >= State->MemoryMapSize)
+        || (State->MemoryMap[PageNumber] == NULL))
+    {
+        return NULL;
+    }
+
+    return (PUCHAR)State->MemoryMap[PageNumber] + PAGE_OFFSET(PhysicalAddress);
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486CopyHostMemory(PVOID Destination,
+                      const VOID *Source,
+                      ULONG Size)
+{
+    switch (Size)
+    {
+        case sizeof(UCHAR):
+            *(PUCHAR)Destination = *(const UCHAR*)Source;
+            break;
+
+        case sizeof(USHORT):
+            *(UNALIGNED USHORT*)Destination = *(const UNALIGNED USHORT*)Source;
+            break;
+
+        case sizeof(ULONG):
+            *(UNALIGNED ULONG*)Destination = *(const UNALIGNED ULONG*)Source;
+            break;
+
+        default:
+            RtlCopyMemory(Destination, Source, Size);
+            break;
+    }
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486ReadPhysicalMemory(PFAST486_STATE State,
+                          ULONG PhysicalAddress,
+                          PVOID Buffer,
+                          ULONG Size)
+{
+    PUCHAR HostPointer = Fast486GetHostPointer(State, PhysicalAddress, Size);
+
+    if (HostPointer != NULL)
+    {
+        /* Plain RAM, read it directly */
+        Fast486CopyHostMemory(Buffer, HostPointer, Size);
+    }
+    else
+    {
+        /* Let the host handle it */
+        State->MemReadCallback(State, PhysicalAddress, Buffer, Size);
+    }
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486WritePhysicalMemory(PFAST486_STATE State,
+                           ULONG PhysicalAddress,
+                           PVOID Buffer,
+                           ULONG Size)
+{
+    PUCHAR HostPointer = Fast486GetHostPointer(State, PhysicalAddress, Size);
+
+#ifndef FAST486_NO_BLOCK_CACHE
+    if (State->CurrentBlock != NULL)
+    {
+        ULONG BlockAddress = State->CurrentBlock->PhysicalAddress;
+
+        /* Writing over the block being executed makes the CPU leave it */
+        if (((PhysicalAddress - BlockAddress) < State->CurrentBlock->Available)
+            || ((BlockAddress - PhysicalAddress) < Size))
+        {
+            State->CurrentBlock = NULL;
+        }
+    }
+#endif
+
+    if (HostPointer != NULL)
+    {
+        /* Plain RAM, write it directly */
+        Fast486CopyHostMemory(HostPointer, Buffer, Size);
+    }
+    else
+    {
+        /* Let the host handle it */
+        State->MemWriteCallback(State, PhysicalAddress, Buffer, Size);
+    }
+}
+
 FORCEINLINE
 ULONG
 FASTCALL
@@ -76,15 +183,17 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
     if ((State->Tlb != NULL)
         && (State->Tlb[VirtualAddress >> 12] != INVALID_TLB_FIELD))
     {
-        /* Return the cached entry */
-        return State->Tlb[VirtualAddress >> 12];
+        TableEntry.Value = State->Tlb[VirtualAddress >> 12];
+
+        /* Return the cached entry, unless the page must be marked as dirty first */
+        if (!MarkAsDirty || TableEntry.Dirty) return TableEntry.Value;
     }
 
     /* Read the directory entry */
-    State->MemReadCallback(State,
-                           PageDirectory + PdeIndex * sizeof(ULONG),
-                           &DirectoryEntry.Value,
-                           sizeof(DirectoryEntry));
+    Fast486ReadPhysicalMemory(State,
+                              PageDirectory + PdeIndex * sizeof(ULONG),
+                              &DirectoryEntry.Value,
+                              sizeof(DirectoryEntry));
 
     /* Make sure it is present */
     if (!DirectoryEntry.Present) return 0;
@@ -96,18 +205,18 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
         DirectoryEntry.Accessed = TRUE;
 
         /* Write back the directory entry */
-        State->MemWriteCallback(State,
-                                PageDirectory + PdeIndex * sizeof(ULONG),
-                                &DirectoryEntry.Value,
-                                sizeof(DirectoryEntry));
+        Fast486WritePhysicalMemory(State,
+                                   PageDirectory + PdeIndex * sizeof(ULONG),
+                                   &DirectoryEntry.Value,
+                                   sizeof(DirectoryEntry));
     }
 
     /* Read the table entry */
-    State->MemReadCallback(State,
-                           (DirectoryEntry.TableAddress << 12)
-                           + PteIndex * sizeof(ULONG),
-                           &TableEntry.Value,
-                           sizeof(TableEntry));
+    Fast486ReadPhysicalMemory(State,
+                              (DirectoryEntry.TableAddress << 12)
+                              + PteIndex * sizeof(ULONG),
+                              &TableEntry.Value,
+                              sizeof(TableEntry));
 
     /* Make sure it is present */
     if (!TableEntry.Present) return 0;
@@ -120,11 +229,11 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
         if (MarkAsDirty) TableEntry.Dirty = TRUE;
 
         /* Write back the table entry */
-        State->MemWriteCallback(State,
-                                (DirectoryEntry.TableAddress << 12)
-                                + PteIndex * sizeof(ULONG),
-                                &TableEntry.Value,
-                                sizeof(TableEntry));
+        Fast486WritePhysicalMemory(State,
+                                   (DirectoryEntry.TableAddress << 12)
+                                   + PteIndex * sizeof(ULONG),
+                                   &TableEntry.Value,
+                                   sizeof(TableEntry));
     }
 
     /*
@@ -208,10 +317,10 @@ Fast486ReadLinearMemory(PFAST486_STATE State,
             }
 
             /* Read the memory */
-            State->MemReadCallback(State,
-                                   (TableEntry.Address << 12) | PageOffset,
-                                   (PVOID)((ULONG_PTR)Buffer + BufferOffset),
-                                   PageLength);
+            Fast486ReadPhysicalMemory(State,
+                                      (TableEntry.Address << 12) | PageOffset,
+                                      (PVOID)((ULONG_PTR)Buffer + BufferOffset),
+                                      PageLength);
 
             BufferOffset += PageLength;
         }
@@ -219,7 +328,7 @@ Fast486ReadLinearMemory(PFAST486_STATE State,
     else
     {
         /* Read the memory */
-        State->MemReadCallback(State, LinearAddress, Buffer, Size);
+        Fast486ReadPhysicalMemory(State, LinearAddress, Buffer, Size);
     }
 
     return TRUE;
@@ -281,10 +390,10 @@ Fast486WriteLinearMemory(PFAST486_STATE State,
             }
 
             /* Write the memory */
-            State->MemWriteCallback(State,
-                                    (TableEntry.Address << 12) | PageOffset,
-                                    (PVOID)((ULONG_PTR)Buffer + BufferOffset),
-                                    PageLength);
+            Fast486WritePhysicalMemory(State,
+                                       (TableEntry.Address << 12) | PageOffset,
+                                       (PVOID)((ULONG_PTR)Buffer + BufferOffset),
+                                       PageLength);
 
             BufferOffset += PageLength;
         }
@@ -292,7 +401,7 @@ Fast486WriteLinearMemory(PFAST486_STATE State,
     else
     {
         /* Write the memory */
-        State->MemWriteCallback(State, LinearAddress, Buffer, Size);
+        Fast486WritePhysicalMemory(State, LinearAddress, Buffer, Size);
     }
 
     return TRUE;
@@ -1013,6 +1122,179 @@ Fast486CalculateParity(UCHAR Number)
     return (0x9669 >> ((Number & 0x0F) ^ (Number >> 4))) & 1;
 }
 
+/*
+ * Computation of the arithmetic flags from the last operation. These are
+ * shared by the eager path and by the lazy one, which only calls them when
+ * a flag is actually read.
+ */
+
+FORCEINLINE
+BOOLEAN
+FASTCALL
+Fast486LazyCarry(PFAST486_LAZY_FLAGS Lazy)
+{
+    switch (Lazy->Operation)
+    {
+        case FAST486_LAZY_ADD:
+            return (Lazy->Result < Lazy->FirstValue) && (Lazy->Result < Lazy->SecondValue);
+
+        case FAST486_LAZY_SUB:
+            return (Lazy->FirstValue < Lazy->SecondValue);
+
+        default:
+            return FALSE;
+    }
+}
+
+FORCEINLINE
+BOOLEAN
+FASTCALL
+Fast486LazyOverflow(PFAST486_LAZY_FLAGS Lazy)
+{
+    ULONG SignFlag = 1 << (Lazy->Bits - 1);
+
+    switch (Lazy->Operation)
+    {
+        case FAST486_LAZY_ADD:
+            return ((Lazy->FirstValue & SignFlag) == (Lazy->SecondValue & SignFlag))
+                   && ((Lazy->FirstValue & SignFlag) != (Lazy->Result & SignFlag));
+
+        case FAST486_LAZY_SUB:
+            return ((Lazy->FirstValue & SignFlag) != (Lazy->SecondValue & SignFlag))
+                   && ((Lazy->FirstValue & SignFlag) != (Lazy->Result & SignFlag));
+
+        default:
+            return FALSE;
+    }
+}
+
+FORCEINLINE
+BOOLEAN
+FASTCALL
+Fast486LazyAuxCarry(PFAST486_LAZY_FLAGS Lazy)
+{
+    switch (Lazy->Operation)
+    {
+        case FAST486_LAZY_ADD:
+            return ((((Lazy->FirstValue & 0x0F) + (Lazy->SecondValue & 0x0F)) & 0x10) != 0);
+
+        case FAST486_LAZY_SUB:
+            return (Lazy->FirstValue & 0x0F) < (Lazy->SecondValue & 0x0F);
+
+        default:
+            return Lazy->AuxCarry;
+    }
+}
+
+FORCEINLINE
+BOOLEAN
+FASTCALL
+Fast486LazySign(PFAST486_LAZY_FLAGS Lazy)
+{
+    return ((Lazy->Result & (1 << (Lazy->Bits - 1))) != 0);
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486ComputeFlags(PFAST486_STATE State, PFAST486_LAZY_FLAGS Lazy)
+{
+    State->Flags.Cf = Fast486LazyCarry(Lazy);
+    State->Flags.Of = Fast486LazyOverflow(Lazy);
+    State->Flags.Af = Fast486LazyAuxCarry(Lazy);
+    State->Flags.Zf = (Lazy->Result == 0);
+    State->Flags.Sf = Fast486LazySign(Lazy);
+    State->Flags.Pf = Fast486CalculateParity(LOBYTE(Lazy->Result));
+}
+
+#ifndef FAST486_NO_LAZY_FLAGS
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486MaterializeFlags(PFAST486_STATE State)
+{
+    if (State->LazyFlags.Operation == FAST486_LAZY_NONE) return;
+
+    /* Write the arithmetic flags into EFLAGS */
+    Fast486ComputeFlags(State, &State->LazyFlags);
+    State->LazyFlags.Operation = FAST486_LAZY_NONE;
+}
+
+#define FAST486_LAZY_GET_FLAG(Name, Flag, Expression)           \
+FORCEINLINE                                                     \
+BOOLEAN                                                         \
+FASTCALL                                                        \
+Name(PFAST486_STATE State)                                      \
+{                                                               \
+    PFAST486_LAZY_FLAGS Lazy = &State->LazyFlags;               \
+    if (Lazy->Operation == FAST486_LAZY_NONE) return Flag;      \
+    return Expression;                                          \
+}
+
+#else
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486MaterializeFlags(PFAST486_STATE State)
+{
+    UNREFERENCED_PARAMETER(State);
+}
+
+#define FAST486_LAZY_GET_FLAG(Name, Flag, Expression)           \
+FORCEINLINE                                                     \
+BOOLEAN                                                         \
+FASTCALL                                                        \
+Name(PFAST486_STATE State)                                      \
+{                                                               \
+    return Flag;                                                \
+}
+
+#endif
+
+FAST486_LAZY_GET_FLAG(Fast486GetCf, State->Flags.Cf, Fast486LazyCarry(Lazy))
+FAST486_LAZY_GET_FLAG(Fast486GetOf, State->Flags.Of, Fast486LazyOverflow(Lazy))
+FAST486_LAZY_GET_FLAG(Fast486GetAf, State->Flags.Af, Fast486LazyAuxCarry(Lazy))
+FAST486_LAZY_GET_FLAG(Fast486GetZf, State->Flags.Zf, (Lazy->Result == 0))
+FAST486_LAZY_GET_FLAG(Fast486GetSf, State->Flags.Sf, Fast486LazySign(Lazy))
+FAST486_LAZY_GET_FLAG(Fast486GetPf, State->Flags.Pf, Fast486CalculateParity(LOBYTE(Lazy->Result)))
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486UpdateFlags(PFAST486_STATE State,
+                   FAST486_LAZY_OPERATION Operation,
+                   ULONG FirstValue,
+                   ULONG SecondValue,
+                   ULONG Result,
+                   UCHAR Bits)
+{
+#ifndef FAST486_NO_LAZY_FLAGS
+    PFAST486_LAZY_FLAGS Lazy = &State->LazyFlags;
+#else
+    FAST486_LAZY_FLAGS LocalFlags;
+    PFAST486_LAZY_FLAGS Lazy = &LocalFlags;
+#endif
+
+    /* Logical operations don't change AF */
+    if (Operation == FAST486_LAZY_LOGIC) Lazy->AuxCarry = Fast486GetAf(State);
+
+    /* Remember the operation */
+    Lazy->Operation = Operation;
+    Lazy->Bits = Bits;
+    Lazy->FirstValue = FirstValue;
+    Lazy->SecondValue = SecondValue;
+    Lazy->Result = Result;
+
+#ifndef FAST486_NO_LAZY_FLAGS
+    /* In eager mode, compute the flags right now */
+    if (!State->LazyFlagsEnabled) Fast486MaterializeFlags(State);
+#else
+    Fast486ComputeFlags(State, Lazy);
+#endif
+}
+
 FORCEINLINE
 BOOLEAN
 FASTCALL
@@ -30,6 +30,7 @@
 #include "common.h"
 #include "opcodes.h"
 #include "fpu.h"
+#include "blkcache.h"
 
 /* DEFINES ********************************************************************/
 
@@ -60,33 +61,48 @@ Fast486ExecutionControl(PFAST486_STATE State, FAST486_EXEC_CMD Command)
 
         if (!State->Halted)
         {
-NextInst:
-            /* Check if this is a new instruction */
-            if (State->PrefixFlags == 0)
+#ifndef FAST486_NO_BLOCK_CACHE
+            if (State->BlockCache != NULL)
             {
-                State->SavedInstPtr = State->InstPtr;
-                State->SavedStackPtr = State->GeneralRegs[FAST486_REG_ESP];
+                /* Execute the instruction through the decoded block cache */
+                Fast486ExecuteCached(State);
             }
-
-            /* Perform an instruction fetch */
-            if (!Fast486FetchByte(State, &Opcode))
+            else
+#endif
             {
-                /* Exception occurred */
-                State->PrefixFlags = 0;
-                continue;
-            }
+NextInst:
+                /* Check if this is a new instruction */
+                if (State->PrefixFlags == 0)
+                {
+                    State->SavedInstPtr = State->InstPtr;
+                    State->SavedStackPtr = State->GeneralRegs[FAST486_REG_ESP];
+                }
+
+                /* Perform an instruction fetch */
+                if (!Fast486FetchByte(State, &Opcode))
+                {
+                    /* Exception occurred */
+                    State->PrefixFlags = 0;
+                    continue;
+                }
 
-            // TODO: Check for CALL/RET to update ProcedureCallCount.
+                // TODO: Check for CALL/RET to update ProcedureCallCount.
+
+#ifndef FAST486_NO_LAZY_FLAGS
+                /* Most instructions need the real flags */
+                if (!Fast486LazyFlagsAware[Opcode]) Fast486MaterializeFlags(State);
+#endif
 
-            /* Call the opcode handler */
-            CurrentHandler = Fast486OpcodeHandlers[Opcode];
-            CurrentHandler(State, Opcode);
+                /* Call the opcode handler */
+                CurrentHandler = Fast486OpcodeHandlers[Opcode];
+                CurrentHandler(State, Opcode);
 
-            /* If this is a prefix, go to the next instruction immediately */
-            if (CurrentHandler == Fast486OpcodePrefix) goto NextInst;
+                /* If this is a prefix, go to the next instruction immediately */
+                if (CurrentHandler == Fast486OpcodePrefix) goto NextInst;
 
-            /* A non-prefix opcode has been executed, reset the prefix flags */
-            State->PrefixFlags = 0;
+                /* A non-prefix opcode has been executed, reset the prefix flags */
+                State->PrefixFlags = 0;
+            }
         }
 
         /*
@@ -126,6 +142,9 @@ VOID
 NTAPI
 Fast486DumpState(PFAST486_STATE State)
 {
+    /* Show the real flags */
+    Fast486MaterializeFlags(State);
+
     DbgPrint("\nFast486DumpState -->\n");
     DbgPrint("\nCPU currently executing in %s mode at %04X:%08X\n",
             (State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PE) ? "protected" : "real",
@@ -241,6 +260,9 @@ Fast486Continue(PFAST486_STATE State)
 {
     /* Call the internal function */
     Fast486ExecutionControl(State, FAST486_CONTINUE);
+
+    /* The caller may look at the flags */
+    Fast486MaterializeFlags(State);
 }
 
 VOID
@@ -249,6 +271,9 @@ Fast486StepInto(PFAST486_STATE State)
 {
     /* Call the internal function */
     Fast486ExecutionControl(State, FAST486_STEP_INTO);
+
+    /* The caller may look at the flags */
+    Fast486MaterializeFlags(State);
 }
 
 VOID
@@ -257,6 +282,9 @@ Fast486StepOver(PFAST486_STATE State)
 {
     /* Call the internal function */
     Fast486ExecutionControl(State, FAST486_STEP_OVER);
+
+    /* The caller may look at the flags */
+    Fast486MaterializeFlags(State);
 }
 
 VOID
@@ -265,6 +293,58 @@ Fast486StepOut(PFAST486_STATE State)
 {
     /* Call the internal function */
     Fast486ExecutionControl(State, FAST486_STEP_OUT);
+
+    /* The caller may look at the flags */
+    Fast486MaterializeFlags(State);
+}
+
+ULONG
+NTAPI
+Fast486ExecuteBatch(PFAST486_STATE State, ULONG MaxSteps)
+{
+    ULONG SavedBudget = State->BatchBudget;
+    BOOLEAN SavedStopped = State->BatchStopped;
+    ULONG Steps = 0;
+
+    /* A batch started from a callback (nested) has its own budget */
+    State->BatchBudget = MaxSteps;
+    State->BatchStopped = FALSE;
+
+    while (State->BatchBudget > 0)
+    {
+        State->BatchBudget--;
+        Steps++;
+
+        /* Call the internal function */
+        Fast486ExecutionControl(State, FAST486_STEP_INTO);
+
+        /*
+         * Don't spin on a halted CPU, give the control back to the caller
+         * so that it can run its timers until an interrupt wakes us up.
+         */
+        if (State->Halted && !(State->Flags.If && State->IntSignaled)) break;
+    }
+
+    /*
+     * Restore the budget of the outer batch, if any, unless Fast486StopBatch
+     * was called meanwhile: then the outer batch must end as well.
+     */
+    if (!State->BatchStopped) State->BatchBudget = SavedBudget;
+    State->BatchStopped |= SavedStopped;
+
+    /* The caller may look at the flags */
+    Fast486MaterializeFlags(State);
+
+    return Steps;
+}
+
+VOID
+NTAPI
+Fast486StopBatch(PFAST486_STATE State)
+{
+    /* The current batch, and those it is nested in, end after the current instruction */
+    State->BatchBudget = 0;
+    State->BatchStopped = TRUE;
 }
 
 /* EOF */
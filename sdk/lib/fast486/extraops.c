@@ -1882,56 +1882,56 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeConditionalJmp)
         /* JO / JNO */
         case 0:
         {
-            Jump = State->Flags.Of;
+            Jump = Fast486GetOf(State);
             break;
         }
 
         /* JC / JNC */
         case 1:
         {
-            Jump = State->Flags.Cf;
+            Jump = Fast486GetCf(State);
             break;
         }
 
         /* JZ / JNZ */
         case 2:
         {
-            Jump = State->Flags.Zf;
+            Jump = Fast486GetZf(State);
             break;
         }
 
         /* JBE / JNBE */
         case 3:
         {
-            Jump = State->Flags.Cf || State->Flags.Zf;
+            Jump = Fast486GetCf(State) || Fast486GetZf(State);
             break;
         }
 
         /* JS / JNS */
         case 4:
         {
-            Jump = State->Flags.Sf;
+            Jump = Fast486GetSf(State);
             break;
         }
 
         /* JP / JNP */
         case 5:
         {
-            Jump = State->Flags.Pf;
+            Jump = Fast486GetPf(State);
             break;
         }
 
         /* JL / JNL */
         case 6:
         {
-            Jump = State->Flags.Sf != State->Flags.Of;
+            Jump = Fast486GetSf(State) != Fast486GetOf(State);
             break;
         }
 
         /* JLE / JNLE */
         case 7:
         {
-            Jump = (State->Flags.Sf != State->Flags.Of) || State->Flags.Zf;
+            Jump = (Fast486GetSf(State) != Fast486GetOf(State)) || Fast486GetZf(State);
             break;
         }
     }
@@ -2204,6 +2204,11 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeExtended)
         return;
     }
 
+#ifndef FAST486_NO_LAZY_FLAGS
+    /* Most instructions need the real flags */
+    if (!FAST486_EXT_LAZY_FLAGS_AWARE(SecondOpcode)) Fast486MaterializeFlags(State);
+#endif
+
     /* Call the extended opcode handler */
     Fast486ExtendedHandlers[SecondOpcode](State, SecondOpcode);
 }
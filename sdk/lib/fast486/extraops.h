@@ -26,6 +26,10 @@
 
 /* DEFINES ********************************************************************/
 
+extern
+FAST486_OPCODE_HANDLER_PROC
+Fast486ExtendedHandlers[FAST486_NUM_OPCODE_HANDLERS];
+
 FAST486_OPCODE_HANDLER(Fast486ExtOpcodeInvalid);
 FAST486_OPCODE_HANDLER(Fast486ExtOpcodeUnimplemented);
 FAST486_OPCODE_HANDLER(Fast486ExtOpcode0F0B);
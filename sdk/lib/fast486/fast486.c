@@ -30,6 +30,7 @@
 #include "common.h"
 #include "opcodes.h"
 #include "fpu.h"
+#include "blkcache.h"
 
 /* DEFAULT CALLBACKS **********************************************************/
 
@@ -122,6 +123,23 @@ Fast486Initialize(PFAST486_STATE         State,
     /* Set the TLB (if given) */
     State->Tlb = Tlb;
 
+    /* No memory map or block cache until the host sets them */
+    State->MemoryMap = NULL;
+    State->MemoryMapSize = 0;
+#ifndef FAST486_NO_BLOCK_CACHE
+    State->BlockCache = NULL;
+#endif
+
+#ifndef FAST486_NO_LAZY_FLAGS
+    /* Compute the arithmetic flags only when needed */
+    State->LazyFlagsEnabled = TRUE;
+#endif
+
+#ifndef FAST486_NO_FPU
+    /* Emulate the FPU exactly unless asked otherwise */
+    State->FpuPrecision = FAST486_FPU_EXACT;
+#endif
+
     /* Reset the CPU */
     Fast486Reset(State);
 }
@@ -132,7 +150,7 @@ Fast486Reset(PFAST486_STATE State)
 {
     FAST486_SEG_REGS i;
 
-    /* Save the callbacks and TLB */
+    /* Save the callbacks, TLB, memory map, block cache, flags mode and FPU precision */
     FAST486_MEM_READ_PROC  MemReadCallback  = State->MemReadCallback;
     FAST486_MEM_WRITE_PROC MemWriteCallback = State->MemWriteCallback;
     FAST486_IO_READ_PROC   IoReadCallback   = State->IoReadCallback;
@@ -141,6 +159,17 @@ Fast486Reset(PFAST486_STATE State)
     FAST486_INT_ACK_PROC   IntAckCallback   = State->IntAckCallback;
     FAST486_FPU_PROC       FpuCallback      = State->FpuCallback;
     PULONG                 Tlb              = State->Tlb;
+    PVOID                 *MemoryMap        = State->MemoryMap;
+    ULONG                  MemoryMapSize    = State->MemoryMapSize;
+#ifndef FAST486_NO_BLOCK_CACHE
+    PFAST486_BLOCK_CACHE   BlockCache       = State->BlockCache;
+#endif
+#ifndef FAST486_NO_LAZY_FLAGS
+    BOOLEAN                LazyFlagsEnabled = State->LazyFlagsEnabled;
+#endif
+#ifndef FAST486_NO_FPU
+    UCHAR                  FpuPrecision     = State->FpuPrecision;
+#endif
 
     /* Clear the entire structure */
     RtlZeroMemory(State, sizeof(*State));
@@ -186,7 +215,7 @@ Fast486Reset(PFAST486_STATE State)
     State->FpuTag = 0xFFFF;
 #endif
 
-    /* Restore the callbacks and TLB */
+    /* Restore the callbacks, TLB, memory map, block cache, flags mode and FPU precision */
     State->MemReadCallback  = MemReadCallback;
     State->MemWriteCallback = MemWriteCallback;
     State->IoReadCallback   = IoReadCallback;
@@ -195,9 +224,79 @@ Fast486Reset(PFAST486_STATE State)
     State->IntAckCallback   = IntAckCallback;
     State->FpuCallback      = FpuCallback;
     State->Tlb              = Tlb;
+    State->MemoryMap        = MemoryMap;
+    State->MemoryMapSize    = MemoryMapSize;
+#ifndef FAST486_NO_BLOCK_CACHE
+    State->BlockCache       = BlockCache;
+#endif
+#ifndef FAST486_NO_LAZY_FLAGS
+    State->LazyFlagsEnabled = LazyFlagsEnabled;
+#endif
+#ifndef FAST486_NO_FPU
+    State->FpuPrecision     = FpuPrecision;
+#endif
 
     /* Flush the TLB */
     Fast486FlushTlb(State);
+
+#ifndef FAST486_NO_BLOCK_CACHE
+    /* Flush the block cache */
+    Fast486FlushBlockCache(State);
+#endif
+}
+
+VOID
+NTAPI
+Fast486SetMemoryMap(PFAST486_STATE State, PVOID *MemoryMap, ULONG NumPages)
+{
+    /*
+     * Each entry of the map is either a host pointer to a physical page,
+     * or NULL if accesses to that page must go through the callbacks.
+     */
+    State->MemoryMap = MemoryMap;
+    State->MemoryMapSize = (MemoryMap != NULL) ? NumPages : 0;
+}
+
+VOID
+NTAPI
+Fast486SetBlockCache(PFAST486_STATE State, PFAST486_BLOCK_CACHE BlockCache)
+{
+#ifndef FAST486_NO_BLOCK_CACHE
+    /* Set the block cache, or disable it if NULL is given */
+    State->BlockCache = BlockCache;
+
+    /* Start with an empty cache */
+    Fast486FlushBlockCache(State);
+#else
+    UNREFERENCED_PARAMETER(State);
+    UNREFERENCED_PARAMETER(BlockCache);
+#endif
+}
+
+VOID
+NTAPI
+Fast486EnableLazyFlags(PFAST486_STATE State, BOOLEAN Enable)
+{
+#ifndef FAST486_NO_LAZY_FLAGS
+    /* Write back the pending flags before switching */
+    Fast486MaterializeFlags(State);
+    State->LazyFlagsEnabled = Enable;
+#else
+    UNREFERENCED_PARAMETER(State);
+    UNREFERENCED_PARAMETER(Enable);
+#endif
+}
+
+VOID
+NTAPI
+Fast486SetFpuPrecision(PFAST486_STATE State, FAST486_FPU_PRECISION Precision)
+{
+#ifndef FAST486_NO_FPU
+    State->FpuPrecision = (UCHAR)Precision;
+#else
+    UNREFERENCED_PARAMETER(State);
+    UNREFERENCED_PARAMETER(Precision);
+#endif
 }
 
 VOID
@@ -253,11 +352,17 @@ Fast486Rewind(PFAST486_STATE State)
 {
     /* This function is used when an instruction has been interrupted remotely */
     State->PrefixFlags = 0;
+    Fast486MaterializeFlags(State);
     State->InstPtr.Long = State->SavedInstPtr.Long;
 
 #ifndef FAST486_NO_PREFETCH
     State->PrefetchValid = FALSE;
 #endif
+
+#ifndef FAST486_NO_BLOCK_CACHE
+    /* The instruction may have changed, leave the current block */
+    State->CurrentBlock = NULL;
+#endif
 }
 
 /* EOF */
@@ -1480,6 +1480,153 @@ Fast486FpuCalculateCosine(PFAST486_STATE State,
     return Fast486FpuCalculateSine(State, &Value, Result);
 }
 
+#ifdef FPU_HOST_REAL10
+
+/* x87 control and status word bits */
+#define FPU_HOST_CONTROL_MASKS  0x003F
+#define FPU_HOST_CONTROL_PC     0x0300
+#define FPU_HOST_CONTROL_RC     0x0C00
+#define FPU_HOST_STATUS_PE      0x0020
+
+typedef union _FPU_HOST_DATA
+{
+    FPU_HOST_REAL Real;
+    struct
+    {
+        ULONGLONG Mantissa;
+        USHORT SignExponent;
+    };
+} FPU_HOST_DATA;
+
+/*
+ * Performs FADD, FMUL, FSUB(R) or FDIV(R) with the FPU of the host, when the
+ * precision is set to FAST486_FPU_HOST and both operands and the result are
+ * normal numbers. Returns FALSE when the exact code must be used instead.
+ */
+static inline BOOLEAN FASTCALL
+Fast486FpuHostArithmetic(PFAST486_STATE State,
+                         INT Operation,
+                         PCFAST486_FPU_DATA_REG FirstOperand,
+                         PCFAST486_FPU_DATA_REG SecondOperand,
+                         PFAST486_FPU_DATA_REG Result)
+{
+    volatile FPU_HOST_DATA First, Second, HostResult;
+    USHORT SavedControl, Control, HostStatus = 0;
+    BOOLEAN CheckInexact;
+    USHORT Exponent;
+
+    if (State->FpuPrecision != FAST486_FPU_HOST) return FALSE;
+
+    /* The host always rounds to nearest */
+    if (State->FpuControl.Rc != FPU_ROUND_NEAREST) return FALSE;
+
+    /* Almost every result is inexact, an unmasked precision exception is left to the exact code */
+    if (!State->FpuControl.Pm) return FALSE;
+
+    /* Zeros, denormals, infinities and NaNs are left to the exact code */
+    if (FPU_IS_ZERO(FirstOperand) || FPU_IS_NAN(FirstOperand)
+        || !FPU_IS_NORMALIZED(FirstOperand) || (FirstOperand->Exponent == 0)
+        || FPU_IS_ZERO(SecondOperand) || FPU_IS_NAN(SecondOperand)
+        || !FPU_IS_NORMALIZED(SecondOperand) || (SecondOperand->Exponent == 0))
+    {
+        return FALSE;
+    }
+
+    /* long double has the format of the FPU data registers */
+    First.Mantissa = FirstOperand->Mantissa;
+    First.SignExponent = FirstOperand->Exponent | (FirstOperand->Sign ? 0x8000 : 0);
+    Second.Mantissa = SecondOperand->Mantissa;
+    Second.SignExponent = SecondOperand->Exponent | (SecondOperand->Sign ? 0x8000 : 0);
+
+    /*
+     * Round to the precision control of the guest, with all exceptions masked.
+     * The flag of the precision exception is sticky, so inexact results only
+     * need to be detected until it is set, which clearing the host exception
+     * flags first makes possible. The operands are volatile, so that the
+     * arithmetic stays between these instructions.
+     */
+    __asm__ __volatile__("fnstcw %0" : "=m" (SavedControl));
+    Control = (SavedControl & ~(FPU_HOST_CONTROL_PC | FPU_HOST_CONTROL_RC))
+              | FPU_HOST_CONTROL_MASKS
+              | (State->FpuControl.Pc << 8);
+    if (Control != SavedControl) __asm__ __volatile__("fldcw %0" : : "m" (Control) : "memory");
+
+    CheckInexact = !State->FpuStatus.Pe;
+    if (CheckInexact) __asm__ __volatile__("fnclex" : : : "memory");
+
+    switch (Operation)
+    {
+        /* FADD */
+        case 0:
+        {
+            HostResult.Real = First.Real + Second.Real;
+            break;
+        }
+
+        /* FMUL */
+        case 1:
+        {
+            HostResult.Real = First.Real * Second.Real;
+            break;
+        }
+
+        /* FSUB and FSUBR, the operands are already in order */
+        case 4:
+        case 5:
+        {
+            HostResult.Real = First.Real - Second.Real;
+            break;
+        }
+
+        /* FDIV and FDIVR */
+        default:
+        {
+            HostResult.Real = First.Real / Second.Real;
+            break;
+        }
+    }
+
+    if (CheckInexact) __asm__ __volatile__("fnstsw %0" : "=m" (HostStatus) : : "memory");
+    if (Control != SavedControl) __asm__ __volatile__("fldcw %0" : : "m" (SavedControl) : "memory");
+
+    /*
+     * Zeros, denormals, infinities and NaNs mean that something special
+     * happened (cancellation, underflow, overflow), let the exact code
+     * compute the result and raise the exceptions.
+     */
+    Exponent = HostResult.SignExponent & 0x7FFF;
+    if ((Exponent == 0) || (Exponent > FPU_MAX_EXPONENT)) return FALSE;
+
+    Result->Mantissa = HostResult.Mantissa;
+    Result->Exponent = Exponent;
+    Result->Sign = (HostResult.SignExponent & 0x8000) ? TRUE : FALSE;
+
+    /* The precision exception is masked, only set its flag */
+    if (HostStatus & FPU_HOST_STATUS_PE) State->FpuStatus.Pe = TRUE;
+
+    return TRUE;
+}
+
+#else
+
+static inline BOOLEAN FASTCALL
+Fast486FpuHostArithmetic(PFAST486_STATE State,
+                         INT Operation,
+                         PCFAST486_FPU_DATA_REG FirstOperand,
+                         PCFAST486_FPU_DATA_REG SecondOperand,
+                         PFAST486_FPU_DATA_REG Result)
+{
+    /* Without an x87 host FPU, the exact code is always used */
+    UNREFERENCED_PARAMETER(State);
+    UNREFERENCED_PARAMETER(Operation);
+    UNREFERENCED_PARAMETER(FirstOperand);
+    UNREFERENCED_PARAMETER(SecondOperand);
+    UNREFERENCED_PARAMETER(Result);
+    return FALSE;
+}
+
+#endif
+
 static inline VOID FASTCALL
 Fast486FpuArithmeticOperation(PFAST486_STATE State,
                               INT Operation,
@@ -1496,14 +1643,22 @@ Fast486FpuArithmeticOperation(PFAST486_STATE State,
         /* FADD */
         case 0:
         {
-            Fast486FpuAdd(State, &FPU_ST(0), Operand, DestOperand);
+            if (!Fast486FpuHostArithmetic(State, Operation, &FPU_ST(0), Operand, DestOperand))
+            {
+                Fast486FpuAdd(State, &FPU_ST(0), Operand, DestOperand);
+            }
+
             break;
         }
 
         /* FMUL */
         case 1:
         {
-            Fast486FpuMultiply(State, &FPU_ST(0), Operand, DestOperand);
+            if (!Fast486FpuHostArithmetic(State, Operation, &FPU_ST(0), Operand, DestOperand))
+            {
+                Fast486FpuMultiply(State, &FPU_ST(0), Operand, DestOperand);
+            }
+
             break;
         }
 
@@ -1521,28 +1676,44 @@ Fast486FpuArithmeticOperation(PFAST486_STATE State,
         /* FSUB */
         case 4:
         {
-            Fast486FpuSubtract(State, &FPU_ST(0), Operand, DestOperand);
+            if (!Fast486FpuHostArithmetic(State, Operation, &FPU_ST(0), Operand, DestOperand))
+            {
+                Fast486FpuSubtract(State, &FPU_ST(0), Operand, DestOperand);
+            }
+
             break;
         }
 
         /* FSUBR */
         case 5:
         {
-            Fast486FpuSubtract(State, Operand, &FPU_ST(0), DestOperand);
+            if (!Fast486FpuHostArithmetic(State, Operation, Operand, &FPU_ST(0), DestOperand))
+            {
+                Fast486FpuSubtract(State, Operand, &FPU_ST(0), DestOperand);
+            }
+
             break;
         }
 
         /* FDIV */
         case 6:
         {
-            Fast486FpuDivide(State, &FPU_ST(0), Operand, DestOperand);
+            if (!Fast486FpuHostArithmetic(State, Operation, &FPU_ST(0), Operand, DestOperand))
+            {
+                Fast486FpuDivide(State, &FPU_ST(0), Operand, DestOperand);
+            }
+
             break;
         }
 
         /* FDIVR */
         case 7:
         {
-            Fast486FpuDivide(State, Operand, &FPU_ST(0), DestOperand);
+            if (!Fast486FpuHostArithmetic(State, Operation, Operand, &FPU_ST(0), DestOperand))
+            {
+                Fast486FpuDivide(State, Operand, &FPU_ST(0), DestOperand);
+            }
+
             break;
         }
     }
@@ -73,6 +73,17 @@
 
 #define INVERSE_NUMBERS_COUNT   50
 
+/*
+ * FAST486_FPU_HOST needs an x87 host FPU, on x86 hosts compiled with GCC:
+ * long double then has the same format as the FPU data registers, and the
+ * host rounds to the precision control of the guest. Elsewhere the exact
+ * code is always used.
+ */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define FPU_HOST_REAL10
+typedef long double FPU_HOST_REAL;
+#endif
+
 enum
 {
     FPU_SINGLE_PRECISION = 0,
@@ -0,0 +1,43 @@
+/*
+ * PROJECT:     Fast486 386/486 CPU Emulation Library
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Stand-in for <windef.h> when building Fast486 for the host
+ */
+
+#ifndef _FAST486_HOST_WINDEF_H
+#define _FAST486_HOST_WINDEF_H
+
+#include <typedefs.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Calling conventions are irrelevant inside the host library */
+#define FASTCALL
+
+#ifdef _MSC_VER
+#define FORCEINLINE static __forceinline
+#else
+#define FORCEINLINE static inline __attribute__((always_inline))
+#endif
+
+#define C_ASSERT(expr) extern char (*c_assert(void)) [(expr) ? 1 : -1]
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+#define UNALIGNED
+
+#define RtlFillMemory(Destination, Length, Fill) memset(Destination, Fill, Length)
+#define RtlEqualMemory(Destination, Source, Length) (!memcmp(Destination, Source, Length))
+
+#ifndef min
+#define min(a, b)  (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b)  (((a) > (b)) ? (a) : (b))
+#endif
+
+#define DbgPrint printf
+
+typedef ULONGLONG *PULONGLONG;
+typedef LONGLONG *PLONGLONG;
+
+#endif /* _FAST486_HOST_WINDEF_H */
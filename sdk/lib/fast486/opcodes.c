@@ -296,6 +296,34 @@ Fast486OpcodeHandlers[FAST486_NUM_OPCODE_HANDLERS] =
     Fast486OpcodeGroupFF,               /* 0xFF */
 };
 
+#ifndef FAST486_NO_LAZY_FLAGS
+/*
+ * Instructions which can be executed while the arithmetic flags are still
+ * pending: they either don't use these flags, or set all of them, or read
+ * them through Fast486Get*. The flags are materialized before any other one.
+ */
+const BOOLEAN
+Fast486LazyFlagsAware[FAST486_NUM_OPCODE_HANDLERS] =
+{
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, FALSE, TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, TRUE,  /* 0x00 - 0x0F */
+    FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, /* 0x10 - 0x1F */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, /* 0x20 - 0x2F */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, /* 0x30 - 0x3F */
+    FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, /* 0x40 - 0x4F */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  /* 0x50 - 0x5F */
+    FALSE, FALSE, FALSE, FALSE, TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, TRUE,  FALSE, FALSE, FALSE, FALSE, FALSE, /* 0x60 - 0x6F */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  /* 0x70 - 0x7F */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, TRUE,  FALSE, FALSE, /* 0x80 - 0x8F */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, /* 0x90 - 0x9F */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, FALSE, TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  FALSE, FALSE, /* 0xA0 - 0xAF */
+    TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  TRUE,  /* 0xB0 - 0xBF */
+    FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, TRUE,  TRUE,  FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, /* 0xC0 - 0xCF */
+    FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, /* 0xD0 - 0xDF */
+    FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, TRUE,  TRUE,  FALSE, TRUE,  FALSE, FALSE, FALSE, FALSE, /* 0xE0 - 0xEF */
+    TRUE,  FALSE, TRUE,  TRUE,  FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE, FALSE  /* 0xF0 - 0xFF */
+};
+#endif
+
 /* PUBLIC FUNCTIONS ***********************************************************/
 
 FAST486_OPCODE_HANDLER(Fast486OpcodeInvalid)
@@ -557,56 +585,56 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeShortConditionalJmp)
         /* JO / JNO */
         case 0:
         {
-            Jump = State->Flags.Of;
+            Jump = Fast486GetOf(State);
             break;
         }
 
         /* JC / JNC */
         case 1:
         {
-            Jump = State->Flags.Cf;
+            Jump = Fast486GetCf(State);
             break;
         }
 
         /* JZ / JNZ */
         case 2:
         {
-            Jump = State->Flags.Zf;
+            Jump = Fast486GetZf(State);
             break;
         }
 
         /* JBE / JNBE */
         case 3:
         {
-            Jump = State->Flags.Cf || State->Flags.Zf;
+            Jump = Fast486GetCf(State) || Fast486GetZf(State);
             break;
         }
 
         /* JS / JNS */
         case 4:
         {
-            Jump = State->Flags.Sf;
+            Jump = Fast486GetSf(State);
             break;
         }
 
         /* JP / JNP */
         case 5:
         {
-            Jump = State->Flags.Pf;
+            Jump = Fast486GetPf(State);
             break;
         }
 
         /* JL / JNL */
         case 6:
         {
-            Jump = State->Flags.Sf != State->Flags.Of;
+            Jump = Fast486GetSf(State) != Fast486GetOf(State);
             break;
         }
 
         /* JLE / JNLE */
         case 7:
         {
-            Jump = (State->Flags.Sf != State->Flags.Of) || State->Flags.Zf;
+            Jump = (Fast486GetSf(State) != Fast486GetOf(State)) || Fast486GetZf(State);
             break;
         }
     }
@@ -1066,13 +1094,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAddByteModrm)
     Result = FirstValue + SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = (Result < FirstValue) && (Result < SecondValue);
-    State->Flags.Of = ((FirstValue & SIGN_FLAG_BYTE) == (SecondValue & SIGN_FLAG_BYTE))
-                      && ((FirstValue & SIGN_FLAG_BYTE) != (Result & SIGN_FLAG_BYTE));
-    State->Flags.Af = ((((FirstValue & 0x0F) + (SecondValue & 0x0F)) & 0x10) != 0);
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_ADD, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     Fast486WriteModrmByteOperands(State,
@@ -1119,13 +1141,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAddModrm)
         Result = FirstValue + SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (Result < FirstValue) && (Result < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_LONG) == (SecondValue & SIGN_FLAG_LONG))
-                          && ((FirstValue & SIGN_FLAG_LONG) != (Result & SIGN_FLAG_LONG));
-        State->Flags.Af = ((((FirstValue & 0x0F) + (SecondValue & 0x0F)) & 0x10) != 0);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_ADD, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         Fast486WriteModrmDwordOperands(State,
@@ -1150,13 +1166,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAddModrm)
         Result = FirstValue + SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (Result < FirstValue) && (Result < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_WORD) == (SecondValue & SIGN_FLAG_WORD))
-                          && ((FirstValue & SIGN_FLAG_WORD) != (Result & SIGN_FLAG_WORD));
-        State->Flags.Af = ((((FirstValue & 0x0F) + (SecondValue & 0x0F)) & 0x10) != 0);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_ADD, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         Fast486WriteModrmWordOperands(State,
@@ -1186,13 +1196,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAddAl)
     Result = FirstValue + SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = (Result < FirstValue) && (Result < SecondValue);
-    State->Flags.Of = ((FirstValue & SIGN_FLAG_BYTE) == (SecondValue & SIGN_FLAG_BYTE))
-                      && ((FirstValue & SIGN_FLAG_BYTE) != (Result & SIGN_FLAG_BYTE));
-    State->Flags.Af = ((((FirstValue & 0x0F) + (SecondValue & 0x0F)) & 0x10) != 0);
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_ADD, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     State->GeneralRegs[FAST486_REG_EAX].LowByte = Result;
@@ -1223,13 +1227,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAddEax)
         Result = FirstValue + SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (Result < FirstValue) && (Result < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_LONG) == (SecondValue & SIGN_FLAG_LONG))
-                          && ((FirstValue & SIGN_FLAG_LONG) != (Result & SIGN_FLAG_LONG));
-        State->Flags.Af = ((((FirstValue & 0x0F) + (SecondValue & 0x0F)) & 0x10) != 0);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_ADD, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].Long = Result;
@@ -1249,13 +1247,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAddEax)
         Result = FirstValue + SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (Result < FirstValue) && (Result < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_WORD) == (SecondValue & SIGN_FLAG_WORD))
-                          && ((FirstValue & SIGN_FLAG_WORD) != (Result & SIGN_FLAG_WORD));
-        State->Flags.Af = ((((FirstValue & 0x0F) + (SecondValue & 0x0F)) & 0x10) != 0);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_ADD, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].LowWord = Result;
@@ -1293,11 +1285,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeOrByteModrm)
     Result = FirstValue | SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     Fast486WriteModrmByteOperands(State,
@@ -1344,11 +1332,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeOrModrm)
         Result = FirstValue | SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         Fast486WriteModrmDwordOperands(State,
@@ -1373,11 +1357,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeOrModrm)
         Result = FirstValue | SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         Fast486WriteModrmWordOperands(State,
@@ -1407,11 +1387,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeOrAl)
     Result = FirstValue | SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     State->GeneralRegs[FAST486_REG_EAX].LowByte = Result;
@@ -1442,11 +1418,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeOrEax)
         Result = FirstValue | SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].Long = Result;
@@ -1466,11 +1438,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeOrEax)
         Result = FirstValue | SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].LowWord = Result;
@@ -1508,11 +1476,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAndByteModrm)
     Result = FirstValue & SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     Fast486WriteModrmByteOperands(State,
@@ -1559,11 +1523,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAndModrm)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         Fast486WriteModrmDwordOperands(State,
@@ -1588,11 +1548,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAndModrm)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         Fast486WriteModrmWordOperands(State,
@@ -1622,11 +1578,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAndAl)
     Result = FirstValue & SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     State->GeneralRegs[FAST486_REG_EAX].LowByte = Result;
@@ -1657,11 +1609,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAndEax)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].Long = Result;
@@ -1681,11 +1629,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeAndEax)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].LowWord = Result;
@@ -1723,11 +1667,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeXorByteModrm)
     Result = FirstValue ^ SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     Fast486WriteModrmByteOperands(State,
@@ -1774,11 +1714,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeXorModrm)
         Result = FirstValue ^ SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         Fast486WriteModrmDwordOperands(State,
@@ -1803,11 +1739,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeXorModrm)
         Result = FirstValue ^ SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         Fast486WriteModrmWordOperands(State,
@@ -1837,11 +1769,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeXorAl)
     Result = FirstValue ^ SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 
     /* Write back the result */
     State->GeneralRegs[FAST486_REG_EAX].LowByte = Result;
@@ -1872,11 +1800,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeXorEax)
         Result = FirstValue ^ SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].Long = Result;
@@ -1896,11 +1820,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeXorEax)
         Result = FirstValue ^ SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
 
         /* Write back the result */
         State->GeneralRegs[FAST486_REG_EAX].LowWord = Result;
@@ -1937,11 +1857,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeTestByteModrm)
     Result = FirstValue & SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 }
 
 FAST486_OPCODE_HANDLER(Fast486OpcodeTestModrm)
@@ -1982,11 +1898,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeTestModrm)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
     }
     else
     {
@@ -2005,11 +1917,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeTestModrm)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
     }
 }
 
@@ -2033,11 +1941,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeTestAl)
     Result = FirstValue & SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = FALSE;
-    State->Flags.Of = FALSE;
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 8);
 }
 
 FAST486_OPCODE_HANDLER(Fast486OpcodeTestEax)
@@ -2065,11 +1969,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeTestEax)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 32);
     }
     else
     {
@@ -2086,11 +1986,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeTestEax)
         Result = FirstValue & SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = FALSE;
-        State->Flags.Of = FALSE;
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, 16);
     }
 }
 
@@ -2872,13 +2768,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeCmpSubByteModrm)
     Result = FirstValue - SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = (FirstValue < SecondValue);
-    State->Flags.Of = ((FirstValue & SIGN_FLAG_BYTE) != (SecondValue & SIGN_FLAG_BYTE))
-                      && ((FirstValue & SIGN_FLAG_BYTE) != (Result & SIGN_FLAG_BYTE));
-    State->Flags.Af = (FirstValue & 0x0F) < (SecondValue & 0x0F);
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_SUB, FirstValue, SecondValue, Result, 8);
 
     /* Check if this is not a CMP */
     if (!(Opcode & 0x10))
@@ -2936,13 +2826,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeCmpSubModrm)
         Result = FirstValue - SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (FirstValue < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_LONG) != (SecondValue & SIGN_FLAG_LONG))
-                          && ((FirstValue & SIGN_FLAG_LONG) != (Result & SIGN_FLAG_LONG));
-        State->Flags.Af = (FirstValue & 0x0F) < (SecondValue & 0x0F);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_SUB, FirstValue, SecondValue, Result, 32);
 
         /* Check if this is not a CMP */
         if (!(Opcode & 0x10))
@@ -2978,13 +2862,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeCmpSubModrm)
         Result = FirstValue - SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (FirstValue < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_WORD) != (SecondValue & SIGN_FLAG_WORD))
-                          && ((FirstValue & SIGN_FLAG_WORD) != (Result & SIGN_FLAG_WORD));
-        State->Flags.Af = (FirstValue & 0x0F) < (SecondValue & 0x0F);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_SUB, FirstValue, SecondValue, Result, 16);
 
         /* Check if this is not a CMP */
         if (!(Opcode & 0x10))
@@ -3018,13 +2896,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeCmpSubAl)
     Result = FirstValue - SecondValue;
 
     /* Update the flags */
-    State->Flags.Cf = (FirstValue < SecondValue);
-    State->Flags.Of = ((FirstValue & SIGN_FLAG_BYTE) != (SecondValue & SIGN_FLAG_BYTE))
-                      && ((FirstValue & SIGN_FLAG_BYTE) != (Result & SIGN_FLAG_BYTE));
-    State->Flags.Af = (FirstValue & 0x0F) < (SecondValue & 0x0F);
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SIGN_FLAG_BYTE) != 0);
-    State->Flags.Pf = Fast486CalculateParity(Result);
+    Fast486UpdateFlags(State, FAST486_LAZY_SUB, FirstValue, SecondValue, Result, 8);
 
     /* Check if this is not a CMP */
     if (!(Opcode & 0x10))
@@ -3059,13 +2931,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeCmpSubEax)
         Result = FirstValue - SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (FirstValue < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_LONG) != (SecondValue & SIGN_FLAG_LONG))
-                          && ((FirstValue & SIGN_FLAG_LONG) != (Result & SIGN_FLAG_LONG));
-        State->Flags.Af = (FirstValue & 0x0F) < (SecondValue & 0x0F);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_LONG) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_SUB, FirstValue, SecondValue, Result, 32);
 
         /* Check if this is not a CMP */
         if (!(Opcode & 0x10))
@@ -3089,13 +2955,7 @@ FAST486_OPCODE_HANDLER(Fast486OpcodeCmpSubEax)
         Result = FirstValue - SecondValue;
 
         /* Update the flags */
-        State->Flags.Cf = (FirstValue < SecondValue);
-        State->Flags.Of = ((FirstValue & SIGN_FLAG_WORD) != (SecondValue & SIGN_FLAG_WORD))
-                          && ((FirstValue & SIGN_FLAG_WORD) != (Result & SIGN_FLAG_WORD));
-        State->Flags.Af = (FirstValue & 0x0F) < (SecondValue & 0x0F);
-        State->Flags.Zf = (Result == 0);
-        State->Flags.Sf = ((Result & SIGN_FLAG_WORD) != 0);
-        State->Flags.Pf = Fast486CalculateParity(Result);
+        Fast486UpdateFlags(State, FAST486_LAZY_SUB, FirstValue, SecondValue, Result, 16);
 
         /* Check if this is not a CMP */
         if (!(Opcode & 0x10))
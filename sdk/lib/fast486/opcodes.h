@@ -37,6 +37,15 @@ extern
 FAST486_OPCODE_HANDLER_PROC
 Fast486OpcodeHandlers[FAST486_NUM_OPCODE_HANDLERS];
 
+#ifndef FAST486_NO_LAZY_FLAGS
+extern
+const BOOLEAN
+Fast486LazyFlagsAware[FAST486_NUM_OPCODE_HANDLERS];
+
+/* Among the extended opcodes, only the conditional jumps know about lazy flags */
+#define FAST486_EXT_LAZY_FLAGS_AWARE(Opcode) (((Opcode) & 0xF0) == 0x80)
+#endif
+
 FAST486_OPCODE_HANDLER(Fast486OpcodeInvalid);
 
 FAST486_OPCODE_HANDLER(Fast486OpcodePrefix);
@@ -56,13 +56,7 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
         case 0:
         {
             Result = (FirstValue + SecondValue) & MaxValue;
-
-            /* Update CF, OF and AF */
-            State->Flags.Cf = (Result < FirstValue) && (Result < SecondValue);
-            State->Flags.Of = ((FirstValue & SignFlag) == (SecondValue & SignFlag))
-                              && ((FirstValue & SignFlag) != (Result & SignFlag));
-            State->Flags.Af = ((((FirstValue & 0x0F) + (SecondValue & 0x0F)) & 0x10) != 0);
-
+            Fast486UpdateFlags(State, FAST486_LAZY_ADD, FirstValue, SecondValue, Result, Bits);
             break;
         }
 
@@ -70,14 +64,18 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
         case 1:
         {
             Result = FirstValue | SecondValue;
-            State->Flags.Cf = State->Flags.Of = FALSE;
+            Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, Bits);
             break;
         }
 
         /* ADC */
         case 2:
         {
-            INT Carry = State->Flags.Cf ? 1 : 0;
+            INT Carry;
+
+            /* This one needs the real carry flag */
+            Fast486MaterializeFlags(State);
+            Carry = State->Flags.Cf ? 1 : 0;
 
             Result = (FirstValue + SecondValue + Carry) & MaxValue;
 
@@ -88,13 +86,22 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
                               && ((FirstValue & SignFlag) != (Result & SignFlag));
             State->Flags.Af = ((FirstValue ^ SecondValue ^ Result) & 0x10) != 0;
 
+            /* Update ZF, SF and PF */
+            State->Flags.Zf = (Result == 0);
+            State->Flags.Sf = ((Result & SignFlag) != 0);
+            State->Flags.Pf = Fast486CalculateParity(LOBYTE(Result));
+
             break;
         }
 
         /* SBB */
         case 3:
         {
-            INT Carry = State->Flags.Cf ? 1 : 0;
+            INT Carry;
+
+            /* This one needs the real carry flag */
+            Fast486MaterializeFlags(State);
+            Carry = State->Flags.Cf ? 1 : 0;
 
             Result = (FirstValue - SecondValue - Carry) & MaxValue;
 
@@ -106,6 +113,11 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
                               && ((FirstValue & SignFlag) != (Result & SignFlag));
             State->Flags.Af = ((FirstValue ^ SecondValue ^ Result) & 0x10) != 0;
 
+            /* Update ZF, SF and PF */
+            State->Flags.Zf = (Result == 0);
+            State->Flags.Sf = ((Result & SignFlag) != 0);
+            State->Flags.Pf = Fast486CalculateParity(LOBYTE(Result));
+
             break;
         }
 
@@ -113,7 +125,7 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
         case 4:
         {
             Result = FirstValue & SecondValue;
-            State->Flags.Cf = State->Flags.Of = FALSE;
+            Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, Bits);
             break;
         }
 
@@ -122,13 +134,7 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
         case 7:
         {
             Result = (FirstValue - SecondValue) & MaxValue;
-
-            /* Update CF, OF and AF */
-            State->Flags.Cf = (FirstValue < SecondValue);
-            State->Flags.Of = ((FirstValue & SignFlag) != (SecondValue & SignFlag))
-                              && ((FirstValue & SignFlag) != (Result & SignFlag));
-            State->Flags.Af = (FirstValue & 0x0F) < (SecondValue & 0x0F);
-
+            Fast486UpdateFlags(State, FAST486_LAZY_SUB, FirstValue, SecondValue, Result, Bits);
             break;
         }
 
@@ -136,7 +142,7 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
         case 6:
         {
             Result = FirstValue ^ SecondValue;
-            State->Flags.Cf = State->Flags.Of = FALSE;
+            Fast486UpdateFlags(State, FAST486_LAZY_LOGIC, FirstValue, SecondValue, Result, Bits);
             break;
         }
 
@@ -144,14 +150,10 @@ Fast486ArithmeticOperation(PFAST486_STATE State,
         {
             /* Shouldn't happen */
             ASSERT(FALSE);
+            Result = 0;
         }
     }
 
-    /* Update ZF, SF and PF */
-    State->Flags.Zf = (Result == 0);
-    State->Flags.Sf = ((Result & SignFlag) != 0);
-    State->Flags.Pf = Fast486CalculateParity(LOBYTE(Result));
-
     /* Return the result */
     return Result;
 }
@@ -2259,6 +2261,8 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeGroup0F01)
         /* INVLPG */
         case 7:
         {
+            FAST486_SEG_REGS Segment = FAST486_REG_DS;
+
 #ifndef FAST486_NO_PREFETCH
             /* Invalidate the prefetch */
             State->PrefetchValid = FALSE;
@@ -2278,10 +2282,18 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeGroup0F01)
                 return;
             }
 
+            /* Check for the segment override */
+            if (State->PrefixFlags & FAST486_PREFIX_SEG)
+            {
+                /* Use the override segment instead */
+                Segment = State->SegmentOverride;
+            }
+
             if (State->Tlb != NULL)
             {
-                /* Clear the TLB entry */
-                State->Tlb[ModRegRm.MemoryAddress >> 12] = INVALID_TLB_FIELD;
+                /* Clear the TLB entry of the linear address, not of the offset */
+                State->Tlb[(State->SegmentRegs[Segment].Base + ModRegRm.MemoryAddress) >> 12]
+                    = INVALID_TLB_FIELD;
             }
 
             break;
@@ -82,60 +82,185 @@ static const parser_state_func parser_funcs[NB_PARSER_STATES] =
 
 /* PRIVATE FUNCTIONS ********************************************************/
 
-static PINFCACHELINE
-InfpFreeLine (PINFCACHELINE Line)
+#define INF_BLOCK_SIZE_MIN  0x4000
+#define INF_BLOCK_SIZE_MAX  0x100000
+#define INF_HASH_SIZE_MIN   16
+
+static PVOID
+InfpAllocate(PINFCACHE Cache,
+             ULONG Size)
 {
-  PINFCACHELINE Next;
-  PINFCACHEFIELD Field;
+  PINFCACHEBLOCK Block;
+  ULONG BlockSize;
+  PVOID Data;
 
-  if (Line == NULL)
+  Size = (Size + sizeof(PVOID) - 1) & ~(ULONG)(sizeof(PVOID) - 1);
+
+  Block = Cache->Blocks;
+  if (Block == NULL || Block->Size - Block->Used < Size)
     {
-      return NULL;
+      /* Grow the blocks geometrically, large INFs then need only a few */
+      BlockSize = INF_BLOCK_SIZE_MIN;
+      if (Block != NULL && Block->Size < INF_BLOCK_SIZE_MAX)
+        {
+          BlockSize = Block->Size * 2;
+        }
+      else if (Block != NULL)
+        {
+          BlockSize = INF_BLOCK_SIZE_MAX;
+        }
+      if (BlockSize - sizeof(INFCACHEBLOCK) < Size)
+        {
+          BlockSize = Size + sizeof(INFCACHEBLOCK);
+        }
+
+      Block = (PINFCACHEBLOCK)MALLOC(BlockSize);
+      if (Block == NULL)
+        {
+          DPRINT1("MALLOC() failed\n");
+          return NULL;
+        }
+      Block->Size = BlockSize;
+      Block->Used = sizeof(INFCACHEBLOCK);
+      Block->Next = Cache->Blocks;
+      Cache->Blocks = Block;
     }
 
-  Next = Line->Next;
-  if (Line->Key != NULL)
+  Data = (PUCHAR)Block + Block->Used;
+  Block->Used += Size;
+
+  return Data;
+}
+
+
+static ULONG
+InfpHashName(PCWSTR Name)
+{
+  ULONG Hash = 0;
+
+  /* Must agree with strcmpiW, which compares lower-cased characters */
+  while (*Name != 0)
     {
-      FREE (Line->Key);
-      Line->Key = NULL;
+      Hash = Hash * 37 + tolowerW(*Name);
+      Name++;
     }
 
-  /* Remove data fields */
-  while (Line->FirstField != NULL)
+  return Hash;
+}
+
+
+static BOOLEAN
+InfpGrowSectionTable(PINFCACHE Cache)
+{
+  PINFCACHESECTION *Table;
+  PINFCACHESECTION Section;
+  ULONG Size;
+  ULONG Bucket;
+
+  Size = Cache->SectionTableSize ? Cache->SectionTableSize * 2 : INF_HASH_SIZE_MIN;
+  Table = (PINFCACHESECTION *)InfpAllocate(Cache, Size * sizeof(PINFCACHESECTION));
+  if (Table == NULL)
     {
-      Field = Line->FirstField->Next;
-      FREE (Line->FirstField);
-      Line->FirstField = Field;
+      return FALSE;
+    }
+  ZEROMEMORY(Table,
+             Size * sizeof(PINFCACHESECTION));
+
+  /* Section names are unique, so rehashing from the list is enough */
+  for (Section = Cache->FirstSection; Section != NULL; Section = Section->Next)
+    {
+      Bucket = InfpHashName(Section->Name) & (Size - 1);
+      Section->HashNext = Table[Bucket];
+      Table[Bucket] = Section;
     }
-  Line->LastField = NULL;
 
-  FREE (Line);
+  /* The old table stays in the arena until the INF is closed */
+  Cache->SectionTable = Table;
+  Cache->SectionTableSize = Size;
 
-  return Next;
+  return TRUE;
 }
 
 
-PINFCACHESECTION
-InfpFreeSection (PINFCACHESECTION Section)
+static BOOLEAN
+InfpGrowKeyTable(PINFCACHE Cache,
+                 PINFCACHESECTION Section)
 {
-  PINFCACHESECTION Next;
+  PINFCACHELINE *Table;
+  PINFCACHELINE Line;
+  PINFCACHELINE Next;
+  ULONG Size;
+  ULONG Bucket;
+  ULONG i;
 
-  if (Section == NULL)
+  Size = Section->KeyTableSize ? Section->KeyTableSize * 2 : INF_HASH_SIZE_MIN;
+  Table = (PINFCACHELINE *)InfpAllocate(Cache, Size * sizeof(PINFCACHELINE));
+  if (Table == NULL)
+    {
+      return FALSE;
+    }
+  ZEROMEMORY(Table,
+             Size * sizeof(PINFCACHELINE));
+
+  /* Only the first line of every key is indexed, move those over */
+  for (i = 0; i < Section->KeyTableSize; i++)
+    {
+      for (Line = Section->KeyTable[i]; Line != NULL; Line = Next)
+        {
+          Next = Line->HashNext;
+          Bucket = InfpHashName(Line->Key) & (Size - 1);
+          Line->HashNext = Table[Bucket];
+          Table[Bucket] = Line;
+        }
+    }
+
+  Section->KeyTable = Table;
+  Section->KeyTableSize = Size;
+
+  return TRUE;
+}
+
+
+PINFCACHE
+InfpCreateCache(LANGID LanguageId)
+{
+  PINFCACHE Cache;
+
+  Cache = (PINFCACHE)MALLOC(sizeof(INFCACHE));
+  if (Cache == NULL)
     {
+      DPRINT1("MALLOC() failed\n");
       return NULL;
     }
 
-  /* Release all keys */
-  Next = Section->Next;
-  while (Section->FirstLine != NULL)
+  ZEROMEMORY(Cache,
+             sizeof(INFCACHE));
+
+  Cache->LanguageId = LanguageId;
+
+  return Cache;
+}
+
+
+VOID
+InfpFreeCache(PINFCACHE Cache)
+{
+  PINFCACHEBLOCK Block;
+
+  if (Cache == NULL)
     {
-      Section->FirstLine = InfpFreeLine (Section->FirstLine);
+      return;
     }
-  Section->LastLine = NULL;
 
-  FREE (Section);
+  /* Sections, lines and fields all live in the blocks */
+  while (Cache->Blocks != NULL)
+    {
+      Block = Cache->Blocks->Next;
+      FREE(Cache->Blocks);
+      Cache->Blocks = Block;
+    }
 
-  return Next;
+  FREE(Cache);
 }
 
 
@@ -150,8 +275,13 @@ InfpFindSection(PINFCACHE Cache,
       return NULL;
     }
 
-  /* iterate through list of sections */
-  Section = Cache->FirstSection;
+  if (Cache->SectionTable == NULL)
+    {
+      return NULL;
+    }
+
+  /* search the hash bucket of the name */
+  Section = Cache->SectionTable[InfpHashName(Name) & (Cache->SectionTableSize - 1)];
   while (Section != NULL)
     {
       if (strcmpiW(Section->Name, Name) == 0)
@@ -159,8 +289,8 @@ InfpFindSection(PINFCACHE Cache,
           return Section;
         }
 
-      /* get the next section*/
-      Section = Section->Next;
+      /* get the next section in the bucket */
+      Section = Section->HashNext;
     }
 
   return NULL;
@@ -172,6 +302,7 @@ InfpAddSection(PINFCACHE Cache,
                PCWSTR Name)
 {
   PINFCACHESECTION Section = NULL;
+  ULONG Bucket;
   ULONG Size;
 
   if (Cache == NULL || Name == NULL)
@@ -180,13 +311,20 @@ InfpAddSection(PINFCACHE Cache,
       return NULL;
     }
 
+  if (Cache->SectionCount >= Cache->SectionTableSize &&
+      !InfpGrowSectionTable(Cache))
+    {
+      DPRINT("InfpGrowSectionTable() failed\n");
+      return NULL;
+    }
+
   /* Allocate and initialize the new section */
   Size = (ULONG)FIELD_OFFSET(INFCACHESECTION,
                              Name[strlenW(Name) + 1]);
-  Section = (PINFCACHESECTION)MALLOC(Size);
+  Section = (PINFCACHESECTION)InfpAllocate(Cache, Size);
   if (Section == NULL)
     {
-      DPRINT("MALLOC() failed\n");
+      DPRINT("InfpAllocate() failed\n");
       return NULL;
     }
   ZEROMEMORY (Section,
@@ -208,25 +346,32 @@ InfpAddSection(PINFCACHE Cache,
       Cache->LastSection = Section;
     }
 
+  /* Index the section name */
+  Bucket = InfpHashName(Name) & (Cache->SectionTableSize - 1);
+  Section->HashNext = Cache->SectionTable[Bucket];
+  Cache->SectionTable[Bucket] = Section;
+  Cache->SectionCount++;
+
   return Section;
 }
 
 
 PINFCACHELINE
-InfpAddLine(PINFCACHESECTION Section)
+InfpAddLine(PINFCACHE Cache,
+            PINFCACHESECTION Section)
 {
   PINFCACHELINE Line;
 
-  if (Section == NULL)
+  if (Cache == NULL || Section == NULL)
     {
       DPRINT("Invalid parameter\n");
       return NULL;
     }
 
-  Line = (PINFCACHELINE)MALLOC(sizeof(INFCACHELINE));
+  Line = (PINFCACHELINE)InfpAllocate(Cache, sizeof(INFCACHELINE));
   if (Line == NULL)
     {
-      DPRINT("MALLOC() failed\n");
+      DPRINT("InfpAllocate() failed\n");
       return NULL;
     }
   ZEROMEMORY(Line,
@@ -251,9 +396,14 @@ InfpAddLine(PINFCACHESECTION Section)
 
 
 PVOID
-InfpAddKeyToLine(PINFCACHELINE Line,
+InfpAddKeyToLine(PINFCACHE Cache,
+                 PINFCACHESECTION Section,
+                 PINFCACHELINE Line,
                  PCWSTR Key)
 {
+  PINFCACHELINE KeyLine;
+  ULONG Bucket;
+
   if (Line == NULL)
     {
       DPRINT1("Invalid Line\n");
@@ -266,21 +416,44 @@ InfpAddKeyToLine(PINFCACHELINE Line,
       return NULL;
     }
 
-  Line->Key = (PWCHAR)MALLOC((strlenW(Key) + 1) * sizeof(WCHAR));
+  if (Section->KeyCount >= Section->KeyTableSize &&
+      !InfpGrowKeyTable(Cache, Section))
+    {
+      DPRINT1("InfpGrowKeyTable() failed\n");
+      return NULL;
+    }
+
+  Line->Key = (PWCHAR)InfpAllocate(Cache, (strlenW(Key) + 1) * sizeof(WCHAR));
   if (Line->Key == NULL)
     {
-      DPRINT1("MALLOC() failed\n");
+      DPRINT1("InfpAllocate() failed\n");
       return NULL;
     }
 
   strcpyW(Line->Key, Key);
 
+  /* Lookups return the first line with a key, later duplicates
+   * are only reachable by walking the section */
+  Bucket = InfpHashName(Key) & (Section->KeyTableSize - 1);
+  for (KeyLine = Section->KeyTable[Bucket]; KeyLine != NULL; KeyLine = KeyLine->HashNext)
+    {
+      if (strcmpiW(KeyLine->Key, Key) == 0)
+        {
+          return (PVOID)Line->Key;
+        }
+    }
+
+  Line->HashNext = Section->KeyTable[Bucket];
+  Section->KeyTable[Bucket] = Line;
+  Section->KeyCount++;
+
   return (PVOID)Line->Key;
 }
 
 
 PVOID
-InfpAddFieldToLine(PINFCACHELINE Line,
+InfpAddFieldToLine(PINFCACHE Cache,
+                   PINFCACHELINE Line,
                    PCWSTR Data)
 {
   PINFCACHEFIELD Field;
@@ -288,10 +461,10 @@ InfpAddFieldToLine(PINFCACHELINE Line,
 
   Size = (ULONG)FIELD_OFFSET(INFCACHEFIELD,
                              Data[strlenW(Data) + 1]);
-  Field = (PINFCACHEFIELD)MALLOC(Size);
+  Field = (PINFCACHEFIELD)InfpAllocate(Cache, Size);
   if (Field == NULL)
     {
-      DPRINT1("MALLOC() failed\n");
+      DPRINT1("InfpAllocate() failed\n");
       return NULL;
     }
   ZEROMEMORY (Field,
@@ -322,15 +495,20 @@ InfpFindKeyLine(PINFCACHESECTION Section,
 {
   PINFCACHELINE Line;
 
-  Line = Section->FirstLine;
+  if (Section->KeyTable == NULL)
+    {
+      return NULL;
+    }
+
+  Line = Section->KeyTable[InfpHashName(Key) & (Section->KeyTableSize - 1)];
   while (Line != NULL)
     {
-      if (Line->Key != NULL && strcmpiW(Line->Key, Key) == 0)
+      if (strcmpiW(Line->Key, Key) == 0)
         {
           return Line;
         }
 
-      Line = Line->Next;
+      Line = Line->HashNext;
     }
 
   return NULL;
@@ -456,7 +634,7 @@ static struct field *add_field_from_token( struct parser *parser, int is_key )
           return NULL;
         }
 
-      parser->line = InfpAddLine(parser->cur_section);
+      parser->line = InfpAddLine(parser->file, parser->cur_section);
       if (parser->line == NULL)
         goto error;
     }
@@ -467,11 +645,11 @@ static struct field *add_field_from_token( struct parser *parser, int is_key )
 
   if (is_key)
     {
-      field = InfpAddKeyToLine(parser->line, parser->token);
+      field = InfpAddKeyToLine(parser->file, parser->cur_section, parser->line, parser->token);
     }
   else
     {
-      field = InfpAddFieldToLine(parser->line, parser->token);
+      field = InfpAddFieldToLine(parser->file, parser->line, parser->token);
     }
 
   if (field != NULL)
@@ -260,23 +260,17 @@ InfpFindFirstMatchLine(PINFCONTEXT ContextIn,
   if (ContextIn->Inf == NULL || ContextIn->Section == NULL)
     return INF_STATUS_INVALID_PARAMETER;
 
-  CacheLine = ((PINFCACHESECTION)(ContextIn->Section))->FirstLine;
-  while (CacheLine != NULL)
+  CacheLine = InfpFindKeyLine((PINFCACHESECTION)ContextIn->Section, Key);
+  if (CacheLine != NULL)
     {
-      if (CacheLine->Key != NULL && strcmpiW (CacheLine->Key, Key) == 0)
+      if (ContextIn != ContextOut)
         {
-
-          if (ContextIn != ContextOut)
-            {
-              ContextOut->Inf = ContextIn->Inf;
-              ContextOut->Section = ContextIn->Section;
-            }
-          ContextOut->Line = (PVOID)CacheLine;
-
-          return INF_STATUS_SUCCESS;
+          ContextOut->Inf = ContextIn->Inf;
+          ContextOut->Section = ContextIn->Section;
         }
+      ContextOut->Line = (PVOID)CacheLine;
 
-      CacheLine = CacheLine->Next;
+      return INF_STATUS_SUCCESS;
     }
 
   return INF_STATUS_NOT_FOUND;
@@ -334,18 +328,10 @@ InfpGetLineCount(HINF InfHandle,
 
   Cache = (PINFCACHE)InfHandle;
 
-  /* Iterate through list of sections */
-  CacheSection = Cache->FirstSection;
-  while (CacheSection != NULL)
+  CacheSection = InfpFindSection(Cache, Section);
+  if (CacheSection != NULL)
     {
-      /* Are the section names the same? */
-      if (strcmpiW(CacheSection->Name, Section) == 0)
-        {
-          return CacheSection->LineCount;
-        }
-
-      /* Get the next section */
-      CacheSection = CacheSection->Next;
+      return CacheSection->LineCount;
     }
 
   DPRINT("Section not found\n");
@@ -47,20 +47,13 @@ InfHostOpenBufferedFile(PHINF InfHandle,
   FileBuffer[BufferSize + 1] = 0;
 
   /* Allocate infcache header */
-  Cache = (PINFCACHE)MALLOC(sizeof(INFCACHE));
+  Cache = InfpCreateCache(LanguageId);
   if (Cache == NULL)
     {
-      DPRINT1("MALLOC() failed\n");
       FREE(FileBuffer);
       return(INF_STATUS_INSUFFICIENT_RESOURCES);
     }
 
-  /* Initialize inicache header */
-  ZEROMEMORY(Cache,
-             sizeof(INFCACHE));
-
-    Cache->LanguageId = LanguageId;
-
   /* Parse the inf buffer */
     if (!RtlIsTextUnicode(FileBuffer, (INT)FileBufferSize, NULL))
     {
@@ -111,7 +104,7 @@ InfHostOpenBufferedFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
@@ -201,20 +194,13 @@ InfHostOpenFile(PHINF InfHandle,
   FileBuffer[FileLength + 1] = 0;
 
   /* Allocate infcache header */
-  Cache = (PINFCACHE)MALLOC(sizeof(INFCACHE));
+  Cache = InfpCreateCache(LanguageId);
   if (Cache == NULL)
     {
-      DPRINT1("MALLOC() failed\n");
       FREE(FileBuffer);
       return -1;
     }
 
-  /* Initialize inicache header */
-  ZEROMEMORY(Cache,
-             sizeof(INFCACHE));
-
-    Cache->LanguageId = LanguageId;
-
   /* Parse the inf buffer */
     if (!RtlIsTextUnicode(FileBuffer, (INT)FileBufferLength, NULL))
     {
@@ -266,7 +252,7 @@ InfHostOpenFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
@@ -291,13 +277,7 @@ InfHostCloseFile(HINF InfHandle)
       return;
     }
 
-  while (Cache->FirstSection != NULL)
-    {
-      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
-    }
-  Cache->LastSection = NULL;
-
-  FREE(Cache);
+  InfpFreeCache(Cache);
 }
 
 /* EOF */
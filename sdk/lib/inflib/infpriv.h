@@ -30,6 +30,7 @@ typedef struct _INFCACHELINE
 {
   struct _INFCACHELINE *Next;
   struct _INFCACHELINE *Prev;
+  struct _INFCACHELINE *HashNext;
 
   LONG FieldCount;
 
@@ -50,9 +51,25 @@ typedef struct _INFCACHESECTION
 
   LONG LineCount;
 
+  /* Hash table of the first line carrying each key */
+  struct _INFCACHELINE **KeyTable;
+  ULONG KeyTableSize;
+  ULONG KeyCount;
+
+  struct _INFCACHESECTION *HashNext;
+
   WCHAR Name[1];
 } INFCACHESECTION, *PINFCACHESECTION;
 
+/* Sections, lines, fields and hash tables are carved from these blocks and
+ * released together when the INF is closed */
+typedef struct _INFCACHEBLOCK
+{
+  struct _INFCACHEBLOCK *Next;
+  ULONG Size;
+  ULONG Used;
+} INFCACHEBLOCK, *PINFCACHEBLOCK;
+
 typedef struct _INFCACHE
 {
   LANGID LanguageId;
@@ -60,6 +77,12 @@ typedef struct _INFCACHE
   PINFCACHESECTION LastSection;
 
   PINFCACHESECTION StringsSection;
+
+  PINFCACHESECTION *SectionTable;
+  ULONG SectionTableSize;
+  ULONG SectionCount;
+
+  PINFCACHEBLOCK Blocks;
 } INFCACHE, *PINFCACHE;
 
 typedef struct _INFCONTEXT
@@ -78,13 +101,18 @@ extern INFSTATUS InfpParseBuffer(PINFCACHE file,
                                  const WCHAR *buffer,
                                  const WCHAR *end,
                                  PULONG error_line);
-extern PINFCACHESECTION InfpFreeSection(PINFCACHESECTION Section);
+extern PINFCACHE InfpCreateCache(LANGID LanguageId);
+extern VOID InfpFreeCache(PINFCACHE Cache);
 extern PINFCACHESECTION InfpAddSection(PINFCACHE Cache,
                                        PCWSTR Name);
-extern PINFCACHELINE InfpAddLine(PINFCACHESECTION Section);
-extern PVOID InfpAddKeyToLine(PINFCACHELINE Line,
+extern PINFCACHELINE InfpAddLine(PINFCACHE Cache,
+                                 PINFCACHESECTION Section);
+extern PVOID InfpAddKeyToLine(PINFCACHE Cache,
+                              PINFCACHESECTION Section,
+                              PINFCACHELINE Line,
                               PCWSTR Key);
-extern PVOID InfpAddFieldToLine(PINFCACHELINE Line,
+extern PVOID InfpAddFieldToLine(PINFCACHE Cache,
+                                PINFCACHELINE Line,
                                 PCWSTR Data);
 extern PINFCACHELINE InfpFindKeyLine(PINFCACHESECTION Section,
                                      PCWSTR Key);
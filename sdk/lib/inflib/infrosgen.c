@@ -80,20 +80,13 @@ InfOpenBufferedFile(PHINF InfHandle,
   FileBuffer[BufferSize + 1] = 0;
 
   /* Allocate infcache header */
-  Cache = (PINFCACHE)MALLOC(sizeof(INFCACHE));
+  Cache = InfpCreateCache(LanguageId);
   if (Cache == NULL)
     {
-      DPRINT("MALLOC() failed\n");
       FREE(FileBuffer);
       return(INF_STATUS_INSUFFICIENT_RESOURCES);
     }
 
-  /* Initialize inicache header */
-  ZEROMEMORY(Cache,
-             sizeof(INFCACHE));
-
-    Cache->LanguageId = LanguageId;
-
     /* Parse the inf buffer */
     if (!RtlIsTextUnicode(FileBuffer, FileBufferSize, NULL))
     {
@@ -144,7 +137,7 @@ InfOpenBufferedFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
@@ -253,20 +246,13 @@ InfOpenFile(PHINF InfHandle,
     }
 
   /* Allocate infcache header */
-  Cache = (PINFCACHE)MALLOC(sizeof(INFCACHE));
+  Cache = InfpCreateCache(LanguageId);
   if (Cache == NULL)
     {
-      DPRINT("MALLOC() failed\n");
       FREE(FileBuffer);
       return(INF_STATUS_INSUFFICIENT_RESOURCES);
     }
 
-  /* Initialize inicache header */
-  ZEROMEMORY(Cache,
-             sizeof(INFCACHE));
-
-    Cache->LanguageId = LanguageId;
-
     /* Parse the inf buffer */
     if (!RtlIsTextUnicode(FileBuffer, FileBufferLength, NULL))
     {
@@ -317,7 +303,7 @@ InfOpenFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
@@ -342,13 +328,7 @@ InfCloseFile(HINF InfHandle)
       return;
     }
 
-  while (Cache->FirstSection != NULL)
-    {
-      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
-    }
-  Cache->LastSection = NULL;
-
-  FREE(Cache);
+  InfpFreeCache(Cache);
 
   if (0 < InfpHeapRefCount)
     {
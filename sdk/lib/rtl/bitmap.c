@@ -10,6 +10,7 @@
 /* INCLUDES *****************************************************************/
 
 #include <rtl.h>
+#include <bitmap.h>
 
 #define NDEBUG
 #include <debug.h>
@@ -18,81 +19,164 @@
 #undef ASSERT
 #define ASSERT(...)
 
-#ifdef USE_RTL_BITMAP64
-#define _BITCOUNT 64
-#define MAXINDEX 0xFFFFFFFFFFFFFFFF
-typedef ULONG64 BITMAP_INDEX, *PBITMAP_INDEX;
-typedef ULONG64 BITMAP_BUFFER, *PBITMAP_BUFFER;
-#define RTL_BITMAP RTL_BITMAP64
-#define PRTL_BITMAP PRTL_BITMAP64
-#define RTL_BITMAP_RUN RTL_BITMAP_RUN64
-#define PRTL_BITMAP_RUN PRTL_BITMAP_RUN64
-#undef BitScanForward
-#define BitScanForward(Index, Mask) \
-    do { unsigned long tmp; BitScanForward64(&tmp, Mask); *Index = tmp; } while (0)
-#undef BitScanReverse
-#define BitScanReverse(Index, Mask) \
-    do { unsigned long tmp; BitScanReverse64(&tmp, Mask); *Index = tmp; } while (0)
-#define RtlFillMemoryUlong RtlFillMemoryUlonglong
-
-#define RtlInitializeBitMap RtlInitializeBitMap64
-#define RtlClearAllBits RtlClearAllBits64
-#define RtlSetAllBits RtlSetAllBits64
-#define RtlClearBit RtlClearBit64
-#define RtlSetBit RtlSetBit64
-#define RtlClearBits RtlClearBits64
-#define RtlSetBits RtlSetBits64
-#define RtlTestBit RtlTestBit64
-#define RtlAreBitsClear RtlAreBitsClear64
-#define RtlAreBitsSet RtlAreBitsSet64
-#define RtlNumberOfSetBits RtlNumberOfSetBits64
-#define RtlNumberOfClearBits RtlNumberOfClearBits64
-#define RtlFindClearBits RtlFindClearBits64
-#define RtlFindSetBits RtlFindSetBits64
-#define RtlFindClearBitsAndSet RtlFindClearBitsAndSet64
-#define RtlFindSetBitsAndClear RtlFindSetBitsAndClear64
-#define RtlFindNextForwardRunClear RtlFindNextForwardRunClear64
-#define RtlFindNextForwardRunSet RtlFindNextForwardRunSet64
-#define RtlFindFirstRunClear RtlFindFirstRunClear64
-#define RtlFindLastBackwardRunClear RtlFindLastBackwardRunClear64
-#define RtlFindClearRuns RtlFindClearRuns64
-#define RtlFindLongestRunClear RtlFindLongestRunClear64
-#define RtlFindLongestRunSet RtlFindLongestRunSet64
-#else
-#define _BITCOUNT 32
-#define MAXINDEX 0xFFFFFFFF
-typedef ULONG BITMAP_INDEX, *PBITMAP_INDEX;
-typedef ULONG BITMAP_BUFFER, *PBITMAP_BUFFER;
-#endif
+/* PRIVATE FUNCTIONS ********************************************************/
 
-/* DATA *********************************************************************/
-
-/* Number of set bits per byte value */
-static const
-UCHAR
-BitCountTable[256] =
-{
-    /* x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 xA xB xC xD xE xF */
-       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, /* 0x */
-       1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, /* 1x */
-       1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, /* 2x */
-       2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, /* 3x */
-       1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, /* 4x */
-       2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, /* 5x */
-       2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, /* 6c */
-       3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, /* 7x */
-       1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, /* 8x */
-       2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, /* 9x */
-       2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, /* Ax */
-       3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, /* Bx */
-       2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, /* Cx */
-       3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, /* Dx */
-       3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, /* Ex */
-       4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8  /* Fx */
-};
+#ifndef USE_RTL_BITMAP64
+/* Pattern must be 0 or MAXULONG */
+SIZE_T
+NTAPI
+RtlpSkipUlongsGeneric(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count,
+    _In_ ULONG Pattern)
+{
+    ULONG_PTR WidePattern = (ULONG_PTR)(LONG_PTR)(LONG)Pattern;
+    PULONG_PTR WideBuffer;
+    SIZE_T Index = 0;
+    const SIZE_T Step = sizeof(ULONG_PTR) / sizeof(ULONG);
 
+    /* Compare single ULONGs until the buffer is aligned */
+    while (Index < Count && ((ULONG_PTR)&Buffer[Index] & (sizeof(ULONG_PTR) - 1)))
+    {
+        if (Buffer[Index] != Pattern) return Index;
+        Index++;
+    }
 
-/* PRIVATE FUNCTIONS ********************************************************/
+    /* Compare 4 words at a time */
+    WideBuffer = (PULONG_PTR)&Buffer[Index];
+    while (Index + 4 * Step <= Count)
+    {
+        if (((WideBuffer[0] ^ WidePattern) | (WideBuffer[1] ^ WidePattern) |
+             (WideBuffer[2] ^ WidePattern) | (WideBuffer[3] ^ WidePattern)) != 0)
+        {
+            break;
+        }
+
+        WideBuffer += 4;
+        Index += 4 * Step;
+    }
+
+    /* Locate the mismatch, or compare what's left */
+    while (Index < Count && Buffer[Index] == Pattern)
+        Index++;
+
+    return Index;
+}
+
+SIZE_T
+NTAPI
+RtlpCountSetBitsGeneric(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count)
+{
+    SIZE_T BitCount = 0;
+    ULONG Value;
+
+    while (Count--)
+    {
+        /* Add up the bits in pairs, nibbles, then bytes */
+        Value = *Buffer++;
+        Value -= (Value >> 1) & 0x55555555;
+        Value = (Value & 0x33333333) + ((Value >> 2) & 0x33333333);
+        Value = (Value + (Value >> 4)) & 0x0F0F0F0F;
+        BitCount += (Value * 0x01010101) >> 24;
+    }
+
+    return BitCount;
+}
+
+#ifdef _M_AMD64
+#define CPUID1_ECX_POPCNT   (1 << 23)
+#define CPUID1_ECX_OSXSAVE  (1 << 27)
+#define CPUID1_ECX_AVX      (1 << 28)
+#define CPUID7_EBX_AVX2     (1 << 5)
+#define XSTATE_MASK_SSE_AVX 0x6
+
+static SIZE_T NTAPI RtlpSkipUlongsFirst(PULONG Buffer, SIZE_T Count, ULONG Pattern);
+static SIZE_T NTAPI RtlpCountSetBitsFirst(PULONG Buffer, SIZE_T Count);
+
+PRTLP_SKIP_ULONGS RtlpSkipUlongs = RtlpSkipUlongsFirst;
+PRTLP_COUNT_SET_BITS RtlpCountSetBits = RtlpCountSetBitsFirst;
+
+VOID
+NTAPI
+RtlpInitializeBitMapRoutines(VOID)
+{
+    INT CpuInfo[4];
+    ULONG MaxFunction;
+    BOOLEAN Popcnt, Avx2 = FALSE;
+
+    __cpuid(CpuInfo, 0);
+    MaxFunction = CpuInfo[0];
+
+    __cpuid(CpuInfo, 1);
+    Popcnt = (CpuInfo[2] & CPUID1_ECX_POPCNT) != 0;
+
+    /* The kernel does not preserve the upper halves of the YMM registers,
+       and user mode may only use them when the OS saves them */
+    if (RtlpGetMode() == UserMode &&
+        MaxFunction >= 7 && Popcnt &&
+        (CpuInfo[2] & (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX)) == (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX) &&
+        (RtlpReadXcr0() & XSTATE_MASK_SSE_AVX) == XSTATE_MASK_SSE_AVX)
+    {
+        __cpuidex(CpuInfo, 7, 0);
+        Avx2 = (CpuInfo[1] & CPUID7_EBX_AVX2) != 0;
+    }
+
+    /* SSE2 is part of amd64, and the kernel saves the registers used */
+    RtlpSkipUlongs = Avx2 ? RtlpSkipUlongsAvx2 : RtlpSkipUlongsSse2;
+    RtlpCountSetBits = Avx2 ? RtlpCountSetBitsAvx2 :
+                       Popcnt ? RtlpCountSetBitsPopcnt : RtlpCountSetBitsGeneric;
+}
+
+/* Selecting twice is harmless, so the first calls need no lock */
+static
+SIZE_T
+NTAPI
+RtlpSkipUlongsFirst(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count,
+    _In_ ULONG Pattern)
+{
+    RtlpInitializeBitMapRoutines();
+    return RtlpSkipUlongs(Buffer, Count, Pattern);
+}
+
+static
+SIZE_T
+NTAPI
+RtlpCountSetBitsFirst(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count)
+{
+    RtlpInitializeBitMapRoutines();
+    return RtlpCountSetBits(Buffer, Count);
+}
+#endif /* _M_AMD64 */
+#endif /* !USE_RTL_BITMAP64 */
+
+static __inline
+PBITMAP_BUFFER
+RtlpSkipWords(
+    _In_ PBITMAP_BUFFER Buffer,
+    _In_ PBITMAP_BUFFER MaxBuffer,
+    _In_ BITMAP_BUFFER Pattern)
+{
+    const SIZE_T UlongsPerWord = sizeof(BITMAP_BUFFER) / sizeof(ULONG);
+    ULONG i;
+
+    /* Most runs are short, only call the scan routine for the long ones */
+    for (i = 0; i < 16; i++)
+    {
+        if (Buffer >= MaxBuffer || *Buffer != Pattern)
+            return Buffer;
+        Buffer++;
+    }
+
+    return Buffer + RtlpSkipUlongs((PULONG)Buffer,
+                                   (MaxBuffer - Buffer) * UlongsPerWord,
+                                   (ULONG)Pattern) / UlongsPerWord;
+}
 
 static __inline
 BITMAP_INDEX
@@ -121,9 +205,10 @@ RtlpGetLengthOfRunClear(
     Value = *Buffer++ >> BitPos << BitPos;
 
     /* Skip all clear ULONGs */
-    while (Value == 0 && Buffer < MaxBuffer)
+    if (Value == 0)
     {
-        Value = *Buffer++;
+        Buffer = RtlpSkipWords(Buffer, MaxBuffer, 0);
+        if (Buffer < MaxBuffer) Value = *Buffer++;
     }
 
     /* Did we reach the end? */
@@ -175,9 +260,10 @@ RtlpGetLengthOfRunSet(
     InvValue = ~(*Buffer++) >> BitPos << BitPos;
 
     /* Skip all set ULONGs */
-    while (InvValue == 0 && Buffer < MaxBuffer)
+    if (InvValue == 0)
     {
-        InvValue = ~(*Buffer++);
+        Buffer = RtlpSkipWords(Buffer, MaxBuffer, MAXINDEX);
+        if (Buffer < MaxBuffer) InvValue = ~(*Buffer++);
     }
 
     /* Did we reach the end? */
@@ -202,6 +288,98 @@ RtlpGetLengthOfRunSet(
     return Length;
 }
 
+static __inline
+BITMAP_INDEX
+RtlpFindClearBits(
+    _In_ PRTL_BITMAP BitMapHeader,
+    _In_opt_ PRTL_BITMAP Summary,
+    _In_ BITMAP_INDEX NumberToFind,
+    _In_ BITMAP_INDEX HintIndex)
+{
+    BITMAP_INDEX CurrentBit, Margin, CurrentLength, MaxLength, Word;
+
+    /* Check for valid parameters */
+    if (!BitMapHeader || NumberToFind > BitMapHeader->SizeOfBitMap)
+    {
+        return MAXINDEX;
+    }
+
+    /* Check if the hint is outside the bitmap */
+    if (HintIndex >= BitMapHeader->SizeOfBitMap) HintIndex = 0;
+
+    /* Check for trivial case */
+    if (NumberToFind == 0)
+    {
+        /* Return hint rounded down to byte margin */
+        return HintIndex & ~7;
+    }
+
+    /* First margin is end of bitmap */
+    Margin = BitMapHeader->SizeOfBitMap;
+
+retry:
+    /* Start with hint index, length is 0 */
+    CurrentBit = HintIndex;
+
+    /* Loop until something is found or the end is reached */
+    while (CurrentBit + NumberToFind < Margin)
+    {
+        MaxLength = MAXINDEX;
+        if (Summary)
+        {
+            /* Skip the full words using the summary */
+            Word = CurrentBit / _BITCOUNT;
+            Word += RtlpGetLengthOfRunSet(Summary, Word, MAXINDEX);
+            if (CurrentBit < Word * _BITCOUNT) CurrentBit = Word * _BITCOUNT;
+
+            /* And don't walk past the end of this word on our own */
+            MaxLength = _BITCOUNT - (CurrentBit & (_BITCOUNT - 1));
+        }
+
+        /* Search for the next clear run, by skipping a set run */
+        CurrentBit += RtlpGetLengthOfRunSet(BitMapHeader,
+                                            CurrentBit,
+                                            MaxLength);
+
+        /* Get length of the clear bit run */
+        CurrentLength = RtlpGetLengthOfRunClear(BitMapHeader,
+                                                CurrentBit,
+                                                NumberToFind);
+
+        /* Is this long enough? */
+        if (CurrentLength >= NumberToFind)
+        {
+            /* It is */
+            return CurrentBit;
+        }
+
+        CurrentBit += CurrentLength;
+    }
+
+    /* Did we start at a hint? */
+    if (HintIndex)
+    {
+        /* Retry at the start */
+        Margin = min(HintIndex + NumberToFind, BitMapHeader->SizeOfBitMap);
+        HintIndex = 0;
+        goto retry;
+    }
+
+    /* Nothing found */
+    return MAXINDEX;
+}
+
+
+BITMAP_INDEX
+NTAPI
+RtlpFindClearBitsWithSummary(
+    _In_ PRTL_BITMAP BitMapHeader,
+    _In_ PRTL_BITMAP Summary,
+    _In_ BITMAP_INDEX NumberToFind,
+    _In_ BITMAP_INDEX HintIndex)
+{
+    return RtlpFindClearBits(BitMapHeader, Summary, NumberToFind, HintIndex);
+}
 
 /* PUBLIC FUNCTIONS **********************************************************/
 
@@ -260,7 +438,7 @@ NTAPI
 RtlInitializeBitMap(
     _Out_ PRTL_BITMAP BitMapHeader,
     _In_opt_ __drv_aliasesMem PBITMAP_BUFFER BitMapBuffer,
-    _In_opt_ ULONG SizeOfBitMap)
+    _In_opt_ BITMAP_INDEX SizeOfBitMap)
 {
     /* Setup the bitmap header */
     BitMapHeader->SizeOfBitMap = SizeOfBitMap;
@@ -296,7 +474,7 @@ RtlClearBit(
     _In_ BITMAP_INDEX BitNumber)
 {
     ASSERT(BitNumber <= BitMapHeader->SizeOfBitMap);
-    BitMapHeader->Buffer[BitNumber / _BITCOUNT] &= ~(1 << (BitNumber & (_BITCOUNT - 1)));
+    BitMapHeader->Buffer[BitNumber / _BITCOUNT] &= ~((BITMAP_INDEX)1 << (BitNumber & (_BITCOUNT - 1)));
 }
 
 VOID
@@ -474,22 +652,19 @@ NTAPI
 RtlNumberOfSetBits(
     _In_ PRTL_BITMAP BitMapHeader)
 {
-    PUCHAR Byte, MaxByte;
-    BITMAP_INDEX BitCount = 0;
-    ULONG Shift;
+    PULONG Buffer = (PULONG)BitMapHeader->Buffer;
+    SIZE_T Ulongs = (SIZE_T)(BitMapHeader->SizeOfBitMap / 32);
+    BITMAP_INDEX BitCount;
+    ULONG Last;
 
-    Byte = (PUCHAR)BitMapHeader->Buffer;
-    MaxByte = Byte + BitMapHeader->SizeOfBitMap / 8;
+    /* Count the full ULONGs */
+    BitCount = RtlpCountSetBits(Buffer, Ulongs);
 
-    while (Byte < MaxByte)
+    /* And the bits of the last one */
+    if (BitMapHeader->SizeOfBitMap & 31)
     {
-        BitCount += BitCountTable[*Byte++];
-    }
-
-    if (BitMapHeader->SizeOfBitMap & 7)
-    {
-        Shift = 8 - (BitMapHeader->SizeOfBitMap & 7);
-        BitCount += BitCountTable[((*Byte) << Shift) & 0xFF];
+        Last = Buffer[Ulongs] << (32 - (BitMapHeader->SizeOfBitMap & 31));
+        BitCount += RtlpCountSetBitsGeneric(&Last, 1);
     }
 
     return BitCount;
@@ -511,65 +686,7 @@ RtlFindClearBits(
     _In_ BITMAP_INDEX NumberToFind,
     _In_ BITMAP_INDEX HintIndex)
 {
-    BITMAP_INDEX CurrentBit, Margin, CurrentLength;
-
-    /* Check for valid parameters */
-    if (!BitMapHeader || NumberToFind > BitMapHeader->SizeOfBitMap)
-    {
-        return MAXINDEX;
-    }
-
-    /* Check if the hint is outside the bitmap */
-    if (HintIndex >= BitMapHeader->SizeOfBitMap) HintIndex = 0;
-
-    /* Check for trivial case */
-    if (NumberToFind == 0)
-    {
-        /* Return hint rounded down to byte margin */
-        return HintIndex & ~7;
-    }
-
-    /* First margin is end of bitmap */
-    Margin = BitMapHeader->SizeOfBitMap;
-
-retry:
-    /* Start with hint index, length is 0 */
-    CurrentBit = HintIndex;
-
-    /* Loop until something is found or the end is reached */
-    while (CurrentBit + NumberToFind < Margin)
-    {
-        /* Search for the next clear run, by skipping a set run */
-        CurrentBit += RtlpGetLengthOfRunSet(BitMapHeader,
-                                            CurrentBit,
-                                            MAXINDEX);
-
-        /* Get length of the clear bit run */
-        CurrentLength = RtlpGetLengthOfRunClear(BitMapHeader,
-                                                CurrentBit,
-                                                NumberToFind);
-
-        /* Is this long enough? */
-        if (CurrentLength >= NumberToFind)
-        {
-            /* It is */
-            return CurrentBit;
-        }
-
-        CurrentBit += CurrentLength;
-    }
-
-    /* Did we start at a hint? */
-    if (HintIndex)
-    {
-        /* Retry at the start */
-        Margin = min(HintIndex + NumberToFind, BitMapHeader->SizeOfBitMap);
-        HintIndex = 0;
-        goto retry;
-    }
-
-    /* Nothing found */
-    return MAXINDEX;
+    return RtlpFindClearBits(BitMapHeader, NULL, NumberToFind, HintIndex);
 }
 
 BITMAP_INDEX
@@ -873,7 +990,7 @@ RtlFindClearRuns(
             for (Run = 0; Run < SizeOfRunArray; Run++)
             {
                 /*Is this the new smallest run? */
-                if (NumberOfBits < RunArray[SmallestRun].NumberOfBits)
+                if (RunArray[Run].NumberOfBits < RunArray[SmallestRun].NumberOfBits)
                 {
                     /* Set it as new smallest run */
                     SmallestRun = Run;
@@ -882,7 +999,7 @@ RtlFindClearRuns(
         }
 
         /* Advance bits */
-        FromIndex += NumberOfBits;
+        FromIndex = StartingIndex + NumberOfBits;
     }
 
     return Run;
@@ -915,7 +1032,7 @@ RtlFindLongestRunClear(
         }
 
         /* Advance bits */
-        FromIndex += NumberOfBits;
+        FromIndex = Index + NumberOfBits;
     }
 
     return MaxNumberOfBits;
@@ -948,9 +1065,8 @@ RtlFindLongestRunSet(
         }
 
         /* Advance bits */
-        FromIndex += NumberOfBits;
+        FromIndex = Index + NumberOfBits;
     }
 
     return MaxNumberOfBits;
 }
-
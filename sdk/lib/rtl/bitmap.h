@@ -0,0 +1,127 @@
+/*
+ * PROJECT:     ReactOS Run-Time Library
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Private bitmap definitions, shared by the 32-bit and 64-bit
+ *              bitmap and summary bitmap functions
+ * FILE:        lib/rtl/bitmap.h
+ */
+
+#ifndef RTL_BITMAP_H
+#define RTL_BITMAP_H
+
+/* bitmap64.c and bitmapsum64.c build the 64-bit variants from the same code */
+#ifdef USE_RTL_BITMAP64
+#define _BITCOUNT 64
+#define MAXINDEX 0xFFFFFFFFFFFFFFFF
+typedef ULONG64 BITMAP_INDEX, *PBITMAP_INDEX;
+typedef ULONG64 BITMAP_BUFFER, *PBITMAP_BUFFER;
+#define RTL_BITMAP RTL_BITMAP64
+#define PRTL_BITMAP PRTL_BITMAP64
+#define RTL_BITMAP_RUN RTL_BITMAP_RUN64
+#define PRTL_BITMAP_RUN PRTL_BITMAP_RUN64
+#define RTL_SUMMARY_BITMAP RTL_SUMMARY_BITMAP64
+#define PRTL_SUMMARY_BITMAP PRTL_SUMMARY_BITMAP64
+#undef BitScanForward
+#define BitScanForward(Index, Mask) \
+    do { unsigned long tmp; BitScanForward64(&tmp, Mask); *Index = tmp; } while (0)
+#undef BitScanReverse
+#define BitScanReverse(Index, Mask) \
+    do { unsigned long tmp; BitScanReverse64(&tmp, Mask); *Index = tmp; } while (0)
+#define RtlFillMemoryUlong RtlFillMemoryUlonglong
+
+#define RtlInitializeBitMap RtlInitializeBitMap64
+#define RtlClearAllBits RtlClearAllBits64
+#define RtlSetAllBits RtlSetAllBits64
+#define RtlClearBit RtlClearBit64
+#define RtlSetBit RtlSetBit64
+#define RtlClearBits RtlClearBits64
+#define RtlSetBits RtlSetBits64
+#define RtlTestBit RtlTestBit64
+#define RtlAreBitsClear RtlAreBitsClear64
+#define RtlAreBitsSet RtlAreBitsSet64
+#define RtlNumberOfSetBits RtlNumberOfSetBits64
+#define RtlNumberOfClearBits RtlNumberOfClearBits64
+#define RtlFindClearBits RtlFindClearBits64
+#define RtlFindSetBits RtlFindSetBits64
+#define RtlFindClearBitsAndSet RtlFindClearBitsAndSet64
+#define RtlFindSetBitsAndClear RtlFindSetBitsAndClear64
+#define RtlFindNextForwardRunClear RtlFindNextForwardRunClear64
+#define RtlFindNextForwardRunSet RtlFindNextForwardRunSet64
+#define RtlFindFirstRunClear RtlFindFirstRunClear64
+#define RtlFindLastBackwardRunClear RtlFindLastBackwardRunClear64
+#define RtlFindClearRuns RtlFindClearRuns64
+#define RtlFindLongestRunClear RtlFindLongestRunClear64
+#define RtlFindLongestRunSet RtlFindLongestRunSet64
+#define RtlInitializeSummaryBitMap RtlInitializeSummaryBitMap64
+#define RtlSummaryClearBits RtlSummaryClearBits64
+#define RtlSummarySetBits RtlSummarySetBits64
+#define RtlSummaryFindClearBits RtlSummaryFindClearBits64
+#define RtlSummaryFindClearBitsAndSet RtlSummaryFindClearBitsAndSet64
+#define RtlpFindClearBitsWithSummary RtlpFindClearBitsWithSummary64
+#else
+#define _BITCOUNT 32
+#define MAXINDEX 0xFFFFFFFF
+typedef ULONG BITMAP_INDEX, *PBITMAP_INDEX;
+typedef ULONG BITMAP_BUFFER, *PBITMAP_BUFFER;
+#endif
+
+/*
+ * The host tools include bitmap.c without rtlp.h, so this header only uses
+ * what their typedefs.h provides. They always get the generic routines.
+ */
+
+/* Scan routines, selected in bitmap.c */
+typedef SIZE_T
+(NTAPI *PRTLP_SKIP_ULONGS)(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count,
+    _In_ ULONG Pattern);
+
+typedef SIZE_T
+(NTAPI *PRTLP_COUNT_SET_BITS)(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count);
+
+SIZE_T
+NTAPI
+RtlpSkipUlongsGeneric(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count,
+    _In_ ULONG Pattern);
+
+SIZE_T
+NTAPI
+RtlpCountSetBitsGeneric(
+    _In_ PULONG Buffer,
+    _In_ SIZE_T Count);
+
+#ifdef _M_AMD64
+/* amd64/bitmap.S */
+SIZE_T NTAPI RtlpSkipUlongsSse2(PULONG Buffer, SIZE_T Count, ULONG Pattern);
+SIZE_T NTAPI RtlpSkipUlongsAvx2(PULONG Buffer, SIZE_T Count, ULONG Pattern);
+SIZE_T NTAPI RtlpCountSetBitsPopcnt(PULONG Buffer, SIZE_T Count);
+SIZE_T NTAPI RtlpCountSetBitsAvx2(PULONG Buffer, SIZE_T Count);
+ULONG64 NTAPI RtlpReadXcr0(VOID);
+
+/* Selected for the processor on first use */
+extern PRTLP_SKIP_ULONGS RtlpSkipUlongs;
+extern PRTLP_COUNT_SET_BITS RtlpCountSetBits;
+
+VOID
+NTAPI
+RtlpInitializeBitMapRoutines(VOID);
+#else
+#define RtlpSkipUlongs RtlpSkipUlongsGeneric
+#define RtlpCountSetBits RtlpCountSetBitsGeneric
+#endif
+
+/* Used by the summary bitmap functions in bitmapsum.c */
+BITMAP_INDEX
+NTAPI
+RtlpFindClearBitsWithSummary(
+    _In_ PRTL_BITMAP BitMapHeader,
+    _In_ PRTL_BITMAP Summary,
+    _In_ BITMAP_INDEX NumberToFind,
+    _In_ BITMAP_INDEX HintIndex);
+
+#endif /* RTL_BITMAP_H */
@@ -0,0 +1,137 @@
+/*
+ * PROJECT:     ReactOS Run-Time Library
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Summary bitmaps, which keep a bit for each full word of a bitmap
+ * FILE:        lib/rtl/bitmapsum.c
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <bitmap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static __inline
+VOID
+RtlpUpdateSummaryWord(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_ BITMAP_INDEX Word)
+{
+    /* The last word only counts as full if the bitmap ends with it */
+    if (Word < BitMapHeader->BitMap.SizeOfBitMap / _BITCOUNT &&
+        BitMapHeader->BitMap.Buffer[Word] == MAXINDEX)
+    {
+        BitMapHeader->Summary.Buffer[Word / _BITCOUNT] |= (BITMAP_INDEX)1 << (Word & (_BITCOUNT - 1));
+    }
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+VOID
+NTAPI
+RtlInitializeSummaryBitMap(
+    _Out_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_ __drv_aliasesMem PBITMAP_BUFFER BitMapBuffer,
+    _In_ __drv_aliasesMem PBITMAP_BUFFER SummaryBuffer,
+    _In_ BITMAP_INDEX SizeOfBitMap)
+{
+    BITMAP_INDEX Word;
+
+    /* The summary has one bit for each word of the bitmap */
+    RtlInitializeBitMap(&BitMapHeader->BitMap, BitMapBuffer, SizeOfBitMap);
+    RtlInitializeBitMap(&BitMapHeader->Summary,
+                        SummaryBuffer,
+                        (SizeOfBitMap + _BITCOUNT - 1) / _BITCOUNT);
+
+    /* Mark the words that are already full */
+    RtlClearAllBits(&BitMapHeader->Summary);
+    for (Word = 0; Word < BitMapHeader->Summary.SizeOfBitMap; Word++)
+    {
+        RtlpUpdateSummaryWord(BitMapHeader, Word);
+    }
+}
+
+VOID
+NTAPI
+RtlSummaryClearBits(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - NumberToClear) BITMAP_INDEX StartingIndex,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - StartingIndex) BITMAP_INDEX NumberToClear)
+{
+    BITMAP_INDEX FirstWord, LastWord;
+
+    if (NumberToClear == 0) return;
+
+    RtlClearBits(&BitMapHeader->BitMap, StartingIndex, NumberToClear);
+
+    /* None of the words we touched is full anymore */
+    FirstWord = StartingIndex / _BITCOUNT;
+    LastWord = (StartingIndex + NumberToClear - 1) / _BITCOUNT;
+    RtlClearBits(&BitMapHeader->Summary, FirstWord, LastWord - FirstWord + 1);
+}
+
+VOID
+NTAPI
+RtlSummarySetBits(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - NumberToSet) BITMAP_INDEX StartingIndex,
+    _In_range_(0, BitMapHeader->BitMap.SizeOfBitMap - StartingIndex) BITMAP_INDEX NumberToSet)
+{
+    BITMAP_INDEX FirstWord, EndWord;
+
+    if (NumberToSet == 0) return;
+
+    RtlSetBits(&BitMapHeader->BitMap, StartingIndex, NumberToSet);
+
+    /* The words we set completely are full now */
+    FirstWord = (StartingIndex + _BITCOUNT - 1) / _BITCOUNT;
+    EndWord = (StartingIndex + NumberToSet) / _BITCOUNT;
+    if (EndWord > FirstWord)
+    {
+        RtlSetBits(&BitMapHeader->Summary, FirstWord, EndWord - FirstWord);
+    }
+
+    /* The ones at the edges might be too */
+    RtlpUpdateSummaryWord(BitMapHeader, StartingIndex / _BITCOUNT);
+    RtlpUpdateSummaryWord(BitMapHeader, (StartingIndex + NumberToSet - 1) / _BITCOUNT);
+}
+
+BITMAP_INDEX
+NTAPI
+RtlSummaryFindClearBits(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_ BITMAP_INDEX NumberToFind,
+    _In_ BITMAP_INDEX HintIndex)
+{
+    return RtlpFindClearBitsWithSummary(&BitMapHeader->BitMap,
+                                        &BitMapHeader->Summary,
+                                        NumberToFind,
+                                        HintIndex);
+}
+
+BITMAP_INDEX
+NTAPI
+RtlSummaryFindClearBitsAndSet(
+    _In_ PRTL_SUMMARY_BITMAP BitMapHeader,
+    _In_ BITMAP_INDEX NumberToFind,
+    _In_ BITMAP_INDEX HintIndex)
+{
+    BITMAP_INDEX Position;
+
+    /* Try to find clear bits */
+    Position = RtlSummaryFindClearBits(BitMapHeader, NumberToFind, HintIndex);
+
+    /* Did we get something? */
+    if (Position != MAXINDEX)
+    {
+        /* Yes, set the bits */
+        RtlSummarySetBits(BitMapHeader, Position, NumberToFind);
+    }
+
+    /* Return what we found */
+    return Position;
+}
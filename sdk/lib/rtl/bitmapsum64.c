@@ -0,0 +1,4 @@
+
+#define USE_RTL_BITMAP64
+
+#include "bitmapsum.c"
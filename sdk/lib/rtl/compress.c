@@ -20,7 +20,96 @@
 #define COMPRESSION_FORMAT_MASK  0x00FF
 #define COMPRESSION_ENGINE_MASK  0xFF00
 
+#define TAG_COMPRESS             'pmoC'
 
+#define LZNT1_CHUNK_SIZE        0x1000
+#define LZNT1_MIN_MATCH         3
+#define LZNT1_HASH_BITS         12
+#define LZNT1_HASH_SIZE         (1 << LZNT1_HASH_BITS)
+#define LZNT1_NO_POSITION       0xFFFF
+#define LZNT1_WORKSPACE_SIZE    0x8010
+
+#define LZNT1_STANDARD_DEPTH    4
+#define LZNT1_MAXIMUM_DEPTH     LZNT1_CHUNK_SIZE
+
+#define LZNT1_HASH(p) \
+    ((((p)[0] | ((p)[1] << 8) | ((p)[2] << 16)) * 0x9E3779B1) >> (32 - LZNT1_HASH_BITS))
+
+typedef struct _LZNT1_WORKSPACE
+{
+    USHORT Head[LZNT1_HASH_SIZE];
+    USHORT Prev[LZNT1_CHUNK_SIZE];
+} LZNT1_WORKSPACE, *PLZNT1_WORKSPACE;
+
+C_ASSERT(sizeof(LZNT1_WORKSPACE) <= LZNT1_WORKSPACE_SIZE);
+
+#define XPRESS_MIN_MATCH        3
+#define XPRESS_MAX_MATCH        0xFFFF
+#define XPRESS_MAX_OFFSET       0x2000
+#define XPRESS_HASH_BITS        15
+#define XPRESS_NO_POSITION      0xFFFFFFFF
+
+#define XPRESS_STANDARD_DEPTH   8
+#define XPRESS_MAXIMUM_DEPTH    64
+
+#define XPRESS_HASH(p) \
+    ((((p)[0] | ((p)[1] << 8) | ((p)[2] << 16)) * 0x9E3779B1) >> (32 - XPRESS_HASH_BITS))
+
+#define XPRESS_HUFF_MAX_OFFSET  0xFFFF
+#define XPRESS_HUFF_WINDOW      0x10000
+#define XPRESS_HUFF_BLOCK_SIZE  0x10000
+#define XPRESS_HUFF_SYMBOLS     512
+#define XPRESS_HUFF_EOF         256
+#define XPRESS_HUFF_MAX_BITS    15
+#define XPRESS_HUFF_TABLE_BITS  10
+#define XPRESS_HUFF_TABLE_SIZE  (XPRESS_HUFF_SYMBOLS / 2)
+
+typedef struct _XPRESS_WORKSPACE
+{
+    ULONG Head[1 << XPRESS_HASH_BITS];
+    ULONG Prev[XPRESS_HUFF_WINDOW];
+
+    /* only used by the Huffman variant */
+    ULONG Items[XPRESS_HUFF_BLOCK_SIZE];
+    ULONG Frequencies[XPRESS_HUFF_SYMBOLS];
+    ULONG NodeFrequencies[2 * XPRESS_HUFF_SYMBOLS];
+    USHORT Parent[2 * XPRESS_HUFF_SYMBOLS];
+    USHORT Leaves[XPRESS_HUFF_SYMBOLS];
+    USHORT Codes[XPRESS_HUFF_SYMBOLS];
+    UCHAR Depth[2 * XPRESS_HUFF_SYMBOLS];
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+} XPRESS_WORKSPACE, *PXPRESS_WORKSPACE;
+
+typedef struct _XPRESS_HUFF_DECODER
+{
+    /* (symbol << 4) | length for the short codes, 0 for the long ones */
+    USHORT Table[1 << XPRESS_HUFF_TABLE_BITS];
+    USHORT Sorted[XPRESS_HUFF_SYMBOLS];
+    USHORT FirstCode[XPRESS_HUFF_MAX_BITS + 1];
+    USHORT FirstIndex[XPRESS_HUFF_MAX_BITS + 1];
+    USHORT Count[XPRESS_HUFF_MAX_BITS + 1];
+    UCHAR Lengths[XPRESS_HUFF_SYMBOLS];
+} XPRESS_HUFF_DECODER, *PXPRESS_HUFF_DECODER;
+
+typedef struct _XPRESS_BIT_WRITER
+{
+    ULONG Bits;
+    ULONG Count;
+    PUCHAR NextBits;
+    PUCHAR NextBits2;
+    PUCHAR NextByte;
+} XPRESS_BIT_WRITER, *PXPRESS_BIT_WRITER;
+
+typedef struct _XPRESS_PARSER
+{
+    PXPRESS_WORKSPACE WorkSpace;
+    const UCHAR *Buffer;
+    ULONG Size;
+    ULONG WindowMask;
+    ULONG MaxOffset;
+    ULONG Depth;
+    BOOLEAN Lazy;
+} XPRESS_PARSER, *PXPRESS_PARSER;
 
 
 /* FUNCTIONS ****************************************************************/
@@ -216,28 +305,197 @@ out:
 }
 
 
+/*
+ * Matches are found with hash chains over the current chunk, LZNT1 back
+ * references never cross a chunk boundary. The standard engine follows a
+ * few links of each chain, the maximum engine follows all of them and
+ * defers a match when the next position starts a longer one.
+ */
+
+/* number of displacement bits of a back reference at the given chunk position */
+static __inline ULONG
+RtlpDisplacementBitsLZNT1(ULONG pos)
+{
+    ULONG displacement_bits;
+
+    for (displacement_bits = 12; displacement_bits > 4; displacement_bits--)
+        if ((1U << (displacement_bits - 1)) < pos) break;
+
+    return displacement_bits;
+}
+
+static __inline VOID
+RtlpInsertHashLZNT1(PLZNT1_WORKSPACE ws, const UCHAR *chunk, ULONG pos, ULONG size)
+{
+    ULONG hash;
+
+    if (pos + LZNT1_MIN_MATCH > size) return;
+
+    hash = LZNT1_HASH(chunk + pos);
+    ws->Prev[pos] = ws->Head[hash];
+    ws->Head[hash] = (USHORT)pos;
+}
+
+static ULONG
+RtlpFindMatchLZNT1(PLZNT1_WORKSPACE ws, const UCHAR *chunk, ULONG pos, ULONG size,
+                   ULONG max_depth, ULONG *match_pos)
+{
+    ULONG max_length, best_length = 0, length, cand;
+    const UCHAR *cur = chunk + pos;
+
+    if (pos + LZNT1_MIN_MATCH > size) return 0;
+
+    max_length = min((0xFFFF >> RtlpDisplacementBitsLZNT1(pos)) + LZNT1_MIN_MATCH, size - pos);
+    cand = ws->Head[LZNT1_HASH(cur)];
+
+    /* all positions in the chain are below pos, so every displacement fits */
+    while (cand != LZNT1_NO_POSITION && max_depth--)
+    {
+        const UCHAR *ref = chunk + cand;
+
+        if (ref[best_length] == cur[best_length] && ref[0] == cur[0] && ref[1] == cur[1])
+        {
+            for (length = 2; length < max_length && ref[length] == cur[length]; length++);
+
+            if (length > best_length)
+            {
+                best_length = length;
+                *match_pos = cand;
+                if (length == max_length) break;
+            }
+        }
+
+        cand = ws->Prev[cand];
+    }
+
+    return (best_length >= LZNT1_MIN_MATCH) ? best_length : 0;
+}
+
+/* compress a single LZNT1 chunk, returns 0 if the result doesn't fit in dst_size bytes */
+static ULONG
+RtlpCompressChunkLZNT1(const UCHAR *chunk, ULONG size, UCHAR *dst, ULONG dst_size,
+                       USHORT engine, PLZNT1_WORKSPACE ws)
+{
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *flags = NULL;
+    ULONG max_depth, pos = 0, length, next_length, match_pos, next_pos, i;
+    ULONG flag_bit = 8;
+    WORD code;
+
+    max_depth = (engine == COMPRESSION_ENGINE_MAXIMUM) ? LZNT1_MAXIMUM_DEPTH
+                                                       : LZNT1_STANDARD_DEPTH;
+
+    RtlFillMemory(ws->Head, sizeof(ws->Head), 0xFF);
+
+    while (pos < size)
+    {
+        /* every 8 entities are preceded by a flags byte */
+        if (flag_bit == 8)
+        {
+            if (dst_cur >= dst_end) return 0;
+            flags = dst_cur++;
+            *flags = 0;
+            flag_bit = 0;
+        }
+
+        length = RtlpFindMatchLZNT1(ws, chunk, pos, size, max_depth, &match_pos);
+
+        if (length && engine == COMPRESSION_ENGINE_MAXIMUM && pos + 1 < size)
+        {
+            /* lazy matching: prefer a literal if the next position matches longer */
+            RtlpInsertHashLZNT1(ws, chunk, pos, size);
+            next_length = RtlpFindMatchLZNT1(ws, chunk, pos + 1, size, max_depth, &next_pos);
+            if (next_length > length) length = 0;
+
+            /* pos is already hashed */
+            i = 1;
+        }
+        else
+        {
+            i = 0;
+        }
+
+        if (length)
+        {
+            if (dst_cur + sizeof(WORD) > dst_end) return 0;
+
+            /* back reference */
+            code = (WORD)(((pos - match_pos - 1) << (16 - RtlpDisplacementBitsLZNT1(pos)))
+                          | (length - LZNT1_MIN_MATCH));
+            *(WORD *)dst_cur = code;
+            dst_cur += sizeof(WORD);
+            *flags |= 1 << flag_bit;
+        }
+        else
+        {
+            if (dst_cur >= dst_end) return 0;
+
+            /* uncompressed data */
+            *dst_cur++ = chunk[pos];
+            length = 1;
+        }
+
+        for (; i < length; i++)
+            RtlpInsertHashLZNT1(ws, chunk, pos + i, size);
+
+        pos += length;
+        flag_bit++;
+    }
+
+    return dst_cur - dst;
+}
+
 static NTSTATUS
 RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
-                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace)
+                        ULONG chunk_size, ULONG *final_size, USHORT engine,
+                        UCHAR *workspace)
 {
         UCHAR *src_cur = src, *src_end = src + src_size;
         UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
-        ULONG block_size;
+        ULONG block_size, compressed_size, available;
+
+        if (engine != COMPRESSION_ENGINE_STANDARD && engine != COMPRESSION_ENGINE_MAXIMUM)
+            return STATUS_NOT_SUPPORTED;
 
         while (src_cur < src_end)
         {
             /* determine size of current chunk */
-            block_size = min(0x1000, src_end - src_cur);
-            if (dst_cur + sizeof(WORD) + block_size > dst_end)
+            block_size = min(LZNT1_CHUNK_SIZE, src_end - src_cur);
+            if (dst_cur + sizeof(WORD) >= dst_end)
                 return STATUS_BUFFER_TOO_SMALL;
 
-            /* write (uncompressed) chunk header */
-            *(WORD *)dst_cur = 0x3000 | (block_size - 1);
-            dst_cur += sizeof(WORD);
+            available = dst_end - dst_cur - sizeof(WORD);
+
+            /* the compressed chunk is only kept if it is smaller */
+            compressed_size = 0;
+            if (workspace)
+            {
+                compressed_size = RtlpCompressChunkLZNT1(src_cur, block_size,
+                                                         dst_cur + sizeof(WORD),
+                                                         min(available, block_size - 1),
+                                                         engine,
+                                                         (PLZNT1_WORKSPACE)workspace);
+            }
+
+            if (compressed_size)
+            {
+                /* write compressed chunk header */
+                *(WORD *)dst_cur = 0xB000 | (compressed_size - 1);
+                dst_cur += sizeof(WORD) + compressed_size;
+            }
+            else
+            {
+                if (block_size > available)
+                    return STATUS_BUFFER_TOO_SMALL;
+
+                /* write (uncompressed) chunk header */
+                *(WORD *)dst_cur = 0x3000 | (block_size - 1);
+                dst_cur += sizeof(WORD);
+
+                /* write chunk content */
+                memcpy(dst_cur, src_cur, block_size);
+                dst_cur += block_size;
+            }
 
-            /* write chunk content */
-            memcpy(dst_cur, src_cur, block_size);
-            dst_cur += block_size;
             src_cur += block_size;
         }
 
@@ -248,174 +506,1241 @@ RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
 }
 
 
-static NTSTATUS
-RtlpWorkSpaceSizeLZNT1(USHORT Engine,
-                       PULONG BufferAndWorkSpaceSize,
-                       PULONG FragmentWorkSpaceSize)
-{
-   if (Engine == COMPRESSION_ENGINE_STANDARD)
-   {
-      *BufferAndWorkSpaceSize = 0x8010;
-      *FragmentWorkSpaceSize = 0x1000;
-      return(STATUS_SUCCESS);
-   }
-   else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
-   {
-      *BufferAndWorkSpaceSize = 0x10;
-      *FragmentWorkSpaceSize = 0x1000;
-      return(STATUS_SUCCESS);
-   }
-
-   return(STATUS_NOT_SUPPORTED);
-}
-
-
 /*
- * @implemented
+ * XPRESS (MS-XCA) shares the LZ77 parser between its plain and Huffman
+ * variants. The plain variant stores flag words and byte-aligned matches
+ * with offsets up to 8 KB, the Huffman variant codes literals and match
+ * headers with one canonical Huffman table per 64 KB of input and allows
+ * offsets up to 64 KB.
  */
-NTSTATUS NTAPI
-RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
-                  IN PUCHAR UncompressedBuffer,
-                  IN ULONG UncompressedBufferSize,
-                  OUT PUCHAR CompressedBuffer,
-                  IN ULONG CompressedBufferSize,
-                  IN ULONG UncompressedChunkSize,
-                  OUT PULONG FinalCompressedSize,
-                  IN PVOID WorkSpace)
+
+static VOID
+RtlpInitParserXpress(PXPRESS_PARSER parser, PXPRESS_WORKSPACE ws, const UCHAR *src,
+                     ULONG src_size, USHORT engine, BOOLEAN huffman)
 {
-   USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+    parser->WorkSpace = ws;
+    parser->Buffer = src;
+    parser->Size = src_size;
+    parser->WindowMask = (huffman ? XPRESS_HUFF_WINDOW : XPRESS_MAX_OFFSET) - 1;
+    parser->MaxOffset = huffman ? XPRESS_HUFF_MAX_OFFSET : XPRESS_MAX_OFFSET;
+    parser->Depth = (engine == COMPRESSION_ENGINE_MAXIMUM) ? XPRESS_MAXIMUM_DEPTH
+                                                           : XPRESS_STANDARD_DEPTH;
+    parser->Lazy = (engine == COMPRESSION_ENGINE_MAXIMUM);
+
+    RtlFillMemory(ws->Head, sizeof(ws->Head), 0xFF);
+}
 
-   if ((Format == COMPRESSION_FORMAT_NONE) ||
-         (Format == COMPRESSION_FORMAT_DEFAULT))
-      return(STATUS_INVALID_PARAMETER);
+static __inline VOID
+RtlpInsertHashXpress(PXPRESS_PARSER parser, ULONG pos)
+{
+    PXPRESS_WORKSPACE ws = parser->WorkSpace;
+    ULONG hash;
 
-   if (Format == COMPRESSION_FORMAT_LZNT1)
-      return(RtlpCompressBufferLZNT1(UncompressedBuffer,
-                                     UncompressedBufferSize,
-                                     CompressedBuffer,
-                                     CompressedBufferSize,
-                                     UncompressedChunkSize,
-                                     FinalCompressedSize,
-                                     WorkSpace));
+    if (pos + XPRESS_MIN_MATCH > parser->Size) return;
 
-   return(STATUS_UNSUPPORTED_COMPRESSION);
+    hash = XPRESS_HASH(parser->Buffer + pos);
+    ws->Prev[pos & parser->WindowMask] = ws->Head[hash];
+    ws->Head[hash] = pos;
 }
 
-
-/*
- * @unimplemented
- */
-NTSTATUS NTAPI
-RtlCompressChunks(IN PUCHAR UncompressedBuffer,
-                  IN ULONG UncompressedBufferSize,
-                  OUT PUCHAR CompressedBuffer,
-                  IN ULONG CompressedBufferSize,
-                  IN OUT PCOMPRESSED_DATA_INFO CompressedDataInfo,
-                  IN ULONG CompressedDataInfoLength,
-                  IN PVOID WorkSpace)
+static ULONG
+RtlpFindMatchXpress(PXPRESS_PARSER parser, ULONG pos, ULONG end, ULONG *offset)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
+    PXPRESS_WORKSPACE ws = parser->WorkSpace;
+    const UCHAR *cur = parser->Buffer + pos;
+    ULONG max_length, best_length = 0, length, cand, next, depth = parser->Depth;
 
-/*
- * @unimplemented
- */
-NTSTATUS NTAPI
-RtlDecompressChunks(OUT PUCHAR UncompressedBuffer,
-                    IN ULONG UncompressedBufferSize,
-                    IN PUCHAR CompressedBuffer,
-                    IN ULONG CompressedBufferSize,
-                    IN PUCHAR CompressedTail,
-                    IN ULONG CompressedTailSize,
-                    IN PCOMPRESSED_DATA_INFO CompressedDataInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
+    if (pos + XPRESS_MIN_MATCH > end) return 0;
 
-/*
- * @implemented
- */
-NTSTATUS NTAPI
-RtlDecompressFragment(IN USHORT format,
-                      OUT PUCHAR uncompressed,
-                      IN ULONG uncompressed_size,
-                      IN PUCHAR compressed,
-                      IN ULONG compressed_size,
-                      IN ULONG offset,
-                      OUT PULONG final_size,
-                      IN PVOID workspace)
-{
-    DPRINT("0x%04x, %p, %u, %p, %u, %u, %p, %p :stub\n", format, uncompressed,
-           uncompressed_size, compressed, compressed_size, offset, final_size, workspace);
+    max_length = min(XPRESS_MAX_MATCH, end - pos);
+    cand = ws->Head[XPRESS_HASH(cur)];
 
-    switch (format & ~COMPRESSION_ENGINE_MAXIMUM)
+    /* older entries of the window are overwritten, the offset check ends the chain */
+    while (cand != XPRESS_NO_POSITION && pos - cand <= parser->MaxOffset && depth--)
     {
-        case COMPRESSION_FORMAT_LZNT1:
-            return lznt1_decompress(uncompressed, uncompressed_size, compressed,
-                                    compressed_size, offset, final_size, workspace);
+        const UCHAR *ref = parser->Buffer + cand;
 
-        case COMPRESSION_FORMAT_NONE:
-        case COMPRESSION_FORMAT_DEFAULT:
-            return STATUS_INVALID_PARAMETER;
+        if (ref[best_length] == cur[best_length] && ref[0] == cur[0] && ref[1] == cur[1])
+        {
+            for (length = 2; length < max_length && ref[length] == cur[length]; length++);
 
-        default:
-            DPRINT1("format %d not implemented\n", format);
-            return STATUS_UNSUPPORTED_COMPRESSION;
+            if (length > best_length)
+            {
+                best_length = length;
+                *offset = pos - cand;
+                if (length == max_length) break;
+            }
+        }
+
+        /* the slot may already belong to a newer position */
+        next = ws->Prev[cand & parser->WindowMask];
+        if (next != XPRESS_NO_POSITION && next >= cand) break;
+        cand = next;
     }
+
+    return (best_length >= XPRESS_MIN_MATCH) ? best_length : 0;
 }
 
-/*
- * @implemented
- */
-NTSTATUS NTAPI
-RtlDecompressBuffer(IN USHORT CompressionFormat,
-                    OUT PUCHAR UncompressedBuffer,
-                    IN ULONG UncompressedBufferSize,
-                    IN PUCHAR CompressedBuffer,
-                    IN ULONG CompressedBufferSize,
-                    OUT PULONG FinalUncompressedSize)
+/* returns the length of the match at pos, or 0 for a literal, and hashes the covered positions */
+static ULONG
+RtlpNextMatchXpress(PXPRESS_PARSER parser, ULONG pos, ULONG end, ULONG *offset)
 {
-    return RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
-                                 CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, NULL);
+    ULONG length, next_length, next_offset, i = 0;
+
+    length = RtlpFindMatchXpress(parser, pos, end, offset);
+
+    if (length && parser->Lazy && pos + 1 < end)
+    {
+        /* prefer a literal if the next position matches longer */
+        RtlpInsertHashXpress(parser, pos);
+        next_length = RtlpFindMatchXpress(parser, pos + 1, end, &next_offset);
+        if (next_length > length) return 0;
+        i = 1;
+    }
+
+    for (; i < max(length, 1); i++)
+        RtlpInsertHashXpress(parser, pos + i);
+
+    return length;
 }
 
-/*
- * @unimplemented
- */
-NTSTATUS NTAPI
-RtlDescribeChunk(IN USHORT CompressionFormat,
-                 IN OUT PUCHAR *CompressedBuffer,
-                 IN PUCHAR EndOfCompressedBufferPlus1,
-                 OUT PUCHAR *ChunkBuffer,
-                 OUT PULONG ChunkSize)
+static NTSTATUS
+RtlpCompressBufferXpress(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                         ULONG *final_size, USHORT engine, PXPRESS_WORKSPACE ws)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *flags_ptr, *half_byte = NULL;
+    ULONG pos = 0, flags = 0, flag_count = 0, match_length, length, offset, needed;
+    XPRESS_PARSER parser;
 
+    if (dst_size < sizeof(ULONG))
+        return STATUS_BUFFER_TOO_SMALL;
 
-/*
- * @unimplemented
- */
-NTSTATUS NTAPI
-RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
-                               OUT PULONG CompressBufferAndWorkSpaceSize,
-                               OUT PULONG CompressFragmentWorkSpaceSize)
-{
-   USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
+    RtlpInitParserXpress(&parser, ws, src, src_size, engine, FALSE);
 
-   if ((Format == COMPRESSION_FORMAT_NONE) ||
-         (Format == COMPRESSION_FORMAT_DEFAULT))
-      return(STATUS_INVALID_PARAMETER);
+    flags_ptr = dst_cur;
+    dst_cur += sizeof(ULONG);
 
-   if (Format == COMPRESSION_FORMAT_LZNT1)
-      return(RtlpWorkSpaceSizeLZNT1(Engine,
-                                    CompressBufferAndWorkSpaceSize,
-                                    CompressFragmentWorkSpaceSize));
+    while (pos < src_size)
+    {
+        match_length = RtlpNextMatchXpress(&parser, pos, src_size, &offset);
+
+        if (match_length)
+        {
+            /* the offset and 3 bits of length, then 4 more bits, a byte, and 2 or 6 bytes */
+            needed = sizeof(WORD);
+            if (match_length - 3 >= 7) needed += half_byte ? 0 : 1;
+            if (match_length - 3 >= 7 + 15) needed += 1;
+            if (match_length - 3 >= 7 + 15 + 255) needed += sizeof(WORD);
+
+            if ((ULONG)(dst_end - dst_cur) < needed)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            length = match_length - XPRESS_MIN_MATCH;
+            *(WORD *)dst_cur = (WORD)(((offset - 1) << 3) | min(length, 7));
+            dst_cur += sizeof(WORD);
+
+            if (length >= 7)
+            {
+                length -= 7;
+
+                /* two lengths share a byte */
+                if (!half_byte)
+                {
+                    half_byte = dst_cur++;
+                    *half_byte = (UCHAR)min(length, 15);
+                }
+                else
+                {
+                    *half_byte |= (UCHAR)(min(length, 15) << 4);
+                    half_byte = NULL;
+                }
+
+                if (length >= 15)
+                {
+                    length -= 15;
+
+                    if (length < 255)
+                    {
+                        *dst_cur++ = (UCHAR)length;
+                    }
+                    else
+                    {
+                        *dst_cur++ = 255;
+                        *(WORD *)dst_cur = (WORD)(length + 15 + 7);
+                        dst_cur += sizeof(WORD);
+                    }
+                }
+            }
+
+            flags = (flags << 1) | 1;
+            pos += match_length;
+        }
+        else
+        {
+            if (dst_cur >= dst_end)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            *dst_cur++ = src[pos++];
+            flags <<= 1;
+        }
+
+        if (++flag_count == 32)
+        {
+            *(ULONG *)flags_ptr = flags;
+
+            if ((ULONG)(dst_end - dst_cur) < sizeof(ULONG))
+                return STATUS_BUFFER_TOO_SMALL;
+
+            flags_ptr = dst_cur;
+            dst_cur += sizeof(ULONG);
+            flags = 0;
+            flag_count = 0;
+        }
+    }
+
+    /* the unused flags are set, the decoder stops at the first match past the end */
+    if (flag_count)
+        flags = (flags << (32 - flag_count)) | ((1u << (32 - flag_count)) - 1);
+    else
+        flags = 0xFFFFFFFF;
+
+    *(ULONG *)flags_ptr = flags;
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpress(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                           ULONG *final_size)
+{
+    UCHAR *src_cur = src, *src_end = src + src_size, *half_byte = NULL;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    ULONG flags = 0, flag_count = 0, length, offset;
+    WORD code;
+
+    while (dst_cur < dst_end)
+    {
+        if (!flag_count)
+        {
+            if (src_cur + sizeof(ULONG) > src_end) break;
+            flags = *(ULONG *)src_cur;
+            src_cur += sizeof(ULONG);
+            flag_count = 32;
+        }
+
+        flag_count--;
+
+        if (!(flags & (1u << flag_count)))
+        {
+            /* uncompressed data */
+            if (src_cur >= src_end) break;
+            *dst_cur++ = *src_cur++;
+            continue;
+        }
+
+        /* a match flag past the end of the data terminates it */
+        if (src_cur == src_end) break;
+
+        if (src_cur + sizeof(WORD) > src_end)
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        code = *(WORD *)src_cur;
+        src_cur += sizeof(WORD);
+
+        length = code & 7;
+        offset = (code >> 3) + 1;
+
+        if (length == 7)
+        {
+            if (!half_byte)
+            {
+                if (src_cur >= src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                half_byte = src_cur++;
+                length = *half_byte & 0xF;
+            }
+            else
+            {
+                length = *half_byte >> 4;
+                half_byte = NULL;
+            }
+
+            if (length == 15)
+            {
+                if (src_cur >= src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                length = *src_cur++;
+
+                if (length == 255)
+                {
+                    if (src_cur + sizeof(WORD) > src_end)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length = *(WORD *)src_cur;
+                    src_cur += sizeof(WORD);
+
+                    if (length == 0)
+                    {
+                        if (src_cur + sizeof(ULONG) > src_end)
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+                        length = *(ULONG *)src_cur;
+                        src_cur += sizeof(ULONG);
+                    }
+
+                    if (length < 15 + 7)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length -= 15 + 7;
+                }
+
+                length += 15;
+            }
+
+            length += 7;
+        }
+
+        length += XPRESS_MIN_MATCH;
+
+        if (offset > (ULONG)(dst_cur - dst))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        length = min(length, (ULONG)(dst_end - dst_cur));
+        if (offset >= length)
+        {
+            RtlCopyMemory(dst_cur, dst_cur - offset, length);
+            dst_cur += length;
+        }
+        else
+        {
+            /* the source and destination overlap */
+            while (length--)
+            {
+                *dst_cur = *(dst_cur - offset);
+                dst_cur++;
+            }
+        }
+    }
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+/* compute length-limited Huffman code lengths, flattening the frequencies until they fit */
+static VOID
+RtlpBuildHuffmanLengths(PXPRESS_WORKSPACE ws)
+{
+    ULONG *freq = ws->NodeFrequencies;
+    ULONG i, j, n, gap, node, leaf, next, a, b, max_depth;
+    USHORT sym;
+
+    for (;;)
+    {
+        RtlZeroMemory(ws->Lengths, sizeof(ws->Lengths));
+
+        for (i = 0, n = 0; i < XPRESS_HUFF_SYMBOLS; i++)
+        {
+            if (ws->Frequencies[i]) ws->Leaves[n++] = (USHORT)i;
+        }
+
+        if (n == 0) return;
+
+        if (n == 1)
+        {
+            /* a code needs at least two symbols */
+            ws->Lengths[ws->Leaves[0]] = 1;
+            ws->Lengths[ws->Leaves[0] ? 0 : 1] = 1;
+            return;
+        }
+
+        /* sort the leaves by frequency */
+        for (gap = n / 2; gap > 0; gap /= 2)
+        {
+            for (i = gap; i < n; i++)
+            {
+                sym = ws->Leaves[i];
+                for (j = i; j >= gap && ws->Frequencies[ws->Leaves[j - gap]] > ws->Frequencies[sym]; j -= gap)
+                    ws->Leaves[j] = ws->Leaves[j - gap];
+                ws->Leaves[j] = sym;
+            }
+        }
+
+        for (i = 0; i < n; i++)
+            freq[i] = ws->Frequencies[ws->Leaves[i]];
+
+        /* leaves and internal nodes are both consumed in increasing order */
+        for (leaf = 0, node = n, next = n; next < 2 * n - 1; next++)
+        {
+            a = (leaf < n && (node >= next || freq[leaf] <= freq[node])) ? leaf++ : node++;
+            b = (leaf < n && (node >= next || freq[leaf] <= freq[node])) ? leaf++ : node++;
+
+            freq[next] = freq[a] + freq[b];
+            ws->Parent[a] = ws->Parent[b] = (USHORT)next;
+        }
+
+        ws->Depth[2 * n - 2] = 0;
+        for (i = 2 * n - 2, max_depth = 0; i-- > 0;)
+        {
+            ws->Depth[i] = ws->Depth[ws->Parent[i]] + 1;
+            if (i < n) max_depth = max(max_depth, ws->Depth[i]);
+        }
+
+        if (max_depth <= XPRESS_HUFF_MAX_BITS)
+        {
+            for (i = 0; i < n; i++)
+                ws->Lengths[ws->Leaves[i]] = ws->Depth[i];
+            return;
+        }
+
+        for (i = 0; i < XPRESS_HUFF_SYMBOLS; i++)
+        {
+            if (ws->Frequencies[i]) ws->Frequencies[i] = (ws->Frequencies[i] >> 1) | 1;
+        }
+    }
+}
+
+/* assign canonical codes, ordered by length and then by symbol */
+static VOID
+RtlpMakeHuffmanCodes(const UCHAR *lengths, USHORT *codes, USHORT *count, USHORT *first_code)
+{
+    ULONG i, code = 0;
+    USHORT next_code[XPRESS_HUFF_MAX_BITS + 1];
+
+    RtlZeroMemory(count, (XPRESS_HUFF_MAX_BITS + 1) * sizeof(USHORT));
+    for (i = 0; i < XPRESS_HUFF_SYMBOLS; i++)
+        count[lengths[i]]++;
+    count[0] = 0;
+
+    for (i = 1; i <= XPRESS_HUFF_MAX_BITS; i++)
+    {
+        code = (code + count[i - 1]) << 1;
+        first_code[i] = next_code[i] = (USHORT)code;
+    }
+
+    if (codes)
+    {
+        for (i = 0; i < XPRESS_HUFF_SYMBOLS; i++)
+        {
+            if (lengths[i]) codes[i] = next_code[lengths[i]]++;
+        }
+    }
+}
+
+static __inline VOID
+RtlpWriteBitsXpress(PXPRESS_BIT_WRITER writer, ULONG bits, ULONG count)
+{
+    writer->Bits = (writer->Bits << count) | bits;
+    writer->Count += count;
+
+    /* the bits go to 16-bit words reserved ahead of the byte stream */
+    if (writer->Count > 16)
+    {
+        writer->Count -= 16;
+        *(WORD *)writer->NextBits = (WORD)(writer->Bits >> writer->Count);
+        writer->NextBits = writer->NextBits2;
+        writer->NextBits2 = writer->NextByte;
+        writer->NextByte += sizeof(WORD);
+    }
+}
+
+static NTSTATUS
+RtlpCompressBufferXpressHuff(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+                             ULONG *final_size, USHORT engine, PXPRESS_WORKSPACE ws)
+{
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    ULONG block_start = 0, block_end, pos, items, i, item, length, offset, bits, sym;
+    USHORT count[XPRESS_HUFF_MAX_BITS + 1], first_code[XPRESS_HUFF_MAX_BITS + 1];
+    XPRESS_BIT_WRITER writer;
+    XPRESS_PARSER parser;
+
+    RtlpInitParserXpress(&parser, ws, src, src_size, engine, TRUE);
+
+    do
+    {
+        block_end = min(src_size, block_start + XPRESS_HUFF_BLOCK_SIZE);
+
+        /* parse the block into literals and matches first, the table depends on them */
+        RtlZeroMemory(ws->Frequencies, sizeof(ws->Frequencies));
+
+        for (pos = block_start, items = 0; pos < block_end; items++)
+        {
+            length = RtlpNextMatchXpress(&parser, pos, block_end, &offset);
+
+            /* the match symbol of offset 1 and length 3 is the end of stream marker */
+            if (length == XPRESS_MIN_MATCH && offset == 1)
+            {
+                ws->Frequencies[src[pos]] += 3;
+                ws->Items[items++] = src[pos++];
+                ws->Items[items++] = src[pos++];
+                ws->Items[items] = src[pos++];
+            }
+            else if (length)
+            {
+                for (bits = 0; (offset >> bits) > 1; bits++);
+                ws->Frequencies[256 + (bits << 4) + min(length - XPRESS_MIN_MATCH, 15)]++;
+                ws->Items[items] = (offset << 16) | (length - XPRESS_MIN_MATCH);
+                pos += length;
+            }
+            else
+            {
+                ws->Frequencies[src[pos]]++;
+                ws->Items[items] = src[pos++];
+            }
+        }
+
+        if (block_end == src_size)
+            ws->Frequencies[XPRESS_HUFF_EOF]++;
+
+        RtlpBuildHuffmanLengths(ws);
+        RtlpMakeHuffmanCodes(ws->Lengths, ws->Codes, count, first_code);
+
+        if ((ULONG)(dst_end - dst_cur) < XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(WORD))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        /* 4 bits per symbol length */
+        for (i = 0; i < XPRESS_HUFF_TABLE_SIZE; i++)
+            dst_cur[i] = ws->Lengths[2 * i] | (ws->Lengths[2 * i + 1] << 4);
+
+        writer.Bits = 0;
+        writer.Count = 0;
+        writer.NextBits = dst_cur + XPRESS_HUFF_TABLE_SIZE;
+        writer.NextBits2 = writer.NextBits + sizeof(WORD);
+        writer.NextByte = writer.NextBits2 + sizeof(WORD);
+
+        for (i = 0; i < items; i++)
+        {
+            /* at most two words of bits and three length bytes per item */
+            if ((ULONG)(dst_end - writer.NextByte) < 4 * sizeof(WORD) + 3)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            item = ws->Items[i];
+            offset = item >> 16;
+
+            if (!offset)
+            {
+                RtlpWriteBitsXpress(&writer, ws->Codes[item], ws->Lengths[item]);
+                continue;
+            }
+
+            length = item & 0xFFFF;
+            for (bits = 0; (offset >> bits) > 1; bits++);
+            sym = 256 + (bits << 4) + min(length, 15);
+
+            RtlpWriteBitsXpress(&writer, ws->Codes[sym], ws->Lengths[sym]);
+
+            if (length >= 15)
+            {
+                if (length - 15 < 255)
+                {
+                    *writer.NextByte++ = (UCHAR)(length - 15);
+                }
+                else
+                {
+                    *writer.NextByte++ = 255;
+                    *(WORD *)writer.NextByte = (WORD)length;
+                    writer.NextByte += sizeof(WORD);
+                }
+            }
+
+            RtlpWriteBitsXpress(&writer, offset - (1 << bits), bits);
+        }
+
+        if (block_end == src_size)
+        {
+            if ((ULONG)(dst_end - writer.NextByte) < 2 * sizeof(WORD))
+                return STATUS_BUFFER_TOO_SMALL;
+
+            RtlpWriteBitsXpress(&writer, ws->Codes[XPRESS_HUFF_EOF], ws->Lengths[XPRESS_HUFF_EOF]);
+        }
+
+        /* flush the reserved words */
+        *(WORD *)writer.NextBits = (WORD)(writer.Bits << (16 - writer.Count));
+        *(WORD *)writer.NextBits2 = 0;
+        dst_cur = writer.NextByte;
+
+        block_start = block_end;
+    }
+    while (block_start < src_size);
+
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+static BOOLEAN
+RtlpBuildHuffmanDecoder(PXPRESS_HUFF_DECODER decoder, const UCHAR *table)
+{
+    ULONG i, j, len, code, left, fill, index;
+    USHORT next_code[XPRESS_HUFF_MAX_BITS + 1];
+
+    for (i = 0; i < XPRESS_HUFF_TABLE_SIZE; i++)
+    {
+        decoder->Lengths[2 * i] = table[i] & 0xF;
+        decoder->Lengths[2 * i + 1] = table[i] >> 4;
+    }
+
+    RtlpMakeHuffmanCodes(decoder->Lengths, NULL, decoder->Count, decoder->FirstCode);
+
+    /* reject over-subscribed codes */
+    for (len = 1, left = 1; len <= XPRESS_HUFF_MAX_BITS; len++)
+    {
+        left = (left << 1) - decoder->Count[len];
+        if ((LONG)left < 0) return FALSE;
+    }
+
+    for (len = 1, index = 0; len <= XPRESS_HUFF_MAX_BITS; len++)
+    {
+        decoder->FirstIndex[len] = (USHORT)index;
+        index += decoder->Count[len];
+    }
+
+    RtlZeroMemory(decoder->Table, sizeof(decoder->Table));
+    RtlCopyMemory(next_code, decoder->FirstCode, sizeof(next_code));
+
+    for (i = 0; i < XPRESS_HUFF_SYMBOLS; i++)
+    {
+        len = decoder->Lengths[i];
+        if (!len) continue;
+
+        code = next_code[len]++;
+        decoder->Sorted[decoder->FirstIndex[len] + code - decoder->FirstCode[len]] = (USHORT)i;
+
+        if (len <= XPRESS_HUFF_TABLE_BITS)
+        {
+            /* every table index that starts with the code */
+            fill = 1 << (XPRESS_HUFF_TABLE_BITS - len);
+            code <<= XPRESS_HUFF_TABLE_BITS - len;
+            for (j = 0; j < fill; j++)
+                decoder->Table[code + j] = (USHORT)((i << 4) | len);
+        }
+    }
+
+    return TRUE;
+}
+
+static __inline ULONG
+RtlpDecodeSymbolXpress(PXPRESS_HUFF_DECODER decoder, ULONG next_bits, ULONG *length)
+{
+    ULONG entry, len, code;
+
+    entry = decoder->Table[next_bits >> (32 - XPRESS_HUFF_TABLE_BITS)];
+    if (entry)
+    {
+        *length = entry & 0xF;
+        return entry >> 4;
+    }
+
+    /* codes longer than the table are looked up among the canonical codes */
+    for (len = XPRESS_HUFF_TABLE_BITS + 1; len <= XPRESS_HUFF_MAX_BITS; len++)
+    {
+        code = next_bits >> (32 - len);
+        if (code - decoder->FirstCode[len] < decoder->Count[len])
+        {
+            *length = len;
+            return decoder->Sorted[decoder->FirstIndex[len] + code - decoder->FirstCode[len]];
+        }
+    }
+
+    *length = 0;
+    return XPRESS_HUFF_SYMBOLS;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpressHuff(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                               ULONG *final_size, PXPRESS_HUFF_DECODER decoder)
+{
+    UCHAR *src_cur = src, *src_end = src + src_size;
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size, *block_end;
+    ULONG next_bits, sym, len, length, offset, bits;
+    LONG extra_bits;
+
+/* refill the bit buffer after consuming bits, zeroes are shifted in past the end */
+#define XPRESS_CONSUME_BITS(n)                                          \
+    do                                                                  \
+    {                                                                   \
+        next_bits <<= (n);                                              \
+        extra_bits -= (n);                                              \
+        if (extra_bits < 0)                                             \
+        {                                                               \
+            if (src_cur + sizeof(WORD) <= src_end)                      \
+            {                                                           \
+                next_bits |= (ULONG)*(WORD *)src_cur << -extra_bits;    \
+                src_cur += sizeof(WORD);                                \
+            }                                                           \
+            else                                                        \
+            {                                                           \
+                src_cur = src_end;                                      \
+            }                                                           \
+            extra_bits += 16;                                           \
+        }                                                               \
+    } while (0)
+
+    while (dst_cur < dst_end)
+    {
+        if (src_cur + XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(WORD) > src_end)
+            break;
+
+        if (!RtlpBuildHuffmanDecoder(decoder, src_cur))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        src_cur += XPRESS_HUFF_TABLE_SIZE;
+
+        next_bits = ((ULONG)*(WORD *)src_cur << 16) | *(WORD *)(src_cur + sizeof(WORD));
+        src_cur += 2 * sizeof(WORD);
+        extra_bits = 16;
+
+        block_end = dst_cur + min(XPRESS_HUFF_BLOCK_SIZE, (ULONG)(dst_end - dst_cur));
+
+        while (dst_cur < block_end)
+        {
+            sym = RtlpDecodeSymbolXpress(decoder, next_bits, &len);
+            if (sym == XPRESS_HUFF_SYMBOLS)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            XPRESS_CONSUME_BITS(len);
+
+            if (sym < 256)
+            {
+                *dst_cur++ = (UCHAR)sym;
+                continue;
+            }
+
+            if (sym == XPRESS_HUFF_EOF && src_cur >= src_end)
+                goto out;
+
+            sym -= 256;
+            length = sym & 0xF;
+            bits = sym >> 4;
+
+            if (length == 15)
+            {
+                if (src_cur >= src_end)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                length = *src_cur++;
+
+                if (length == 255)
+                {
+                    if (src_cur + sizeof(WORD) > src_end)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length = *(WORD *)src_cur;
+                    src_cur += sizeof(WORD);
+
+                    if (length < 15)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    length -= 15;
+                }
+
+                length += 15;
+            }
+
+            length += XPRESS_MIN_MATCH;
+
+            offset = 1 << bits;
+            if (bits)
+            {
+                offset += next_bits >> (32 - bits);
+                XPRESS_CONSUME_BITS(bits);
+            }
+
+            if (offset > (ULONG)(dst_cur - dst))
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            length = min(length, (ULONG)(dst_end - dst_cur));
+            if (offset >= length)
+            {
+                RtlCopyMemory(dst_cur, dst_cur - offset, length);
+                dst_cur += length;
+            }
+            else
+            {
+                /* the source and destination overlap */
+                while (length--)
+                {
+                    *dst_cur = *(dst_cur - offset);
+                    dst_cur++;
+                }
+            }
+        }
+    }
+
+#undef XPRESS_CONSUME_BITS
+
+out:
+    if (final_size)
+        *final_size = dst_cur - dst;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpWorkSpaceSizeXpress(USHORT Format,
+                        USHORT Engine,
+                        PULONG BufferAndWorkSpaceSize,
+                        PULONG FragmentWorkSpaceSize)
+{
+    if (Engine != COMPRESSION_ENGINE_STANDARD && Engine != COMPRESSION_ENGINE_MAXIMUM)
+        return STATUS_NOT_SUPPORTED;
+
+    if (Format == COMPRESSION_FORMAT_XPRESS)
+    {
+        *BufferAndWorkSpaceSize = FIELD_OFFSET(XPRESS_WORKSPACE, Prev[XPRESS_MAX_OFFSET]);
+        *FragmentWorkSpaceSize = 0;
+    }
+    else
+    {
+        *BufferAndWorkSpaceSize = sizeof(XPRESS_WORKSPACE);
+        *FragmentWorkSpaceSize = sizeof(XPRESS_HUFF_DECODER);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpDecompressXpressHuff(UCHAR *dst, ULONG dst_size, UCHAR *src, ULONG src_size,
+                         ULONG *final_size, UCHAR *workspace)
+{
+    PXPRESS_HUFF_DECODER decoder = (PXPRESS_HUFF_DECODER)workspace;
+    NTSTATUS Status;
+
+    /* RtlDecompressBuffer has no workspace */
+    if (!decoder)
+    {
+        decoder = RtlpAllocateMemory(sizeof(XPRESS_HUFF_DECODER), TAG_COMPRESS);
+        if (!decoder) return STATUS_NO_MEMORY;
+    }
+
+    Status = RtlpDecompressBufferXpressHuff(dst, dst_size, src, src_size, final_size, decoder);
+
+    if (decoder != (PXPRESS_HUFF_DECODER)workspace)
+        RtlpFreeMemory(decoder, TAG_COMPRESS);
+
+    return Status;
+}
+
+
+static NTSTATUS
+RtlpWorkSpaceSizeLZNT1(USHORT Engine,
+                       PULONG BufferAndWorkSpaceSize,
+                       PULONG FragmentWorkSpaceSize)
+{
+   if (Engine == COMPRESSION_ENGINE_STANDARD)
+   {
+      *BufferAndWorkSpaceSize = LZNT1_WORKSPACE_SIZE;
+      *FragmentWorkSpaceSize = 0x1000;
+      return(STATUS_SUCCESS);
+   }
+   else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+   {
+      *BufferAndWorkSpaceSize = LZNT1_WORKSPACE_SIZE;
+      *FragmentWorkSpaceSize = 0x1000;
+      return(STATUS_SUCCESS);
+   }
+
+   return(STATUS_NOT_SUPPORTED);
+}
+
+
+static BOOLEAN
+RtlpIsZeroBuffer(IN PUCHAR Buffer,
+                 IN ULONG Size)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+    {
+        if (Buffer[i] != 0) return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS NTAPI
+RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
+                  IN PUCHAR UncompressedBuffer,
+                  IN ULONG UncompressedBufferSize,
+                  OUT PUCHAR CompressedBuffer,
+                  IN ULONG CompressedBufferSize,
+                  IN ULONG UncompressedChunkSize,
+                  OUT PULONG FinalCompressedSize,
+                  IN PVOID WorkSpace)
+{
+   USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
+   NTSTATUS Status;
+
+   if ((Format == COMPRESSION_FORMAT_NONE) ||
+         (Format == COMPRESSION_FORMAT_DEFAULT))
+      return(STATUS_INVALID_PARAMETER);
+
+   if (Format == COMPRESSION_FORMAT_LZNT1)
+   {
+      Status = RtlpCompressBufferLZNT1(UncompressedBuffer,
+                                       UncompressedBufferSize,
+                                       CompressedBuffer,
+                                       CompressedBufferSize,
+                                       UncompressedChunkSize,
+                                       FinalCompressedSize,
+                                       Engine,
+                                       WorkSpace);
+   }
+   else if (Format == COMPRESSION_FORMAT_XPRESS || Format == COMPRESSION_FORMAT_XPRESS_HUFF)
+   {
+      /* see RtlGetCompressionWorkSpaceSize */
+      if (Format == COMPRESSION_FORMAT_XPRESS && Engine == COMPRESSION_ENGINE_HIBER)
+         Engine = COMPRESSION_ENGINE_STANDARD;
+
+      if (Engine != COMPRESSION_ENGINE_STANDARD && Engine != COMPRESSION_ENGINE_MAXIMUM)
+         return(STATUS_NOT_SUPPORTED);
+
+      if (!WorkSpace)
+         return(STATUS_INVALID_PARAMETER);
+
+      if (Format == COMPRESSION_FORMAT_XPRESS)
+         Status = RtlpCompressBufferXpress(UncompressedBuffer,
+                                           UncompressedBufferSize,
+                                           CompressedBuffer,
+                                           CompressedBufferSize,
+                                           FinalCompressedSize,
+                                           Engine,
+                                           WorkSpace);
+      else
+         Status = RtlpCompressBufferXpressHuff(UncompressedBuffer,
+                                               UncompressedBufferSize,
+                                               CompressedBuffer,
+                                               CompressedBufferSize,
+                                               FinalCompressedSize,
+                                               Engine,
+                                               WorkSpace);
+   }
+   else
+   {
+      return(STATUS_UNSUPPORTED_COMPRESSION);
+   }
+
+   /* the data is compressed all the same, callers may store zeroes as sparse */
+   if (Status == STATUS_SUCCESS && UncompressedBufferSize != 0 &&
+       RtlpIsZeroBuffer(UncompressedBuffer, UncompressedBufferSize))
+      return(STATUS_BUFFER_ALL_ZEROS);
+
+   return(Status);
+}
+
+
+NTSTATUS
+NTAPI
+RtlpDecompressChunk(IN USHORT Format,
+                    OUT PUCHAR UncompressedChunk,
+                    IN ULONG UncompressedChunkSize,
+                    IN PUCHAR CompressedChunk,
+                    IN ULONG CompressedChunkSize)
+{
+    NTSTATUS Status;
+    ULONG FinalSize;
+
+    if (CompressedChunkSize == 0)
+    {
+        RtlZeroMemory(UncompressedChunk, UncompressedChunkSize);
+        return STATUS_SUCCESS;
+    }
+
+    if (CompressedChunkSize == UncompressedChunkSize)
+    {
+        /* the chunk did not compress and was stored as is */
+        RtlCopyMemory(UncompressedChunk, CompressedChunk, UncompressedChunkSize);
+        return STATUS_SUCCESS;
+    }
+
+    Status = RtlDecompressBuffer(Format,
+                                 UncompressedChunk,
+                                 UncompressedChunkSize,
+                                 CompressedChunk,
+                                 CompressedChunkSize,
+                                 &FinalSize);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* trailing zeroes need not be present in the compressed data */
+    if (FinalSize < UncompressedChunkSize)
+        RtlZeroMemory(UncompressedChunk + FinalSize, UncompressedChunkSize - FinalSize);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS NTAPI
+RtlCompressChunks(IN PUCHAR UncompressedBuffer,
+                  IN ULONG UncompressedBufferSize,
+                  OUT PUCHAR CompressedBuffer,
+                  IN ULONG CompressedBufferSize,
+                  IN OUT PCOMPRESSED_DATA_INFO CompressedDataInfo,
+                  IN ULONG CompressedDataInfoLength,
+                  IN PVOID WorkSpace)
+{
+    USHORT FormatAndEngine = CompressedDataInfo->CompressionFormatAndEngine;
+    PUCHAR CompressedEnd = CompressedBuffer + CompressedBufferSize;
+    ULONG ChunkSize, NumberOfChunks, Chunk, Size, FinalSize;
+    NTSTATUS Status;
+
+    if (CompressedDataInfo->ChunkShift < 9 || CompressedDataInfo->ChunkShift > 16)
+        return STATUS_INVALID_PARAMETER;
+
+    ChunkSize = 1 << CompressedDataInfo->ChunkShift;
+    NumberOfChunks = (UncompressedBufferSize + ChunkSize - 1) >> CompressedDataInfo->ChunkShift;
+
+    if (NumberOfChunks > MAXUSHORT ||
+        CompressedDataInfoLength < FIELD_OFFSET(COMPRESSED_DATA_INFO, CompressedChunkSizes[NumberOfChunks]))
+        return STATUS_INVALID_PARAMETER;
+
+    for (Chunk = 0; Chunk < NumberOfChunks; Chunk++)
+    {
+        Size = min(ChunkSize, UncompressedBufferSize);
+
+        /* an all-zero chunk is described with a compressed size of 0 */
+        if (RtlpIsZeroBuffer(UncompressedBuffer, Size))
+        {
+            FinalSize = 0;
+        }
+        else
+        {
+            /* keep the chunk only if it got smaller */
+            Status = RtlCompressBuffer(FormatAndEngine,
+                                       UncompressedBuffer,
+                                       Size,
+                                       CompressedBuffer,
+                                       min(CompressedEnd - CompressedBuffer, Size - 1),
+                                       ChunkSize,
+                                       &FinalSize,
+                                       WorkSpace);
+
+            if (Status == STATUS_BUFFER_TOO_SMALL)
+            {
+                if ((ULONG)(CompressedEnd - CompressedBuffer) < Size)
+                    return STATUS_BUFFER_TOO_SMALL;
+
+                /* store the chunk uncompressed */
+                RtlCopyMemory(CompressedBuffer, UncompressedBuffer, Size);
+                FinalSize = Size;
+            }
+            else if (!NT_SUCCESS(Status))
+            {
+                return Status;
+            }
+        }
+
+        CompressedDataInfo->CompressedChunkSizes[Chunk] = FinalSize;
+        CompressedBuffer += FinalSize;
+        UncompressedBuffer += Size;
+        UncompressedBufferSize -= Size;
+    }
+
+    CompressedDataInfo->NumberOfChunks = (USHORT)NumberOfChunks;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS NTAPI
+RtlDecompressChunks(OUT PUCHAR UncompressedBuffer,
+                    IN ULONG UncompressedBufferSize,
+                    IN PUCHAR CompressedBuffer,
+                    IN ULONG CompressedBufferSize,
+                    IN PUCHAR CompressedTail,
+                    IN ULONG CompressedTailSize,
+                    IN PCOMPRESSED_DATA_INFO CompressedDataInfo)
+{
+    PUCHAR CompressedEnd = CompressedBuffer + CompressedBufferSize;
+    PULONG ChunkSizes = CompressedDataInfo->CompressedChunkSizes;
+    PUCHAR *ChunkData = NULL;
+    BOOLEAN InTail = FALSE;
+    ULONG ChunkSize, NumberOfChunks, Chunk, Size;
+    USHORT Format;
+    NTSTATUS Status;
+
+    if (CompressedDataInfo->ChunkShift < 9 || CompressedDataInfo->ChunkShift > 16)
+        return STATUS_INVALID_PARAMETER;
+
+    Format = CompressedDataInfo->CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
+    ChunkSize = 1 << CompressedDataInfo->ChunkShift;
+    NumberOfChunks = (UncompressedBufferSize + ChunkSize - 1) >> CompressedDataInfo->ChunkShift;
+
+    if (NumberOfChunks > CompressedDataInfo->NumberOfChunks)
+        return STATUS_BAD_COMPRESSION_BUFFER;
+
+    /* large buffers are spread over the processors, the thread pool only exists in user mode */
+    if (RtlpGetMode() == UserMode && NumberOfChunks >= RTLP_PARALLEL_MIN_CHUNKS &&
+        NtCurrentPeb()->NumberOfProcessors > 1)
+    {
+        ChunkData = RtlpAllocateMemory(NumberOfChunks * sizeof(PUCHAR), TAG_COMPRESS);
+    }
+
+    for (Chunk = 0; Chunk < NumberOfChunks; Chunk++)
+    {
+        Size = ChunkSizes[Chunk];
+
+        if (Size > min(ChunkSize, UncompressedBufferSize - Chunk * ChunkSize))
+        {
+            Status = STATUS_BAD_COMPRESSION_BUFFER;
+            goto Quit;
+        }
+
+        /* chunks which don't fit in the first buffer continue in the tail */
+        if (Size > (ULONG)(CompressedEnd - CompressedBuffer))
+        {
+            if (InTail || Size > CompressedTailSize)
+            {
+                Status = STATUS_BAD_COMPRESSION_BUFFER;
+                goto Quit;
+            }
+
+            CompressedBuffer = CompressedTail;
+            CompressedEnd = CompressedTail + CompressedTailSize;
+            InTail = TRUE;
+        }
+
+        if (ChunkData)
+        {
+            ChunkData[Chunk] = CompressedBuffer;
+        }
+        else
+        {
+            Status = RtlpDecompressChunk(Format,
+                                         UncompressedBuffer + Chunk * ChunkSize,
+                                         min(ChunkSize, UncompressedBufferSize - Chunk * ChunkSize),
+                                         CompressedBuffer,
+                                         Size);
+            if (!NT_SUCCESS(Status)) goto Quit;
+        }
+
+        CompressedBuffer += Size;
+    }
+
+    Status = STATUS_SUCCESS;
+    if (ChunkData)
+    {
+        Status = RtlpDecompressChunksParallel(Format,
+                                              UncompressedBuffer,
+                                              UncompressedBufferSize,
+                                              ChunkSize,
+                                              NumberOfChunks,
+                                              ChunkData,
+                                              ChunkSizes);
+    }
+
+Quit:
+    if (ChunkData)
+        RtlpFreeMemory(ChunkData, TAG_COMPRESS);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS NTAPI
+RtlDecompressFragment(IN USHORT format,
+                      OUT PUCHAR uncompressed,
+                      IN ULONG uncompressed_size,
+                      IN PUCHAR compressed,
+                      IN ULONG compressed_size,
+                      IN ULONG offset,
+                      OUT PULONG final_size,
+                      IN PVOID workspace)
+{
+    DPRINT("0x%04x, %p, %u, %p, %u, %u, %p, %p :stub\n", format, uncompressed,
+           uncompressed_size, compressed, compressed_size, offset, final_size, workspace);
+
+    switch (format & ~COMPRESSION_ENGINE_MAXIMUM)
+    {
+        case COMPRESSION_FORMAT_LZNT1:
+            return lznt1_decompress(uncompressed, uncompressed_size, compressed,
+                                    compressed_size, offset, final_size, workspace);
+
+        /* XPRESS streams can only be decoded from the start */
+        case COMPRESSION_FORMAT_XPRESS:
+            if (offset) return STATUS_NOT_SUPPORTED;
+            return RtlpDecompressBufferXpress(uncompressed, uncompressed_size, compressed,
+                                              compressed_size, final_size);
+
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            if (offset) return STATUS_NOT_SUPPORTED;
+            return RtlpDecompressXpressHuff(uncompressed, uncompressed_size, compressed,
+                                            compressed_size, final_size, workspace);
+
+        case COMPRESSION_FORMAT_NONE:
+        case COMPRESSION_FORMAT_DEFAULT:
+            return STATUS_INVALID_PARAMETER;
+
+        default:
+            DPRINT1("format %d not implemented\n", format);
+            return STATUS_UNSUPPORTED_COMPRESSION;
+    }
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS NTAPI
+RtlDecompressBuffer(IN USHORT CompressionFormat,
+                    OUT PUCHAR UncompressedBuffer,
+                    IN ULONG UncompressedBufferSize,
+                    IN PUCHAR CompressedBuffer,
+                    IN ULONG CompressedBufferSize,
+                    OUT PULONG FinalUncompressedSize)
+{
+    return RtlDecompressFragment(CompressionFormat, UncompressedBuffer, UncompressedBufferSize,
+                                 CompressedBuffer, CompressedBufferSize, 0, FinalUncompressedSize, NULL);
+}
+
+/*
+ * @unimplemented
+ */
+NTSTATUS NTAPI
+RtlDescribeChunk(IN USHORT CompressionFormat,
+                 IN OUT PUCHAR *CompressedBuffer,
+                 IN PUCHAR EndOfCompressedBufferPlus1,
+                 OUT PUCHAR *ChunkBuffer,
+                 OUT PULONG ChunkSize)
+{
+    UNIMPLEMENTED;
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+
+/*
+ * @unimplemented
+ */
+NTSTATUS NTAPI
+RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
+                               OUT PULONG CompressBufferAndWorkSpaceSize,
+                               OUT PULONG CompressFragmentWorkSpaceSize)
+{
+   USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
+
+   if ((Format == COMPRESSION_FORMAT_NONE) ||
+         (Format == COMPRESSION_FORMAT_DEFAULT))
+      return(STATUS_INVALID_PARAMETER);
+
+   if (Format == COMPRESSION_FORMAT_LZNT1)
+      return(RtlpWorkSpaceSizeLZNT1(Engine,
+                                    CompressBufferAndWorkSpaceSize,
+                                    CompressFragmentWorkSpaceSize));
+
+   /* the hibernation engine is plain XPRESS, as the standard engine does it */
+   if (Format == COMPRESSION_FORMAT_XPRESS && Engine == COMPRESSION_ENGINE_HIBER)
+      Engine = COMPRESSION_ENGINE_STANDARD;
+
+   if (Format == COMPRESSION_FORMAT_XPRESS || Format == COMPRESSION_FORMAT_XPRESS_HUFF)
+      return(RtlpWorkSpaceSizeXpress(Format,
+                                     Engine,
+                                     CompressBufferAndWorkSpaceSize,
+                                     CompressFragmentWorkSpaceSize));
 
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
@@ -0,0 +1,172 @@
+/*
+ * COPYRIGHT:         See COPYING in the top level directory
+ * PROJECT:           ReactOS system libraries
+ * PURPOSE:           Parallel decompression of compressed chunks
+ * FILE:              lib/rtl/decompchunks.c
+ * PROGRAMMER:
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* MACROS *******************************************************************/
+
+#define TAG_COMPRESS                'pmoC'
+
+#define RTLP_PARALLEL_MAX_WORKERS   16
+
+/*
+ * The chunks are independent, every thread takes the next chunk that nobody
+ * works on until all of them are done. The context lives on the heap and is
+ * referenced by the caller and by every queued work item, so a work item that
+ * only starts after the caller returned finds no chunk left and just drops
+ * its reference. The caller only waits for the chunks that were claimed.
+ */
+typedef struct _RTLP_DECOMPRESS_CHUNKS_CONTEXT
+{
+    LONG ReferenceCount;
+    USHORT Format;
+    PUCHAR UncompressedBuffer;
+    ULONG UncompressedBufferSize;
+    ULONG ChunkSize;
+    ULONG NumberOfChunks;
+    PUCHAR *ChunkData;
+    PULONG ChunkSizes;
+    LONG NextChunk;
+    LONG FinishedChunks;
+    NTSTATUS Status;
+    HANDLE DoneEvent;
+} RTLP_DECOMPRESS_CHUNKS_CONTEXT, *PRTLP_DECOMPRESS_CHUNKS_CONTEXT;
+
+/* FUNCTIONS ****************************************************************/
+
+static VOID
+RtlpDereferenceDecompressContext(IN PRTLP_DECOMPRESS_CHUNKS_CONTEXT Context)
+{
+    if (InterlockedDecrement(&Context->ReferenceCount) != 0) return;
+
+    if (Context->DoneEvent) NtClose(Context->DoneEvent);
+    RtlpFreeMemory(Context, TAG_COMPRESS);
+}
+
+static VOID
+RtlpDecompressChunksLoop(IN PRTLP_DECOMPRESS_CHUNKS_CONTEXT Context)
+{
+    NTSTATUS Status;
+    ULONG Chunk, Offset;
+
+    for (;;)
+    {
+        /* the buffers may be gone once all chunks are claimed, don't touch them */
+        Chunk = InterlockedIncrement(&Context->NextChunk) - 1;
+        if (Chunk >= Context->NumberOfChunks) break;
+
+        /* skip the work if another chunk failed, but still count the chunk */
+        if (NT_SUCCESS(Context->Status))
+        {
+            Offset = Chunk * Context->ChunkSize;
+            Status = RtlpDecompressChunk(Context->Format,
+                                         Context->UncompressedBuffer + Offset,
+                                         min(Context->ChunkSize, Context->UncompressedBufferSize - Offset),
+                                         Context->ChunkData[Chunk],
+                                         Context->ChunkSizes[Chunk]);
+            if (!NT_SUCCESS(Status))
+                InterlockedCompareExchange(&Context->Status, Status, STATUS_SUCCESS);
+        }
+
+        if ((ULONG)InterlockedIncrement(&Context->FinishedChunks) == Context->NumberOfChunks &&
+            Context->DoneEvent)
+        {
+            NtSetEvent(Context->DoneEvent, NULL);
+        }
+    }
+}
+
+static VOID
+NTAPI
+RtlpDecompressChunksWorker(IN PVOID Parameter)
+{
+    PRTLP_DECOMPRESS_CHUNKS_CONTEXT Context = Parameter;
+
+    RtlpDecompressChunksLoop(Context);
+    RtlpDereferenceDecompressContext(Context);
+}
+
+NTSTATUS
+NTAPI
+RtlpDecompressChunksParallel(IN USHORT Format,
+                             OUT PUCHAR UncompressedBuffer,
+                             IN ULONG UncompressedBufferSize,
+                             IN ULONG ChunkSize,
+                             IN ULONG NumberOfChunks,
+                             IN PUCHAR *ChunkData,
+                             IN PULONG ChunkSizes)
+{
+    PRTLP_DECOMPRESS_CHUNKS_CONTEXT Context;
+    NTSTATUS Status;
+    ULONG Workers, i;
+
+    Context = RtlpAllocateMemory(sizeof(*Context), TAG_COMPRESS);
+    if (!Context) return STATUS_NO_MEMORY;
+
+    Context->ReferenceCount = 1;
+    Context->Format = Format;
+    Context->UncompressedBuffer = UncompressedBuffer;
+    Context->UncompressedBufferSize = UncompressedBufferSize;
+    Context->ChunkSize = ChunkSize;
+    Context->NumberOfChunks = NumberOfChunks;
+    Context->ChunkData = ChunkData;
+    Context->ChunkSizes = ChunkSizes;
+    Context->NextChunk = 0;
+    Context->FinishedChunks = 0;
+    Context->Status = STATUS_SUCCESS;
+    Context->DoneEvent = NULL;
+
+    /* the calling thread is a worker too */
+    Workers = min(NtCurrentPeb()->NumberOfProcessors, RTLP_PARALLEL_MAX_WORKERS) - 1;
+    Workers = min(Workers, NumberOfChunks / RTLP_PARALLEL_MIN_CHUNKS);
+
+    if (Workers > 0)
+    {
+        Status = NtCreateEvent(&Context->DoneEvent,
+                               EVENT_ALL_ACCESS,
+                               NULL,
+                               NotificationEvent,
+                               FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            /* decompress everything in the calling thread */
+            Context->DoneEvent = NULL;
+            Workers = 0;
+        }
+    }
+
+    for (i = 0; i < Workers; i++)
+    {
+        InterlockedIncrement(&Context->ReferenceCount);
+        Status = RtlQueueWorkItem(RtlpDecompressChunksWorker, Context, WT_EXECUTEDEFAULT);
+        if (!NT_SUCCESS(Status))
+        {
+            /* the threads that did start share the work with the caller */
+            InterlockedDecrement(&Context->ReferenceCount);
+            break;
+        }
+    }
+
+    RtlpDecompressChunksLoop(Context);
+
+    /* every chunk is claimed now, wait for the ones still in progress */
+    if ((ULONG)InterlockedCompareExchange(&Context->FinishedChunks, 0, 0) != NumberOfChunks)
+        NtWaitForSingleObject(Context->DoneEvent, FALSE, NULL);
+
+    Status = Context->Status;
+    RtlpDereferenceDecompressContext(Context);
+
+    return Status;
+}
+
+/* EOF */
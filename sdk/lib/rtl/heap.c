@@ -70,6 +70,15 @@ RtlpFindLeastSetBit(ULONG Bits)
 /* Maximum size of a tail-filling pattern used for compare operation */
 UCHAR FillPattern[HEAP_ENTRY_SIZE] =
 {
+    HEAP_TAIL_FILL,
+    HEAP_TAIL_FILL,
+    HEAP_TAIL_FILL,
+    HEAP_TAIL_FILL,
+    HEAP_TAIL_FILL,
+    HEAP_TAIL_FILL,
+    HEAP_TAIL_FILL,
+    HEAP_TAIL_FILL,
+#ifdef _WIN64
     HEAP_TAIL_FILL,
     HEAP_TAIL_FILL,
     HEAP_TAIL_FILL,
@@ -78,6 +87,7 @@ UCHAR FillPattern[HEAP_ENTRY_SIZE] =
     HEAP_TAIL_FILL,
     HEAP_TAIL_FILL,
     HEAP_TAIL_FILL
+#endif
 };
 
 /* FUNCTIONS *****************************************************************/
@@ -1584,6 +1594,9 @@ RtlDestroyHeap(HANDLE HeapPtr) /* [in] Handle of heap */
         RtlpRemoveHeapFromProcessList(Heap);
     }
 
+    /* Tear down the front end heap */
+    RtlpDestroyLowFragHeap(Heap);
+
     /* Delete the heap lock */
     if (!(Heap->Flags & HEAP_NO_SERIALIZE))
     {
@@ -1928,6 +1941,7 @@ RtlAllocateHeap(IN PVOID HeapPtr,
     BOOLEAN HeapLocked = FALSE;
     PHEAP_VIRTUAL_ALLOC_ENTRY VirtualBlock = NULL;
     PHEAP_ENTRY_EXTRA Extra;
+    PVOID FrontEndBlock;
     NTSTATUS Status;
 
     /* Force flags */
@@ -1977,6 +1991,15 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Let the front end heap serve small blocks without the heap lock */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH &&
+        Index <= HEAP_LFH_MAX_INDEX &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT))
+    {
+        FrontEndBlock = RtlpLowFragHeapAlloc(Heap, Flags, Size, Index);
+        if (FrontEndBlock) return FrontEndBlock;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2180,6 +2203,13 @@ BOOLEAN NTAPI RtlFreeHeap(
     if (RtlpHeapIsSpecial(Flags))
         return RtlDebugFreeHeap(Heap, Flags, Ptr);
 
+    /* Get pointer to the heap entry */
+    HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+
+    /* Front end blocks go back without the heap lock */
+    if (RtlpIsLowFragHeapEntry(Heap, HeapEntry))
+        return RtlpLowFragHeapFree(Heap, Flags, HeapEntry);
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2187,9 +2217,6 @@ BOOLEAN NTAPI RtlFreeHeap(
         Locked = TRUE;
     }
 
-    /* Get pointer to the heap entry */
-    HeapEntry = (PHEAP_ENTRY)Ptr - 1;
-
     /* Check this entry, fail if it's invalid */
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
         (((ULONG_PTR)Ptr & 0x7) != 0) ||
@@ -2590,6 +2617,10 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         return NULL;
     }
 
+    /* Front end blocks are resized by the front end */
+    if (RtlpIsLowFragHeapEntry(Heap, (PHEAP_ENTRY)Ptr - 1))
+        return RtlpLowFragHeapReAlloc(Heap, Flags, Ptr, Size);
+
     /* Calculate allocation size and index */
     if (Size)
         AllocationSize = Size;
@@ -3086,11 +3117,15 @@ RtlSizeHeap(
         return (SIZE_T)-1;
     }
 
-    /* Get size of this block depending if it's a usual or a big one */
+    /* Get size of this block depending if it's a usual, a big or a front end one */
     if (HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC)
     {
         EntrySize = RtlpGetSizeOfBigBlock(HeapEntry);
     }
+    else if (RtlpIsLowFragHeapEntry(Heap, HeapEntry))
+    {
+        EntrySize = RtlpLowFragHeapSize(HeapEntry);
+    }
     else
     {
         /* Calculate it */
@@ -3154,6 +3189,10 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Front end blocks live inside a busy backend block */
+    if (RtlpIsLowFragHeapEntry(Heap, HeapEntry))
+        return RtlpValidateLowFragHeapEntry(HeapEntry);
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
@@ -3918,13 +3957,13 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LFH || !HeapHandle)
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+        /* Put the low fragmentation heap in front of the backend */
+        return RtlpCreateLowFragHeap((PHEAP)HeapHandle);
     }
 
     return STATUS_SUCCESS;
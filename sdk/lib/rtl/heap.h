@@ -55,6 +55,27 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Front end heap types, as reported through HeapCompatibilityInformation */
+#define HEAP_FRONT_END_NONE    0
+#define HEAP_FRONT_END_LFH     2
+
+/* Low fragmentation heap definitions */
+#define HEAP_LFH_BUCKETS       80
+#define HEAP_LFH_SLOTS         16
+#define HEAP_LFH_MAX_BLOCK_SIZE 0x4000
+#define HEAP_LFH_MAX_INDEX     (HEAP_LFH_MAX_BLOCK_SIZE >> HEAP_ENTRY_SHIFT)
+#define HEAP_LFH_USER_BLOCK_SIZE 0x8000
+
+/* LFHFlags value of blocks owned by the low fragmentation heap */
+#define HEAP_LFH_BLOCK         0xFF
+
+#define HEAP_SUBSEGMENT_SIGNATURE 0x4C464853 /* 'SHFL' */
+
+/* Subsegment states */
+#define HEAP_SUBSEGMENT_ACTIVE   0 /* Owned by an affinity slot or the allocating thread */
+#define HEAP_SUBSEGMENT_DETACHED 1 /* Ran out of blocks, owned by nobody */
+#define HEAP_SUBSEGMENT_LISTED   2 /* On the bucket's partial list */
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -327,6 +348,47 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+typedef union _INTERLOCK_SEQ
+{
+    struct
+    {
+        ULONG FreeEntryOffset:16; /* First free block, in heap entries from the subsegment */
+        ULONG Depth:14;           /* Number of free blocks */
+        ULONG State:2;            /* HEAP_SUBSEGMENT_* */
+    };
+    LONG Exchg;
+} INTERLOCK_SEQ, *PINTERLOCK_SEQ;
+
+typedef struct _HEAP_SUBSEGMENT
+{
+    volatile INTERLOCK_SEQ AggregateExchg;
+    ULONG Signature;
+    struct _LFH_HEAP *LowFragHeap;
+    USHORT BlockUnits;
+    USHORT BlockCount;
+    USHORT BucketIndex;
+    USHORT Reserved;
+    LIST_ENTRY ListEntry; /* Flink is NULL while not on the partial list */
+} HEAP_SUBSEGMENT, *PHEAP_SUBSEGMENT;
+
+typedef struct _HEAP_BUCKET
+{
+    PHEAP_SUBSEGMENT volatile ActiveSubSegments[HEAP_LFH_SLOTS];
+    LIST_ENTRY PartialList;
+    USHORT BlockUnits;
+    USHORT BlockCount;
+} HEAP_BUCKET, *PHEAP_BUCKET;
+
+typedef struct _LFH_HEAP
+{
+    PHEAP Heap;
+    PHEAP_LOCK LockVariable;
+    HEAP_LOCK Lock;
+    ULONG SlotCount;
+    volatile LONG NextAffinity;
+    HEAP_BUCKET Buckets[HEAP_LFH_BUCKETS];
+} LFH_HEAP, *PLFH_HEAP;
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -352,6 +414,43 @@ RtlpValidateHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry);
 BOOLEAN NTAPI
 RtlpValidateHeapHeaders(PHEAP Heap, BOOLEAN Recalculate);
 
+/* heaplfh.c */
+FORCEINLINE BOOLEAN
+RtlpIsLowFragHeapEntry(PHEAP Heap, PHEAP_ENTRY HeapEntry)
+{
+    return Heap->FrontEndHeapType == HEAP_FRONT_END_LFH &&
+           HeapEntry->LFHFlags == HEAP_LFH_BLOCK;
+}
+
+NTSTATUS NTAPI
+RtlpCreateLowFragHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpDestroyLowFragHeap(PHEAP Heap);
+
+PVOID NTAPI
+RtlpLowFragHeapAlloc(PHEAP Heap,
+                     ULONG Flags,
+                     SIZE_T Size,
+                     SIZE_T Index);
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    ULONG Flags,
+                    PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLowFragHeapReAlloc(PHEAP Heap,
+                       ULONG Flags,
+                       PVOID Ptr,
+                       SIZE_T Size);
+
+SIZE_T NTAPI
+RtlpLowFragHeapSize(PHEAP_ENTRY HeapEntry);
+
+BOOLEAN NTAPI
+RtlpValidateLowFragHeapEntry(PHEAP_ENTRY HeapEntry);
+
 /* heapdbg.c */
 HANDLE NTAPI
 RtlDebugCreateHeap(ULONG Flags,
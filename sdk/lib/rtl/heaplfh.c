@@ -0,0 +1,546 @@
+/*
+ * PROJECT:     ReactOS system libraries
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     RTL Low Fragmentation Heap front end
+ */
+
+/* Small blocks are grouped in size buckets. Each bucket owns subsegments,
+   user blocks carved from the backend heap and split into blocks of the
+   bucket size. Every bucket has a handful of affinity slots holding the
+   subsegment a group of threads allocates from, threads pick their slot
+   through TEB::HeapVirtualAffinity and move to another one on contention.
+
+   A thread claims a slot by exchanging it with HEAP_LFH_SLOT_BUSY, so only
+   one thread pops blocks from a given subsegment at a time, while frees push
+   blocks back from any thread. Both sides update the subsegment free list
+   with a single compare-exchange on INTERLOCK_SEQ, which also carries the
+   subsegment state. The front end lock only protects the partial lists and
+   is never held while calling into the backend. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define HEAP_LFH_SLOT_BUSY ((PHEAP_SUBSEGMENT)1)
+#define HEAP_LFH_CLAIM_ATTEMPTS 4
+
+#define HEAP_SUBSEGMENT_HEADER_UNITS \
+    (ROUND_UP(sizeof(HEAP_SUBSEGMENT), sizeof(HEAP_ENTRY)) >> HEAP_ENTRY_SHIFT)
+
+/* FUNCTIONS *****************************************************************/
+
+/* Exact buckets up to 32 heap entries, then eight buckets per power of two */
+static ULONG
+RtlpLfhBucketIndex(SIZE_T Index)
+{
+    ULONG Shift;
+
+    if (Index <= 32) return (ULONG)Index - 1;
+
+    for (Shift = 2; ((Index - 1) >> Shift) >= 16; Shift++);
+
+    return 32 + (Shift - 2) * 8 + (ULONG)((Index - 1) >> Shift) - 8;
+}
+
+static USHORT
+RtlpLfhBucketUnits(ULONG BucketIndex)
+{
+    if (BucketIndex < 32) return (USHORT)(BucketIndex + 1);
+
+    BucketIndex -= 32;
+    return (USHORT)((9 + (BucketIndex % 8)) << (2 + BucketIndex / 8));
+}
+
+static ULONG
+RtlpLfhGetSlot(PLFH_HEAP LowFragHeap,
+               BOOLEAN Reassign)
+{
+    PTEB Teb = NtCurrentTeb();
+    ULONG Affinity = Teb->HeapVirtualAffinity;
+
+    /* Spread new threads over the slots, and move a thread off a contended one */
+    if (!Affinity || Reassign)
+    {
+        Affinity = (ULONG)InterlockedIncrement(&LowFragHeap->NextAffinity) % HEAP_LFH_SLOTS + 1;
+        Teb->HeapVirtualAffinity = (USHORT)Affinity;
+    }
+
+    return (Affinity - 1) % LowFragHeap->SlotCount;
+}
+
+static PHEAP_SUBSEGMENT
+RtlpLfhGetBlockSubSegment(PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_SUBSEGMENT SubSegment;
+    ULONG Offset;
+
+    if (((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) ||
+        !(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
+        HeapEntry->LFHFlags != HEAP_LFH_BLOCK ||
+        HeapEntry->Size < HEAP_SUBSEGMENT_HEADER_UNITS)
+    {
+        return NULL;
+    }
+
+    /* Busy blocks keep the distance to their subsegment in Size */
+    SubSegment = (PHEAP_SUBSEGMENT)(HeapEntry - HeapEntry->Size);
+    if (SubSegment->Signature != HEAP_SUBSEGMENT_SIGNATURE) return NULL;
+
+    Offset = HeapEntry->Size - HEAP_SUBSEGMENT_HEADER_UNITS;
+    if ((Offset % SubSegment->BlockUnits) ||
+        (Offset / SubSegment->BlockUnits) >= SubSegment->BlockCount)
+    {
+        return NULL;
+    }
+
+    return SubSegment;
+}
+
+/* Only called by the thread owning the subsegment */
+static PHEAP_ENTRY
+RtlpLfhPopBlock(PHEAP_SUBSEGMENT SubSegment)
+{
+    INTERLOCK_SEQ Old, New;
+    PHEAP_ENTRY HeapEntry;
+
+    for (;;)
+    {
+        Old.Exchg = SubSegment->AggregateExchg.Exchg;
+        New.Exchg = Old.Exchg;
+
+        if (!Old.Depth)
+        {
+            /* Exhausted, the next free puts it back on the partial list */
+            New.State = HEAP_SUBSEGMENT_DETACHED;
+            HeapEntry = NULL;
+        }
+        else
+        {
+            /* Free blocks link to each other through UnusedBytesLength */
+            HeapEntry = (PHEAP_ENTRY)SubSegment + Old.FreeEntryOffset;
+            New.FreeEntryOffset = HeapEntry->UnusedBytesLength;
+            New.Depth = Old.Depth - 1;
+        }
+
+        if (InterlockedCompareExchange(&SubSegment->AggregateExchg.Exchg,
+                                       New.Exchg,
+                                       Old.Exchg) == Old.Exchg)
+        {
+            return HeapEntry;
+        }
+    }
+}
+
+/* Hands a subsegment the caller owns to the partial list */
+static VOID
+RtlpLfhListSubSegment(PLFH_HEAP LowFragHeap,
+                      PHEAP_SUBSEGMENT SubSegment)
+{
+    PHEAP_BUCKET Bucket = &LowFragHeap->Buckets[SubSegment->BucketIndex];
+    INTERLOCK_SEQ Old, New;
+
+    RtlEnterHeapLock(LowFragHeap->LockVariable, TRUE);
+
+    do
+    {
+        Old.Exchg = SubSegment->AggregateExchg.Exchg;
+        New.Exchg = Old.Exchg;
+        New.State = Old.Depth ? HEAP_SUBSEGMENT_LISTED : HEAP_SUBSEGMENT_DETACHED;
+    } while (InterlockedCompareExchange(&SubSegment->AggregateExchg.Exchg,
+                                        New.Exchg,
+                                        Old.Exchg) != Old.Exchg);
+
+    if (New.State == HEAP_SUBSEGMENT_LISTED)
+        InsertTailList(&Bucket->PartialList, &SubSegment->ListEntry);
+
+    RtlLeaveHeapLock(LowFragHeap->LockVariable);
+}
+
+static PHEAP_SUBSEGMENT
+RtlpLfhGetSubSegment(PLFH_HEAP LowFragHeap,
+                     ULONG BucketIndex)
+{
+    PHEAP_BUCKET Bucket = &LowFragHeap->Buckets[BucketIndex];
+    PHEAP_SUBSEGMENT SubSegment = NULL;
+    PHEAP_ENTRY HeapEntry;
+    INTERLOCK_SEQ Old, New;
+    PLIST_ENTRY ListEntry;
+    ULONG Offset;
+    LONG i;
+
+    /* Reuse a partially free subsegment first */
+    RtlEnterHeapLock(LowFragHeap->LockVariable, TRUE);
+
+    if (!IsListEmpty(&Bucket->PartialList))
+    {
+        ListEntry = RemoveHeadList(&Bucket->PartialList);
+        SubSegment = CONTAINING_RECORD(ListEntry, HEAP_SUBSEGMENT, ListEntry);
+        SubSegment->ListEntry.Flink = NULL;
+
+        /* Frees may still be pushing blocks into it */
+        do
+        {
+            Old.Exchg = SubSegment->AggregateExchg.Exchg;
+            New.Exchg = Old.Exchg;
+            New.State = HEAP_SUBSEGMENT_ACTIVE;
+        } while (InterlockedCompareExchange(&SubSegment->AggregateExchg.Exchg,
+                                            New.Exchg,
+                                            Old.Exchg) != Old.Exchg);
+    }
+
+    RtlLeaveHeapLock(LowFragHeap->LockVariable);
+
+    if (SubSegment) return SubSegment;
+
+    /* Carve a new one from the backend, which takes the heap lock itself */
+    SubSegment = RtlAllocateHeap(LowFragHeap->Heap,
+                                 0,
+                                 (HEAP_SUBSEGMENT_HEADER_UNITS +
+                                  Bucket->BlockCount * Bucket->BlockUnits) << HEAP_ENTRY_SHIFT);
+    if (!SubSegment) return NULL;
+
+    SubSegment->Signature = HEAP_SUBSEGMENT_SIGNATURE;
+    SubSegment->LowFragHeap = LowFragHeap;
+    SubSegment->BlockUnits = Bucket->BlockUnits;
+    SubSegment->BlockCount = Bucket->BlockCount;
+    SubSegment->BucketIndex = (USHORT)BucketIndex;
+    SubSegment->Reserved = 0;
+    SubSegment->ListEntry.Flink = NULL;
+    SubSegment->ListEntry.Blink = NULL;
+
+    /* Thread all blocks on the free list, lowest address first */
+    Offset = 0;
+    for (i = Bucket->BlockCount - 1; i >= 0; i--)
+    {
+        HeapEntry = (PHEAP_ENTRY)SubSegment + HEAP_SUBSEGMENT_HEADER_UNITS + i * Bucket->BlockUnits;
+        HeapEntry->Size = (USHORT)(HeapEntry - (PHEAP_ENTRY)SubSegment);
+        HeapEntry->Flags = 0;
+        HeapEntry->SmallTagIndex = 0;
+        HeapEntry->UnusedBytesLength = (USHORT)Offset;
+        HeapEntry->LFHFlags = HEAP_LFH_BLOCK;
+        HeapEntry->UnusedBytes = 0;
+        Offset = HeapEntry->Size;
+    }
+
+    New.Exchg = 0;
+    New.FreeEntryOffset = Offset;
+    New.Depth = Bucket->BlockCount;
+    New.State = HEAP_SUBSEGMENT_ACTIVE;
+    SubSegment->AggregateExchg.Exchg = New.Exchg;
+
+    return SubSegment;
+}
+
+NTSTATUS NTAPI
+RtlpCreateLowFragHeap(PHEAP Heap)
+{
+    PLFH_HEAP LowFragHeap;
+    PHEAP_BUCKET Bucket;
+    ULONG BlockCount;
+    ULONG i;
+    NTSTATUS Status;
+
+    /* The front end relies on TEB affinity and is never used by debug heaps */
+    if (RtlpGetMode() != UserMode ||
+        (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+        Heap->Signature != HEAP_SIGNATURE ||
+        RtlpHeapIsSpecial(Heap->Flags) ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED)) ||
+        ((Heap->Flags & HEAP_CREATE_ALIGN_16) && sizeof(HEAP_ENTRY) < 16))
+    {
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+
+    /* Nothing to do if someone was faster */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH)
+    {
+        RtlLeaveHeapLock(Heap->LockVariable);
+        return STATUS_SUCCESS;
+    }
+
+    LowFragHeap = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, sizeof(LFH_HEAP));
+    if (!LowFragHeap)
+    {
+        RtlLeaveHeapLock(Heap->LockVariable);
+        return STATUS_NO_MEMORY;
+    }
+
+    LowFragHeap->Heap = Heap;
+    LowFragHeap->LockVariable = &LowFragHeap->Lock;
+    Status = RtlInitializeHeapLock(&LowFragHeap->LockVariable);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(Heap, 0, LowFragHeap);
+        RtlLeaveHeapLock(Heap->LockVariable);
+        return Status;
+    }
+
+    /* Two slots per processor keep collisions rare */
+    LowFragHeap->SlotCount = min(max(NtCurrentPeb()->NumberOfProcessors * 2, 1), HEAP_LFH_SLOTS);
+
+    ASSERT(RtlpLfhBucketIndex(HEAP_LFH_MAX_INDEX) < HEAP_LFH_BUCKETS);
+    for (i = 0; i < HEAP_LFH_BUCKETS; i++)
+    {
+        Bucket = &LowFragHeap->Buckets[i];
+        Bucket->BlockUnits = RtlpLfhBucketUnits(i);
+
+        /* User blocks stay above the front end limit so they come from the backend */
+        BlockCount = ((HEAP_LFH_USER_BLOCK_SIZE >> HEAP_ENTRY_SHIFT) - HEAP_SUBSEGMENT_HEADER_UNITS) / Bucket->BlockUnits;
+        Bucket->BlockCount = (USHORT)min(max(BlockCount, 4), 0x3FFF);
+
+        InitializeListHead(&Bucket->PartialList);
+    }
+
+    /* Publish the front end before switching the heap over to it */
+    InterlockedExchangePointer(&Heap->FrontEndHeap, LowFragHeap);
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LFH;
+
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    DPRINT("Enabled LFH on heap %p, %lu slots\n", Heap, LowFragHeap->SlotCount);
+
+    return STATUS_SUCCESS;
+}
+
+VOID NTAPI
+RtlpDestroyLowFragHeap(PHEAP Heap)
+{
+    PLFH_HEAP LowFragHeap = (PLFH_HEAP)Heap->FrontEndHeap;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_END_LFH) return;
+
+    /* Subsegments live in heap segments and go away with them */
+    RtlDeleteHeapLock(LowFragHeap->LockVariable);
+
+    Heap->FrontEndHeapType = HEAP_FRONT_END_NONE;
+    Heap->FrontEndHeap = NULL;
+}
+
+PVOID NTAPI
+RtlpLowFragHeapAlloc(PHEAP Heap,
+                     ULONG Flags,
+                     SIZE_T Size,
+                     SIZE_T Index)
+{
+    PLFH_HEAP LowFragHeap = (PLFH_HEAP)Heap->FrontEndHeap;
+    PHEAP_SUBSEGMENT volatile *Slot;
+    PHEAP_SUBSEGMENT SubSegment;
+    PHEAP_ENTRY HeapEntry = NULL;
+    ULONG BucketIndex;
+    ULONG Attempt;
+
+    BucketIndex = RtlpLfhBucketIndex(Index);
+
+    /* Claim our affinity slot */
+    for (Attempt = 0; Attempt < HEAP_LFH_CLAIM_ATTEMPTS; Attempt++)
+    {
+        Slot = &LowFragHeap->Buckets[BucketIndex].ActiveSubSegments[RtlpLfhGetSlot(LowFragHeap, Attempt != 0)];
+        SubSegment = InterlockedExchangePointer((PVOID volatile *)Slot, HEAP_LFH_SLOT_BUSY);
+        if (SubSegment != HEAP_LFH_SLOT_BUSY) break;
+    }
+
+    /* Heavily contended, let the backend serve this one */
+    if (Attempt == HEAP_LFH_CLAIM_ATTEMPTS) return NULL;
+
+    if (SubSegment) HeapEntry = RtlpLfhPopBlock(SubSegment);
+
+    if (HeapEntry)
+    {
+        InterlockedExchangePointer((PVOID volatile *)Slot, SubSegment);
+    }
+    else
+    {
+        /* Drop the exhausted subsegment and get another one with the slot released,
+           the backend may raise an exception */
+        InterlockedExchangePointer((PVOID volatile *)Slot, NULL);
+
+        SubSegment = RtlpLfhGetSubSegment(LowFragHeap, BucketIndex);
+        if (!SubSegment) return NULL;
+
+        /* Nobody else can pop from it yet */
+        HeapEntry = RtlpLfhPopBlock(SubSegment);
+        ASSERT(HeapEntry != NULL);
+
+        /* Install it, unless another thread refilled the slot meanwhile */
+        if (InterlockedCompareExchangePointer((PVOID volatile *)Slot, SubSegment, NULL) != NULL)
+            RtlpLfhListSubSegment(LowFragHeap, SubSegment);
+    }
+
+    HeapEntry->Flags = HEAP_ENTRY_BUSY | (UCHAR)((Flags & HEAP_SETTABLE_USER_FLAGS) >> 4);
+    HeapEntry->UnusedBytesLength = (USHORT)((SubSegment->BlockUnits << HEAP_ENTRY_SHIFT) - Size);
+
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(HeapEntry + 1, Size);
+
+    return HeapEntry + 1;
+}
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    ULONG Flags,
+                    PHEAP_ENTRY HeapEntry)
+{
+    PLFH_HEAP LowFragHeap;
+    PHEAP_SUBSEGMENT SubSegment;
+    PHEAP_BUCKET Bucket;
+    INTERLOCK_SEQ Old, New;
+    BOOLEAN Release = FALSE;
+
+    SubSegment = RtlpLfhGetBlockSubSegment(HeapEntry);
+    if (!SubSegment)
+    {
+        DPRINT1("HEAP: Trying to free an invalid address %p!\n", HeapEntry + 1);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    LowFragHeap = SubSegment->LowFragHeap;
+    Bucket = &LowFragHeap->Buckets[SubSegment->BucketIndex];
+
+    /* Once pushed, the block may be handed out again at any time */
+    HeapEntry->Flags = 0;
+
+    do
+    {
+        Old.Exchg = SubSegment->AggregateExchg.Exchg;
+        New.Exchg = Old.Exchg;
+        HeapEntry->UnusedBytesLength = (USHORT)Old.FreeEntryOffset;
+        New.FreeEntryOffset = HeapEntry->Size;
+        New.Depth = Old.Depth + 1;
+        if (Old.State == HEAP_SUBSEGMENT_DETACHED)
+            New.State = HEAP_SUBSEGMENT_LISTED;
+    } while (InterlockedCompareExchange(&SubSegment->AggregateExchg.Exchg,
+                                        New.Exchg,
+                                        Old.Exchg) != Old.Exchg);
+
+    if (Old.State == HEAP_SUBSEGMENT_DETACHED)
+    {
+        /* First block back in an exhausted subsegment, make it available again */
+        RtlEnterHeapLock(LowFragHeap->LockVariable, TRUE);
+        InsertTailList(&Bucket->PartialList, &SubSegment->ListEntry);
+        RtlLeaveHeapLock(LowFragHeap->LockVariable);
+    }
+    else if (Old.State == HEAP_SUBSEGMENT_LISTED &&
+             New.Depth == SubSegment->BlockCount)
+    {
+        /* Nobody allocates from it and all blocks are back, return it to the backend.
+           Skip it if the thread relisting it has not linked it in yet */
+        RtlEnterHeapLock(LowFragHeap->LockVariable, TRUE);
+
+        Old.Exchg = SubSegment->AggregateExchg.Exchg;
+        if (SubSegment->ListEntry.Flink &&
+            Old.State == HEAP_SUBSEGMENT_LISTED &&
+            Old.Depth == SubSegment->BlockCount)
+        {
+            RemoveEntryList(&SubSegment->ListEntry);
+            SubSegment->ListEntry.Flink = NULL;
+            SubSegment->Signature = 0;
+            Release = TRUE;
+        }
+
+        RtlLeaveHeapLock(LowFragHeap->LockVariable);
+
+        if (Release) RtlFreeHeap(LowFragHeap->Heap, 0, SubSegment);
+    }
+
+    return TRUE;
+}
+
+PVOID NTAPI
+RtlpLowFragHeapReAlloc(PHEAP Heap,
+                       ULONG Flags,
+                       PVOID Ptr,
+                       SIZE_T Size)
+{
+    PHEAP_ENTRY HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+    PHEAP_SUBSEGMENT SubSegment;
+    EXCEPTION_RECORD ExceptionRecord;
+    SIZE_T BlockSize, OldSize;
+    PVOID NewBaseAddress;
+
+    SubSegment = RtlpLfhGetBlockSubSegment(HeapEntry);
+    if (!SubSegment)
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    BlockSize = SubSegment->BlockUnits << HEAP_ENTRY_SHIFT;
+    OldSize = BlockSize - HeapEntry->UnusedBytesLength;
+
+    /* Resize in place while it fits and does not waste most of the block */
+    if (Size + sizeof(HEAP_ENTRY) <= BlockSize &&
+        ((Flags & HEAP_REALLOC_IN_PLACE_ONLY) || Size + sizeof(HEAP_ENTRY) > BlockSize / 2))
+    {
+        if (Size > OldSize && (Flags & HEAP_ZERO_MEMORY))
+            RtlZeroMemory((PCHAR)Ptr + OldSize, Size - OldSize);
+
+        HeapEntry->UnusedBytesLength = (USHORT)(BlockSize - Size);
+        return Ptr;
+    }
+
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        DPRINT1("Realloc in place failed, but it was the only option\n");
+
+        if (Flags & HEAP_GENERATE_EXCEPTIONS)
+        {
+            ExceptionRecord.ExceptionCode = STATUS_NO_MEMORY;
+            ExceptionRecord.ExceptionRecord = NULL;
+            ExceptionRecord.NumberParameters = 1;
+            ExceptionRecord.ExceptionFlags = 0;
+            ExceptionRecord.ExceptionInformation[0] = Size;
+
+            RtlRaiseException(&ExceptionRecord);
+        }
+
+        return NULL;
+    }
+
+    /* Move it to a block of the right size, front end or backend */
+    NewBaseAddress = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+    if (!NewBaseAddress) return NULL;
+
+    RtlMoveMemory(NewBaseAddress, Ptr, min(Size, OldSize));
+
+    if (Size > OldSize && (Flags & HEAP_ZERO_MEMORY))
+        RtlZeroMemory((PCHAR)NewBaseAddress + OldSize, Size - OldSize);
+
+    RtlpLowFragHeapFree(Heap, Flags, HeapEntry);
+
+    return NewBaseAddress;
+}
+
+SIZE_T NTAPI
+RtlpLowFragHeapSize(PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_SUBSEGMENT SubSegment;
+
+    SubSegment = RtlpLfhGetBlockSubSegment(HeapEntry);
+    if (!SubSegment)
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return (SIZE_T)-1;
+    }
+
+    return (SubSegment->BlockUnits << HEAP_ENTRY_SHIFT) - HeapEntry->UnusedBytesLength;
+}
+
+BOOLEAN NTAPI
+RtlpValidateLowFragHeapEntry(PHEAP_ENTRY HeapEntry)
+{
+    if (RtlpLfhGetBlockSubSegment(HeapEntry)) return TRUE;
+
+    DPRINT1("HEAP: Invalid LFH entry %p\n", HeapEntry);
+    return FALSE;
+}
+
+/* EOF */
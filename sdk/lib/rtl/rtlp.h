@@ -221,6 +221,28 @@ extern HANDLE TimerThreadHandle;
 NTSTATUS
 RtlpInitializeTimerThread(VOID);
 
+/* compress.c */
+NTSTATUS
+NTAPI
+RtlpDecompressChunk(IN USHORT Format,
+                    OUT PUCHAR UncompressedChunk,
+                    IN ULONG UncompressedChunkSize,
+                    IN PUCHAR CompressedChunk,
+                    IN ULONG CompressedChunkSize);
+
+/* decompchunks.c, only in the user mode RTL. The kernel has a stub in its libsupp.c */
+#define RTLP_PARALLEL_MIN_CHUNKS    16
+
+NTSTATUS
+NTAPI
+RtlpDecompressChunksParallel(IN USHORT Format,
+                             OUT PUCHAR UncompressedBuffer,
+                             IN ULONG UncompressedBufferSize,
+                             IN ULONG ChunkSize,
+                             IN ULONG NumberOfChunks,
+                             IN PUCHAR *ChunkData,
+                             IN PULONG ChunkSizes);
+
 /* bitmap64.c */
 typedef struct _RTL_BITMAP64
 {
@@ -234,6 +256,39 @@ typedef struct _RTL_BITMAP_RUN64
     ULONG64 NumberOfBits;
 } RTL_BITMAP_RUN64, *PRTL_BITMAP_RUN64;
 
+typedef struct _RTL_SUMMARY_BITMAP64
+{
+    RTL_BITMAP64 BitMap;
+    RTL_BITMAP64 Summary;
+} RTL_SUMMARY_BITMAP64, *PRTL_SUMMARY_BITMAP64;
+
+/* Used by the 64-bit summary bitmap functions in bitmapsum64.c */
+VOID
+NTAPI
+RtlInitializeBitMap64(
+    _Out_ PRTL_BITMAP64 BitMapHeader,
+    _In_ PULONG64 BitMapBuffer,
+    _In_ ULONG64 SizeOfBitMap);
+
+VOID
+NTAPI
+RtlClearAllBits64(
+    _In_ PRTL_BITMAP64 BitMapHeader);
+
+VOID
+NTAPI
+RtlClearBits64(
+    _In_ PRTL_BITMAP64 BitMapHeader,
+    _In_ ULONG64 StartingIndex,
+    _In_ ULONG64 NumberToClear);
+
+VOID
+NTAPI
+RtlSetBits64(
+    _In_ PRTL_BITMAP64 BitMapHeader,
+    _In_ ULONG64 StartingIndex,
+    _In_ ULONG64 NumberToSet);
+
 /* nls.c */
 WCHAR
 NTAPI
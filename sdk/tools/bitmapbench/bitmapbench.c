@@ -0,0 +1,649 @@
+/*
+ * PROJECT:     ReactOS bitmap benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Times the RTL bitmap searches on sparse, dense and fragmented
+ *              bitmaps with each of the scan routines the host supports, and
+ *              checks their results against each other. Searches through a
+ *              summary bitmap are timed and checked the same way.
+ */
+
+#include "rtl.h"
+#include <time.h>
+
+#define MIN_SECONDS     0.2
+#define MAX_RUNS        64
+
+typedef struct _KERNEL_INFO
+{
+    const char *Name;
+    PRTLP_SKIP_ULONGS Skip;
+    PRTLP_COUNT_SET_BITS Count;
+    BOOL Available;
+} KERNEL_INFO, *PKERNEL_INFO;
+
+typedef struct _PATTERN_INFO
+{
+    const char *Name;
+    VOID (*Fill)(PULONG Buffer, ULONG Bits);
+} PATTERN_INFO, *PPATTERN_INFO;
+
+typedef struct _BENCH_OP
+{
+    const char *Name;
+    ULONG64 (*Run)(PRTL_BITMAP BitMap, ULONG Hint);
+#ifdef _LP64
+    ULONG64 (*Run64)(PRTL_BITMAP64 BitMap, ULONG Hint);
+#endif
+} BENCH_OP, *PBENCH_OP;
+
+static ULONG Seed = 0x12345678;
+
+/* Summaries of the bitmap being timed */
+static RTL_SUMMARY_BITMAP SummaryBitMap;
+#ifdef _LP64
+static RTL_SUMMARY_BITMAP64 SummaryBitMap64;
+#endif
+
+/* HELPERS ********************************************************************/
+
+static double
+Now(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+static ULONG
+Random(void)
+{
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+static BOOLEAN
+TestBit(PULONG Buffer, ULONG Bit)
+{
+    return (Buffer[Bit / 32] >> (Bit & 31)) & 1;
+}
+
+static VOID
+FillRandom(PULONG Buffer, ULONG Bits, ULONG Spacing, BOOLEAN Set)
+{
+    RTL_BITMAP BitMap;
+    ULONG i;
+
+    RtlInitializeBitMap(&BitMap, Buffer, Bits);
+    if (Set) RtlClearAllBits(&BitMap); else RtlSetAllBits(&BitMap);
+
+    for (i = 0; i < Bits / Spacing; i++)
+    {
+        if (Set)
+            RtlSetBits(&BitMap, Random() % Bits, 1);
+        else
+            RtlClearBits(&BitMap, Random() % Bits, 1);
+    }
+}
+
+/* One bit in a thousand set, like a fresh page file */
+static VOID
+FillSparse(PULONG Buffer, ULONG Bits)
+{
+    FillRandom(Buffer, Bits, 1000, TRUE);
+}
+
+/* One bit in a thousand clear, like system PTEs under load */
+static VOID
+FillDense(PULONG Buffer, ULONG Bits)
+{
+    FillRandom(Buffer, Bits, 1000, FALSE);
+}
+
+/* One bit in 64K clear, like a pool that is nearly used up */
+static VOID
+FillFull(PULONG Buffer, ULONG Bits)
+{
+    FillRandom(Buffer, Bits, 65536, FALSE);
+}
+
+/* Runs of up to 512 bits, like a long used volume */
+static VOID
+FillFragmented(PULONG Buffer, ULONG Bits)
+{
+    RTL_BITMAP BitMap;
+    ULONG Bit = 0, Length;
+
+    RtlInitializeBitMap(&BitMap, Buffer, Bits);
+    RtlClearAllBits(&BitMap);
+
+    while (Bit < Bits)
+    {
+        Length = min(1 + Random() % 512, Bits - Bit);
+        RtlSetBits(&BitMap, Bit, Length);
+        Bit += Length;
+        Bit += min(1 + Random() % 64, Bits - Bit);
+    }
+}
+
+static const PATTERN_INFO Patterns[] =
+{
+    { "sparse",     FillSparse },
+    { "dense",      FillDense },
+    { "full",       FillFull },
+    { "fragmented", FillFragmented },
+};
+
+/* OPERATIONS *****************************************************************/
+
+static ULONG64
+OpCount(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    return RtlNumberOfSetBits(BitMap);
+}
+
+static ULONG64
+OpFindClear1(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    return RtlFindClearBits(BitMap, 1, Hint);
+}
+
+static ULONG64
+OpFindClear64(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    return RtlFindClearBits(BitMap, 64, Hint);
+}
+
+static ULONG64
+OpFindSet64(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    return RtlFindSetBits(BitMap, 64, Hint);
+}
+
+static ULONG64
+OpSummaryFindClear1(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    return RtlSummaryFindClearBits(&SummaryBitMap, 1, Hint);
+}
+
+static ULONG64
+OpSummaryFindClear64(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    return RtlSummaryFindClearBits(&SummaryBitMap, 64, Hint);
+}
+
+static ULONG64
+OpLongestClear(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    ULONG Start = 0, Length;
+
+    Length = RtlFindLongestRunClear(BitMap, &Start);
+    return ((ULONG64)Start << 32) | Length;
+}
+
+static ULONG64
+OpClearRuns(PRTL_BITMAP BitMap, ULONG Hint)
+{
+    RTL_BITMAP_RUN Runs[MAX_RUNS];
+    ULONG64 Result = 0;
+    ULONG Count, i;
+
+    Count = RtlFindClearRuns(BitMap, Runs, MAX_RUNS, TRUE);
+    for (i = 0; i < Count; i++)
+        Result += ((ULONG64)Runs[i].StartingIndex << 20) ^ Runs[i].NumberOfBits;
+
+    return Result + Count;
+}
+
+#ifdef _LP64
+static ULONG64
+OpCount64(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    return RtlNumberOfSetBits64(BitMap);
+}
+
+static ULONG64
+OpFindClear164(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    return (ULONG)RtlFindClearBits64(BitMap, 1, Hint);
+}
+
+static ULONG64
+OpFindClear6464(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    return (ULONG)RtlFindClearBits64(BitMap, 64, Hint);
+}
+
+static ULONG64
+OpFindSet6464(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    return (ULONG)RtlFindSetBits64(BitMap, 64, Hint);
+}
+
+static ULONG64
+OpSummaryFindClear164(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    return (ULONG)RtlSummaryFindClearBits64(&SummaryBitMap64, 1, Hint);
+}
+
+static ULONG64
+OpSummaryFindClear6464(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    return (ULONG)RtlSummaryFindClearBits64(&SummaryBitMap64, 64, Hint);
+}
+
+static ULONG64
+OpLongestClear64(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    ULONG64 Start = 0, Length;
+
+    Length = RtlFindLongestRunClear64(BitMap, &Start);
+    return (Start << 32) | Length;
+}
+
+static ULONG64
+OpClearRuns64(PRTL_BITMAP64 BitMap, ULONG Hint)
+{
+    RTL_BITMAP_RUN64 Runs[MAX_RUNS];
+    ULONG64 Result = 0;
+    ULONG Count, i;
+
+    Count = RtlFindClearRuns64(BitMap, Runs, MAX_RUNS, TRUE);
+    for (i = 0; i < Count; i++)
+        Result += (Runs[i].StartingIndex << 20) ^ Runs[i].NumberOfBits;
+
+    return Result + Count;
+}
+
+#define OP(Name, Run) { Name, Run, Run##64 }
+#else
+#define OP(Name, Run) { Name, Run }
+#endif
+
+/* The 64-bit results have to match the 32-bit ones on the same buffer */
+static const BENCH_OP Ops[] =
+{
+    OP("NumberOfSetBits", OpCount),
+    OP("FindClearBits 1", OpFindClear1),
+    OP("FindClearBits 64", OpFindClear64),
+    OP("FindSetBits 64", OpFindSet64),
+    OP("Summary FindClear 1", OpSummaryFindClear1),
+    OP("Summary FindClear 64", OpSummaryFindClear64),
+    OP("FindLongestRunClear", OpLongestClear),
+    OP("FindClearRuns 64", OpClearRuns),
+};
+
+/* CHECKS *********************************************************************/
+
+/* Bit by bit versions of the results that do not depend on search order */
+static BOOL
+CheckResults(PRTL_BITMAP BitMap, const char *Pattern, const char *Kernel)
+{
+    ULONG Bits = BitMap->SizeOfBitMap, SetBits = 0, Longest = 0, LongestStart = 0;
+    ULONG Run = 0, Hint, Result, Start, Length, i;
+    BOOL Success = TRUE;
+
+    for (i = 0; i < Bits; i++)
+    {
+        if (TestBit(BitMap->Buffer, i))
+        {
+            SetBits++;
+            Run = 0;
+        }
+        else if (++Run > Longest)
+        {
+            Longest = Run;
+            LongestStart = i + 1 - Run;
+        }
+    }
+
+    if (RtlNumberOfSetBits(BitMap) != SetBits)
+    {
+        printf("%s/%s: NumberOfSetBits is %u instead of %u\n",
+               Pattern, Kernel, RtlNumberOfSetBits(BitMap), SetBits);
+        Success = FALSE;
+    }
+
+    Length = RtlFindLongestRunClear(BitMap, &Start);
+    if (Length != Longest || (Length && Start != LongestStart))
+    {
+        printf("%s/%s: FindLongestRunClear is %u at %u instead of %u at %u\n",
+               Pattern, Kernel, Length, Start, Longest, LongestStart);
+        Success = FALSE;
+    }
+
+    for (i = 0; i < 64; i++)
+    {
+        Hint = Random() % Bits;
+        Length = 1 + Random() % 128;
+        Result = RtlFindClearBits(BitMap, Length, Hint);
+        if (Result == MAXULONG) continue;
+
+        /* The run has to be clear */
+        for (Run = 0; Run < Length && Result + Run < Bits && !TestBit(BitMap->Buffer, Result + Run); Run++);
+        if (Run != Length)
+        {
+            printf("%s/%s: FindClearBits(%u, %u) returned %u, which is not clear\n",
+                   Pattern, Kernel, Length, Hint, Result);
+            Success = FALSE;
+        }
+    }
+
+    return Success;
+}
+
+/* Allocates and frees runs through a plain and two summary bitmaps in step */
+static BOOL
+CheckSummary(ULONG Bits)
+{
+    RTL_BITMAP Plain;
+    RTL_SUMMARY_BITMAP Summary;
+#ifdef _LP64
+    RTL_SUMMARY_BITMAP64 Summary64;
+    PULONG64 Buffer64 = calloc((Bits + 63) / 64, sizeof(ULONG64));
+    PULONG64 SummaryBuffer64 = calloc((Bits + 4095) / 4096, sizeof(ULONG64));
+    ULONG64 Result64;
+#endif
+    PULONG Buffer = calloc((Bits + 63) / 64, sizeof(ULONG64));
+    PULONG SummaryBits = calloc((Bits + 63) / 64, sizeof(ULONG64));
+    PULONG SummaryBuffer = calloc((Bits + 1023) / 1024, sizeof(ULONG));
+    ULONG Starts[256] = { 0 }, Lengths[256] = { 0 };
+    ULONG Result, Length, Hint, Word, Slot, i;
+    BOOL Success = TRUE;
+
+    RtlInitializeBitMap(&Plain, Buffer, Bits);
+    RtlClearAllBits(&Plain);
+    RtlInitializeSummaryBitMap(&Summary, SummaryBits, SummaryBuffer, Bits);
+#ifdef _LP64
+    RtlInitializeSummaryBitMap64(&Summary64, Buffer64, SummaryBuffer64, Bits);
+#endif
+
+    for (i = 0; i < 20000 && Success; i++)
+    {
+        Slot = Random() % 256;
+
+        /* Free what the slot holds, then allocate a new run into it */
+        if (Lengths[Slot])
+        {
+            RtlClearBits(&Plain, Starts[Slot], Lengths[Slot]);
+            RtlSummaryClearBits(&Summary, Starts[Slot], Lengths[Slot]);
+#ifdef _LP64
+            RtlSummaryClearBits64(&Summary64, Starts[Slot], Lengths[Slot]);
+#endif
+            Lengths[Slot] = 0;
+        }
+
+        Length = 1 + Random() % (Bits / 200);
+        Hint = Random() % Bits;
+        Result = RtlFindClearBitsAndSet(&Plain, Length, Hint);
+        if (RtlSummaryFindClearBitsAndSet(&Summary, Length, Hint) != Result)
+        {
+            printf("summary: FindClearBitsAndSet(%u, %u) differs\n", Length, Hint);
+            Success = FALSE;
+        }
+#ifdef _LP64
+        Result64 = RtlSummaryFindClearBitsAndSet64(&Summary64, Length, Hint);
+        if ((ULONG)Result64 != Result)
+        {
+            printf("summary: 64-bit FindClearBitsAndSet(%u, %u) differs\n", Length, Hint);
+            Success = FALSE;
+        }
+#endif
+        if (Result != MAXULONG)
+        {
+            Starts[Slot] = Result;
+            Lengths[Slot] = Length;
+        }
+    }
+
+    /* The bits must match, and the summary must know all full words */
+    if (memcmp(Buffer, SummaryBits, (Bits + 7) / 8))
+    {
+        printf("summary: bitmap differs\n");
+        Success = FALSE;
+    }
+    for (Word = 0; Word < Bits / 32; Word++)
+    {
+        if ((SummaryBits[Word] == MAXULONG) != TestBit(SummaryBuffer, Word))
+        {
+            printf("summary: word %u is out of date\n", Word);
+            Success = FALSE;
+            break;
+        }
+    }
+#ifdef _LP64
+    if (memcmp(Buffer, Buffer64, (Bits + 7) / 8))
+    {
+        printf("summary: 64-bit bitmap differs\n");
+        Success = FALSE;
+    }
+    for (Word = 0; Word < Bits / 64; Word++)
+    {
+        if ((Buffer64[Word] == ~0ULL) != ((SummaryBuffer64[Word / 64] >> (Word & 63)) & 1))
+        {
+            printf("summary: 64-bit word %u is out of date\n", Word);
+            Success = FALSE;
+            break;
+        }
+    }
+    free(Buffer64);
+    free(SummaryBuffer64);
+#endif
+
+    free(SummaryBits);
+    free(SummaryBuffer);
+    free(Buffer);
+    return Success;
+}
+
+/* BENCHMARK ******************************************************************/
+
+static double
+TimeOp(const BENCH_OP *Op, PRTL_BITMAP BitMap, BOOL Wide, PULONG64 Result)
+{
+#ifdef _LP64
+    RTL_BITMAP64 BitMap64;
+#endif
+    ULONG Hints[64], Calls = 0, i;
+    double Start, Elapsed;
+
+    /* The same hints for every routine */
+    Seed = 0x9E3779B9;
+    for (i = 0; i < 64; i++)
+        Hints[i] = Random() % BitMap->SizeOfBitMap;
+
+#ifdef _LP64
+    RtlInitializeBitMap64(&BitMap64, (PULONG64)BitMap->Buffer, BitMap->SizeOfBitMap);
+#endif
+
+    *Result = 0;
+    Start = Now();
+    do
+    {
+        for (i = 0; i < 8; i++, Calls++)
+        {
+#ifdef _LP64
+            if (Wide)
+                *Result += Op->Run64(&BitMap64, Hints[Calls % 64]);
+            else
+#endif
+                *Result += Op->Run(BitMap, Hints[Calls % 64]);
+        }
+        Elapsed = Now() - Start;
+    }
+    while (Elapsed < MIN_SECONDS);
+
+    /* Make the sum independent of the number of calls */
+    *Result = 0;
+    for (i = 0; i < 64; i++)
+    {
+#ifdef _LP64
+        if (Wide)
+            *Result += Op->Run64(&BitMap64, Hints[i]);
+        else
+#endif
+            *Result += Op->Run(BitMap, Hints[i]);
+    }
+
+    return Elapsed * 1e6 / Calls;
+}
+
+static VOID
+Usage(void)
+{
+    printf("Usage: bitmapbench [-b megabits]\n"
+           "\n"
+           "Prints the microseconds per call for each scan routine. Bitmaps have\n"
+           "64 megabits by default.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    KERNEL_INFO Kernels[] =
+    {
+        { "generic", RtlpSkipUlongsGeneric, RtlpCountSetBitsGeneric, TRUE },
+#ifdef _M_AMD64
+        { "sse2", RtlpSkipUlongsSse2, RtlpCountSetBitsPopcnt, FALSE },
+        { "avx2", RtlpSkipUlongsAvx2, RtlpCountSetBitsAvx2, FALSE },
+#endif
+    };
+    const ULONG KernelCount = sizeof(Kernels) / sizeof(Kernels[0]);
+    ULONG64 Results[sizeof(Kernels) / sizeof(Kernels[0])], NarrowResult = 0;
+    ULONG Bits = 64 << 20, Widths = 1, Pattern, OpIndex, Width, k;
+    RTL_BITMAP BitMap;
+    PULONG Buffer, SummaryBuffer;
+#ifdef _LP64
+    PULONG64 SummaryBuffer64;
+#endif
+    double Time;
+    BOOL Success = TRUE;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "-b") && i + 1 < argc)
+        {
+            Bits = strtoul(argv[++i], NULL, 0) << 20;
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (i < argc || !Bits || Bits > (1U << 31))
+    {
+        Usage();
+        return 1;
+    }
+
+#ifdef _M_AMD64
+    /* The dispatcher picks the best routines the processor and the OS allow */
+    RtlpInitializeBitMapRoutines();
+    Kernels[1].Available = TRUE;
+    Kernels[2].Available = (RtlpSkipUlongs == RtlpSkipUlongsAvx2);
+    if (!__builtin_cpu_supports("popcnt"))
+        Kernels[1].Count = RtlpCountSetBitsGeneric;
+#endif
+
+#ifdef _LP64
+    Widths = 2;
+#endif
+
+    /* A few odd bits at the end, and room for the 64-bit functions to read */
+    Bits -= 13;
+    Buffer = calloc((Bits + 63) / 64, sizeof(ULONG64));
+    SummaryBuffer = calloc((Bits + 1023) / 1024, sizeof(ULONG));
+#ifdef _LP64
+    SummaryBuffer64 = calloc((Bits + 4095) / 4096, sizeof(ULONG64));
+    if (!SummaryBuffer64) Buffer = NULL;
+#endif
+    if (!Buffer || !SummaryBuffer)
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+    RtlInitializeBitMap(&BitMap, Buffer, Bits);
+
+    Success &= CheckSummary((1 << 18) - 13);
+
+    printf("%-11s %-22s", "Bitmap", "Function");
+    for (k = 0; k < KernelCount; k++)
+        printf(" %10s", Kernels[k].Available ? Kernels[k].Name : "-");
+    printf("\n");
+
+    for (Pattern = 0; Pattern < sizeof(Patterns) / sizeof(Patterns[0]); Pattern++)
+    {
+        Seed = 0x12345678 + Pattern;
+        Patterns[Pattern].Fill(Buffer, Bits);
+        RtlInitializeSummaryBitMap(&SummaryBitMap, Buffer, SummaryBuffer, Bits);
+#ifdef _LP64
+        RtlInitializeSummaryBitMap64(&SummaryBitMap64, (PULONG64)Buffer, SummaryBuffer64, Bits);
+#endif
+
+        for (k = 0; k < KernelCount; k++)
+        {
+            if (!Kernels[k].Available) continue;
+#ifdef _M_AMD64
+            RtlpSkipUlongs = Kernels[k].Skip;
+            RtlpCountSetBits = Kernels[k].Count;
+#endif
+            Success &= CheckResults(&BitMap, Patterns[Pattern].Name, Kernels[k].Name);
+        }
+
+        for (OpIndex = 0; OpIndex < sizeof(Ops) / sizeof(Ops[0]); OpIndex++)
+        {
+            for (Width = 0; Width < Widths; Width++)
+            {
+                printf("%-11s %-19s %-2s", Patterns[Pattern].Name, Ops[OpIndex].Name, Width ? "64" : "");
+
+                for (k = 0; k < KernelCount; k++)
+                {
+                    if (!Kernels[k].Available)
+                    {
+                        printf(" %10s", "-");
+                        continue;
+                    }
+#ifdef _M_AMD64
+                    RtlpSkipUlongs = Kernels[k].Skip;
+                    RtlpCountSetBits = Kernels[k].Count;
+#endif
+                    Time = TimeOp(&Ops[OpIndex], &BitMap, Width, &Results[k]);
+                    printf(" %10.2f", Time);
+                    fflush(stdout);
+                }
+                printf("\n");
+
+                for (k = 1; k < KernelCount; k++)
+                {
+                    if (Kernels[k].Available && Results[k] != Results[0])
+                    {
+                        printf("%-11s %s: %s differs from %s\n", "", Ops[OpIndex].Name,
+                               Kernels[k].Name, Kernels[0].Name);
+                        Success = FALSE;
+                    }
+                }
+
+                if (Width == 0)
+                {
+                    NarrowResult = Results[0];
+                }
+                else if (Results[0] != NarrowResult)
+                {
+                    printf("%-11s %s: 64-bit result differs\n", "", Ops[OpIndex].Name);
+                    Success = FALSE;
+                }
+            }
+        }
+    }
+
+#ifdef _LP64
+    free(SummaryBuffer64);
+#endif
+    free(SummaryBuffer);
+    free(Buffer);
+    return Success ? 0 : 1;
+}
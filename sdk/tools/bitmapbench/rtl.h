@@ -0,0 +1,148 @@
+/*
+ * PROJECT:     ReactOS bitmap benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Stand-in for the RTL private header when building
+ *              lib/rtl/bitmap.c for the host
+ */
+
+#ifndef _BITMAPBENCH_RTL_H
+#define _BITMAPBENCH_RTL_H
+
+#include <typedefs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The amd64 routines in lib/rtl/amd64/bitmap.S use the Windows calling convention */
+#if defined(__x86_64__) && defined(BITMAPBENCH_ASM)
+#define _M_AMD64
+#undef NTAPI
+#define NTAPI __attribute__((ms_abi))
+#endif
+
+#define _In_
+#define _Out_
+#define _In_opt_
+#define _In_range_(Low, High)
+#define __drv_aliasesMem
+
+#ifndef min
+#define min(a, b)  (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b)  (((a) > (b)) ? (a) : (b))
+#endif
+
+typedef LONG_PTR SSIZE_T;
+typedef uint64_t *PULONG64;
+
+#define KernelMode 0
+#define UserMode 1
+#define RtlpGetMode() UserMode
+
+#define BitScanForward(Index, Mask) \
+    ((Mask) ? (*(Index) = __builtin_ctz(Mask), 1) : 0)
+#define BitScanReverse(Index, Mask) \
+    ((Mask) ? (*(Index) = 31 - __builtin_clz(Mask), 1) : 0)
+#define BitScanForward64(Index, Mask) \
+    ((Mask) ? (*(Index) = __builtin_ctzll(Mask), 1) : 0)
+#define BitScanReverse64(Index, Mask) \
+    ((Mask) ? (*(Index) = 63 - __builtin_clzll(Mask), 1) : 0)
+
+#ifdef _M_AMD64
+static __inline void
+__cpuidex(int CpuInfo[4], int Function, int SubFunction)
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a" (CpuInfo[0]), "=b" (CpuInfo[1]), "=c" (CpuInfo[2]), "=d" (CpuInfo[3])
+                         : "a" (Function), "c" (SubFunction));
+}
+
+#define __cpuid(CpuInfo, Function) __cpuidex(CpuInfo, Function, 0)
+#endif
+
+static __inline VOID
+RtlFillMemoryUlong(PVOID Destination, SIZE_T Length, ULONG Fill)
+{
+    PULONG Dest = Destination;
+    SIZE_T Count = Length / sizeof(ULONG);
+
+    while (Count--) *Dest++ = Fill;
+}
+
+static __inline VOID
+RtlFillMemoryUlonglong(PVOID Destination, SIZE_T Length, ULONGLONG Fill)
+{
+    ULONGLONG *Dest = Destination;
+    SIZE_T Count = Length / sizeof(ULONGLONG);
+
+    while (Count--) *Dest++ = Fill;
+}
+
+typedef struct _RTL_SUMMARY_BITMAP
+{
+    RTL_BITMAP BitMap;
+    RTL_BITMAP Summary;
+} RTL_SUMMARY_BITMAP, *PRTL_SUMMARY_BITMAP;
+
+typedef struct _RTL_BITMAP64
+{
+    ULONG64 SizeOfBitMap;
+    PULONG64 Buffer;
+} RTL_BITMAP64, *PRTL_BITMAP64;
+
+typedef struct _RTL_BITMAP_RUN64
+{
+    ULONG64 StartingIndex;
+    ULONG64 NumberOfBits;
+} RTL_BITMAP_RUN64, *PRTL_BITMAP_RUN64;
+
+typedef struct _RTL_SUMMARY_BITMAP64
+{
+    RTL_BITMAP64 BitMap;
+    RTL_BITMAP64 Summary;
+} RTL_SUMMARY_BITMAP64, *PRTL_SUMMARY_BITMAP64;
+
+/* Bitmap functions */
+VOID NTAPI RtlInitializeBitMap(PRTL_BITMAP BitMapHeader, PULONG BitMapBuffer, ULONG SizeOfBitMap);
+VOID NTAPI RtlClearAllBits(PRTL_BITMAP BitMapHeader);
+VOID NTAPI RtlSetAllBits(PRTL_BITMAP BitMapHeader);
+VOID NTAPI RtlClearBits(PRTL_BITMAP BitMapHeader, ULONG StartingIndex, ULONG NumberToClear);
+VOID NTAPI RtlSetBits(PRTL_BITMAP BitMapHeader, ULONG StartingIndex, ULONG NumberToSet);
+ULONG NTAPI RtlNumberOfSetBits(PRTL_BITMAP BitMapHeader);
+ULONG NTAPI RtlFindClearBits(PRTL_BITMAP BitMapHeader, ULONG NumberToFind, ULONG HintIndex);
+ULONG NTAPI RtlFindSetBits(PRTL_BITMAP BitMapHeader, ULONG NumberToFind, ULONG HintIndex);
+ULONG NTAPI RtlFindClearRuns(PRTL_BITMAP BitMapHeader, PRTL_BITMAP_RUN RunArray,
+                             ULONG SizeOfRunArray, BOOLEAN LocateLongestRuns);
+ULONG NTAPI RtlFindLongestRunClear(PRTL_BITMAP BitMapHeader, PULONG StartingIndex);
+ULONG NTAPI RtlFindClearBitsAndSet(PRTL_BITMAP BitMapHeader, ULONG NumberToFind, ULONG HintIndex);
+VOID NTAPI RtlInitializeSummaryBitMap(PRTL_SUMMARY_BITMAP BitMapHeader, PULONG BitMapBuffer,
+                                      PULONG SummaryBuffer, ULONG SizeOfBitMap);
+VOID NTAPI RtlSummaryClearBits(PRTL_SUMMARY_BITMAP BitMapHeader, ULONG StartingIndex, ULONG NumberToClear);
+VOID NTAPI RtlSummarySetBits(PRTL_SUMMARY_BITMAP BitMapHeader, ULONG StartingIndex, ULONG NumberToSet);
+ULONG NTAPI RtlSummaryFindClearBits(PRTL_SUMMARY_BITMAP BitMapHeader, ULONG NumberToFind, ULONG HintIndex);
+ULONG NTAPI RtlSummaryFindClearBitsAndSet(PRTL_SUMMARY_BITMAP BitMapHeader, ULONG NumberToFind, ULONG HintIndex);
+
+#ifdef _LP64
+VOID NTAPI RtlInitializeBitMap64(PRTL_BITMAP64 BitMapHeader, PULONG64 BitMapBuffer, ULONG64 SizeOfBitMap);
+VOID NTAPI RtlClearAllBits64(PRTL_BITMAP64 BitMapHeader);
+VOID NTAPI RtlClearBits64(PRTL_BITMAP64 BitMapHeader, ULONG64 StartingIndex, ULONG64 NumberToClear);
+VOID NTAPI RtlSetBits64(PRTL_BITMAP64 BitMapHeader, ULONG64 StartingIndex, ULONG64 NumberToSet);
+ULONG64 NTAPI RtlNumberOfSetBits64(PRTL_BITMAP64 BitMapHeader);
+ULONG64 NTAPI RtlFindClearBits64(PRTL_BITMAP64 BitMapHeader, ULONG64 NumberToFind, ULONG64 HintIndex);
+ULONG64 NTAPI RtlFindSetBits64(PRTL_BITMAP64 BitMapHeader, ULONG64 NumberToFind, ULONG64 HintIndex);
+ULONG NTAPI RtlFindClearRuns64(PRTL_BITMAP64 BitMapHeader, PRTL_BITMAP_RUN64 RunArray,
+                               ULONG SizeOfRunArray, BOOLEAN LocateLongestRuns);
+ULONG64 NTAPI RtlFindLongestRunClear64(PRTL_BITMAP64 BitMapHeader, PULONG64 StartingIndex);
+VOID NTAPI RtlInitializeSummaryBitMap64(PRTL_SUMMARY_BITMAP64 BitMapHeader, PULONG64 BitMapBuffer,
+                                        PULONG64 SummaryBuffer, ULONG64 SizeOfBitMap);
+VOID NTAPI RtlSummaryClearBits64(PRTL_SUMMARY_BITMAP64 BitMapHeader, ULONG64 StartingIndex, ULONG64 NumberToClear);
+ULONG64 NTAPI RtlSummaryFindClearBits64(PRTL_SUMMARY_BITMAP64 BitMapHeader, ULONG64 NumberToFind, ULONG64 HintIndex);
+ULONG64 NTAPI RtlSummaryFindClearBitsAndSet64(PRTL_SUMMARY_BITMAP64 BitMapHeader, ULONG64 NumberToFind, ULONG64 HintIndex);
+#endif
+
+/* Last, since bitmap64.c and bitmapsum64.c rename the types above */
+#include <bitmap.h>
+
+#endif /* _BITMAPBENCH_RTL_H */
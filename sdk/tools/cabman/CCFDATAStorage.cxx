@@ -1,10 +1,10 @@
 /*
  * PROJECT:     ReactOS cabinet manager
  * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
- * PURPOSE:     CCFDATAStorage class implementation for Linux/Unix
+ * PURPOSE:     CCFDATAStorage class implementation
  * COPYRIGHT:   Copyright 2017 Casper S. Hornstrup (chorns@users.sourceforge.net)
  *              Copyright 2017 Colin Finck <mail@colinfinck.de>
- *              Copyright 2018 Dmitry Bagdanov <dimbo_job@mail.ru>   
+ *              Copyright 2018 Dmitry Bagdanov <dimbo_job@mail.ru>
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,7 +30,9 @@
  */
 CCFDATAStorage::CCFDATAStorage()
 {
-    FileHandle = NULL;
+    Chunks = NULL;
+    ChunkCount = 0;
+    CurrentPosition = 0;
 }
 
 /**
@@ -41,22 +43,23 @@ CCFDATAStorage::CCFDATAStorage()
 */
 CCFDATAStorage::~CCFDATAStorage()
 {
-    ASSERT(FileHandle == NULL);
+    ASSERT(Chunks == NULL);
 }
 
 /**
 * @name CCFDATAStorage class
 * @implemented
 *
-* Creates the file
+* Creates the storage
 *
 * @return
 * Status of operation
 */
 ULONG CCFDATAStorage::Create()
 {
-    if ((FileHandle = tmpfile()) == NULL)
-        return CAB_STATUS_CANNOT_CREATE;
+    ASSERT(Chunks == NULL);
+
+    CurrentPosition = 0;
 
     return CAB_STATUS_SUCCESS;
 }
@@ -65,18 +68,23 @@ ULONG CCFDATAStorage::Create()
 * @name CCFDATAStorage class
 * @implemented
 *
-* Destroys the file
+* Destroys the storage
 *
 * @return
 * Status of operation
 */
 ULONG CCFDATAStorage::Destroy()
 {
-    ASSERT(FileHandle != NULL);
+    ULONG i;
+
+    for (i = 0; i < ChunkCount; i++)
+        free(Chunks[i]);
 
-    fclose(FileHandle);
+    free(Chunks);
 
-    FileHandle = NULL;
+    Chunks = NULL;
+    ChunkCount = 0;
+    CurrentPosition = 0;
 
     return CAB_STATUS_SUCCESS;
 }
@@ -85,20 +93,14 @@ ULONG CCFDATAStorage::Destroy()
 * @name CCFDATAStorage class
 * @implemented
 *
-* Truncate the scratch file to zero bytes
+* Discards all blocks. The memory is kept for the blocks of the next disk
 *
 * @return
 * Status of operation
 */
 ULONG CCFDATAStorage::Truncate()
 {
-    fclose(FileHandle);
-    FileHandle = tmpfile();
-    if (FileHandle == NULL)
-    {
-        DPRINT(MID_TRACE, ("ERROR '%i'.\n", errno));
-        return CAB_STATUS_FAILURE;
-    }
+    CurrentPosition = 0;
 
     return CAB_STATUS_SUCCESS;
 }
@@ -107,14 +109,14 @@ ULONG CCFDATAStorage::Truncate()
 * @name CCFDATAStorage class
 * @implemented
 *
-* Returns current position in file
+* Returns the position the next block is written to
 *
 * @return
 * Current position
 */
 ULONG CCFDATAStorage::Position()
 {
-    return (ULONG)ftell(FileHandle);
+    return CurrentPosition;
 }
 
 
@@ -122,48 +124,19 @@ ULONG CCFDATAStorage::Position()
 * @name CCFDATAStorage class
 * @implemented
 *
-* Seeks to an absolute position
+* Returns a block that was written before
 *
 * @param Position
-* Absolute position to seek to
+* Position the block was written to
 *
 * @return
-* Status of operation
+* Pointer to the block data. It stays valid until the storage is truncated
 */
-ULONG CCFDATAStorage::Seek(LONG Position)
+void* CCFDATAStorage::GetBlock(ULONG Position)
 {
-    if (fseek(FileHandle, (off_t)Position, SEEK_SET) != 0)
-        return CAB_STATUS_FAILURE;
-    else
-        return CAB_STATUS_SUCCESS;
-}
+    ASSERT(Position < ChunkCount * CAB_SCRATCH_CHUNKSIZE);
 
-
-/**
-* @name CCFDATAStorage class
-* @implemented
-*
-* Reads a CFDATA block from the file
-*
-* @param Data
-* Pointer to CFDATA block for the buffer
-*
-* @param Buffer
-* Pointer to buffer to store data read
-*
-* @param BytesRead
-* Pointer to buffer to write number of bytes read
-*
-* @return
-* Status of operation
-*/
-ULONG CCFDATAStorage::ReadBlock(PCFDATA Data, void* Buffer, PULONG BytesRead)
-{
-    *BytesRead = fread(Buffer, 1, Data->CompSize, FileHandle);
-    if (*BytesRead != Data->CompSize)
-        return CAB_STATUS_CANNOT_READ;
-
-    return CAB_STATUS_SUCCESS;
+    return Chunks[Position / CAB_SCRATCH_CHUNKSIZE] + (Position % CAB_SCRATCH_CHUNKSIZE);
 }
 
 
@@ -171,7 +144,7 @@ ULONG CCFDATAStorage::ReadBlock(PCFDATA Data, void* Buffer, PULONG BytesRead)
 * @name CCFDATAStorage class
 * @implemented
 *
-* Writes a CFDATA block to the file
+* Writes a CFDATA block to the storage
 *
 * @param Data
 * Pointer to CFDATA block for the buffer
@@ -187,9 +160,34 @@ ULONG CCFDATAStorage::ReadBlock(PCFDATA Data, void* Buffer, PULONG BytesRead)
 */
 ULONG CCFDATAStorage::WriteBlock(PCFDATA Data, void* Buffer, PULONG BytesWritten)
 {
-    *BytesWritten = fwrite(Buffer, 1, Data->CompSize, FileHandle);
-    if (*BytesWritten != Data->CompSize)
-        return CAB_STATUS_CANNOT_WRITE;
+    ULONG Chunk = CurrentPosition / CAB_SCRATCH_CHUNKSIZE;
+    ULONG Offset = CurrentPosition % CAB_SCRATCH_CHUNKSIZE;
+    PUCHAR* NewChunks;
+
+    ASSERT(Data->CompSize <= CAB_MAX_COMPSIZE);
+
+    *BytesWritten = 0;
+
+    if (Chunk == ChunkCount)
+    {
+        NewChunks = (PUCHAR*)realloc(Chunks, (ChunkCount + 1) * sizeof(PUCHAR));
+        if (NewChunks == NULL)
+            return CAB_STATUS_NOMEMORY;
+        Chunks = NewChunks;
+
+        Chunks[ChunkCount] = (PUCHAR)malloc(CAB_SCRATCH_CHUNKSIZE);
+        if (Chunks[ChunkCount] == NULL)
+            return CAB_STATUS_NOMEMORY;
+        ChunkCount++;
+    }
+
+    memcpy(Chunks[Chunk] + Offset, Buffer, Data->CompSize);
+    *BytesWritten = Data->CompSize;
+
+    /* Blocks never cross chunks, so start a new chunk if the largest block does not fit */
+    CurrentPosition += Data->CompSize;
+    if (CAB_SCRATCH_CHUNKSIZE - (CurrentPosition % CAB_SCRATCH_CHUNKSIZE) < CAB_MAX_COMPSIZE)
+        CurrentPosition = (Chunk + 1) * CAB_SCRATCH_CHUNKSIZE;
 
     return CAB_STATUS_SUCCESS;
 }
@@ -18,14 +18,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#if !defined(_WIN32)
+#if defined(_WIN32)
+# include <io.h>
+#else
 # include <dirent.h>
+# include <sys/mman.h>
 # include <sys/stat.h>
 # include <sys/types.h>
 #endif
 #include "cabinet.h"
 #include "raw.h"
 #include "mszip.h"
+#include "lzx.h"
+#include "comppool.h"
 
 #ifndef CAB_READ_ONLY
 
@@ -81,6 +86,7 @@ CCabinet::CCabinet()
     *CabinetReservedFile = '\0';
 
     FileOpen = false;
+    FileView = NULL;
     CabinetReservedFileBuffer = NULL;
     CabinetReservedFileSize = 0;
 
@@ -100,6 +106,8 @@ CCabinet::CCabinet()
     MaxDiskSize  = 0;
     BlockIsSplit = false;
     ScratchFile  = NULL;
+    ThreadCount  = CCompressionPool::GetProcessorCount();
+    Pool         = NULL;
 
     FolderUncompSize = 0;
     BytesLeftInBlock = 0;
@@ -122,6 +130,9 @@ CCabinet::~CCabinet()
 
     if (CodecSelected)
         delete Codec;
+
+    if (Pool)
+        delete Pool;
 }
 
 bool CCabinet::IsSeparator(char Char)
@@ -369,6 +380,8 @@ bool CCabinet::SetCompressionCodec(char* CodecName)
         SelectCodec(CAB_CODEC_RAW);
     else if( !strcasecmp(CodecName, "mszip") )
         SelectCodec(CAB_CODEC_MSZIP);
+    else if( !strcasecmp(CodecName, "lzx") )
+        SelectCodec(CAB_CODEC_LZX);
     else
     {
         printf("ERROR: Invalid codec specified!\n");
@@ -496,6 +509,9 @@ ULONG CCabinet::Open()
 
         FileOpen = true;
 
+        /* Blocks are uncompressed directly from the mapped file when possible */
+        MapFile();
+
         /* Load CAB header */
         if ((Status = ReadBlock(&CABHeader, sizeof(CFHEADER), &BytesRead))
             != CAB_STATUS_SUCCESS)
@@ -532,9 +548,9 @@ ULONG CCabinet::Open()
             FolderReserved  = (Size >> 16) & 0xFF;
             DataReserved    = (Size >> 24) & 0xFF;
 
-            if (fseek(FileHandle, CabinetReserved, SEEK_CUR) != 0)
+            if (SeekFile(CabinetReserved, SEEK_CUR) != 0)
             {
-                DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+                DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
                 return CAB_STATUS_FAILURE;
             }
         }
@@ -628,6 +644,7 @@ void CCabinet::Close()
 {
     if (FileOpen)
     {
+        UnmapFile();
         fclose(FileHandle);
         FileOpen = false;
     }
@@ -755,9 +772,12 @@ ULONG CCabinet::ExtractFile(char* FileName)
     ULONG CurrentOffset;
     PUCHAR Buffer;
     PUCHAR CurrentBuffer;
+    void* BlockData;
     FILE* DestFile;
     PCFFILE_NODE File;
+    PCFDATA_NODE DataNode;
     CFDATA CFData;
+    ULONG WindowBits = 0;
     ULONG Status;
     bool Skip;
 #if defined(_WIN32)
@@ -785,6 +805,13 @@ ULONG CCabinet::ExtractFile(char* FileName)
             SelectCodec(CAB_CODEC_MSZIP);
             break;
 
+        case CAB_COMP_LZX:
+            WindowBits = (CurrentFolderNode->Folder.CompressionType >> 8) & 0x1F;
+            if ((WindowBits < LZX_MIN_WINDOW_BITS) || (WindowBits > LZX_MAX_WINDOW_BITS))
+                return CAB_STATUS_UNSUPPCOMP;
+            SelectCodec(CAB_CODEC_LZX);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -835,7 +862,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
     SetAttributesOnFile(DestName, File->File.Attributes);
 
-    Buffer = (PUCHAR)malloc(CAB_BLOCKSIZE + 12); // This should be enough
+    Buffer = (PUCHAR)malloc(CAB_MAX_COMPSIZE);
     if (!Buffer)
     {
         fclose(DestFile);
@@ -843,13 +870,24 @@ ULONG CCabinet::ExtractFile(char* FileName)
         return CAB_STATUS_NOMEMORY;
     }
 
+    if (CodecId == CAB_CODEC_LZX)
+    {
+        Status = PrepareCodec(File->DataBlock, Buffer, WindowBits);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            fclose(DestFile);
+            free(Buffer);
+            return Status;
+        }
+    }
+
     /* Call OnExtract event handler */
     OnExtract(&File->File, FileName);
 
     /* Search to start of file */
-    if (fseek(FileHandle, (off_t)File->DataBlock->AbsoluteOffset, SEEK_SET) != 0)
+    if (SeekFile(File->DataBlock->AbsoluteOffset, SEEK_SET) != 0)
     {
-        DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+        DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
         fclose(DestFile);
         free(Buffer);
         return CAB_STATUS_INVALID_CAB;
@@ -861,6 +899,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
     Skip = true;
 
+    DataNode   = File->DataBlock;
     ReuseBlock = (CurrentDataNode == File->DataBlock);
     if (Size > 0)
     {
@@ -894,15 +933,26 @@ ULONG CCabinet::ExtractFile(char* FileName)
                         CFData.CompSize,
                         CFData.UncompSize));
 
-                    ASSERT(CFData.CompSize <= CAB_BLOCKSIZE + 12);
+                    ASSERT(CFData.CompSize <= CAB_MAX_COMPSIZE);
 
                     BytesToRead = CFData.CompSize;
 
                     DPRINT(MAX_TRACE, ("Read: (0x%lX,0x%lX).\n",
                         (unsigned long)CurrentBuffer, (unsigned long)Buffer));
 
-                    if (((Status = ReadBlock(CurrentBuffer, BytesToRead, &BytesRead)) !=
-                        CAB_STATUS_SUCCESS) || (BytesToRead != BytesRead))
+                    if ((CurrentBuffer == Buffer) && (CFData.UncompSize != 0))
+                    {
+                        /* The block is not split, so it can be uncompressed where it is */
+                        Status = MapBlock(Buffer, BytesToRead, &BlockData);
+                        BytesRead = BytesToRead;
+                    }
+                    else
+                    {
+                        Status = ReadBlock(CurrentBuffer, BytesToRead, &BytesRead);
+                        BlockData = Buffer;
+                    }
+
+                    if ((Status != CAB_STATUS_SUCCESS) || (BytesToRead != BytesRead))
                     {
                         fclose(DestFile);
                         free(Buffer);
@@ -970,11 +1020,12 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
                         /* The file is continued in the first data block in the folder */
                         File->DataBlock = CurrentFolderNode->DataListHead;
+                        DataNode        = File->DataBlock;
 
                         /* Search to start of file */
-                        if (fseek(FileHandle, (off_t)File->DataBlock->AbsoluteOffset, SEEK_SET) != 0)
+                        if (SeekFile(File->DataBlock->AbsoluteOffset, SEEK_SET) != 0)
                         {
-                            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+                            DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
                             fclose(DestFile);
                             free(Buffer);
                             return CAB_STATUS_INVALID_CAB;
@@ -986,16 +1037,13 @@ ULONG CCabinet::ExtractFile(char* FileName)
                             (UINT)File->DataBlock->AbsoluteOffset,
                             (UINT)File->DataBlock->UncompOffset));
 
-                        CurrentDataNode = File->DataBlock;
-                        ReuseBlock = true;
-
                         RestartSearch = true;
                     }
                 } while (CFData.UncompSize == 0);
 
                 DPRINT(MAX_TRACE, ("TotalBytesRead (%u).\n", (UINT)TotalBytesRead));
 
-                Status = Codec->Uncompress(OutputBuffer, Buffer, TotalBytesRead, &BytesToWrite);
+                Status = Codec->Uncompress(OutputBuffer, BlockData, TotalBytesRead, &BytesToWrite);
                 if (Status != CS_SUCCESS)
                 {
                     fclose(DestFile);
@@ -1016,6 +1064,11 @@ ULONG CCabinet::ExtractFile(char* FileName)
                 }
 
                 BytesLeftInBlock = BytesToWrite;
+
+                /* Remember the block, the next file may start in it */
+                CurrentDataNode = DataNode;
+                if (DataNode)
+                    DataNode = DataNode->Next;
             }
             else
             {
@@ -1039,15 +1092,16 @@ ULONG CCabinet::ExtractFile(char* FileName)
                     CFData.CompSize, CFData.UncompSize));
 
                 /* Go to next data block */
-                if (fseek(FileHandle, (off_t)CurrentDataNode->AbsoluteOffset + sizeof(CFDATA) +
+                if (SeekFile(CurrentDataNode->AbsoluteOffset + sizeof(CFDATA) +
                     CurrentDataNode->Data.CompSize, SEEK_SET) != 0)
                 {
-                    DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+                    DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
                     fclose(DestFile);
                     free(Buffer);
                     return CAB_STATUS_INVALID_CAB;
                 }
 
+                DataNode   = CurrentDataNode->Next;
                 ReuseBlock = false;
             }
 
@@ -1095,6 +1149,84 @@ ULONG CCabinet::ExtractFile(char* FileName)
     return CAB_STATUS_SUCCESS;
 }
 
+ULONG CCabinet::PrepareCodec(PCFDATA_NODE DataNode, PUCHAR Buffer, ULONG WindowBits)
+/*
+ * FUNCTION: Brings the codec to the state it has before a data block
+ * ARGUMENTS:
+ *     DataNode   = Pointer to data block that is uncompressed next
+ *     Buffer     = Pointer to buffer for compressed data
+ *     WindowBits = LZX window size of the folder
+ * RETURNS:
+ *     Status of operation
+ * NOTES:
+ *     LZX data blocks refer to data in earlier blocks of the folder, so
+ *     they can only be uncompressed in order from the start of the folder
+ */
+{
+    PCFDATA_NODE Node;
+    CFDATA CFData;
+    void* BlockData;
+    ULONG BytesRead;
+    ULONG BytesUncompressed;
+    ULONG Status;
+
+    /* Nothing to do if the block was the last one uncompressed or follows it */
+    if ((CurrentDataNode != NULL) &&
+        ((CurrentDataNode == DataNode) || (CurrentDataNode->Next == DataNode)) &&
+        (((CLZXCodec*)Codec)->GetWindowBits() == WindowBits))
+    {
+        return CAB_STATUS_SUCCESS;
+    }
+
+    DPRINT(MAX_TRACE, ("Uncompressing folder up to block at (0x%X).\n", (UINT)DataNode->AbsoluteOffset));
+
+    ((CLZXCodec*)Codec)->Reset(WindowBits);
+    CurrentDataNode = NULL;
+
+    for (Node = CurrentFolderNode->DataListHead; Node != DataNode; Node = Node->Next)
+    {
+        if (Node == NULL)
+            return CAB_STATUS_INVALID_CAB;
+
+        if (SeekFile(Node->AbsoluteOffset, SEEK_SET) != 0)
+        {
+            DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        if (((Status = ReadBlock(&CFData, sizeof(CFDATA), &BytesRead)) !=
+            CAB_STATUS_SUCCESS) || (BytesRead != sizeof(CFDATA)) ||
+            (CFData.CompSize > CAB_MAX_COMPSIZE))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        if ((Status = MapBlock(Buffer, CFData.CompSize, &BlockData)) != CAB_STATUS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        Status = Codec->Uncompress(OutputBuffer, BlockData, CFData.CompSize, &BytesUncompressed);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+            if (Status == CS_NOMEMORY)
+                return CAB_STATUS_NOMEMORY;
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        if (BytesUncompressed != CFData.UncompSize)
+            return CAB_STATUS_INVALID_CAB;
+
+        CurrentDataNode = Node;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
 bool CCabinet::IsCodecSelected()
 /*
  * FUNCTION: Returns the value of CodecSelected
@@ -1131,10 +1263,17 @@ void CCabinet::SelectCodec(LONG Id)
             Codec = new CMSZipCodec();
             break;
 
+        case CAB_CODEC_LZX:
+            Codec = new CLZXCodec();
+            break;
+
         default:
             return;
     }
 
+    /* A new codec has not uncompressed anything yet */
+    CurrentDataNode = NULL;
+
     CodecId       = Id;
     CodecSelected = true;
 }
@@ -1155,7 +1294,7 @@ ULONG CCabinet::NewCabinet()
 
     CurrentDiskNumber = 0;
 
-    OutputBuffer = malloc(CAB_BLOCKSIZE + 12); // This should be enough
+    OutputBuffer = malloc(CAB_MAX_COMPSIZE);
     InputBuffer  = malloc(CAB_BLOCKSIZE + 12); // This should be enough
     if ((!OutputBuffer) || (!InputBuffer))
     {
@@ -1246,8 +1385,15 @@ ULONG CCabinet::NewFolder()
  *     Status of operation
  */
 {
+    ULONG Status;
+
     DPRINT(MAX_TRACE, ("Creating new folder.\n"));
 
+    /* Blocks of the previous folder must be stored before LastBlockStart is reset */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     CurrentFolderNode = NewFolderNode();
     if (!CurrentFolderNode)
     {
@@ -1264,6 +1410,12 @@ ULONG CCabinet::NewFolder()
             CurrentFolderNode->Folder.CompressionType = CAB_COMP_MSZIP;
             break;
 
+        case CAB_CODEC_LZX:
+            /* Every folder is a separate LZX stream */
+            CurrentFolderNode->Folder.CompressionType = CAB_COMP_LZX | (LZX_DEFAULT_WINDOW_BITS << 8);
+            ((CLZXCodec*)Codec)->Reset(LZX_DEFAULT_WINDOW_BITS);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1409,6 +1561,33 @@ ULONG CCabinet::WriteDisk(ULONG MoreDisks)
 {
     PCFFILE_NODE FileNode;
     ULONG Status;
+    bool UsePool;
+
+    /* MSZIP blocks don't depend on each other, so they can be compressed in
+       any order. The disk a block goes to must be known before the next one
+       is read though, so this only works if the disk size is not limited */
+    UsePool = (ThreadCount > 1) && (MaxDiskSize == 0) && (CodecId == CAB_CODEC_MSZIP);
+
+    if (Pool && (!UsePool || (Pool->GetCodecId() != CodecId)))
+    {
+        Status = FlushDataBlocks();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+
+        delete Pool;
+        Pool = NULL;
+    }
+
+    if (UsePool && !Pool)
+    {
+        Pool = new CCompressionPool();
+        if (Pool->Create(CodecId, ThreadCount) != CAB_STATUS_SUCCESS)
+        {
+            /* Compress in this thread instead */
+            delete Pool;
+            Pool = NULL;
+        }
+    }
 
     ContinueFile = false;
     FileNode = FileListHead;
@@ -1496,6 +1675,10 @@ ULONG CCabinet::CommitDisk(ULONG MoreDisks)
     PCFFOLDER_NODE FolderNode;
     ULONG Status;
 
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     OnCabinetName(CurrentDiskNumber, CabinetName);
 
     /* Create file, fail if it already exists */
@@ -1580,6 +1763,12 @@ ULONG CCabinet::CloseCabinet()
 {
     ULONG Status;
 
+    if (Pool)
+    {
+        delete Pool;
+        Pool = NULL;
+    }
+
     DestroyFileNodes();
 
     DestroyFolderNodes();
@@ -1837,6 +2026,17 @@ void CCabinet::SetMaxDiskSize(ULONG Size)
     MaxDiskSize = Size;
 }
 
+
+void CCabinet::SetThreadCount(ULONG Count)
+/*
+ * FUNCTION: Sets the number of threads that compress data blocks
+ * ARGUMENTS:
+ *     Count = Number of threads (1 compresses in the calling thread)
+ */
+{
+    ThreadCount = (Count > 0) ? Count : 1;
+}
+
 #endif /* CAB_READ_ONLY */
 
 
@@ -2087,9 +2287,9 @@ ULONG CCabinet::ReadString(char* String, LONG MaxLength)
     // + 1 to skip the terminating NULL character as well.
     Size = -(MaxLength - Size) + 1;
 
-    if (fseek(FileHandle, (off_t)Size, SEEK_CUR) != 0)
+    if (SeekFile(Size, SEEK_CUR) != 0)
     {
-        DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+        DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
         return CAB_STATUS_INVALID_CAB;
     }
 
@@ -2113,9 +2313,9 @@ ULONG CCabinet::ReadFileTable()
         (UINT)CABHeader.FileTableOffset));
 
     /* Seek to file table */
-    if (fseek(FileHandle, (off_t)CABHeader.FileTableOffset, SEEK_SET) != 0)
+    if (SeekFile(CABHeader.FileTableOffset, SEEK_SET) != 0)
     {
-        DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+        DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
         return CAB_STATUS_INVALID_CAB;
     }
 
@@ -2190,9 +2390,9 @@ ULONG CCabinet::ReadDataBlocks(PCFFOLDER_NODE FolderNode)
         }
 
         /* Seek to data block */
-        if (fseek(FileHandle, (off_t)AbsoluteOffset, SEEK_SET) != 0)
+        if (SeekFile(AbsoluteOffset, SEEK_SET) != 0)
         {
-            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+            DPRINT(MIN_TRACE, ("SeekFile() failed.\n"));
             return CAB_STATUS_INVALID_CAB;
         }
 
@@ -2421,6 +2621,7 @@ void CCabinet::DestroyFolderNodes()
     }
     FolderListHead = NULL;
     FolderListTail = NULL;
+    CurrentDataNode = NULL;
 }
 
 
@@ -2540,12 +2741,154 @@ ULONG CCabinet::ReadBlock(void* Buffer,
  *     Status of operation
  */
 {
-    *BytesRead = fread(Buffer, 1, Size, FileHandle);
+    if (FileView)
+    {
+        *BytesRead = FileViewSize - FileViewPosition;
+        if (*BytesRead > Size)
+            *BytesRead = Size;
+        memcpy(Buffer, FileView + FileViewPosition, *BytesRead);
+        FileViewPosition += *BytesRead;
+    }
+    else
+    {
+        *BytesRead = fread(Buffer, 1, Size, FileHandle);
+    }
+
     if ( *BytesRead != Size )
         return CAB_STATUS_INVALID_CAB;
     return CAB_STATUS_SUCCESS;
 }
 
+
+ULONG CCabinet::MapBlock(void* Buffer,
+                         ULONG Size,
+                         void** Data)
+/*
+ * FUNCTION: Reads a block of data from file without copying it if possible
+ * ARGUMENTS:
+ *     Buffer = Pointer to data buffer used if the file is not mapped
+ *     Size   = Length of data
+ *     Data   = Address of buffer to place pointer to the data
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG BytesRead;
+    ULONG Status;
+
+    if (FileView)
+    {
+        if (Size > FileViewSize - FileViewPosition)
+            return CAB_STATUS_INVALID_CAB;
+
+        *Data = FileView + FileViewPosition;
+        FileViewPosition += Size;
+        return CAB_STATUS_SUCCESS;
+    }
+
+    Status = ReadBlock(Buffer, Size, &BytesRead);
+    *Data = Buffer;
+    return Status;
+}
+
+
+int CCabinet::SeekFile(LONG Offset, int Origin)
+/*
+ * FUNCTION: Changes the position in the cabinet file
+ * ARGUMENTS:
+ *     Offset = Offset to move by
+ *     Origin = SEEK_SET or SEEK_CUR, like for fseek
+ * RETURNS:
+ *     0 on success, like fseek
+ */
+{
+    LONGLONG Position;
+
+    if (!FileView)
+        return fseek(FileHandle, (off_t)Offset, Origin);
+
+    Position = Offset;
+    if (Origin == SEEK_CUR)
+        Position += FileViewPosition;
+
+    if ((Position < 0) || (Position > FileViewSize))
+        return -1;
+
+    FileViewPosition = (ULONG)Position;
+    return 0;
+}
+
+
+void CCabinet::MapFile()
+/*
+ * FUNCTION: Maps the open cabinet file into memory
+ * NOTES:
+ *     If that fails, the file is read with FileHandle
+ */
+{
+#if defined(_WIN32)
+    LARGE_INTEGER Size;
+    HANDLE Handle = (HANDLE)_get_osfhandle(_fileno(FileHandle));
+
+    FileView = NULL;
+
+    if (!GetFileSizeEx(Handle, &Size) || (Size.QuadPart == 0) || (Size.HighPart != 0))
+        return;
+
+    FileMapping = CreateFileMapping(Handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (FileMapping == NULL)
+        return;
+
+    FileView = (PUCHAR)MapViewOfFile(FileMapping, FILE_MAP_READ, 0, 0, 0);
+    if (FileView == NULL)
+    {
+        CloseHandle(FileMapping);
+        return;
+    }
+
+    FileViewSize = Size.LowPart;
+#else
+    struct stat Stat;
+    void* View;
+
+    FileView = NULL;
+
+    if ((fstat(fileno(FileHandle), &Stat) != 0) ||
+        (Stat.st_size == 0) || ((ULONGLONG)Stat.st_size > 0xFFFFFFFF))
+    {
+        return;
+    }
+
+    View = mmap(NULL, Stat.st_size, PROT_READ, MAP_PRIVATE, fileno(FileHandle), 0);
+    if (View == MAP_FAILED)
+        return;
+
+    FileView     = (PUCHAR)View;
+    FileViewSize = (ULONG)Stat.st_size;
+#endif
+
+    FileViewPosition = 0;
+}
+
+
+void CCabinet::UnmapFile()
+/*
+ * FUNCTION: Removes the mapping created by MapFile
+ */
+{
+    if (!FileView)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(FileView);
+    CloseHandle(FileMapping);
+#else
+    munmap(FileView, FileViewSize);
+#endif
+
+    FileView = NULL;
+}
+
 bool CCabinet::MatchFileNamePattern(char* FileName, char* Pattern)
 /*
  * FUNCTION: Matches a wildcard character pattern against a file
@@ -2931,37 +3274,24 @@ ULONG CCabinet::CommitDataBlocks(PCFFOLDER_NODE FolderNode)
  */
 {
     PCFDATA_NODE DataNode;
-    ULONG BytesRead;
-    ULONG Status;
 
     DataNode = FolderNode->DataListHead;
-    if (DataNode != NULL)
-        Status = ScratchFile->Seek(DataNode->ScratchFilePosition);
-
     while (DataNode != NULL)
     {
-        DPRINT(MAX_TRACE, ("Reading block at (0x%X)  CompSize (%u)  UncompSize (%u).\n",
+        DPRINT(MAX_TRACE, ("Writing block at (0x%X)  CompSize (%u)  UncompSize (%u).\n",
             (UINT)DataNode->ScratchFilePosition,
             DataNode->Data.CompSize,
             DataNode->Data.UncompSize));
 
-        /* InputBuffer is free for us to use here, so we use it and avoid a
-           memory allocation. OutputBuffer can't be used here because it may
-           still contain valid data (if a data block spans two or more disks) */
-        Status = ScratchFile->ReadBlock(&DataNode->Data, InputBuffer, &BytesRead);
-        if (Status != CAB_STATUS_SUCCESS)
-        {
-            DPRINT(MIN_TRACE, ("Cannot read from scratch file (%u).\n", (UINT)Status));
-            return Status;
-        }
-
         if (fwrite(&DataNode->Data, sizeof(CFDATA), 1, FileHandle) < 1)
         {
             DPRINT(MIN_TRACE, ("Cannot write to file.\n"));
             return CAB_STATUS_CANNOT_WRITE;
         }
 
-        if (fwrite(InputBuffer, DataNode->Data.CompSize, 1, FileHandle) < 1)
+        /* The block goes straight from scratch storage to the cabinet */
+        if (fwrite(ScratchFile->GetBlock(DataNode->ScratchFilePosition),
+                   DataNode->Data.CompSize, 1, FileHandle) < 1)
         {
             DPRINT(MIN_TRACE, ("Cannot write to file.\n"));
             return CAB_STATUS_CANNOT_WRITE;
@@ -2981,11 +3311,27 @@ ULONG CCabinet::WriteDataBlock()
  */
 {
     ULONG Status;
-    ULONG BytesWritten;
-    PCFDATA_NODE DataNode;
 
     if (!BlockIsSplit)
     {
+        if (Pool)
+        {
+            /* The oldest block is stored to make room for this one */
+            if (Pool->IsFull())
+            {
+                Status = RetireDataBlock();
+                if (Status != CAB_STATUS_SUCCESS)
+                    return Status;
+            }
+
+            Pool->Submit(InputBuffer, CurrentIBufferSize, CurrentFolderNode);
+
+            CurrentIBufferSize = 0;
+            CurrentIBuffer     = InputBuffer;
+
+            return CAB_STATUS_SUCCESS;
+        }
+
         Status = Codec->Compress(OutputBuffer,
             InputBuffer,
             CurrentIBufferSize,
@@ -2998,7 +3344,35 @@ ULONG CCabinet::WriteDataBlock()
         CurrentOBufferSize = TotalCompSize;
     }
 
-    DataNode = NewDataNode(CurrentFolderNode);
+    Status = StoreDataBlock(CurrentFolderNode, CurrentIBufferSize);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    if (!BlockIsSplit)
+    {
+        CurrentIBufferSize = 0;
+        CurrentIBuffer     = InputBuffer;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::StoreDataBlock(PCFFOLDER_NODE FolderNode, ULONG UncompSize)
+/*
+ * FUNCTION: Writes the compressed data block to the scratch file
+ * ARGUMENTS:
+ *     FolderNode = Pointer to folder node the block belongs to
+ *     UncompSize = Size of the block before it was compressed
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status;
+    ULONG BytesWritten;
+    PCFDATA_NODE DataNode;
+
+    DataNode = NewDataNode(FolderNode);
     if (!DataNode)
     {
         DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
@@ -3022,7 +3396,7 @@ ULONG CCabinet::WriteDataBlock()
     else
     {
         DataNode->Data.CompSize   = (USHORT)CurrentOBufferSize;
-        DataNode->Data.UncompSize = (USHORT)CurrentIBufferSize;
+        DataNode->Data.UncompSize = (USHORT)UncompSize;
     }
 
     DataNode->Data.Checksum = 0;
@@ -3043,18 +3417,57 @@ ULONG CCabinet::WriteDataBlock()
 
     DiskSize += BytesWritten;
 
-    CurrentFolderNode->TotalFolderSize += (BytesWritten + sizeof(CFDATA));
-    CurrentFolderNode->Folder.DataBlockCount++;
+    FolderNode->TotalFolderSize += (BytesWritten + sizeof(CFDATA));
+    FolderNode->Folder.DataBlockCount++;
 
     CurrentOBuffer = (unsigned char*)CurrentOBuffer + DataNode->Data.CompSize;
     CurrentOBufferSize -= DataNode->Data.CompSize;
 
     LastBlockStart += DataNode->Data.UncompSize;
 
-    if (!BlockIsSplit)
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::RetireDataBlock()
+/*
+ * FUNCTION: Writes the oldest data block of the compression pool to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status;
+    ULONG UncompSize;
+    void* FolderNode;
+
+    Status = Pool->Retire(&CurrentOBuffer, &CurrentOBufferSize, &UncompSize, &FolderNode);
+    if (Status != CS_SUCCESS)
     {
-        CurrentIBufferSize = 0;
-        CurrentIBuffer     = InputBuffer;
+        DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Status));
+        return (Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+    }
+
+    DPRINT(MAX_TRACE, ("Block compressed. UncompSize (%u)  CompSize(%u).\n",
+        (UINT)UncompSize, (UINT)CurrentOBufferSize));
+
+    return StoreDataBlock((PCFFOLDER_NODE)FolderNode, UncompSize);
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Writes all blocks of the compression pool to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status;
+
+    while (Pool && (Pool->Pending() > 0))
+    {
+        Status = RetireDataBlock();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
     }
 
     return CAB_STATUS_SUCCESS;
@@ -101,6 +101,8 @@ extern ULONG DebugTraceLevel;
 #define CAB_SIGNATURE        0x4643534D // "MSCF"
 #define CAB_VERSION          0x0103
 #define CAB_BLOCKSIZE        32768
+#define CAB_MAX_COMPSIZE     (CAB_BLOCKSIZE + 6144) // Largest compressed data block
+#define CAB_SCRATCH_CHUNKSIZE 0x100000          // Scratch storage is allocated in pieces of this size
 
 #define CAB_COMP_MASK        0x00FF
 #define CAB_COMP_NONE        0x0000
@@ -193,7 +195,7 @@ typedef struct _CFDATA_NODE
 {
     struct _CFDATA_NODE *Next;
     struct _CFDATA_NODE *Prev;
-    ULONG       ScratchFilePosition;    // Absolute offset in scratch file
+    ULONG       ScratchFilePosition;    // Position in scratch storage
     ULONG       AbsoluteOffset;         // Absolute offset in cabinet
     ULONG       UncompOffset;           // Uncompressed offset in folder
     CFDATA         Data;
@@ -308,14 +310,16 @@ public:
     ULONG Destroy();
     ULONG Truncate();
     ULONG Position();
-    ULONG Seek(LONG Position);
-    ULONG ReadBlock(PCFDATA Data, void* Buffer, PULONG BytesRead);
+    void* GetBlock(ULONG Position);
     ULONG WriteBlock(PCFDATA Data, void* Buffer, PULONG BytesWritten);
 private:
-    char FullName[PATH_MAX];
-    FILE* FileHandle;
+    PUCHAR* Chunks;
+    ULONG ChunkCount;
+    ULONG CurrentPosition;
 };
 
+class CCompressionPool;
+
 #endif /* CAB_READ_ONLY */
 
 class CCabinet
@@ -395,6 +399,8 @@ public:
     ULONG AddFile(char* FileName);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of threads that compress data blocks */
+    void SetThreadCount(ULONG Count);
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -430,7 +436,12 @@ private:
     void DestroyDeletedFolderNodes();
     ULONG ComputeChecksum(void* Buffer, ULONG Size, ULONG Seed);
     ULONG ReadBlock(void* Buffer, ULONG Size, PULONG BytesRead);
+    ULONG MapBlock(void* Buffer, ULONG Size, void** Data);
+    int SeekFile(LONG Offset, int Origin);
+    void MapFile();
+    void UnmapFile();
     bool MatchFileNamePattern(char* FileName, char* Pattern);
+    ULONG PrepareCodec(PCFDATA_NODE DataNode, PUCHAR Buffer, ULONG WindowBits);
 #ifndef CAB_READ_ONLY
     ULONG InitCabinetHeader();
     ULONG WriteCabinetHeader(bool MoreDisks);
@@ -438,6 +449,9 @@ private:
     ULONG WriteFileEntries();
     ULONG CommitDataBlocks(PCFFOLDER_NODE FolderNode);
     ULONG WriteDataBlock();
+    ULONG StoreDataBlock(PCFFOLDER_NODE FolderNode, ULONG UncompSize);
+    ULONG RetireDataBlock();
+    ULONG FlushDataBlocks();
     ULONG GetAttributesOnFile(PCFFILE_NODE File);
     ULONG SetAttributesOnFile(char* FileName, USHORT FileAttributes);
     ULONG GetFileTimes(FILE* FileHandle, PCFFILE_NODE File);
@@ -464,6 +478,12 @@ private:
     ULONG CabinetReservedFileSize;
     FILE* FileHandle;
     bool FileOpen;
+    PUCHAR FileView;            // Cabinet file mapped into memory, NULL if it is read with FileHandle
+    ULONG FileViewSize;
+    ULONG FileViewPosition;     // Current position in FileView
+#if defined(_WIN32)
+    HANDLE FileMapping;
+#endif
     CFHEADER CABHeader;
     ULONG CabinetReserved;
     ULONG FolderReserved;
@@ -503,6 +523,8 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+    ULONG ThreadCount;          // Number of compression threads
+    CCompressionPool *Pool;     // Compresses data blocks when there are several threads
 #endif /* CAB_READ_ONLY */
 };
 
@@ -0,0 +1,369 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/comppool.cxx
+ * PURPOSE:     Worker threads for compressing independent data blocks
+ * NOTES:       Only codecs that compress each CFDATA block on its own
+ *              can use this. Blocks are retired in the order they were
+ *              submitted, so the cabinet does not depend on the number
+ *              of threads.
+ */
+#include <stdio.h>
+#include "comppool.h"
+#include "raw.h"
+#include "mszip.h"
+
+#ifndef CAB_READ_ONLY
+
+
+/* Semaphores */
+
+#if defined(_WIN32)
+
+static bool InitSemaphore(CAB_SEMAPHORE* Semaphore, ULONG Count)
+{
+    *Semaphore = CreateSemaphore(NULL, Count, 0x7FFFFFFF, NULL);
+    return (*Semaphore != NULL);
+}
+
+static void DeleteSemaphore(CAB_SEMAPHORE* Semaphore)
+{
+    CloseHandle(*Semaphore);
+}
+
+static void WaitSemaphore(CAB_SEMAPHORE* Semaphore)
+{
+    WaitForSingleObject(*Semaphore, INFINITE);
+}
+
+static void PostSemaphore(CAB_SEMAPHORE* Semaphore, ULONG Count)
+{
+    ReleaseSemaphore(*Semaphore, Count, NULL);
+}
+
+#else
+
+static bool InitSemaphore(CAB_SEMAPHORE* Semaphore, ULONG Count)
+{
+    if (pthread_mutex_init(&Semaphore->Mutex, NULL) != 0)
+        return false;
+
+    if (pthread_cond_init(&Semaphore->Cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&Semaphore->Mutex);
+        return false;
+    }
+
+    Semaphore->Count = Count;
+    return true;
+}
+
+static void DeleteSemaphore(CAB_SEMAPHORE* Semaphore)
+{
+    pthread_cond_destroy(&Semaphore->Cond);
+    pthread_mutex_destroy(&Semaphore->Mutex);
+}
+
+static void WaitSemaphore(CAB_SEMAPHORE* Semaphore)
+{
+    pthread_mutex_lock(&Semaphore->Mutex);
+    while (Semaphore->Count == 0)
+        pthread_cond_wait(&Semaphore->Cond, &Semaphore->Mutex);
+    Semaphore->Count--;
+    pthread_mutex_unlock(&Semaphore->Mutex);
+}
+
+static void PostSemaphore(CAB_SEMAPHORE* Semaphore, ULONG Count)
+{
+    pthread_mutex_lock(&Semaphore->Mutex);
+    Semaphore->Count += Count;
+    pthread_cond_broadcast(&Semaphore->Cond);
+    pthread_mutex_unlock(&Semaphore->Mutex);
+}
+
+#endif
+
+
+/* CCompressionPool */
+
+CCompressionPool::CCompressionPool()
+/*
+ * FUNCTION: Default constructor
+ */
+{
+    CodecId     = -1;
+    ThreadCount = 0;
+    Jobs        = NULL;
+    JobCount    = 0;
+    SubmitCount = 0;
+    RunCount    = 0;
+    RetireCount = 0;
+    Shutdown    = false;
+}
+
+
+CCompressionPool::~CCompressionPool()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    Destroy();
+}
+
+
+ULONG CCompressionPool::GetProcessorCount()
+/*
+ * FUNCTION: Returns the number of processors on this machine
+ */
+{
+    LONG Count;
+
+#if defined(_WIN32)
+    SYSTEM_INFO SystemInfo;
+
+    GetSystemInfo(&SystemInfo);
+    Count = SystemInfo.dwNumberOfProcessors;
+#else
+    Count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (Count < 1)
+        return 1;
+    if (Count > CAB_MAX_THREADS)
+        return CAB_MAX_THREADS;
+    return Count;
+}
+
+
+ULONG CCompressionPool::Create(LONG Id, ULONG Count)
+/*
+ * FUNCTION: Starts the worker threads
+ * ARGUMENTS:
+ *     Id    = Codec the workers compress with
+ *     Count = Number of worker threads
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG i;
+
+    ASSERT(Jobs == NULL);
+
+    if ((Id != CAB_CODEC_RAW) && (Id != CAB_CODEC_MSZIP))
+        return CAB_STATUS_UNSUPPCOMP;
+
+    if (Count > CAB_MAX_THREADS)
+        Count = CAB_MAX_THREADS;
+
+    /* Two blocks per thread keep the workers busy while the oldest block is stored */
+    JobCount = 2 * Count;
+    Jobs = (PCOMPRESSION_JOB)malloc(JobCount * sizeof(COMPRESSION_JOB));
+    if (!Jobs)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    for (i = 0; i < JobCount; i++)
+    {
+        if (!InitSemaphore(&Jobs[i].Done, 0))
+        {
+            while (i-- > 0)
+                DeleteSemaphore(&Jobs[i].Done);
+            free(Jobs);
+            Jobs = NULL;
+            return CAB_STATUS_NOMEMORY;
+        }
+    }
+
+    InitSemaphore(&JobsQueued, 0);
+    InitSemaphore(&Lock, 1);
+
+    CodecId     = Id;
+    SubmitCount = 0;
+    RunCount    = 0;
+    RetireCount = 0;
+    Shutdown    = false;
+
+    for (ThreadCount = 0; ThreadCount < Count; ThreadCount++)
+    {
+#if defined(_WIN32)
+        Threads[ThreadCount] = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
+        if (Threads[ThreadCount] == NULL)
+            break;
+#else
+        if (pthread_create(&Threads[ThreadCount], NULL, WorkerThread, this) != 0)
+            break;
+#endif
+    }
+
+    if (ThreadCount == 0)
+    {
+        Destroy();
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    DPRINT(MID_TRACE, ("Started %u compression threads.\n", (UINT)ThreadCount));
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+void CCompressionPool::Destroy()
+/*
+ * FUNCTION: Stops the worker threads
+ */
+{
+    ULONG i;
+
+    if (!Jobs)
+        return;
+
+    /* Wake up every worker, they exit when they see the flag */
+    WaitSemaphore(&Lock);
+    Shutdown = true;
+    PostSemaphore(&Lock, 1);
+    PostSemaphore(&JobsQueued, ThreadCount);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+#else
+        pthread_join(Threads[i], NULL);
+#endif
+    }
+
+    for (i = 0; i < JobCount; i++)
+        DeleteSemaphore(&Jobs[i].Done);
+    DeleteSemaphore(&JobsQueued);
+    DeleteSemaphore(&Lock);
+
+    free(Jobs);
+    Jobs        = NULL;
+    JobCount    = 0;
+    ThreadCount = 0;
+    CodecId     = -1;
+}
+
+
+void CCompressionPool::Submit(void* Buffer, ULONG Length, void* Context)
+/*
+ * FUNCTION: Queues a data block for compression
+ * ARGUMENTS:
+ *     Buffer  = Pointer to uncompressed data
+ *     Length  = Length of data, at most CAB_BLOCKSIZE
+ *     Context = Value to return with the block when it is retired
+ * NOTES:
+ *     The pool must not be full
+ */
+{
+    PCOMPRESSION_JOB Job;
+
+    ASSERT(!IsFull());
+    ASSERT(Length <= CAB_BLOCKSIZE);
+
+    Job = &Jobs[SubmitCount % JobCount];
+    memcpy(Job->InputBuffer, Buffer, Length);
+    Job->InputLength = Length;
+    Job->Context     = Context;
+
+    SubmitCount++;
+    PostSemaphore(&JobsQueued, 1);
+}
+
+
+ULONG CCompressionPool::Retire(void** Buffer, PULONG Length, PULONG InputLength, void** Context)
+/*
+ * FUNCTION: Waits for the oldest submitted data block
+ * ARGUMENTS:
+ *     Buffer      = Address of buffer to place pointer to compressed data
+ *     Length      = Address of buffer to place size of compressed data
+ *     InputLength = Address of buffer to place size of uncompressed data
+ *     Context     = Address of buffer to place the value given to Submit
+ * RETURNS:
+ *     Status of the codec
+ * NOTES:
+ *     The compressed data stays valid until the next block is submitted
+ */
+{
+    PCOMPRESSION_JOB Job;
+
+    ASSERT(Pending() > 0);
+
+    Job = &Jobs[RetireCount % JobCount];
+    WaitSemaphore(&Job->Done);
+    RetireCount++;
+
+    *Buffer      = Job->OutputBuffer;
+    *Length      = Job->OutputLength;
+    *InputLength = Job->InputLength;
+    *Context     = Job->Context;
+
+    return Job->Status;
+}
+
+
+void CCompressionPool::RunJobs(CCABCodec* Codec)
+/*
+ * FUNCTION: Compresses blocks until the pool is destroyed
+ * ARGUMENTS:
+ *     Codec = Codec instance that belongs to this thread
+ */
+{
+    PCOMPRESSION_JOB Job;
+
+    for (;;)
+    {
+        WaitSemaphore(&JobsQueued);
+
+        WaitSemaphore(&Lock);
+        if (Shutdown)
+        {
+            PostSemaphore(&Lock, 1);
+            return;
+        }
+        Job = &Jobs[RunCount % JobCount];
+        RunCount++;
+        PostSemaphore(&Lock, 1);
+
+        Job->Status = Codec->Compress(Job->OutputBuffer,
+                                      Job->InputBuffer,
+                                      Job->InputLength,
+                                      &Job->OutputLength);
+
+        PostSemaphore(&Job->Done, 1);
+    }
+}
+
+
+#if defined(_WIN32)
+DWORD WINAPI CCompressionPool::WorkerThread(LPVOID Parameter)
+#else
+void* CCompressionPool::WorkerThread(void* Parameter)
+#endif
+/*
+ * FUNCTION: Entry point of the worker threads
+ * ARGUMENTS:
+ *     Parameter = Pointer to the pool
+ */
+{
+    CCompressionPool* Pool = (CCompressionPool*)Parameter;
+    CCABCodec* Codec;
+
+    /* Codecs keep stream state, so every thread needs its own */
+    if (Pool->CodecId == CAB_CODEC_RAW)
+        Codec = new CRawCodec();
+    else
+        Codec = new CMSZipCodec();
+
+    Pool->RunJobs(Codec);
+
+    delete Codec;
+    return 0;
+}
+
+#endif /* CAB_READ_ONLY */
+
+/* EOF */
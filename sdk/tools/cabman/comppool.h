@@ -0,0 +1,96 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/comppool.h
+ * PURPOSE:     Worker threads for compressing independent data blocks
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#ifndef CAB_READ_ONLY
+
+#define CAB_MAX_THREADS 64
+
+
+/* Types */
+
+#if defined(_WIN32)
+typedef HANDLE CAB_SEMAPHORE;
+typedef HANDLE CAB_THREAD;
+#else
+typedef struct _CAB_SEMAPHORE
+{
+    pthread_mutex_t Mutex;
+    pthread_cond_t Cond;
+    ULONG Count;
+} CAB_SEMAPHORE;
+typedef pthread_t CAB_THREAD;
+#endif
+
+typedef struct _COMPRESSION_JOB
+{
+    CAB_SEMAPHORE Done;                     // Signalled when the block is compressed
+    void* Context;                          // Caller data, returned with the block
+    ULONG Status;                           // Status returned by the codec
+    ULONG InputLength;
+    ULONG OutputLength;
+    UCHAR InputBuffer[CAB_BLOCKSIZE];
+    UCHAR OutputBuffer[CAB_MAX_COMPSIZE];
+} COMPRESSION_JOB, *PCOMPRESSION_JOB;
+
+
+/* Classes */
+
+class CCompressionPool
+{
+public:
+    /* Default constructor */
+    CCompressionPool();
+    /* Default destructor */
+    virtual ~CCompressionPool();
+    /* Starts the worker threads */
+    ULONG Create(LONG Id, ULONG Count);
+    /* Stops the worker threads */
+    void Destroy();
+    /* Returns the codec the workers use */
+    LONG GetCodecId() { return CodecId; };
+    /* Returns the number of blocks that are not retired yet */
+    ULONG Pending() { return SubmitCount - RetireCount; };
+    /* Returns true if no more blocks can be submitted before one is retired */
+    bool IsFull() { return Pending() == JobCount; };
+    /* Queues a data block for compression */
+    void Submit(void* Buffer, ULONG Length, void* Context);
+    /* Waits for the oldest data block and returns the compressed data */
+    ULONG Retire(void** Buffer, PULONG Length, PULONG InputLength, void** Context);
+    /* Returns the number of processors on this machine */
+    static ULONG GetProcessorCount();
+private:
+    void RunJobs(CCABCodec* Codec);
+#if defined(_WIN32)
+    static DWORD WINAPI WorkerThread(LPVOID Parameter);
+#else
+    static void* WorkerThread(void* Parameter);
+#endif
+
+    LONG CodecId;
+    ULONG ThreadCount;
+    CAB_THREAD Threads[CAB_MAX_THREADS];
+    PCOMPRESSION_JOB Jobs;
+    ULONG JobCount;
+    CAB_SEMAPHORE JobsQueued;               // Counts submitted blocks nobody works on yet
+    CAB_SEMAPHORE Lock;                     // Protects RunCount
+    ULONG SubmitCount;
+    ULONG RunCount;
+    ULONG RetireCount;
+    bool Shutdown;
+};
+
+#endif /* CAB_READ_ONLY */
+
+/* EOF */
@@ -783,6 +783,32 @@ void CDFParser::DoInfFileName(char* FileName)
     InfFileNameSet = true;
 }
 
+ULONG CDFParser::DoCompressionType(char* Type)
+/*
+ * FUNCTION: Selects the compression engine
+ * ARGUMENTS:
+ *     Type = Pointer to name of engine (NONE, MSZIP or LZX)
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    DPRINT(MID_TRACE, ("Setting compression type to '%s'\n", Type));
+
+    /* All folders of a cabinet use the same engine */
+    if (CabinetCreated)
+    {
+        printf("ERROR: CompressionType must be set before the first file.\n");
+        return CAB_STATUS_FAILURE;
+    }
+
+    if (strcasecmp(Type, "NONE") == 0)
+        SelectCodec(CAB_CODEC_RAW);
+    else if (!SetCompressionCodec(Type))
+        return CAB_STATUS_FAILURE;
+
+    return CAB_STATUS_SUCCESS;
+}
+
 ULONG CDFParser::SetupNewDisk()
 /*
  * FUNCTION: Sets up parameters for a new disk
@@ -831,6 +857,8 @@ ULONG CDFParser::PerformSetCommand()
         SetType = stMaxDiskSize;
     else if (strcasecmp(CurrentString, "InfFileName") == 0)
         SetType = stInfFileName;
+    else if (strcasecmp(CurrentString, "CompressionType") == 0)
+        SetType = stCompressionType;
     else
         return CAB_STATUS_FAILURE;
 
@@ -895,6 +923,9 @@ ULONG CDFParser::PerformSetCommand()
             DoInfFileName(CurrentString);
             return CAB_STATUS_SUCCESS;
 
+        case stCompressionType:
+            return DoCompressionType(CurrentString);
+
         default:
             return CAB_STATUS_FAILURE;
     }
@@ -45,7 +45,8 @@ typedef enum
     stDiskLabel,
     stDiskLabelTemplate,
     stMaxDiskSize,
-    stInfFileName
+    stInfFileName,
+    stCompressionType
 } SETTYPE;
 
 
@@ -86,6 +87,7 @@ private:
     void DoCabinetNameTemplate(char* Template);
     void DoInfFileName(char* InfFileName);
     ULONG DoMaxDiskSize(bool NumberValid, ULONG Number);
+    ULONG DoCompressionType(char* Type);
     ULONG SetupNewDisk();
     ULONG PerformSetCommand();
     ULONG PerformNewCommand();
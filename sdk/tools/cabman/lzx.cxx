@@ -0,0 +1,748 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.cxx
+ * PURPOSE:     CAB codec for LZX compressed data
+ * NOTES:       The lzxcomp library from hhpcomp does the compression.
+ *              A folder is one LZX stream, every data block holds one
+ *              32K frame of it, so the codec keeps its state from one
+ *              block to the next until the folder ends.
+ */
+#include <stdio.h>
+#include "lzx.h"
+
+static const UCHAR PositionSlots[LZX_MAX_WINDOW_BITS - LZX_MIN_WINDOW_BITS + 1] =
+{
+    30, 32, 34, 36, 38, 42, 50
+};
+
+
+/* CLZXCodec */
+
+CLZXCodec::CLZXCodec()
+/*
+ * FUNCTION: Default constructor
+ */
+{
+    ULONG i;
+
+    for (i = 0; i < LZX_MAX_POSITION_SLOTS; i++)
+    {
+        ExtraBits[i] = (i < 4) ? 0 : (i < 36) ? (UCHAR)((i - 2) / 2) : 17;
+        PositionBase[i] = (i == 0) ? 0 : PositionBase[i - 1] + (1 << ExtraBits[i - 1]);
+    }
+
+    Compressor = NULL;
+    Window     = NULL;
+    WindowBits = 0;
+
+    Reset(LZX_DEFAULT_WINDOW_BITS);
+}
+
+
+CLZXCodec::~CLZXCodec()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    if (Compressor)
+        lzx_finish(Compressor, NULL);
+
+    if (Window)
+        free(Window);
+}
+
+
+void CLZXCodec::Reset(ULONG WindowBits)
+/*
+ * FUNCTION: Starts a new LZX stream
+ * ARGUMENTS:
+ *     WindowBits = Base 2 logarithm of the window size (15-21)
+ */
+{
+    if (Compressor)
+    {
+        lzx_finish(Compressor, NULL);
+        Compressor = NULL;
+    }
+
+    if ((WindowBits != this->WindowBits) && Window)
+    {
+        free(Window);
+        Window = NULL;
+    }
+
+    this->WindowBits = WindowBits;
+    WindowSize       = 1 << WindowBits;
+    WindowPosition   = 0;
+    PositionSlots    = ::PositionSlots[WindowBits - LZX_MIN_WINDOW_BITS];
+
+    R0 = R1 = R2   = 1;
+    HeaderRead     = false;
+    IntelFileSize  = 0;
+    IntelPosition  = 0;
+    BlockType      = 0;
+    BlockRemaining = 0;
+    BlockPadding   = false;
+
+    /* Code lengths are sent as differences to those of the previous block */
+    memset(MainTree.Lengths, 0, sizeof(MainTree.Lengths));
+    memset(LengthTree.Lengths, 0, sizeof(LengthTree.Lengths));
+
+    MainTree.Symbols    = LZX_NUM_CHARS + 8 * PositionSlots;
+    LengthTree.Symbols  = LZX_LENGTH_SYMBOLS;
+    AlignedTree.Symbols = LZX_ALIGNED_SYMBOLS;
+    PreTree.Symbols     = LZX_PRETREE_SYMBOLS;
+}
+
+
+int CLZXCodec::GetBytes(void* Context, int Count, void* Buffer)
+/*
+ * FUNCTION: Supplies input data to the compressor
+ */
+{
+    CLZXCodec* Codec = (CLZXCodec*)Context;
+
+    if ((ULONG)Count > Codec->InputLeft)
+        Count = Codec->InputLeft;
+
+    memcpy(Buffer, Codec->InputPosition, Count);
+    Codec->InputPosition += Count;
+    Codec->InputLeft     -= Count;
+
+    return Count;
+}
+
+
+int CLZXCodec::PutBytes(void* Context, int Count, void* Buffer)
+/*
+ * FUNCTION: Stores compressed data from the compressor
+ */
+{
+    CLZXCodec* Codec = (CLZXCodec*)Context;
+
+    if ((ULONG)Count > Codec->OutputLeft)
+    {
+        Codec->Overflow = true;
+        return 0;
+    }
+
+    memcpy(Codec->OutputPosition, Buffer, Count);
+    Codec->OutputPosition += Count;
+    Codec->OutputLeft     -= Count;
+
+    return Count;
+}
+
+
+int CLZXCodec::AtEndOfInput(void* Context)
+/*
+ * FUNCTION: Tells the compressor whether all input has been supplied
+ */
+{
+    return (((CLZXCodec*)Context)->InputLeft == 0);
+}
+
+
+ULONG CLZXCodec::Compress(void* OutputBuffer,
+                          void* InputBuffer,
+                          ULONG InputLength,
+                          PULONG OutputLength)
+/*
+ * FUNCTION: Compresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer   = Pointer to buffer to place compressed data
+ *     InputBuffer    = Pointer to buffer with data to be compressed
+ *     InputLength    = Length of input buffer
+ *     OutputLength   = Address of buffer to place size of compressed data
+ */
+{
+    DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
+
+    if (!Compressor)
+    {
+        if (lzx_init(&Compressor, WindowBits,
+                     GetBytes, this, AtEndOfInput,
+                     PutBytes, this, NULL, NULL) != 0)
+        {
+            DPRINT(MIN_TRACE, ("lzx_init() failed.\n"));
+            Compressor = NULL;
+            return CS_NOMEMORY;
+        }
+    }
+
+    InputPosition  = (PUCHAR)InputBuffer;
+    InputLeft      = InputLength;
+    OutputPosition = (PUCHAR)OutputBuffer;
+    OutputLeft     = CAB_MAX_COMPSIZE;
+    Overflow       = false;
+
+    /* One LZX block per data block, so every block ends on a frame boundary */
+    lzx_compress_block(Compressor, InputLength, 0);
+
+    /* Only the last block of a folder is short. Full frames are already
+       padded to 16 bits by the compressor, a short one must be padded here */
+    if (InputLength < LZX_FRAME_SIZE)
+    {
+        lzx_align_output(Compressor);
+        lzx_finish(Compressor, NULL);
+        Compressor = NULL;
+    }
+
+    if (Overflow)
+    {
+        DPRINT(MIN_TRACE, ("Compressed data does not fit in a block.\n"));
+        return CS_BADSTREAM;
+    }
+
+    *OutputLength = (ULONG)(OutputPosition - (PUCHAR)OutputBuffer);
+
+    return CS_SUCCESS;
+}
+
+
+void CLZXCodec::EnsureBits(ULONG Count)
+/*
+ * FUNCTION: Makes sure that at least Count (up to 17) bits are buffered
+ * NOTES:
+ *     Reading past the end of the input supplies zeroes. The caller
+ *     finds out by comparing BitPosition with BitEnd
+ */
+{
+    while (BitsLeft < Count)
+    {
+        BitBuffer <<= 16;
+        if (BitPosition + 2 <= BitEnd)
+            BitBuffer |= BitPosition[0] | (BitPosition[1] << 8);
+        BitPosition += 2;
+        BitsLeft    += 16;
+    }
+}
+
+
+ULONG CLZXCodec::ReadBits(ULONG Count)
+/*
+ * FUNCTION: Reads up to 17 bits from the input
+ */
+{
+    if (Count == 0)
+        return 0;
+
+    EnsureBits(Count);
+    BitsLeft -= Count;
+
+    return (BitBuffer >> BitsLeft) & ((1 << Count) - 1);
+}
+
+
+bool CLZXCodec::BuildTree(PLZX_TREE Tree)
+/*
+ * FUNCTION: Builds the decoding tables for a canonical Huffman code
+ * ARGUMENTS:
+ *     Tree = Pointer to tree with the code lengths filled in
+ * RETURNS:
+ *     false if the code lengths don't describe a prefix code
+ */
+{
+    USHORT Offset[LZX_MAX_CODE_LENGTH + 1];
+    ULONG Symbol;
+    ULONG Length;
+    ULONG Code;
+    ULONG Index;
+    ULONG Fill;
+    LONG Left;
+
+    memset(Tree->Count, 0, sizeof(Tree->Count));
+    for (Symbol = 0; Symbol < Tree->Symbols; Symbol++)
+        Tree->Count[Tree->Lengths[Symbol]]++;
+    Tree->Count[0] = 0;
+
+    /* Incomplete codes are allowed, over-subscribed ones are not */
+    Left = 1;
+    for (Length = 1; Length <= LZX_MAX_CODE_LENGTH; Length++)
+    {
+        Left <<= 1;
+        Left -= Tree->Count[Length];
+        if (Left < 0)
+            return false;
+    }
+
+    Offset[1] = 0;
+    for (Length = 1; Length < LZX_MAX_CODE_LENGTH; Length++)
+        Offset[Length + 1] = Offset[Length] + Tree->Count[Length];
+
+    for (Symbol = 0; Symbol < Tree->Symbols; Symbol++)
+    {
+        if (Tree->Lengths[Symbol] != 0)
+            Tree->Sorted[Offset[Tree->Lengths[Symbol]]++] = (USHORT)Symbol;
+    }
+
+    /* Codes of up to LZX_TABLE_BITS bits are looked up directly */
+    memset(Tree->Table, 0xFF, sizeof(Tree->Table));
+
+    Code  = 0;
+    Index = 0;
+    for (Length = 1; Length <= LZX_TABLE_BITS; Length++)
+    {
+        for (Symbol = 0; Symbol < Tree->Count[Length]; Symbol++, Code++)
+        {
+            for (Fill = 0; Fill < (1U << (LZX_TABLE_BITS - Length)); Fill++)
+            {
+                Tree->Table[(Code << (LZX_TABLE_BITS - Length)) + Fill] =
+                    (USHORT)((Tree->Sorted[Index] << 4) | (Length - 1));
+            }
+            Index++;
+        }
+        Code <<= 1;
+    }
+
+    return true;
+}
+
+
+LONG CLZXCodec::DecodeSymbol(PLZX_TREE Tree)
+/*
+ * FUNCTION: Reads one Huffman coded symbol
+ * RETURNS:
+ *     The symbol, or -1 if the input is not a valid code
+ */
+{
+    ULONG Peek;
+    ULONG Entry;
+    ULONG Length;
+    ULONG Code;
+    ULONG First;
+    ULONG Index;
+
+    EnsureBits(LZX_MAX_CODE_LENGTH);
+    Peek = (BitBuffer >> (BitsLeft - LZX_MAX_CODE_LENGTH)) & 0xFFFF;
+
+    Entry = Tree->Table[Peek >> (LZX_MAX_CODE_LENGTH - LZX_TABLE_BITS)];
+    if (Entry != 0xFFFF)
+    {
+        BitsLeft -= (Entry & 0x0F) + 1;
+        return Entry >> 4;
+    }
+
+    /* Longer codes are found one bit at a time */
+    Code  = 0;
+    First = 0;
+    Index = 0;
+    for (Length = 1; Length <= LZX_MAX_CODE_LENGTH; Length++)
+    {
+        Code |= (Peek >> (LZX_MAX_CODE_LENGTH - Length)) & 1;
+        if (Code < First + Tree->Count[Length])
+        {
+            BitsLeft -= Length;
+            return Tree->Sorted[Index + Code - First];
+        }
+        Index += Tree->Count[Length];
+        First += Tree->Count[Length];
+        First <<= 1;
+        Code  <<= 1;
+    }
+
+    return -1;
+}
+
+
+bool CLZXCodec::ReadLengths(PLZX_TREE Tree, ULONG First, ULONG Last)
+/*
+ * FUNCTION: Reads the code lengths of a range of symbols
+ * ARGUMENTS:
+ *     Tree  = Pointer to tree to update
+ *     First = First symbol to read
+ *     Last  = Symbol after the last one to read
+ * RETURNS:
+ *     false if the lengths could not be read
+ * NOTES:
+ *     Runs may overshoot Last a little. The overshoot is kept, as the
+ *     next range is coded relative to it
+ */
+{
+    ULONG Symbol;
+    ULONG Run;
+    LONG Value;
+    ULONG i;
+
+    for (i = 0; i < LZX_PRETREE_SYMBOLS; i++)
+        PreTree.Lengths[i] = (UCHAR)ReadBits(4);
+
+    if (!BuildTree(&PreTree))
+        return false;
+
+    Symbol = First;
+    while (Symbol < Last)
+    {
+        Value = DecodeSymbol(&PreTree);
+        if (Value < 0)
+            return false;
+
+        if (Value == 17)
+        {
+            Run   = ReadBits(4) + 4;
+            Value = 0;
+        }
+        else if (Value == 18)
+        {
+            Run   = ReadBits(5) + 20;
+            Value = 0;
+        }
+        else if (Value == 19)
+        {
+            Run   = ReadBits(1) + 4;
+            Value = DecodeSymbol(&PreTree);
+            if ((Value < 0) || (Value > 16))
+                return false;
+            Value = Tree->Lengths[Symbol] - Value;
+            if (Value < 0)
+                Value += 17;
+        }
+        else
+        {
+            Run   = 1;
+            Value = Tree->Lengths[Symbol] - Value;
+            if (Value < 0)
+                Value += 17;
+        }
+
+        if (Symbol + Run > sizeof(Tree->Lengths))
+            return false;
+
+        while (Run-- > 0)
+            Tree->Lengths[Symbol++] = (UCHAR)Value;
+    }
+
+    return true;
+}
+
+
+ULONG CLZXCodec::ReadBlockHeader()
+/*
+ * FUNCTION: Reads the header and the trees of an LZX block
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG i;
+
+    if (!HeaderRead)
+    {
+        /* Size of the translated file if E8 call translation was used */
+        if (ReadBits(1))
+        {
+            IntelFileSize  = ReadBits(16) << 16;
+            IntelFileSize |= ReadBits(16);
+        }
+        HeaderRead = true;
+    }
+
+    BlockType       = ReadBits(3);
+    BlockRemaining  = ReadBits(16) << 8;
+    BlockRemaining |= ReadBits(8);
+
+    DPRINT(MAX_TRACE, ("Block type (%u)  Length (%u).\n", (UINT)BlockType, (UINT)BlockRemaining));
+
+    switch (BlockType)
+    {
+        case LZX_BLOCK_ALIGNED:
+            for (i = 0; i < LZX_ALIGNED_SYMBOLS; i++)
+                AlignedTree.Lengths[i] = (UCHAR)ReadBits(3);
+            if (!BuildTree(&AlignedTree))
+                return CS_BADSTREAM;
+            /* Fall through */
+
+        case LZX_BLOCK_VERBATIM:
+            if (!ReadLengths(&MainTree, 0, LZX_NUM_CHARS) ||
+                !ReadLengths(&MainTree, LZX_NUM_CHARS, MainTree.Symbols) ||
+                !BuildTree(&MainTree) ||
+                !ReadLengths(&LengthTree, 0, LZX_LENGTH_SYMBOLS) ||
+                !BuildTree(&LengthTree))
+            {
+                return CS_BADSTREAM;
+            }
+            break;
+
+        case LZX_BLOCK_UNCOMPRESSED:
+            /* Skip 1-16 bits of padding to the next 16 bit boundary */
+            EnsureBits(16);
+            if (BitsLeft > 16)
+                BitPosition -= 2;
+            BitsLeft  = 0;
+            BitBuffer = 0;
+
+            if (BitPosition + 12 > BitEnd)
+                return CS_BADSTREAM;
+
+            R0 = BitPosition[0] | (BitPosition[1] << 8) | (BitPosition[2] << 16) | (BitPosition[3] << 24);
+            R1 = BitPosition[4] | (BitPosition[5] << 8) | (BitPosition[6] << 16) | (BitPosition[7] << 24);
+            R2 = BitPosition[8] | (BitPosition[9] << 8) | (BitPosition[10] << 16) | (BitPosition[11] << 24);
+            BitPosition += 12;
+
+            BlockPadding = ((BlockRemaining & 1) != 0);
+            break;
+
+        default:
+            DPRINT(MID_TRACE, ("Bad LZX block type (%u).\n", (UINT)BlockType));
+            return CS_BADSTREAM;
+    }
+
+    return CS_SUCCESS;
+}
+
+
+ULONG CLZXCodec::DecodeRun(ULONG Length)
+/*
+ * FUNCTION: Uncompresses data of the current block into the window
+ * ARGUMENTS:
+ *     Length = Number of bytes to uncompress
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Mask = WindowSize - 1;
+    ULONG MatchLength;
+    ULONG MatchOffset;
+    ULONG Source;
+    ULONG Slot;
+    ULONG Extra;
+    LONG Element;
+    LONG Footer;
+
+    if (BlockType == LZX_BLOCK_UNCOMPRESSED)
+    {
+        if (BitPosition + Length > BitEnd)
+            return CS_BADSTREAM;
+
+        memcpy(Window + WindowPosition, BitPosition, Length);
+        BitPosition    += Length;
+        WindowPosition  = (WindowPosition + Length) & Mask;
+        return CS_SUCCESS;
+    }
+
+    while (Length > 0)
+    {
+        Element = DecodeSymbol(&MainTree);
+        if (Element < 0)
+            return CS_BADSTREAM;
+
+        if (Element < LZX_NUM_CHARS)
+        {
+            Window[WindowPosition] = (UCHAR)Element;
+            WindowPosition = (WindowPosition + 1) & Mask;
+            Length--;
+            continue;
+        }
+
+        Element -= LZX_NUM_CHARS;
+        Slot     = Element >> 3;
+
+        MatchLength = Element & 7;
+        if (MatchLength == LZX_NUM_PRIMARY_LENGTHS)
+        {
+            Footer = DecodeSymbol(&LengthTree);
+            if (Footer < 0)
+                return CS_BADSTREAM;
+            MatchLength += Footer;
+        }
+        MatchLength += LZX_MIN_MATCH;
+
+        /* The first three slots repeat one of the last three offsets */
+        if (Slot == 0)
+        {
+            MatchOffset = R0;
+        }
+        else if (Slot == 1)
+        {
+            MatchOffset = R1;
+            R1 = R0;
+            R0 = MatchOffset;
+        }
+        else if (Slot == 2)
+        {
+            MatchOffset = R2;
+            R2 = R0;
+            R0 = MatchOffset;
+        }
+        else
+        {
+            Extra       = ExtraBits[Slot];
+            MatchOffset = PositionBase[Slot] - 2;
+
+            if ((BlockType == LZX_BLOCK_ALIGNED) && (Extra >= 3))
+            {
+                /* The low three bits have their own tree */
+                MatchOffset += ReadBits(Extra - 3) << 3;
+                Footer = DecodeSymbol(&AlignedTree);
+                if (Footer < 0)
+                    return CS_BADSTREAM;
+                MatchOffset += Footer;
+            }
+            else
+            {
+                MatchOffset += ReadBits(Extra);
+            }
+
+            R2 = R1;
+            R1 = R0;
+            R0 = MatchOffset;
+        }
+
+        /* Matches never cross a frame */
+        if ((MatchLength > Length) || (MatchOffset == 0) || (MatchOffset > WindowSize - 3))
+        {
+            DPRINT(MID_TRACE, ("Bad match. Length (%u)  Offset (%u).\n", (UINT)MatchLength, (UINT)MatchOffset));
+            return CS_BADSTREAM;
+        }
+
+        Length -= MatchLength;
+
+        Source = (WindowPosition - MatchOffset) & Mask;
+        while (MatchLength-- > 0)
+        {
+            Window[WindowPosition] = Window[Source];
+            WindowPosition = (WindowPosition + 1) & Mask;
+            Source         = (Source + 1) & Mask;
+        }
+    }
+
+    return CS_SUCCESS;
+}
+
+
+void CLZXCodec::TranslateE8(PUCHAR Buffer, ULONG Length)
+/*
+ * FUNCTION: Undoes the E8 call translation of a frame
+ * ARGUMENTS:
+ *     Buffer = Pointer to uncompressed frame
+ *     Length = Length of frame
+ * NOTES:
+ *     The compressor replaces the relative target of every E8 (CALL)
+ *     opcode with an absolute one. The last 10 bytes are never translated
+ */
+{
+    PUCHAR End = Buffer + Length - 10;
+    PUCHAR Data = Buffer;
+    LONG Position = (LONG)IntelPosition;
+    LONG Absolute;
+    LONG Relative;
+
+    while (Data < End)
+    {
+        if (*Data++ != 0xE8)
+        {
+            Position++;
+            continue;
+        }
+
+        Absolute = (LONG)(Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((ULONG)Data[3] << 24));
+        if ((Absolute >= -Position) && (Absolute < IntelFileSize))
+        {
+            Relative = (Absolute >= 0) ? Absolute - Position : Absolute + IntelFileSize;
+            Data[0] = (UCHAR)Relative;
+            Data[1] = (UCHAR)(Relative >> 8);
+            Data[2] = (UCHAR)(Relative >> 16);
+            Data[3] = (UCHAR)(Relative >> 24);
+        }
+
+        Data     += 4;
+        Position += 5;
+    }
+}
+
+
+ULONG CLZXCodec::Uncompress(void* OutputBuffer,
+                            void* InputBuffer,
+                            ULONG InputLength,
+                            PULONG OutputLength)
+/*
+ * FUNCTION: Uncompresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place uncompressed data
+ *     InputBuffer  = Pointer to buffer with data to be uncompressed
+ *     InputLength  = Length of input buffer
+ *     OutputLength = Address of buffer to place size of uncompressed data
+ * NOTES:
+ *     The data must be the next block of the folder. A block holds one
+ *     frame, which is 32K unless it is the last one of the folder
+ */
+{
+    ULONG FrameStart;
+    ULONG FrameLength;
+    ULONG Run;
+    ULONG Status;
+    LONG BitsUnread;
+
+    DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
+
+    if (!Window)
+    {
+        Window = (PUCHAR)malloc(WindowSize);
+        if (!Window)
+            return CS_NOMEMORY;
+    }
+
+    BitPosition = (PUCHAR)InputBuffer;
+    BitEnd      = BitPosition + InputLength;
+    BitBuffer   = 0;
+    BitsLeft    = 0;
+
+    FrameStart  = WindowPosition;
+    FrameLength = 0;
+
+    while (FrameLength < LZX_FRAME_SIZE)
+    {
+        if (BlockRemaining == 0)
+        {
+            if (BlockPadding && (BitPosition < BitEnd))
+            {
+                BitPosition++;
+                BlockPadding = false;
+            }
+
+            /* A short frame ends where the data block does */
+            BitsUnread = (LONG)(BitEnd - BitPosition) * 8 + (LONG)BitsLeft;
+            if (BitsUnread < 16)
+                break;
+
+            Status = ReadBlockHeader();
+            if (Status != CS_SUCCESS)
+                return Status;
+        }
+
+        Run = LZX_FRAME_SIZE - FrameLength;
+        if (Run > BlockRemaining)
+            Run = BlockRemaining;
+
+        Status = DecodeRun(Run);
+        if (Status != CS_SUCCESS)
+            return Status;
+
+        BlockRemaining -= Run;
+        FrameLength    += Run;
+    }
+
+    /* Reading beyond the end means the data is truncated */
+    BitsUnread = (LONG)(BitEnd - BitPosition) * 8 + (LONG)BitsLeft;
+    if (BitsUnread < 0)
+    {
+        DPRINT(MID_TRACE, ("Read beyond the end of the block.\n"));
+        return CS_BADSTREAM;
+    }
+
+    memcpy(OutputBuffer, Window + FrameStart, FrameLength);
+
+    /* Translation is only done for the first 1GB */
+    if ((IntelFileSize != 0) && (FrameLength > 10) &&
+        (IntelPosition < LZX_FRAME_SIZE * LZX_FRAME_SIZE))
+    {
+        TranslateE8((PUCHAR)OutputBuffer, FrameLength);
+    }
+    IntelPosition += FrameLength;
+
+    *OutputLength = FrameLength;
+
+    return CS_SUCCESS;
+}
+
+/* EOF */
@@ -0,0 +1,120 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.h
+ * PURPOSE:     CAB codec for LZX compressed data
+ */
+
+#pragma once
+
+#include "cabinet.h"
+#include <stdint.h>
+
+extern "C" {
+#include <lzx_compress.h>
+}
+
+#define LZX_MIN_WINDOW_BITS     15
+#define LZX_MAX_WINDOW_BITS     21
+#define LZX_DEFAULT_WINDOW_BITS 16
+
+#define LZX_FRAME_SIZE          32768
+#define LZX_MIN_MATCH           2
+#define LZX_NUM_CHARS           256
+#define LZX_NUM_PRIMARY_LENGTHS 7
+#define LZX_PRETREE_SYMBOLS     20
+#define LZX_ALIGNED_SYMBOLS     8
+#define LZX_LENGTH_SYMBOLS      249
+#define LZX_MAX_POSITION_SLOTS  50
+#define LZX_MAINTREE_SYMBOLS    (LZX_NUM_CHARS + 8 * LZX_MAX_POSITION_SLOTS)
+#define LZX_MAX_CODE_LENGTH     16
+#define LZX_TABLE_BITS          10
+#define LZX_LENGTHS_SAFETY      64
+
+#define LZX_BLOCK_VERBATIM      1
+#define LZX_BLOCK_ALIGNED       2
+#define LZX_BLOCK_UNCOMPRESSED  3
+
+
+/* Types */
+
+typedef struct _LZX_TREE
+{
+    ULONG Symbols;                          /* Number of symbols in the tree */
+    UCHAR Lengths[LZX_MAINTREE_SYMBOLS + LZX_LENGTHS_SAFETY]; /* Code length of each symbol */
+    USHORT Count[LZX_MAX_CODE_LENGTH + 1];  /* Number of codes of each length */
+    USHORT Sorted[LZX_MAINTREE_SYMBOLS];    /* Symbols in canonical code order */
+    USHORT Table[1 << LZX_TABLE_BITS];      /* Symbol and length of short codes */
+} LZX_TREE, *PLZX_TREE;
+
+
+/* Classes */
+
+class CLZXCodec : public CCABCodec
+{
+public:
+    /* Default constructor */
+    CLZXCodec();
+    /* Default destructor */
+    virtual ~CLZXCodec();
+    /* Starts a new folder */
+    void Reset(ULONG WindowBits);
+    /* Returns the window size of the current folder */
+    ULONG GetWindowBits() { return WindowBits; };
+    /* Compresses a data block */
+    virtual ULONG Compress(void* OutputBuffer,
+                           void* InputBuffer,
+                           ULONG InputLength,
+                           PULONG OutputLength);
+    /* Uncompresses a data block */
+    virtual ULONG Uncompress(void* OutputBuffer,
+                             void* InputBuffer,
+                             ULONG InputLength,
+                             PULONG OutputLength);
+private:
+    static int GetBytes(void* Context, int Count, void* Buffer);
+    static int PutBytes(void* Context, int Count, void* Buffer);
+    static int AtEndOfInput(void* Context);
+    void EnsureBits(ULONG Count);
+    ULONG ReadBits(ULONG Count);
+    bool BuildTree(PLZX_TREE Tree);
+    bool ReadLengths(PLZX_TREE Tree, ULONG First, ULONG Last);
+    LONG DecodeSymbol(PLZX_TREE Tree);
+    ULONG ReadBlockHeader();
+    ULONG DecodeRun(ULONG Length);
+    void TranslateE8(PUCHAR Buffer, ULONG Length);
+
+    ULONG WindowBits;
+    /* Compressor state */
+    lzx_data* Compressor;
+    PUCHAR InputPosition;
+    ULONG InputLeft;
+    PUCHAR OutputPosition;
+    ULONG OutputLeft;
+    bool Overflow;
+    /* Decompressor state */
+    PUCHAR Window;
+    ULONG WindowSize;
+    ULONG WindowPosition;
+    ULONG PositionSlots;
+    ULONG PositionBase[LZX_MAX_POSITION_SLOTS];
+    UCHAR ExtraBits[LZX_MAX_POSITION_SLOTS];
+    ULONG R0, R1, R2;
+    bool HeaderRead;
+    LONG IntelFileSize;
+    ULONG IntelPosition;
+    ULONG BlockType;
+    ULONG BlockRemaining;
+    bool BlockPadding;
+    LZX_TREE MainTree;
+    LZX_TREE LengthTree;
+    LZX_TREE AlignedTree;
+    LZX_TREE PreTree;
+    /* Input bit stream of the current block */
+    PUCHAR BitPosition;
+    PUCHAR BitEnd;
+    ULONG BitBuffer;
+    ULONG BitsLeft;
+};
+
+/* EOF */
@@ -129,7 +129,8 @@ ULONG CMSZipCodec::Uncompress(void* OutputBuffer,
 
     DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
 
-    Magic = *((PUSHORT)InputBuffer);
+    /* The block may be read straight from a mapped cabinet, so it is not aligned */
+    memcpy(&Magic, InputBuffer, sizeof(Magic));
 
     if (Magic != MSZIP_MAGIC)
     {
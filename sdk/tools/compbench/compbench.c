@@ -0,0 +1,232 @@
+/*
+ * PROJECT:     ReactOS compression benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Compares the ratio and the throughput of the RTL compression
+ *              formats on the host.
+ */
+
+#include "rtl.h"
+#include <time.h>
+
+#define MIN_SECONDS     0.5
+#define SAMPLE_SIZE     (4 << 20)
+
+typedef struct _FORMAT_INFO
+{
+    const char *Name;
+    USHORT FormatAndEngine;
+} FORMAT_INFO, *PFORMAT_INFO;
+
+static const FORMAT_INFO Formats[] =
+{
+    { "LZNT1",        COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD },
+    { "LZNT1/max",    COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM },
+    { "XPRESS",       COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_STANDARD },
+    { "XPRESS/max",   COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM },
+    { "XPRESS_HUFF",  COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD },
+    { "XPRESS_HUFF/max", COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM },
+};
+
+PEB CompBenchPeb = { 1 };
+
+/* STUBS **********************************************************************/
+
+NTSTATUS NTAPI
+RtlpDecompressChunksParallel(USHORT Format, PUCHAR UncompressedBuffer, ULONG UncompressedBufferSize,
+                             ULONG ChunkSize, ULONG NumberOfChunks, PUCHAR *ChunkData,
+                             PULONG ChunkSizes)
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/* BENCHMARK ******************************************************************/
+
+static double
+Now(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/* Text-like data, used when no files are given */
+static PUCHAR
+MakeSample(PULONG Size)
+{
+    static const char *Words[] =
+    {
+        "ReactOS", "kernel", "registry", "driver", "NTSTATUS", "the", "of",
+        "compression", "buffer", "chunk", "return", "if", "while", "0x1000",
+        "RtlCompressBuffer", "{", "}", ";", "\n", "    ", "=", "(", ")"
+    };
+    PUCHAR Buffer;
+    ULONG Seed = 1, Pos = 0, Length;
+    const char *Word;
+
+    Buffer = malloc(SAMPLE_SIZE);
+    if (!Buffer) return NULL;
+
+    while (Pos < SAMPLE_SIZE)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Word = Words[(Seed >> 16) % (sizeof(Words) / sizeof(Words[0]))];
+        Length = min((ULONG)strlen(Word), SAMPLE_SIZE - Pos);
+        memcpy(Buffer + Pos, Word, Length);
+        Pos += Length;
+
+        if (Pos < SAMPLE_SIZE && (Seed & 0x300))
+            Buffer[Pos++] = ' ';
+    }
+
+    *Size = SAMPLE_SIZE;
+    return Buffer;
+}
+
+static PUCHAR
+ReadFile(const char *FileName, PULONG Size)
+{
+    PUCHAR Buffer;
+    FILE *File;
+    long Length;
+
+    File = fopen(FileName, "rb");
+    if (!File) return NULL;
+
+    fseek(File, 0, SEEK_END);
+    Length = ftell(File);
+    fseek(File, 0, SEEK_SET);
+
+    Buffer = malloc(Length ? Length : 1);
+    if (Buffer && fread(Buffer, 1, Length, File) != (size_t)Length)
+    {
+        free(Buffer);
+        Buffer = NULL;
+    }
+
+    fclose(File);
+    *Size = (ULONG)Length;
+    return Buffer;
+}
+
+static BOOL
+RunFormat(const FORMAT_INFO *Format, PUCHAR Data, ULONG Size)
+{
+    ULONG WorkSpaceSize, FragmentSize, CompressedSize, FinalSize, BufferSize, Runs;
+    PUCHAR WorkSpace, Compressed, Decompressed;
+    double Start, CompressTime, DecompressTime;
+    NTSTATUS Status;
+    BOOL Result = FALSE;
+
+    Status = RtlGetCompressionWorkSpaceSize(Format->FormatAndEngine, &WorkSpaceSize, &FragmentSize);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("%-16s RtlGetCompressionWorkSpaceSize failed: 0x%08x\n", Format->Name, Status);
+        return FALSE;
+    }
+
+    /* the Huffman variant has a 256 byte table for every 64 KB */
+    BufferSize = Size + Size / 8 + (Size / 0x10000 + 1) * 0x110;
+    WorkSpace = malloc(WorkSpaceSize);
+    Compressed = malloc(BufferSize);
+    Decompressed = malloc(Size + 1);
+    if (!WorkSpace || !Compressed || !Decompressed)
+    {
+        printf("%-16s out of memory\n", Format->Name);
+        goto Quit;
+    }
+
+    Runs = 0;
+    Start = Now();
+    do
+    {
+        Status = RtlCompressBuffer(Format->FormatAndEngine, Data, Size, Compressed,
+                                   BufferSize, 0x1000, &CompressedSize, WorkSpace);
+        Runs++;
+    }
+    while (NT_SUCCESS(Status) && Now() - Start < MIN_SECONDS);
+    CompressTime = (Now() - Start) / Runs;
+
+    if (!NT_SUCCESS(Status))
+    {
+        printf("%-16s RtlCompressBuffer failed: 0x%08x\n", Format->Name, Status);
+        goto Quit;
+    }
+
+    Runs = 0;
+    Start = Now();
+    do
+    {
+        Status = RtlDecompressBuffer(Format->FormatAndEngine & 0xFF, Decompressed, Size,
+                                     Compressed, CompressedSize, &FinalSize);
+        Runs++;
+    }
+    while (NT_SUCCESS(Status) && Now() - Start < MIN_SECONDS);
+    DecompressTime = (Now() - Start) / Runs;
+
+    if (!NT_SUCCESS(Status) || FinalSize != Size || memcmp(Data, Decompressed, Size))
+    {
+        printf("%-16s round trip failed: 0x%08x\n", Format->Name, Status);
+        goto Quit;
+    }
+
+    printf("%-16s %10u %7.2f%% %9.1f %9.1f\n",
+           Format->Name,
+           CompressedSize,
+           Size ? 100.0 * CompressedSize / Size : 0.0,
+           Size / CompressTime / 1e6,
+           Size / DecompressTime / 1e6);
+    Result = TRUE;
+
+Quit:
+    free(WorkSpace);
+    free(Compressed);
+    free(Decompressed);
+    return Result;
+}
+
+static BOOL
+RunAll(const char *Name, PUCHAR Data, ULONG Size)
+{
+    BOOL Result = TRUE;
+    ULONG i;
+
+    printf("\n%s, %u bytes\n", Name, Size);
+    printf("%-16s %10s %8s %9s %9s\n", "Format", "Size", "Ratio", "Comp MB/s", "Dec MB/s");
+
+    for (i = 0; i < sizeof(Formats) / sizeof(Formats[0]); i++)
+        Result &= RunFormat(&Formats[i], Data, Size);
+
+    return Result;
+}
+
+int main(int argc, char *argv[])
+{
+    PUCHAR Data;
+    ULONG Size;
+    BOOL Result = TRUE;
+    int i;
+
+    if (argc < 2)
+    {
+        Data = MakeSample(&Size);
+        if (!Data) return 1;
+
+        Result = RunAll("Built-in sample", Data, Size);
+        free(Data);
+        return Result ? 0 : 1;
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        Data = ReadFile(argv[i], &Size);
+        if (!Data)
+        {
+            printf("Cannot read %s\n", argv[i]);
+            Result = FALSE;
+            continue;
+        }
+
+        Result &= RunAll(argv[i], Data, Size);
+        free(Data);
+    }
+
+    return Result ? 0 : 1;
+}
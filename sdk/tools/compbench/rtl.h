@@ -0,0 +1,105 @@
+/*
+ * PROJECT:     ReactOS compression benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Stand-in for the RTL private header when building
+ *              lib/rtl/compress.c for the host
+ */
+
+#ifndef _COMPBENCH_RTL_H
+#define _COMPBENCH_RTL_H
+
+#include <typedefs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define C_ASSERT(expr) extern char (*c_assert(void)) [(expr) ? 1 : -1]
+
+#define RtlFillMemory(Destination, Length, Fill) memset(Destination, Fill, Length)
+#define RtlEqualMemory(Destination, Source, Length) (!memcmp(Destination, Source, Length))
+
+#ifndef min
+#define min(a, b)  (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b)  (((a) > (b)) ? (a) : (b))
+#endif
+
+typedef USHORT WORD;
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000)
+#define STATUS_BUFFER_ALL_ZEROS         ((NTSTATUS)0x00000117)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002)
+#define STATUS_ACCESS_VIOLATION         ((NTSTATUS)0xC0000005)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000D)
+#define STATUS_NO_MEMORY                ((NTSTATUS)0xC0000017)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BB)
+#define STATUS_BAD_COMPRESSION_BUFFER   ((NTSTATUS)0xC0000242)
+#define STATUS_UNSUPPORTED_COMPRESSION  ((NTSTATUS)0xC000025F)
+
+#define COMPRESSION_FORMAT_NONE         0x0000
+#define COMPRESSION_FORMAT_DEFAULT      0x0001
+#define COMPRESSION_FORMAT_LZNT1        0x0002
+#define COMPRESSION_FORMAT_XPRESS       0x0003
+#define COMPRESSION_FORMAT_XPRESS_HUFF  0x0004
+#define COMPRESSION_ENGINE_STANDARD     0x0000
+#define COMPRESSION_ENGINE_MAXIMUM      0x0100
+#define COMPRESSION_ENGINE_HIBER        0x0200
+
+typedef struct _COMPRESSED_DATA_INFO
+{
+    USHORT CompressionFormatAndEngine;
+    UCHAR CompressionUnitShift;
+    UCHAR ChunkShift;
+    UCHAR ClusterShift;
+    UCHAR Reserved;
+    USHORT NumberOfChunks;
+    ULONG CompressedChunkSizes[ANYSIZE_ARRAY];
+} COMPRESSED_DATA_INFO, *PCOMPRESSED_DATA_INFO;
+
+/* The benchmark is single-threaded, RtlDecompressChunks never goes parallel */
+#define KernelMode 0
+#define UserMode 1
+#define RtlpGetMode() KernelMode
+
+typedef struct _PEB
+{
+    ULONG NumberOfProcessors;
+} PEB, *PPEB;
+
+extern PEB CompBenchPeb;
+#define NtCurrentPeb() (&CompBenchPeb)
+
+#define RtlpAllocateMemory(Bytes, Tag) malloc(Bytes)
+#define RtlpFreeMemory(Mem, Tag) free(Mem)
+
+#define RTLP_PARALLEL_MIN_CHUNKS 16
+
+NTSTATUS NTAPI
+RtlpDecompressChunk(USHORT Format, PUCHAR UncompressedChunk, ULONG UncompressedChunkSize,
+                    PUCHAR CompressedChunk, ULONG CompressedChunkSize);
+
+NTSTATUS NTAPI
+RtlpDecompressChunksParallel(USHORT Format, PUCHAR UncompressedBuffer, ULONG UncompressedBufferSize,
+                             ULONG ChunkSize, ULONG NumberOfChunks, PUCHAR *ChunkData,
+                             PULONG ChunkSizes);
+
+NTSTATUS NTAPI
+RtlCompressBuffer(USHORT CompressionFormatAndEngine, PUCHAR UncompressedBuffer,
+                  ULONG UncompressedBufferSize, PUCHAR CompressedBuffer,
+                  ULONG CompressedBufferSize, ULONG UncompressedChunkSize,
+                  PULONG FinalCompressedSize, PVOID WorkSpace);
+
+NTSTATUS NTAPI
+RtlDecompressBuffer(USHORT CompressionFormat, PUCHAR UncompressedBuffer,
+                    ULONG UncompressedBufferSize, PUCHAR CompressedBuffer,
+                    ULONG CompressedBufferSize, PULONG FinalUncompressedSize);
+
+NTSTATUS NTAPI
+RtlGetCompressionWorkSpaceSize(USHORT CompressionFormatAndEngine,
+                               PULONG CompressBufferAndWorkSpaceSize,
+                               PULONG CompressFragmentWorkSpaceSize);
+
+#endif /* _COMPBENCH_RTL_H */
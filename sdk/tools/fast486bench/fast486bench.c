@@ -0,0 +1,677 @@
+/*
+ * PROJECT:     Fast486 benchmark and conformance harness
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Runs raw guest images on the host build of Fast486, measures
+ *              the speed of the emulator and checks the final CPU state
+ *              against golden traces.
+ */
+
+#include <windef.h>
+#include <fast486.h>
+#include <time.h>
+
+#define DEFAULT_MEMORY_SIZE     (16 << 20)
+#define DEFAULT_MAX_STEPS       2000000000ULL
+#define BATCH_SIZE              65536
+
+/* 16-bit images run in real mode from 1000:0000 */
+#define IMAGE16_SEGMENT         0x1000
+#define IMAGE16_ADDRESS         (IMAGE16_SEGMENT << 4)
+#define IMAGE16_STACK           0xFFFE
+
+/* 32-bit images run in flat protected mode from 0x100000 */
+#define IMAGE32_ADDRESS         0x100000
+#define GDT_ADDRESS             0x800
+#define CODE32_SELECTOR         0x08
+#define DATA32_SELECTOR         0x10
+
+#define MAX_IMAGES              16
+#define MAX_IMAGE_SIZE          0x10000
+#define MAX_GOLDEN_LINES        256
+#define MAX_LINE_LENGTH         512
+
+typedef struct _GUEST_IMAGE
+{
+    const char *Name;
+    const char *Class;
+    BOOLEAN Is32Bit;
+    const UCHAR *Code;
+    ULONG Size;
+} GUEST_IMAGE, *PGUEST_IMAGE;
+
+typedef struct _GUEST_RESULT
+{
+    ULONGLONG Steps;
+    double Seconds;
+    BOOLEAN Halted;
+    char Trace[MAX_LINE_LENGTH];
+} GUEST_RESULT, *PGUEST_RESULT;
+
+/* BUILT-IN BENCHMARKS ********************************************************/
+
+static const UCHAR AluCode[] =
+{
+    0xBA, 0x20, 0x00,       // mov dx, 0x20
+    0x31, 0xC0,             // xor ax, ax
+    0xBB, 0x34, 0x12,       // mov bx, 0x1234
+    0x31, 0xF6,             // xor si, si
+    0xB9, 0xFF, 0xFF,       // L1: mov cx, 0xffff
+    0x01, 0xD8,             // L2: add ax, bx
+    0x83, 0xD6, 0x00,       // adc si, 0
+    0x31, 0xC3,             // xor bx, ax
+    0xC1, 0xC3, 0x03,       // rol bx, 3
+    0x29, 0xC8,             // sub ax, cx
+    0x81, 0xE3, 0xFF, 0x7F, // and bx, 0x7fff
+    0x83, 0xC8, 0x01,       // or ax, 1
+    0x39, 0xD8,             // cmp ax, bx
+    0x72, 0x01,             // jb L3
+    0x47,                   // inc di
+    0x49,                   // L3: dec cx
+    0x75, 0xE5,             // jnz L2
+    0x4A,                   // dec dx
+    0x75, 0xDF,             // jnz L1
+    0xF4,                   // hlt
+};
+
+static const UCHAR StringCode[] =
+{
+    0xB8, 0x00, 0x20,                   // mov ax, 0x2000
+    0x8E, 0xD8,                         // mov ds, ax
+    0x8E, 0xC0,                         // mov es, ax
+    0xFC,                               // cld
+    0x31, 0xFF,                         // xor di, di
+    0x66, 0xB8, 0x04, 0x03, 0x02, 0x01, // mov eax, 0x01020304
+    0xB9, 0x00, 0x40,                   // mov cx, 0x4000
+    0x66, 0xF3, 0xAB,                   // rep stosd
+    0xB8, 0x00, 0x30,                   // mov ax, 0x3000
+    0x8E, 0xC0,                         // mov es, ax
+    0xBA, 0x00, 0x01,                   // mov dx, 0x100
+    0x31, 0xF6,                         // L1: xor si, si
+    0x31, 0xFF,                         // xor di, di
+    0xB9, 0x00, 0x40,                   // mov cx, 0x4000
+    0x66, 0xF3, 0xA5,                   // rep movsd
+    0x31, 0xF6,                         // xor si, si
+    0x31, 0xFF,                         // xor di, di
+    0xB9, 0xFF, 0xFF,                   // mov cx, 0xffff
+    0xF3, 0xA6,                         // repe cmpsb
+    0x89, 0xCB,                         // mov bx, cx
+    0x31, 0xF6,                         // xor si, si
+    0xB9, 0x00, 0x10,                   // mov cx, 0x1000
+    0xAC,                               // L2: lodsb
+    0x00, 0xC4,                         // add ah, al
+    0xE2, 0xFB,                         // loop L2
+    0xBF, 0x00, 0x80,                   // mov di, 0x8000
+    0x88, 0xE0,                         // mov al, ah
+    0xB9, 0x00, 0x01,                   // mov cx, 0x100
+    0xF3, 0xAA,                         // rep stosb
+    0x4A,                               // dec dx
+    0x75, 0xD4,                         // jnz L1
+    0xF4,                               // hlt
+};
+
+static const UCHAR FpuCode[] =
+{
+    0xDB, 0xE3,             // fninit
+    0xD9, 0xEC,             // fldlg2
+    0xD9, 0xEA,             // fldl2e
+    0xD9, 0xEB,             // fldpi
+    0xD9, 0xE8,             // fld1
+    0xBA, 0x20, 0x00,       // mov dx, 0x20
+    0xB9, 0xFF, 0xFF,       // L1: mov cx, 0xffff
+    0xD8, 0xC1,             // L2: fadd st, st(1)
+    0xD8, 0xCB,             // fmul st, st(3)
+    0xD8, 0xF2,             // fdiv st, st(2)
+    0xD8, 0xE3,             // fsub st, st(3)
+    0xD8, 0xC8,             // fmul st, st(0)
+    0xD8, 0xF9,             // fdivr st, st(1)
+    0xE2, 0xF2,             // loop L2
+    0x4A,                   // dec dx
+    0x75, 0xEC,             // jnz L1
+    0xDD, 0x1E, 0x00, 0x01, // fstp qword [0x100]
+    0xDD, 0x1E, 0x08, 0x01, // fstp qword [0x108]
+    0xDD, 0x1E, 0x10, 0x01, // fstp qword [0x110]
+    0xDD, 0x1E, 0x18, 0x01, // fstp qword [0x118]
+    0xF4,                   // hlt
+};
+
+static const UCHAR PagingCode[] =
+{
+    0xFC,                               // cld
+    0xBF, 0x00, 0x10, 0x40, 0x00,       // mov edi, 0x401000
+    0xB8, 0x03, 0x00, 0x00, 0x00,       // mov eax, 3
+    0xB9, 0x00, 0x10, 0x00, 0x00,       // mov ecx, 0x1000
+    0xAB,                               // L1: stosd
+    0x05, 0x00, 0x10, 0x00, 0x00,       // add eax, 0x1000
+    0xE2, 0xF8,                         // loop L1
+    0xBF, 0x00, 0x00, 0x40, 0x00,       // mov edi, 0x400000
+    0xB8, 0x03, 0x10, 0x40, 0x00,       // mov eax, 0x401003
+    0xB9, 0x04, 0x00, 0x00, 0x00,       // mov ecx, 4
+    0xAB,                               // L2: stosd
+    0x05, 0x00, 0x10, 0x00, 0x00,       // add eax, 0x1000
+    0xE2, 0xF8,                         // loop L2
+    0xB8, 0x00, 0x00, 0x40, 0x00,       // mov eax, 0x400000
+    0x0F, 0x22, 0xD8,                   // mov cr3, eax
+    0x0F, 0x20, 0xC0,                   // mov eax, cr0
+    0x0D, 0x00, 0x00, 0x00, 0x80,       // or eax, 0x80000000
+    0x0F, 0x22, 0xC0,                   // mov cr0, eax
+    0x31, 0xDB,                         // xor ebx, ebx
+    0xBA, 0xD0, 0x07, 0x00, 0x00,       // mov edx, 2000
+    0xBE, 0x00, 0x00, 0x80, 0x00,       // L3: mov esi, 0x800000
+    0xB9, 0x00, 0x04, 0x00, 0x00,       // mov ecx, 1024
+    0x8B, 0x06,                         // L4: mov eax, [esi]
+    0x01, 0x46, 0x04,                   // add [esi + 4], eax
+    0x03, 0x5E, 0x08,                   // add ebx, [esi + 8]
+    0xFF, 0x06,                         // inc dword [esi]
+    0x81, 0xC6, 0x00, 0x10, 0x00, 0x00, // add esi, 0x1000
+    0xE2, 0xEE,                         // loop L4
+    0x0F, 0x20, 0xD8,                   // mov eax, cr3
+    0x0F, 0x22, 0xD8,                   // mov cr3, eax
+    0x4A,                               // dec edx
+    0x75, 0xDB,                         // jnz L3
+    0xF4,                               // hlt
+};
+
+static const UCHAR SegmentCode[] =
+{
+    0xB9, 0x40, 0x42, 0x0F, 0x00, // mov ecx, 1000000
+    0x66, 0xBB, 0x10, 0x00,       // mov bx, DATA32_SELECTOR
+    0x8E, 0xDB,                   // L1: mov ds, bx
+    0x8E, 0xC3,                   // mov es, bx
+    0x8E, 0xE3,                   // mov fs, bx
+    0x8E, 0xEB,                   // mov gs, bx
+    0x1E,                         // push ds
+    0x07,                         // pop es
+    0x16,                         // push ss
+    0x0F, 0xA1,                   // pop fs
+    0xE2, 0xF1,                   // loop L1
+    0xF4,                         // hlt
+};
+
+static const GUEST_IMAGE BuiltinImages[] =
+{
+    { "alu",     "ALU",     FALSE, AluCode,     sizeof(AluCode)     },
+    { "string",  "String",  FALSE, StringCode,  sizeof(StringCode)  },
+    { "fpu",     "FPU",     FALSE, FpuCode,     sizeof(FpuCode)     },
+    { "paging",  "Paging",  TRUE,  PagingCode,  sizeof(PagingCode)  },
+    { "segment", "Segment", TRUE,  SegmentCode, sizeof(SegmentCode) },
+};
+
+/* Final state of the built-in benchmarks, in the golden trace format */
+static const char *BuiltinGolden[] =
+{
+    "alu EAX=000027FF ECX=00000000 EDX=00000000 EBX=000007EB"
+    " ESP=0000FFFE EBP=00000000 ESI=00000104 EDI=0000F9FF EIP=0000002C EFL=00000046"
+    " CS=1000 SS=1000 DS=1000 ES=1000 FS=0000 GS=0000 MEM=2C36855D STEPS=24639748",
+    "string EAX=01023030 ECX=00000000 EDX=00000000 EBX=00000000"
+    " ESP=0000FFFE EBP=00000000 ESI=00001000 EDI=00008100 EIP=0000004B EFL=00000046"
+    " CS=1000 SS=1000 DS=2000 ES=3000 FS=0000 GS=0000 MEM=012D8148 STEPS=24120844",
+    "fpu EAX=00000000 ECX=00000000 EDX=00000000 EBX=00000000"
+    " ESP=0000FFFE EBP=00000000 ESI=00000000 EDI=00000000 EIP=00000032 EFL=00000046"
+    " CS=1000 SS=1000 DS=1000 ES=1000 FS=0000 GS=0000 MEM=256491CF STEPS=14679947",
+    "paging EAX=00400000 ECX=00000000 EDX=00000000 EBX=00000000"
+    " ESP=00100000 EBP=00000000 ESI=00C00000 EDI=00400010 EIP=0010006F EFL=00000046"
+    " CS=0008 SS=0010 DS=0010 ES=0010 FS=0010 GS=0010 MEM=A5BE9068 STEPS=12312315",
+    "segment EAX=00000000 ECX=00000000 EDX=00000000 EBX=00000010"
+    " ESP=00100000 EBP=00000000 ESI=00000000 EDI=00000000 EIP=00100019 EFL=00000002"
+    " CS=0008 SS=0010 DS=0010 ES=0010 FS=0010 GS=0010 MEM=8FECEAFB STEPS=9000003",
+    NULL
+};
+
+/* GLOBALS ********************************************************************/
+
+static PUCHAR Memory;
+static ULONG MemorySize = DEFAULT_MEMORY_SIZE;
+static PVOID *MemoryMap;
+static PULONG Tlb;
+static PFAST486_BLOCK_CACHE BlockCache;
+static FAST486_STATE State;
+
+static ULONGLONG MaxSteps = DEFAULT_MAX_STEPS;
+static BOOLEAN UseBlockCache = FALSE;
+static BOOLEAN UseLazyFlags = TRUE;
+static BOOLEAN UseHostFpu = FALSE;
+static BOOLEAN UseTlb = TRUE;
+static BOOLEAN UseMemoryMap = TRUE;
+
+static char *GoldenLines[MAX_GOLDEN_LINES];
+static ULONG GoldenCount;
+
+/* CALLBACKS ******************************************************************/
+
+static VOID
+FASTCALL
+MemReadCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    ULONG i;
+
+    if ((Address < MemorySize) && (Size <= MemorySize - Address))
+    {
+        RtlCopyMemory(Buffer, &Memory[Address], Size);
+        return;
+    }
+
+    /* Nothing is mapped past the end of the memory */
+    for (i = 0; i < Size; i++)
+    {
+        ((PUCHAR)Buffer)[i] = ((Address + i) < MemorySize) ? Memory[Address + i] : 0xFF;
+    }
+}
+
+static VOID
+FASTCALL
+MemWriteCallback(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
+{
+    ULONG i;
+
+    if ((Address < MemorySize) && (Size <= MemorySize - Address))
+    {
+        RtlCopyMemory(&Memory[Address], Buffer, Size);
+        return;
+    }
+
+    for (i = 0; i < Size; i++)
+    {
+        if ((Address + i) < MemorySize) Memory[Address + i] = ((PUCHAR)Buffer)[i];
+    }
+}
+
+/* PRIVATE FUNCTIONS **********************************************************/
+
+static ULONG
+HashMemory(VOID)
+{
+    ULONG Hash = 0x811C9DC5;
+    ULONG i;
+
+    /* FNV-1a, one 32-bit word at a time */
+    for (i = 0; i < MemorySize; i += sizeof(ULONG))
+    {
+        Hash = (Hash ^ *(PULONG)&Memory[i]) * 0x01000193;
+    }
+
+    return Hash;
+}
+
+static BOOLEAN
+LoadImageFile(const char *FileName, BOOLEAN Is32Bit, PGUEST_IMAGE Image, PUCHAR Buffer, ULONG BufferSize)
+{
+    FILE *File;
+    const char *Name;
+    long Size;
+
+    File = fopen(FileName, "rb");
+    if (File == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", FileName);
+        return FALSE;
+    }
+
+    fseek(File, 0, SEEK_END);
+    Size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+
+    if ((Size <= 0) || ((ULONG)Size > BufferSize)
+        || (fread(Buffer, 1, Size, File) != (size_t)Size))
+    {
+        fprintf(stderr, "Cannot load %s\n", FileName);
+        fclose(File);
+        return FALSE;
+    }
+
+    fclose(File);
+
+    /* Traces are keyed by the file name without its path */
+    Name = strrchr(FileName, '/');
+    if (Name == NULL) Name = strrchr(FileName, '\\');
+
+    Image->Name = Name ? Name + 1 : FileName;
+    Image->Class = "-";
+    Image->Is32Bit = Is32Bit;
+    Image->Code = Buffer;
+    Image->Size = (ULONG)Size;
+    return TRUE;
+}
+
+static VOID
+SetupProtectedMode(VOID)
+{
+    /* Null descriptor, flat 32-bit code and flat 32-bit data */
+    static const ULONGLONG Gdt[] =
+    {
+        0ULL,
+        0x00CF9A000000FFFFULL,
+        0x00CF92000000FFFFULL
+    };
+
+    RtlCopyMemory(&Memory[GDT_ADDRESS], Gdt, sizeof(Gdt));
+    State.Gdtr.Address = GDT_ADDRESS;
+    State.Gdtr.Size = sizeof(Gdt) - 1;
+    State.ControlRegisters[FAST486_REG_CR0] |= FAST486_CR0_PE;
+
+    Fast486SetSegment(&State, FAST486_REG_DS, DATA32_SELECTOR);
+    Fast486SetSegment(&State, FAST486_REG_ES, DATA32_SELECTOR);
+    Fast486SetSegment(&State, FAST486_REG_FS, DATA32_SELECTOR);
+    Fast486SetSegment(&State, FAST486_REG_GS, DATA32_SELECTOR);
+    Fast486SetStack(&State, DATA32_SELECTOR, IMAGE32_ADDRESS);
+    Fast486ExecuteAt(&State, CODE32_SELECTOR, IMAGE32_ADDRESS);
+}
+
+static BOOLEAN
+RunImage(PGUEST_IMAGE Image, PGUEST_RESULT Result)
+{
+    ULONG LoadAddress = Image->Is32Bit ? IMAGE32_ADDRESS : IMAGE16_ADDRESS;
+    ULONG i;
+    clock_t Start;
+
+    if (Image->Size > MemorySize - LoadAddress)
+    {
+        fprintf(stderr, "%s does not fit in the memory\n", Image->Name);
+        return FALSE;
+    }
+
+    RtlZeroMemory(Memory, MemorySize);
+    RtlCopyMemory(&Memory[LoadAddress], Image->Code, Image->Size);
+
+    Fast486Initialize(&State,
+                      MemReadCallback,
+                      MemWriteCallback,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      NULL,
+                      UseTlb ? Tlb : NULL);
+
+    if (UseMemoryMap) Fast486SetMemoryMap(&State, MemoryMap, MemorySize / FAST486_PAGE_SIZE);
+    if (UseBlockCache) Fast486SetBlockCache(&State, BlockCache);
+    Fast486EnableLazyFlags(&State, UseLazyFlags);
+    Fast486SetFpuPrecision(&State, UseHostFpu ? FAST486_FPU_HOST : FAST486_FPU_EXACT);
+
+    if (Image->Is32Bit)
+    {
+        SetupProtectedMode();
+    }
+    else
+    {
+        Fast486SetSegment(&State, FAST486_REG_DS, IMAGE16_SEGMENT);
+        Fast486SetSegment(&State, FAST486_REG_ES, IMAGE16_SEGMENT);
+        Fast486SetStack(&State, IMAGE16_SEGMENT, IMAGE16_STACK);
+        Fast486ExecuteAt(&State, IMAGE16_SEGMENT, 0);
+    }
+
+    Result->Steps = 0;
+    Start = clock();
+
+    while (!State.Halted && (Result->Steps < MaxSteps))
+    {
+        Result->Steps += Fast486ExecuteBatch(&State, (ULONG)min(MaxSteps - Result->Steps, BATCH_SIZE));
+    }
+
+    Result->Seconds = (double)(clock() - Start) / CLOCKS_PER_SEC;
+    Result->Halted = State.Halted;
+
+    i = sprintf(Result->Trace,
+                "%s EAX=%08X ECX=%08X EDX=%08X EBX=%08X ESP=%08X EBP=%08X ESI=%08X EDI=%08X",
+                Image->Name,
+                State.GeneralRegs[FAST486_REG_EAX].Long,
+                State.GeneralRegs[FAST486_REG_ECX].Long,
+                State.GeneralRegs[FAST486_REG_EDX].Long,
+                State.GeneralRegs[FAST486_REG_EBX].Long,
+                State.GeneralRegs[FAST486_REG_ESP].Long,
+                State.GeneralRegs[FAST486_REG_EBP].Long,
+                State.GeneralRegs[FAST486_REG_ESI].Long,
+                State.GeneralRegs[FAST486_REG_EDI].Long);
+
+    sprintf(Result->Trace + i,
+            " EIP=%08X EFL=%08X CS=%04X SS=%04X DS=%04X ES=%04X FS=%04X GS=%04X MEM=%08X STEPS=%llu",
+            State.InstPtr.Long,
+            State.Flags.Long,
+            State.SegmentRegs[FAST486_REG_CS].Selector,
+            State.SegmentRegs[FAST486_REG_SS].Selector,
+            State.SegmentRegs[FAST486_REG_DS].Selector,
+            State.SegmentRegs[FAST486_REG_ES].Selector,
+            State.SegmentRegs[FAST486_REG_FS].Selector,
+            State.SegmentRegs[FAST486_REG_GS].Selector,
+            HashMemory(),
+            (unsigned long long)Result->Steps);
+
+    return TRUE;
+}
+
+static const char *
+FindGolden(const char *Name)
+{
+    size_t Length = strlen(Name);
+    ULONG i;
+
+    for (i = 0; i < GoldenCount; i++)
+    {
+        if (!strncmp(GoldenLines[i], Name, Length) && (GoldenLines[i][Length] == ' '))
+        {
+            return GoldenLines[i];
+        }
+    }
+
+    return NULL;
+}
+
+static BOOLEAN
+AddGolden(const char *Line)
+{
+    size_t Length = strcspn(Line, "\r\n");
+
+    /* Skip comments and empty lines */
+    if ((Length == 0) || (Line[0] == '#')) return TRUE;
+
+    if (GoldenCount == MAX_GOLDEN_LINES) return FALSE;
+
+    GoldenLines[GoldenCount] = malloc(Length + 1);
+    if (GoldenLines[GoldenCount] == NULL) return FALSE;
+
+    memcpy(GoldenLines[GoldenCount], Line, Length);
+    GoldenLines[GoldenCount][Length] = '\0';
+    GoldenCount++;
+
+    return TRUE;
+}
+
+static BOOLEAN
+LoadGoldenFile(const char *FileName)
+{
+    char Line[MAX_LINE_LENGTH];
+    FILE *File;
+
+    File = fopen(FileName, "r");
+    if (File == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", FileName);
+        return FALSE;
+    }
+
+    while (fgets(Line, sizeof(Line), File))
+    {
+        if (!AddGolden(Line))
+        {
+            fprintf(stderr, "Too many traces in %s\n", FileName);
+            fclose(File);
+            return FALSE;
+        }
+    }
+
+    fclose(File);
+    return TRUE;
+}
+
+static VOID
+Usage(VOID)
+{
+    printf("Usage: fast486bench [options] [[-16|-32] image ...]\n"
+           "\n"
+           "Runs each raw image until it executes HLT and prints the speed of the\n"
+           "emulator. 16-bit images are loaded at 1000:0000 in real mode, 32-bit\n"
+           "images at 0x100000 in flat protected mode. Without images, the built-in\n"
+           "benchmarks are run and checked against their known final state.\n"
+           "\n"
+           "  -16, -32     Mode of the images that follow (default: -16)\n"
+           "  -m <MB>      Guest memory size (default: %u MB)\n"
+           "  -n <steps>   Stop an image after this many instructions\n"
+           "  -g <file>    Compare the final state with the golden traces in <file>\n"
+           "  -w <file>    Write the final states to <file> as golden traces\n"
+           "  -B           Use the block cache (FAST486_ENABLE_BLOCK_CACHE builds)\n"
+           "  -L           Disable the lazy flags\n"
+           "  -T           Disable the TLB\n"
+           "  -M           Disable the direct memory map\n"
+           "  -F           Use the host FPU for the basic arithmetic\n",
+           DEFAULT_MEMORY_SIZE >> 20);
+}
+
+/* FUNCTIONS ******************************************************************/
+
+int main(int argc, char *argv[])
+{
+    static UCHAR ImageBuffers[MAX_IMAGES][MAX_IMAGE_SIZE];
+    GUEST_IMAGE Images[MAX_IMAGES];
+    ULONG ImageCount = 0;
+    BOOLEAN Is32Bit = FALSE;
+    BOOLEAN Builtin, Failed = FALSE;
+    const char *GoldenFile = NULL;
+    const char *OutputFile = NULL;
+    PGUEST_IMAGE ImageList;
+    GUEST_RESULT Result;
+    FILE *Output = NULL;
+    const char *Golden;
+    const char *Status;
+    ULONG i;
+    int Arg;
+
+    for (Arg = 1; Arg < argc; Arg++)
+    {
+        if (!strcmp(argv[Arg], "-16")) Is32Bit = FALSE;
+        else if (!strcmp(argv[Arg], "-32")) Is32Bit = TRUE;
+        else if (!strcmp(argv[Arg], "-m") && (Arg + 1 < argc)) MemorySize = strtoul(argv[++Arg], NULL, 0) << 20;
+        else if (!strcmp(argv[Arg], "-n") && (Arg + 1 < argc)) MaxSteps = strtoull(argv[++Arg], NULL, 0);
+        else if (!strcmp(argv[Arg], "-g") && (Arg + 1 < argc)) GoldenFile = argv[++Arg];
+        else if (!strcmp(argv[Arg], "-w") && (Arg + 1 < argc)) OutputFile = argv[++Arg];
+#ifndef FAST486_NO_BLOCK_CACHE
+        else if (!strcmp(argv[Arg], "-B")) UseBlockCache = TRUE;
+#endif
+        else if (!strcmp(argv[Arg], "-L")) UseLazyFlags = FALSE;
+        else if (!strcmp(argv[Arg], "-T")) UseTlb = FALSE;
+        else if (!strcmp(argv[Arg], "-M")) UseMemoryMap = FALSE;
+        else if (!strcmp(argv[Arg], "-F")) UseHostFpu = TRUE;
+        else if (argv[Arg][0] == '-')
+        {
+            Usage();
+            return 1;
+        }
+        else
+        {
+            if (ImageCount == MAX_IMAGES)
+            {
+                fprintf(stderr, "Too many images\n");
+                return 1;
+            }
+
+            if (!LoadImageFile(argv[Arg], Is32Bit, &Images[ImageCount], ImageBuffers[ImageCount], MAX_IMAGE_SIZE))
+            {
+                return 1;
+            }
+
+            ImageCount++;
+        }
+    }
+
+    /* The memory must hold the 32-bit images and the page tables of the built-in ones */
+    if ((MemorySize < DEFAULT_MEMORY_SIZE) || (MemorySize % FAST486_PAGE_SIZE))
+    {
+        fprintf(stderr, "The memory size must be at least %u MB\n", DEFAULT_MEMORY_SIZE >> 20);
+        return 1;
+    }
+
+    Builtin = (ImageCount == 0);
+    ImageList = Builtin ? (PGUEST_IMAGE)BuiltinImages : Images;
+    if (Builtin) ImageCount = sizeof(BuiltinImages) / sizeof(BuiltinImages[0]);
+
+    if (GoldenFile)
+    {
+        if (!LoadGoldenFile(GoldenFile)) return 1;
+    }
+    else if (Builtin)
+    {
+        for (i = 0; BuiltinGolden[i] != NULL; i++) AddGolden(BuiltinGolden[i]);
+    }
+
+    if (OutputFile)
+    {
+        Output = fopen(OutputFile, "w");
+        if (Output == NULL)
+        {
+            fprintf(stderr, "Cannot create %s\n", OutputFile);
+            return 1;
+        }
+    }
+
+    Memory = malloc(MemorySize);
+    MemoryMap = malloc((MemorySize / FAST486_PAGE_SIZE) * sizeof(PVOID));
+    Tlb = malloc(FAST486_NUM_TLB_ENTRIES * sizeof(ULONG));
+    BlockCache = malloc(sizeof(FAST486_BLOCK_CACHE));
+
+    if (!Memory || !MemoryMap || !Tlb || !BlockCache)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    for (i = 0; i < MemorySize / FAST486_PAGE_SIZE; i++)
+    {
+        MemoryMap[i] = &Memory[i * FAST486_PAGE_SIZE];
+    }
+
+    printf("%-16s %-8s %14s %9s %9s  %s\n", "Image", "Class", "Instructions", "Seconds", "MIPS", "Result");
+
+    for (i = 0; i < ImageCount; i++)
+    {
+        if (!RunImage(&ImageList[i], &Result))
+        {
+            Failed = TRUE;
+            continue;
+        }
+
+        Golden = FindGolden(ImageList[i].Name);
+
+        if (!Result.Halted) Status = "NOT HALTED";
+        else if (Golden == NULL) Status = "-";
+        else if (strcmp(Golden, Result.Trace)) Status = "MISMATCH";
+        else Status = "OK";
+
+        if (!Result.Halted || ((Golden != NULL) && strcmp(Golden, Result.Trace))) Failed = TRUE;
+
+        printf("%-16s %-8s %14llu %9.3f %9.2f  %s\n",
+               ImageList[i].Name,
+               ImageList[i].Class,
+               (unsigned long long)Result.Steps,
+               Result.Seconds,
+               (Result.Seconds > 0.0) ? (double)Result.Steps / (Result.Seconds * 1e6) : 0.0,
+               Status);
+
+        if ((Golden != NULL) && strcmp(Golden, Result.Trace))
+        {
+            printf("  expected: %s\n  actual:   %s\n", Golden, Result.Trace);
+        }
+
+        if (Output) fprintf(Output, "%s\n", Result.Trace);
+    }
+
+    if (Output) fclose(Output);
+
+    free(BlockCache);
+    free(Tlb);
+    free(MemoryMap);
+    free(Memory);
+
+    for (i = 0; i < GoldenCount; i++) free(GoldenLines[i]);
+
+    return Failed ? 1 : 0;
+}
+
+/* EOF */
@@ -0,0 +1,1615 @@
+/*
+ * PROJECT:     ReactOS heap benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Runs the RTL heap on the host, on top of an mmap based
+ *              virtual memory mock, and replays synthetic and captured
+ *              allocation traces on several threads.
+ */
+
+/* Besides the built-in larson and xmalloc workloads, trace files can be
+   replayed. They have one operation per line, the pointers only pair the
+   operations of a block and may be any hex value:
+
+       <thread> a <size> <pointer>
+       <thread> r <pointer> <size> <new pointer>
+       <thread> f <pointer>
+
+   Blank lines and lines starting with '#' are ignored. Every block keeps the
+   order of its operations when the threads of a trace are spread over fewer
+   or more benchmark threads. */
+
+#include "rtl.h"
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_THREADS         64
+#define MAX_THREAD_COUNTS   16
+#define MAX_LOCKS           64
+#define SAMPLE_INTERVAL     1000000     // ns
+#define TRACE_MIN_OPS       1000000     // replayed per run unless -n is given
+#define TRACE_HASH_BITS     20
+
+#define HEAP_FRONT_END_LFH  2           // HeapCompatibilityInformation value
+
+#define LARSON_BLOCKS       5000        // per thread
+#define LARSON_MIN_SIZE     8
+#define LARSON_MAX_SIZE     1000
+
+#define XMALLOC_RING_SIZE   4096
+#define XMALLOC_BATCH       64
+
+typedef struct _VM_REGION
+{
+    PUCHAR Base;
+    SIZE_T Size;
+    PUCHAR Committed;           // one byte per page
+} VM_REGION, *PVM_REGION;
+
+typedef struct _LOCK_STATS
+{
+    ULONGLONG Acquires;
+    ULONGLONG Contentions;
+    ULONGLONG HoldTime;
+} LOCK_STATS, *PLOCK_STATS;
+
+typedef struct _LARSON_ARRAY
+{
+    volatile LONG Owned;
+    PVOID Blocks[LARSON_BLOCKS];
+    ULONG Sizes[LARSON_BLOCKS];
+} LARSON_ARRAY, *PLARSON_ARRAY;
+
+/* Filled by one thread and drained by the next one */
+typedef struct _XMALLOC_RING
+{
+    volatile ULONG Head;
+    volatile ULONG Tail;
+    PVOID Blocks[XMALLOC_RING_SIZE];
+    ULONG Sizes[XMALLOC_RING_SIZE];
+} XMALLOC_RING, *PXMALLOC_RING;
+
+typedef struct _TRACE_OP
+{
+    ULONG Object;
+    ULONG Sequence;             // operations on the object before this one
+    ULONG Size;
+    USHORT Thread;              // in order of appearance in the trace
+    UCHAR Type;                 // 'a', 'r' or 'f'
+} TRACE_OP, *PTRACE_OP;
+
+typedef struct _TRACE_OBJECT
+{
+    PVOID Block;
+    ULONG Size;
+    ULONG OpCount;              // in one pass
+    volatile ULONG Done;        // over all passes
+    USHORT LastThread;
+    BOOLEAN Live;
+} TRACE_OBJECT, *PTRACE_OBJECT;
+
+typedef struct _TRACE_POINTER
+{
+    ULONGLONG Pointer;
+    ULONG Object;
+    LONG Next;
+} TRACE_POINTER, *PTRACE_POINTER;
+
+typedef struct _TRACE
+{
+    PTRACE_OP Ops;
+    ULONG OpCount;
+    PTRACE_OBJECT Objects;
+    ULONG ObjectCount;
+    ULONG ThreadCount;
+    SIZE_T PeakLive;
+    ULONG Ignored;
+} TRACE, *PTRACE;
+
+typedef struct _BENCH_RUN *PBENCH_RUN;
+
+typedef struct _BENCH_THREAD
+{
+    PBENCH_RUN Run;
+    ULONG Index;
+    ULONG Seed;
+    ULONGLONG Ops;
+    ULONG Failures;
+    volatile LONG_PTR Live;     // bytes allocated minus bytes freed by this thread
+    PULONG TraceOps;
+    ULONG TraceOpCount;
+    pthread_t Handle;
+    BOOL Started;
+    UCHAR Padding[64];          // keeps the counters of two threads apart
+} BENCH_THREAD, *PBENCH_THREAD;
+
+typedef struct _WORKLOAD
+{
+    const char *Name;
+    BOOL (*Prepare)(PBENCH_RUN Run);
+    VOID (*Worker)(PBENCH_THREAD Thread);
+    VOID (*Cleanup)(PBENCH_RUN Run);
+} WORKLOAD, *PWORKLOAD;
+
+typedef struct _BENCH_RUN
+{
+    const WORKLOAD *Workload;
+    PTRACE Trace;
+    PVOID Heap;
+    ULONG ThreadCount;
+    ULONG Passes;
+    volatile LONG Stop;
+    volatile LONG Finished;
+    PLARSON_ARRAY Arrays;
+    PXMALLOC_RING Rings;
+    BENCH_THREAD Threads[MAX_THREADS];
+} BENCH_RUN;
+
+PEB HeapBenchPeb;
+__thread TEB HeapBenchTeb;
+static __thread NTSTATUS LastStatus;
+
+static pthread_mutex_t VmLock = PTHREAD_MUTEX_INITIALIZER;
+static PVM_REGION *Regions;
+static ULONG RegionCount;
+static ULONG RegionMax;
+static SIZE_T VmCommitted;
+static SIZE_T VmPeakCommitted;
+static ULONG VmCalls;
+
+static pthread_mutex_t LockListLock = PTHREAD_MUTEX_INITIALIZER;
+static PHEAP_LOCK LockList[MAX_LOCKS];
+static LOCK_STATS DeletedLockStats;
+
+static double Seconds = 1.0;
+static ULONG Passes;
+
+/* HELPERS ********************************************************************/
+
+static ULONGLONG
+NowNs(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (ULONGLONG)Time.tv_sec * 1000000000 + Time.tv_nsec;
+}
+
+static VOID
+SleepNs(ULONG Nanoseconds)
+{
+    struct timespec Time = { 0, Nanoseconds };
+
+    nanosleep(&Time, NULL);
+}
+
+static ULONG
+Random(PULONG Seed)
+{
+    ULONG Value = *Seed;
+
+    Value ^= Value << 13;
+    Value ^= Value >> 17;
+    Value ^= Value << 5;
+    return *Seed = Value;
+}
+
+static ULONG
+GetProcessorCount(void)
+{
+    LONG Count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (Count < 1)
+        return 1;
+    if (Count > MAX_THREADS)
+        return MAX_THREADS;
+    return Count;
+}
+
+/* VIRTUAL MEMORY *************************************************************/
+
+/* Caller holds VmLock */
+static PVM_REGION
+VmFindRegion(PVOID Address, PULONG Position)
+{
+    LONG Low = 0, High = (LONG)RegionCount - 1, Middle;
+    PVM_REGION Region;
+
+    while (Low <= High)
+    {
+        Middle = (Low + High) / 2;
+        Region = Regions[Middle];
+
+        if ((PUCHAR)Address < Region->Base)
+            High = Middle - 1;
+        else if ((PUCHAR)Address >= Region->Base + Region->Size)
+            Low = Middle + 1;
+        else
+        {
+            if (Position) *Position = Middle;
+            return Region;
+        }
+    }
+
+    if (Position) *Position = Low;
+    return NULL;
+}
+
+static PVM_REGION
+VmInsertRegion(PUCHAR Base, SIZE_T Size)
+{
+    PVM_REGION Region, *NewRegions;
+    ULONG Position;
+
+    if (RegionCount == RegionMax)
+    {
+        NewRegions = realloc(Regions, (RegionMax + 64) * sizeof(PVM_REGION));
+        if (!NewRegions) return NULL;
+        Regions = NewRegions;
+        RegionMax += 64;
+    }
+
+    Region = malloc(sizeof(VM_REGION));
+    if (!Region) return NULL;
+
+    Region->Committed = calloc(Size >> PAGE_SHIFT, 1);
+    if (!Region->Committed)
+    {
+        free(Region);
+        return NULL;
+    }
+
+    Region->Base = Base;
+    Region->Size = Size;
+
+    VmFindRegion(Base, &Position);
+    memmove(&Regions[Position + 1], &Regions[Position], (RegionCount - Position) * sizeof(PVM_REGION));
+    Regions[Position] = Region;
+    RegionCount++;
+
+    return Region;
+}
+
+static VOID
+VmCommit(PVM_REGION Region, PUCHAR Start, PUCHAR End)
+{
+    ULONG_PTR Page;
+
+    mprotect(Start, End - Start, PROT_READ | PROT_WRITE);
+
+    for (Page = (Start - Region->Base) >> PAGE_SHIFT; Page < (ULONG_PTR)(End - Region->Base) >> PAGE_SHIFT; Page++)
+    {
+        if (Region->Committed[Page]) continue;
+        Region->Committed[Page] = 1;
+        VmCommitted += PAGE_SIZE;
+    }
+
+    VmPeakCommitted = max(VmPeakCommitted, VmCommitted);
+}
+
+/* Decommitted pages read as zeroes again once committed, like on NT */
+static VOID
+VmDecommit(PVM_REGION Region, PUCHAR Start, PUCHAR End, BOOL Release)
+{
+    ULONG_PTR Page;
+
+    if (Release)
+        munmap(Start, End - Start);
+    else
+        mmap(Start, End - Start, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+
+    for (Page = (Start - Region->Base) >> PAGE_SHIFT; Page < (ULONG_PTR)(End - Region->Base) >> PAGE_SHIFT; Page++)
+    {
+        if (!Region->Committed[Page]) continue;
+        Region->Committed[Page] = 0;
+        VmCommitted -= PAGE_SIZE;
+    }
+}
+
+NTSTATUS NTAPI
+ZwAllocateVirtualMemory(HANDLE ProcessHandle, PVOID *BaseAddress, ULONG_PTR ZeroBits,
+                        PSIZE_T RegionSize, ULONG AllocationType, ULONG Protect)
+{
+    PVM_REGION Region;
+    PUCHAR Start, End;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (!*RegionSize || !(AllocationType & (MEM_RESERVE | MEM_COMMIT)))
+        return STATUS_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&VmLock);
+    VmCalls++;
+
+    if (!*BaseAddress)
+    {
+        /* Committing without a base address reserves the range as well */
+        Start = mmap(NULL, ROUND_UP(*RegionSize, PAGE_SIZE), PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (Start == MAP_FAILED)
+        {
+            Status = STATUS_NO_MEMORY;
+            goto Quit;
+        }
+
+        End = Start + ROUND_UP(*RegionSize, PAGE_SIZE);
+        Region = VmInsertRegion(Start, End - Start);
+        if (!Region)
+        {
+            munmap(Start, End - Start);
+            Status = STATUS_NO_MEMORY;
+            goto Quit;
+        }
+    }
+    else
+    {
+        /* The heap never reserves at a given address */
+        Start = (PUCHAR)ROUND_DOWN(*BaseAddress, PAGE_SIZE);
+        End = (PUCHAR)ROUND_UP((PUCHAR)*BaseAddress + *RegionSize, PAGE_SIZE);
+        Region = VmFindRegion(Start, NULL);
+        if (!Region || End > Region->Base + Region->Size || (AllocationType & MEM_RESERVE))
+        {
+            Status = STATUS_CONFLICTING_ADDRESSES;
+            goto Quit;
+        }
+    }
+
+    if (AllocationType & MEM_COMMIT)
+        VmCommit(Region, Start, End);
+
+    *BaseAddress = Start;
+    *RegionSize = End - Start;
+
+Quit:
+    pthread_mutex_unlock(&VmLock);
+    return Status;
+}
+
+NTSTATUS NTAPI
+ZwFreeVirtualMemory(HANDLE ProcessHandle, PVOID *BaseAddress,
+                    PSIZE_T RegionSize, ULONG FreeType)
+{
+    PVM_REGION Region;
+    PUCHAR Start, End;
+    ULONG Position;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    pthread_mutex_lock(&VmLock);
+    VmCalls++;
+
+    Region = VmFindRegion(*BaseAddress, &Position);
+    if (!Region)
+    {
+        Status = STATUS_MEMORY_NOT_ALLOCATED;
+        goto Quit;
+    }
+
+    Start = (PUCHAR)ROUND_DOWN(*BaseAddress, PAGE_SIZE);
+    if (*RegionSize)
+        End = (PUCHAR)ROUND_UP((PUCHAR)*BaseAddress + *RegionSize, PAGE_SIZE);
+    else
+        End = Region->Base + Region->Size;
+
+    if (End > Region->Base + Region->Size)
+    {
+        Status = STATUS_UNABLE_TO_FREE_VM;
+        goto Quit;
+    }
+
+    if (FreeType == MEM_DECOMMIT)
+    {
+        VmDecommit(Region, Start, End, FALSE);
+    }
+    else if (FreeType == MEM_RELEASE)
+    {
+        /* A whole region, or its end like the heap does when shrinking big blocks */
+        if (*RegionSize && Start == Region->Base && End != Region->Base + Region->Size)
+        {
+            Status = STATUS_UNABLE_TO_FREE_VM;
+            goto Quit;
+        }
+        if (!*RegionSize && Start != Region->Base)
+        {
+            Status = STATUS_FREE_VM_NOT_AT_BASE;
+            goto Quit;
+        }
+        if (End != Region->Base + Region->Size)
+        {
+            Status = STATUS_UNABLE_TO_FREE_VM;
+            goto Quit;
+        }
+
+        VmDecommit(Region, Start, End, TRUE);
+
+        if (Start == Region->Base)
+        {
+            memmove(&Regions[Position], &Regions[Position + 1], (RegionCount - Position - 1) * sizeof(PVM_REGION));
+            RegionCount--;
+            free(Region->Committed);
+            free(Region);
+        }
+        else
+        {
+            Region->Size = Start - Region->Base;
+        }
+    }
+    else
+    {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Quit;
+    }
+
+    *BaseAddress = Start;
+    *RegionSize = End - Start;
+
+Quit:
+    pthread_mutex_unlock(&VmLock);
+    return Status;
+}
+
+NTSTATUS NTAPI
+ZwQueryVirtualMemory(HANDLE ProcessHandle, PVOID BaseAddress,
+                     MEMORY_INFORMATION_CLASS MemoryInformationClass,
+                     PVOID MemoryInformation, SIZE_T MemoryInformationLength,
+                     PSIZE_T ReturnLength)
+{
+    PMEMORY_BASIC_INFORMATION Info = MemoryInformation;
+    PVM_REGION Region;
+    ULONG_PTR Page, Pages;
+    UCHAR State;
+
+    if (MemoryInformationClass != MemoryBasicInformation)
+        return STATUS_NOT_IMPLEMENTED;
+    if (MemoryInformationLength < sizeof(MEMORY_BASIC_INFORMATION))
+        return STATUS_INFO_LENGTH_MISMATCH;
+
+    pthread_mutex_lock(&VmLock);
+
+    RtlZeroMemory(Info, sizeof(MEMORY_BASIC_INFORMATION));
+    Info->BaseAddress = (PVOID)ROUND_DOWN(BaseAddress, PAGE_SIZE);
+
+    Region = VmFindRegion(BaseAddress, NULL);
+    if (!Region)
+    {
+        Info->RegionSize = PAGE_SIZE;
+        Info->State = MEM_FREE;
+        Info->Protect = PAGE_NOACCESS;
+    }
+    else
+    {
+        /* Pages in the same state as the first one */
+        Pages = Region->Size >> PAGE_SHIFT;
+        Page = ((PUCHAR)Info->BaseAddress - Region->Base) >> PAGE_SHIFT;
+        State = Region->Committed[Page];
+        while (Page < Pages && Region->Committed[Page] == State)
+            Page++;
+
+        Info->AllocationBase = Region->Base;
+        Info->AllocationProtect = PAGE_READWRITE;
+        Info->RegionSize = Region->Base + (Page << PAGE_SHIFT) - (PUCHAR)Info->BaseAddress;
+        Info->State = State ? MEM_COMMIT : MEM_RESERVE;
+        Info->Protect = State ? PAGE_READWRITE : 0;
+        Info->Type = MEM_PRIVATE;
+    }
+
+    pthread_mutex_unlock(&VmLock);
+
+    if (ReturnLength) *ReturnLength = sizeof(MEMORY_BASIC_INFORMATION);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NTAPI
+ZwQuerySystemInformation(SYSTEM_INFORMATION_CLASS SystemInformationClass,
+                         PVOID SystemInformation, ULONG Length, PULONG ResultLength)
+{
+    PSYSTEM_BASIC_INFORMATION Info = SystemInformation;
+
+    if (SystemInformationClass != SystemBasicInformation)
+        return STATUS_NOT_IMPLEMENTED;
+    if (Length < sizeof(SYSTEM_BASIC_INFORMATION))
+        return STATUS_INFO_LENGTH_MISMATCH;
+
+    RtlZeroMemory(Info, sizeof(SYSTEM_BASIC_INFORMATION));
+    Info->PageSize = PAGE_SIZE;
+    Info->AllocationGranularity = 0x10000;
+    Info->MinimumUserModeAddress = 0x10000;
+#ifdef _WIN64
+    Info->MaximumUserModeAddress = 0x7FFFFFEFFFF;
+#else
+    Info->MaximumUserModeAddress = 0x7FFEFFFF;
+#endif
+    Info->NumberOfProcessors = (CCHAR)HeapBenchPeb.NumberOfProcessors;
+
+    if (ResultLength) *ResultLength = sizeof(SYSTEM_BASIC_INFORMATION);
+    return STATUS_SUCCESS;
+}
+
+/* LOCKS **********************************************************************/
+
+NTSTATUS NTAPI
+RtlInitializeHeapLock(PHEAP_LOCK *Lock)
+{
+    pthread_mutexattr_t Attributes;
+    ULONG i;
+
+    RtlZeroMemory(*Lock, sizeof(HEAP_LOCK));
+
+    /* Critical sections can be entered recursively */
+    pthread_mutexattr_init(&Attributes);
+    pthread_mutexattr_settype(&Attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&(*Lock)->Mutex, &Attributes);
+    pthread_mutexattr_destroy(&Attributes);
+
+    pthread_mutex_lock(&LockListLock);
+    for (i = 0; i < MAX_LOCKS && LockList[i]; i++);
+    if (i < MAX_LOCKS) LockList[i] = *Lock;
+    pthread_mutex_unlock(&LockListLock);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NTAPI
+RtlDeleteHeapLock(PHEAP_LOCK Lock)
+{
+    ULONG i;
+
+    pthread_mutex_lock(&LockListLock);
+    for (i = 0; i < MAX_LOCKS; i++)
+    {
+        if (LockList[i] != Lock) continue;
+        LockList[i] = NULL;
+        DeletedLockStats.Acquires += Lock->Acquires;
+        DeletedLockStats.Contentions += Lock->Contentions;
+        DeletedLockStats.HoldTime += Lock->HoldTime;
+    }
+    pthread_mutex_unlock(&LockListLock);
+
+    pthread_mutex_destroy(&Lock->Mutex);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS NTAPI
+RtlEnterHeapLock(PHEAP_LOCK Lock, BOOLEAN Exclusive)
+{
+    BOOL Contended = FALSE;
+
+    if (pthread_mutex_trylock(&Lock->Mutex))
+    {
+        pthread_mutex_lock(&Lock->Mutex);
+        Contended = TRUE;
+    }
+
+    if (++Lock->Recursion == 1)
+    {
+        Lock->Acquires++;
+        Lock->Contentions += Contended;
+        Lock->AcquireTime = NowNs();
+    }
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN NTAPI
+RtlTryEnterHeapLock(PHEAP_LOCK Lock, BOOLEAN Exclusive)
+{
+    if (pthread_mutex_trylock(&Lock->Mutex))
+        return FALSE;
+
+    if (++Lock->Recursion == 1)
+    {
+        Lock->Acquires++;
+        Lock->AcquireTime = NowNs();
+    }
+
+    return TRUE;
+}
+
+NTSTATUS NTAPI
+RtlLeaveHeapLock(PHEAP_LOCK Lock)
+{
+    if (--Lock->Recursion == 0)
+        Lock->HoldTime += NowNs() - Lock->AcquireTime;
+
+    pthread_mutex_unlock(&Lock->Mutex);
+    return STATUS_SUCCESS;
+}
+
+/* Counters of the live locks are only read while no thread runs */
+static VOID
+GetLockStats(PLOCK_STATS Stats)
+{
+    ULONG i;
+
+    pthread_mutex_lock(&LockListLock);
+
+    *Stats = DeletedLockStats;
+    for (i = 0; i < MAX_LOCKS; i++)
+    {
+        if (!LockList[i]) continue;
+        Stats->Acquires += LockList[i]->Acquires;
+        Stats->Contentions += LockList[i]->Contentions;
+        Stats->HoldTime += LockList[i]->HoldTime;
+    }
+
+    pthread_mutex_unlock(&LockListLock);
+}
+
+/* STUBS **********************************************************************/
+
+BOOLEAN RtlpPageHeapEnabled = FALSE;
+
+VOID NTAPI
+RtlRaiseException(PEXCEPTION_RECORD ExceptionRecord)
+{
+    printf("Heap raised exception 0x%08x\n", ExceptionRecord->ExceptionCode);
+    abort();
+}
+
+VOID NTAPI
+RtlSetLastWin32ErrorAndNtStatusFromNtStatus(NTSTATUS Status)
+{
+    LastStatus = Status;
+}
+
+VOID NTAPI
+RtlpSetHeapParameters(PRTL_HEAP_PARAMETERS Parameters)
+{
+    PPEB Peb = RtlGetCurrentPeb();
+
+    /* Apply defaults for non-set parameters */
+    if (!Parameters->SegmentCommit) Parameters->SegmentCommit = Peb->HeapSegmentCommit;
+    if (!Parameters->SegmentReserve) Parameters->SegmentReserve = Peb->HeapSegmentReserve;
+    if (!Parameters->DeCommitFreeBlockThreshold) Parameters->DeCommitFreeBlockThreshold = Peb->HeapDeCommitFreeBlockThreshold;
+    if (!Parameters->DeCommitTotalFreeThreshold) Parameters->DeCommitTotalFreeThreshold = Peb->HeapDeCommitTotalFreeThreshold;
+}
+
+VOID NTAPI
+RtlpAddHeapToProcessList(PVOID Heap)
+{
+}
+
+VOID NTAPI
+RtlpRemoveHeapFromProcessList(PVOID Heap)
+{
+}
+
+/* The page heap is never enabled */
+PVOID NTAPI
+RtlpPageHeapCreate(ULONG Flags, PVOID Addr, SIZE_T TotalSize, SIZE_T CommitSize,
+                   PVOID Lock, PRTL_HEAP_PARAMETERS Parameters)
+{
+    return NULL;
+}
+
+PVOID NTAPI
+RtlpPageHeapDestroy(PVOID HeapPtr)
+{
+    return HeapPtr;
+}
+
+PVOID NTAPI
+RtlpPageHeapAllocate(PVOID HeapPtr, ULONG Flags, SIZE_T Size)
+{
+    return NULL;
+}
+
+BOOLEAN NTAPI
+RtlpPageHeapFree(PVOID HeapPtr, ULONG Flags, PVOID Ptr)
+{
+    return FALSE;
+}
+
+PVOID NTAPI
+RtlpPageHeapReAllocate(PVOID HeapPtr, ULONG Flags, PVOID Ptr, SIZE_T Size)
+{
+    return NULL;
+}
+
+BOOLEAN NTAPI
+RtlpPageHeapLock(PVOID HeapPtr)
+{
+    return FALSE;
+}
+
+BOOLEAN NTAPI
+RtlpPageHeapUnlock(PVOID HeapPtr)
+{
+    return FALSE;
+}
+
+BOOLEAN NTAPI
+RtlpPageHeapGetUserInfo(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress,
+                        PVOID *UserValue, PULONG UserFlags)
+{
+    return FALSE;
+}
+
+BOOLEAN NTAPI
+RtlpPageHeapSetUserValue(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress, PVOID UserValue)
+{
+    return FALSE;
+}
+
+BOOLEAN NTAPI
+RtlpPageHeapSetUserFlags(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress,
+                         ULONG UserFlagsReset, ULONG UserFlagsSet)
+{
+    return FALSE;
+}
+
+BOOLEAN NTAPI
+RtlpDebugPageHeapValidate(PVOID HeapPtr, ULONG Flags, PVOID Block)
+{
+    return FALSE;
+}
+
+SIZE_T NTAPI
+RtlpPageHeapSize(PVOID HeapPtr, ULONG Flags, PVOID Ptr)
+{
+    return (SIZE_T)-1;
+}
+
+/* LARSON *********************************************************************/
+
+/* Every thread frees and allocates random blocks of an array, then hands the
+   array to another thread, which frees blocks it did not allocate */
+
+static ULONG
+LarsonSize(PULONG Seed)
+{
+    return LARSON_MIN_SIZE + Random(Seed) % (LARSON_MAX_SIZE - LARSON_MIN_SIZE + 1);
+}
+
+static PLARSON_ARRAY
+LarsonTake(PBENCH_RUN Run, ULONG First)
+{
+    PLARSON_ARRAY Array;
+    ULONG i;
+
+    for (;;)
+    {
+        for (i = 0; i < Run->ThreadCount; i++)
+        {
+            Array = &Run->Arrays[(First + i) % Run->ThreadCount];
+            if (!Array->Owned && !InterlockedCompareExchange(&Array->Owned, 1, 0))
+                return Array;
+        }
+
+        sched_yield();
+    }
+}
+
+static BOOL
+LarsonPrepare(PBENCH_RUN Run)
+{
+    PLARSON_ARRAY Array;
+    ULONG Seed = 4141, i, j;
+
+    Run->Arrays = calloc(Run->ThreadCount, sizeof(LARSON_ARRAY));
+    if (!Run->Arrays) return FALSE;
+
+    for (i = 0; i < Run->ThreadCount; i++)
+    {
+        Array = &Run->Arrays[i];
+        for (j = 0; j < LARSON_BLOCKS; j++)
+        {
+            Array->Sizes[j] = LarsonSize(&Seed);
+            Array->Blocks[j] = RtlAllocateHeap(Run->Heap, 0, Array->Sizes[j]);
+            if (!Array->Blocks[j]) return FALSE;
+            Run->Threads[0].Live += Array->Sizes[j];
+        }
+    }
+
+    return TRUE;
+}
+
+static VOID
+LarsonWorker(PBENCH_THREAD Thread)
+{
+    PBENCH_RUN Run = Thread->Run;
+    PLARSON_ARRAY Array;
+    PVOID Block;
+    ULONG Size, Slot, i;
+
+    Array = LarsonTake(Run, Thread->Index);
+
+    while (!Run->Stop)
+    {
+        for (i = 0; i < LARSON_BLOCKS; i++)
+        {
+            Slot = Random(&Thread->Seed) % LARSON_BLOCKS;
+            RtlFreeHeap(Run->Heap, 0, Array->Blocks[Slot]);
+            Thread->Live -= Array->Sizes[Slot];
+
+            Size = LarsonSize(&Thread->Seed);
+            Block = RtlAllocateHeap(Run->Heap, 0, Size);
+            if (Block)
+            {
+                *(PUCHAR)Block = (UCHAR)Size;
+                Thread->Live += Size;
+            }
+            else
+            {
+                Thread->Failures++;
+                Size = 0;
+            }
+
+            Array->Blocks[Slot] = Block;
+            Array->Sizes[Slot] = Size;
+        }
+
+        Thread->Ops += 2 * LARSON_BLOCKS;
+
+        __atomic_store_n(&Array->Owned, 0, __ATOMIC_RELEASE);
+        Array = LarsonTake(Run, (ULONG)(Array - Run->Arrays) + 1);
+    }
+
+    __atomic_store_n(&Array->Owned, 0, __ATOMIC_RELEASE);
+}
+
+static VOID
+LarsonCleanup(PBENCH_RUN Run)
+{
+    ULONG i, j;
+
+    if (!Run->Arrays) return;
+
+    for (i = 0; i < Run->ThreadCount; i++)
+    {
+        for (j = 0; j < LARSON_BLOCKS; j++)
+            RtlFreeHeap(Run->Heap, 0, Run->Arrays[i].Blocks[j]);
+    }
+
+    free(Run->Arrays);
+}
+
+/* XMALLOC ********************************************************************/
+
+/* Every thread allocates blocks for the previous thread to free, as in
+   xmalloc-test, so nearly all blocks are freed by another thread */
+
+static ULONG
+XmallocSize(PULONG Seed)
+{
+    ULONG Value = Random(Seed);
+    ULONG Base = 8 << (Value % 8);
+
+    return Base + (Value >> 8) % Base;
+}
+
+static BOOL
+XmallocPrepare(PBENCH_RUN Run)
+{
+    Run->Rings = calloc(Run->ThreadCount, sizeof(XMALLOC_RING));
+    return (Run->Rings != NULL);
+}
+
+static VOID
+XmallocWorker(PBENCH_THREAD Thread)
+{
+    PBENCH_RUN Run = Thread->Run;
+    PXMALLOC_RING Own = &Run->Rings[Thread->Index];
+    PXMALLOC_RING Next = &Run->Rings[(Thread->Index + 1) % Run->ThreadCount];
+    PVOID Block;
+    ULONG Head, Tail, Size, i;
+
+    while (!Run->Stop)
+    {
+        for (i = 0; i < XMALLOC_BATCH; i++)
+        {
+            Head = Own->Head;
+            if (Head - __atomic_load_n(&Own->Tail, __ATOMIC_ACQUIRE) == XMALLOC_RING_SIZE)
+                break;
+
+            Size = XmallocSize(&Thread->Seed);
+            Block = RtlAllocateHeap(Run->Heap, 0, Size);
+            if (!Block)
+            {
+                Thread->Failures++;
+                break;
+            }
+
+            *(PUCHAR)Block = (UCHAR)Size;
+            Own->Blocks[Head % XMALLOC_RING_SIZE] = Block;
+            Own->Sizes[Head % XMALLOC_RING_SIZE] = Size;
+            __atomic_store_n(&Own->Head, Head + 1, __ATOMIC_RELEASE);
+
+            Thread->Live += Size;
+            Thread->Ops++;
+        }
+
+        for (i = 0; i < XMALLOC_BATCH; i++)
+        {
+            Tail = Next->Tail;
+            if (Tail == __atomic_load_n(&Next->Head, __ATOMIC_ACQUIRE))
+                break;
+
+            RtlFreeHeap(Run->Heap, 0, Next->Blocks[Tail % XMALLOC_RING_SIZE]);
+            Thread->Live -= Next->Sizes[Tail % XMALLOC_RING_SIZE];
+            __atomic_store_n(&Next->Tail, Tail + 1, __ATOMIC_RELEASE);
+
+            Thread->Ops++;
+        }
+    }
+}
+
+static VOID
+XmallocCleanup(PBENCH_RUN Run)
+{
+    PXMALLOC_RING Ring;
+    ULONG i;
+
+    if (!Run->Rings) return;
+
+    for (i = 0; i < Run->ThreadCount; i++)
+    {
+        Ring = &Run->Rings[i];
+        for (; Ring->Tail != Ring->Head; Ring->Tail++)
+            RtlFreeHeap(Run->Heap, 0, Ring->Blocks[Ring->Tail % XMALLOC_RING_SIZE]);
+    }
+
+    free(Run->Rings);
+}
+
+/* TRACES *********************************************************************/
+
+static VOID
+FreeTrace(PTRACE Trace)
+{
+    free(Trace->Ops);
+    free(Trace->Objects);
+    free(Trace);
+}
+
+static BOOL
+AddTraceOp(PTRACE Trace, ULONG Object, UCHAR Type, ULONG Size, USHORT Thread, PULONG OpMax)
+{
+    PTRACE_OP NewOps;
+    PTRACE_OP Op;
+
+    if (Trace->OpCount == *OpMax)
+    {
+        NewOps = realloc(Trace->Ops, (*OpMax * 2 + 1024) * sizeof(TRACE_OP));
+        if (!NewOps) return FALSE;
+        Trace->Ops = NewOps;
+        *OpMax = *OpMax * 2 + 1024;
+    }
+
+    Op = &Trace->Ops[Trace->OpCount++];
+    Op->Object = Object;
+    Op->Sequence = Trace->Objects[Object].OpCount++;
+    Op->Size = Size;
+    Op->Thread = Thread;
+    Op->Type = Type;
+
+    Trace->Objects[Object].LastThread = Thread;
+    return TRUE;
+}
+
+static ULONG
+HashPointer(ULONGLONG Pointer)
+{
+    return (ULONG)((Pointer * 0x9E3779B97F4A7C15ULL) >> (64 - TRACE_HASH_BITS));
+}
+
+/* Pairs the pointers of a trace with the blocks they belong to */
+typedef struct _POINTER_MAP
+{
+    PLONG Buckets;
+    PTRACE_POINTER Entries;
+    ULONG Count;
+    ULONG Max;
+    LONG FreeEntry;
+} POINTER_MAP, *PPOINTER_MAP;
+
+static PLONG
+FindPointer(PPOINTER_MAP Map, ULONGLONG Pointer)
+{
+    PLONG Link = &Map->Buckets[HashPointer(Pointer)];
+
+    while (*Link != -1 && Map->Entries[*Link].Pointer != Pointer)
+        Link = &Map->Entries[*Link].Next;
+
+    return Link;
+}
+
+static BOOL
+InsertPointer(PPOINTER_MAP Map, ULONGLONG Pointer, ULONG Object)
+{
+    PTRACE_POINTER NewEntries;
+    PLONG Link;
+    LONG Index;
+
+    Link = FindPointer(Map, Pointer);
+    if (*Link != -1)
+    {
+        /* Allocated twice without a free, the first block is never freed */
+        Map->Entries[*Link].Object = Object;
+        return TRUE;
+    }
+
+    if (Map->FreeEntry != -1)
+    {
+        Index = Map->FreeEntry;
+        Map->FreeEntry = Map->Entries[Index].Next;
+    }
+    else
+    {
+        if (Map->Count == Map->Max)
+        {
+            NewEntries = realloc(Map->Entries, (Map->Max * 2 + 1024) * sizeof(TRACE_POINTER));
+            if (!NewEntries) return FALSE;
+            Map->Entries = NewEntries;
+            Map->Max = Map->Max * 2 + 1024;
+        }
+        Index = Map->Count++;
+    }
+
+    Map->Entries[Index].Pointer = Pointer;
+    Map->Entries[Index].Object = Object;
+    Map->Entries[Index].Next = -1;
+    *Link = Index;
+    return TRUE;
+}
+
+static VOID
+RemovePointer(PPOINTER_MAP Map, PLONG Link)
+{
+    LONG Index = *Link;
+
+    *Link = Map->Entries[Index].Next;
+    Map->Entries[Index].Next = Map->FreeEntry;
+    Map->FreeEntry = Index;
+}
+
+static PTRACE
+LoadTrace(const char *FileName)
+{
+    PTRACE Trace;
+    PTRACE_OBJECT Object, NewObjects;
+    POINTER_MAP Map = { NULL, NULL, 0, 0, -1 };
+    ULONG ThreadIds[MAX_THREADS * 4];
+    ULONG OpMax = 0, ObjectMax = 0, Line = 0, ThreadId, Size, Index, i;
+    ULONGLONG Pointer, NewPointer;
+    SIZE_T Live = 0;
+    char Buffer[256], Type;
+    PLONG Link;
+    BOOL Result = FALSE;
+    FILE *File;
+
+    File = fopen(FileName, "r");
+    if (!File)
+    {
+        printf("Cannot read %s\n", FileName);
+        return NULL;
+    }
+
+    Trace = calloc(1, sizeof(TRACE));
+    Map.Buckets = malloc(sizeof(LONG) << TRACE_HASH_BITS);
+    if (!Trace || !Map.Buckets) goto Quit;
+    memset(Map.Buckets, 0xFF, sizeof(LONG) << TRACE_HASH_BITS);
+
+    while (fgets(Buffer, sizeof(Buffer), File))
+    {
+        Line++;
+        if (Buffer[0] == '#' || Buffer[0] == '\n' || Buffer[0] == '\r' || !Buffer[0])
+            continue;
+
+        Pointer = NewPointer = 0;
+        Size = 0;
+        if (sscanf(Buffer, "%u %c", &ThreadId, &Type) != 2 ||
+            (Type == 'a' && sscanf(Buffer, "%*u %*c %u %llx", &Size, &NewPointer) != 2) ||
+            (Type == 'r' && sscanf(Buffer, "%*u %*c %llx %u %llx", &Pointer, &Size, &NewPointer) != 3) ||
+            (Type == 'f' && sscanf(Buffer, "%*u %*c %llx", &Pointer) != 1) ||
+            (Type != 'a' && Type != 'r' && Type != 'f'))
+        {
+            printf("%s(%u): invalid operation\n", FileName, Line);
+            goto Quit;
+        }
+
+        /* Number the threads in order of appearance */
+        for (i = 0; i < Trace->ThreadCount && ThreadIds[i] != ThreadId; i++);
+        if (i == Trace->ThreadCount)
+        {
+            if (i == sizeof(ThreadIds) / sizeof(ThreadIds[0]))
+            {
+                printf("%s(%u): too many threads\n", FileName, Line);
+                goto Quit;
+            }
+            ThreadIds[Trace->ThreadCount++] = ThreadId;
+        }
+
+        Link = NULL;
+        if (Type != 'a')
+        {
+            Link = FindPointer(&Map, Pointer);
+            if (*Link == -1)
+            {
+                /* Blocks allocated before the capture started */
+                Trace->Ignored++;
+                if (Type == 'f') continue;
+                Type = 'a';
+                Link = NULL;
+            }
+        }
+
+        if (Type == 'a')
+        {
+            if (Trace->ObjectCount == ObjectMax)
+            {
+                NewObjects = realloc(Trace->Objects, (ObjectMax * 2 + 1024) * sizeof(TRACE_OBJECT));
+                if (!NewObjects) goto Quit;
+                Trace->Objects = NewObjects;
+                ObjectMax = ObjectMax * 2 + 1024;
+            }
+
+            Index = Trace->ObjectCount++;
+            RtlZeroMemory(&Trace->Objects[Index], sizeof(TRACE_OBJECT));
+        }
+        else
+        {
+            Index = Map.Entries[*Link].Object;
+            RemovePointer(&Map, Link);
+        }
+
+        Object = &Trace->Objects[Index];
+        if (!AddTraceOp(Trace, Index, Type, Size, (USHORT)i, &OpMax)) goto Quit;
+
+        /* Follow the live bytes for the peak */
+        Live -= Object->Size;
+        Object->Size = (Type == 'f') ? 0 : Size;
+        Object->Live = (Type != 'f');
+        Live += Object->Size;
+        Trace->PeakLive = max(Trace->PeakLive, Live);
+
+        if (Type != 'f' && !InsertPointer(&Map, NewPointer, Index)) goto Quit;
+    }
+
+    /* Free what is left at the end, so that every pass starts empty */
+    for (Index = 0; Index < Trace->ObjectCount; Index++)
+    {
+        Object = &Trace->Objects[Index];
+        if (Object->Live && !AddTraceOp(Trace, Index, 'f', 0, Object->LastThread, &OpMax))
+            goto Quit;
+        Object->Size = 0;
+    }
+
+    Result = (Trace->OpCount != 0);
+    if (!Result) printf("%s: no operations\n", FileName);
+
+Quit:
+    if (!Result && Trace)
+    {
+        if (Trace->OpCount) printf("%s: out of memory\n", FileName);
+        FreeTrace(Trace);
+        Trace = NULL;
+    }
+
+    free(Map.Buckets);
+    free(Map.Entries);
+    fclose(File);
+    return Trace;
+}
+
+static BOOL
+TracePrepare(PBENCH_RUN Run)
+{
+    PTRACE Trace = Run->Trace;
+    PBENCH_THREAD Thread;
+    ULONG i;
+
+    for (i = 0; i < Trace->ObjectCount; i++)
+    {
+        Trace->Objects[i].Block = NULL;
+        Trace->Objects[i].Size = 0;
+        Trace->Objects[i].Done = 0;
+    }
+
+    for (i = 0; i < Run->ThreadCount; i++)
+    {
+        Run->Threads[i].TraceOps = malloc(Trace->OpCount * sizeof(ULONG));
+        if (!Run->Threads[i].TraceOps) return FALSE;
+    }
+
+    /* Spread the trace threads over the benchmark threads */
+    for (i = 0; i < Trace->OpCount; i++)
+    {
+        Thread = &Run->Threads[Trace->Ops[i].Thread % Run->ThreadCount];
+        Thread->TraceOps[Thread->TraceOpCount++] = i;
+    }
+
+    return TRUE;
+}
+
+static VOID
+TraceWorker(PBENCH_THREAD Thread)
+{
+    PBENCH_RUN Run = Thread->Run;
+    PTRACE Trace = Run->Trace;
+    PTRACE_OBJECT Object;
+    PTRACE_OP Op;
+    PVOID Block;
+    ULONG Pass, Target, Spins, i;
+
+    for (Pass = 0; Pass < Run->Passes; Pass++)
+    {
+        for (i = 0; i < Thread->TraceOpCount; i++)
+        {
+            Op = &Trace->Ops[Thread->TraceOps[i]];
+            Object = &Trace->Objects[Op->Object];
+
+            /* Wait for the previous operation on the block, which may belong to another thread */
+            Target = Pass * Object->OpCount + Op->Sequence;
+            for (Spins = 0; __atomic_load_n(&Object->Done, __ATOMIC_ACQUIRE) != Target; Spins++)
+            {
+                if (Spins >= 100) sched_yield();
+            }
+
+            switch (Op->Type)
+            {
+                case 'a':
+                    Block = RtlAllocateHeap(Run->Heap, 0, Op->Size);
+                    break;
+
+                case 'r':
+                    Block = RtlReAllocateHeap(Run->Heap, 0, Object->Block, Op->Size);
+                    if (!Block && Object->Block)
+                    {
+                        Thread->Failures++;
+                        Block = Object->Block;
+                        Op = NULL;
+                    }
+                    break;
+
+                default:
+                    RtlFreeHeap(Run->Heap, 0, Object->Block);
+                    Block = NULL;
+                    break;
+            }
+
+            if (Op)
+            {
+                if (!Block && Op->Type != 'f') Thread->Failures++;
+                if (Block && Op->Size) *(PUCHAR)Block = (UCHAR)Op->Size;
+
+                Thread->Live += (LONG_PTR)(Block ? Op->Size : 0) - (LONG_PTR)Object->Size;
+                Object->Size = Block ? Op->Size : 0;
+                Object->Block = Block;
+            }
+
+            __atomic_store_n(&Object->Done, Target + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    Thread->Ops = (ULONGLONG)Run->Passes * Thread->TraceOpCount;
+}
+
+static VOID
+TraceCleanup(PBENCH_RUN Run)
+{
+    ULONG i;
+
+    for (i = 0; i < Run->ThreadCount; i++)
+        free(Run->Threads[i].TraceOps);
+}
+
+static const WORKLOAD Workloads[] =
+{
+    { "larson",  LarsonPrepare,  LarsonWorker,  LarsonCleanup },
+    { "xmalloc", XmallocPrepare, XmallocWorker, XmallocCleanup },
+};
+
+static const WORKLOAD TraceWorkload = { NULL, TracePrepare, TraceWorker, TraceCleanup };
+
+/* BENCHMARK ******************************************************************/
+
+static void *
+WorkerThread(void *Parameter)
+{
+    PBENCH_THREAD Thread = (PBENCH_THREAD)Parameter;
+
+    Thread->Run->Workload->Worker(Thread);
+    InterlockedIncrement(&Thread->Run->Finished);
+    return NULL;
+}
+
+static BOOL
+RunBench(const char *Name, const WORKLOAD *Workload, PTRACE Trace, BOOL FrontEnd, ULONG ThreadCount)
+{
+    PBENCH_RUN Run;
+    LOCK_STATS Before, After;
+    ULONGLONG Start, Elapsed, Ops = 0;
+    SIZE_T PeakLive = 0, PeakCommitted;
+    LONG_PTR Live;
+    ULONG HeapType = HEAP_FRONT_END_LFH, Failures = 0, VmCallsBefore, i;
+    BOOL FrontEndEnabled = FALSE, Valid, Result = FALSE;
+
+    Run = calloc(1, sizeof(BENCH_RUN));
+    if (!Run)
+    {
+        printf("%-12s out of memory\n", Name);
+        return FALSE;
+    }
+
+    Run->Workload = Workload;
+    Run->Trace = Trace;
+    Run->ThreadCount = ThreadCount;
+    if (Trace)
+        Run->Passes = Passes ? Passes : max(1, TRACE_MIN_OPS / Trace->OpCount);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Run->Threads[i].Run = Run;
+        Run->Threads[i].Index = i;
+        Run->Threads[i].Seed = 0x9E3779B9 * (i + 1);
+    }
+
+    pthread_mutex_lock(&VmLock);
+    VmPeakCommitted = VmCommitted;
+    pthread_mutex_unlock(&VmLock);
+
+    Run->Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    if (!Run->Heap)
+    {
+        printf("%-12s RtlCreateHeap failed\n", Name);
+        free(Run);
+        return FALSE;
+    }
+
+    if (FrontEnd)
+    {
+        FrontEndEnabled = NT_SUCCESS(RtlSetHeapInformation(Run->Heap,
+                                                           HeapCompatibilityInformation,
+                                                           &HeapType,
+                                                           sizeof(HeapType)));
+    }
+
+    if (!Workload->Prepare(Run))
+    {
+        printf("%-12s preparing failed\n", Name);
+        goto Quit;
+    }
+
+    GetLockStats(&Before);
+    VmCallsBefore = VmCalls;
+    Start = NowNs();
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Run->Threads[i].Started = !pthread_create(&Run->Threads[i].Handle, NULL, WorkerThread, &Run->Threads[i]);
+        if (!Run->Threads[i].Started)
+        {
+            /* The others may wait for its blocks forever, so stop here */
+            printf("%-12s cannot start thread %u\n", Name, i);
+            abort();
+        }
+    }
+
+    /* Sample the live bytes while the threads run */
+    do
+    {
+        SleepNs(SAMPLE_INTERVAL);
+
+        for (Live = 0, i = 0; i < ThreadCount; i++)
+            Live += Run->Threads[i].Live;
+        PeakLive = max(PeakLive, (SIZE_T)max(Live, 0));
+    }
+    while (Trace ? Run->Finished < (LONG)ThreadCount : NowNs() - Start < Seconds * 1e9);
+
+    Run->Stop = TRUE;
+    for (i = 0; i < ThreadCount; i++)
+        pthread_join(Run->Threads[i].Handle, NULL);
+
+    Elapsed = NowNs() - Start;
+    GetLockStats(&After);
+    PeakCommitted = VmPeakCommitted;
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Ops += Run->Threads[i].Ops;
+        Failures += Run->Threads[i].Failures;
+    }
+
+    if (Trace) PeakLive = Trace->PeakLive;
+
+    Valid = RtlValidateHeap(Run->Heap, 0, NULL);
+
+    printf("%-12s %-5s %3u %9.2f %9lu %9lu %8.2f %8.2f %7.1f %7.1f %8u\n",
+           Name,
+           FrontEndEnabled ? "lfh" : (FrontEnd ? "n/a" : "none"),
+           ThreadCount,
+           Ops / (Elapsed / 1e3),
+           (unsigned long)(PeakCommitted >> 10),
+           (unsigned long)(PeakLive >> 10),
+           PeakLive ? (double)PeakCommitted / PeakLive : 0.0,
+           Ops ? (double)(After.Acquires - Before.Acquires) / Ops : 0.0,
+           100.0 * (After.HoldTime - Before.HoldTime) / Elapsed,
+           After.Acquires > Before.Acquires ?
+               100.0 * (After.Contentions - Before.Contentions) / (After.Acquires - Before.Acquires) : 0.0,
+           VmCalls - VmCallsBefore);
+
+    if (Failures)
+        printf("%-12s %u allocations failed\n", "", Failures);
+
+    if (!Valid)
+        printf("%-12s heap validation failed\n", "");
+    else
+        Result = TRUE;
+
+Quit:
+    Workload->Cleanup(Run);
+    RtlDestroyHeap(Run->Heap);
+    free(Run);
+    return Result;
+}
+
+static BOOL
+ParseThreadCounts(char *List, PULONG ThreadCounts, PULONG Count)
+{
+    char *Next;
+    ULONG Value;
+
+    for (*Count = 0; *List; List = Next + (*Next == ','))
+    {
+        Value = strtoul(List, &Next, 10);
+        if (Next == List || (*Next && *Next != ',') || !Value || Value > MAX_THREADS ||
+            *Count == MAX_THREAD_COUNTS)
+        {
+            return FALSE;
+        }
+        ThreadCounts[(*Count)++] = Value;
+    }
+
+    return (*Count != 0);
+}
+
+static VOID
+Usage(void)
+{
+    printf("Usage: heapbench [-t threads[,threads...]] [-s seconds] [-n passes]\n"
+           "                 [-f none|lfh|all] [-d] [larson|xmalloc|trace file...]\n"
+           "\n"
+           "  -t  thread counts, by default powers of two up to the processor count\n"
+           "  -s  duration of the larson and xmalloc runs, 1 second by default\n"
+           "  -n  passes over a trace, by default enough for %u operations\n"
+           "  -f  front end heap to compare, all by default\n"
+           "  -d  enable tail, free and parameter checking through the debug heap\n"
+           "\n"
+           "Mops/s counts allocations, reallocations and frees. Overhead is the peak\n"
+           "committed memory over the peak of live requested bytes. Held is the share\n"
+           "of the time a heap lock was held, Contended the share of lock acquisitions\n"
+           "that had to wait.\n",
+           TRACE_MIN_OPS);
+}
+
+int main(int argc, char *argv[])
+{
+    static char *DefaultTargets[] = { "larson", "xmalloc" };
+    ULONG ThreadCounts[MAX_THREAD_COUNTS];
+    ULONG ThreadCountCount = 0, Processors, Count, LastCount, Front, i, j;
+    BOOL FrontEnds[2] = { TRUE, TRUE };
+    char **Targets;
+    int TargetCount, t;
+    const WORKLOAD *Workload;
+    PTRACE Trace;
+    BOOL Result = TRUE;
+
+    for (t = 1; t < argc && argv[t][0] == '-'; t++)
+    {
+        if (!strcmp(argv[t], "-t") && t + 1 < argc)
+        {
+            if (!ParseThreadCounts(argv[++t], ThreadCounts, &ThreadCountCount))
+            {
+                Usage();
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[t], "-s") && t + 1 < argc)
+        {
+            Seconds = atof(argv[++t]);
+        }
+        else if (!strcmp(argv[t], "-n") && t + 1 < argc)
+        {
+            Passes = strtoul(argv[++t], NULL, 0);
+        }
+        else if (!strcmp(argv[t], "-f") && t + 1 < argc)
+        {
+            t++;
+            FrontEnds[0] = !strcmp(argv[t], "none") || !strcmp(argv[t], "all");
+            FrontEnds[1] = !strcmp(argv[t], "lfh") || !strcmp(argv[t], "all");
+        }
+        else if (!strcmp(argv[t], "-d"))
+        {
+            HeapBenchPeb.NtGlobalFlag = FLG_HEAP_ENABLE_TAIL_CHECK |
+                                        FLG_HEAP_ENABLE_FREE_CHECK |
+                                        FLG_HEAP_VALIDATE_PARAMETERS;
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (Seconds <= 0 || (!FrontEnds[0] && !FrontEnds[1]))
+    {
+        Usage();
+        return 1;
+    }
+
+    /* The mock maps heap pages one to one */
+    if (sysconf(_SC_PAGESIZE) != PAGE_SIZE)
+    {
+        printf("heapbench needs %u byte pages\n", PAGE_SIZE);
+        return 1;
+    }
+
+    Processors = GetProcessorCount();
+    if (!ThreadCountCount)
+    {
+        for (Count = 1; Count < Processors && ThreadCountCount < MAX_THREAD_COUNTS - 1; Count *= 2)
+            ThreadCounts[ThreadCountCount++] = Count;
+        ThreadCounts[ThreadCountCount++] = Processors;
+    }
+
+    /* The usual defaults of a process */
+    HeapBenchPeb.NumberOfProcessors = Processors;
+    HeapBenchPeb.HeapSegmentReserve = 0x100000;
+    HeapBenchPeb.HeapSegmentCommit = 2 * PAGE_SIZE;
+    HeapBenchPeb.HeapDeCommitTotalFreeThreshold = 0x10000;
+    HeapBenchPeb.HeapDeCommitFreeBlockThreshold = PAGE_SIZE;
+
+    Targets = (t < argc) ? &argv[t] : DefaultTargets;
+    TargetCount = (t < argc) ? argc - t : (int)(sizeof(DefaultTargets) / sizeof(DefaultTargets[0]));
+
+    printf("%-12s %-5s %3s %9s %9s %9s %8s %8s %7s %7s %8s\n",
+           "Workload", "Front", "Thr", "Mops/s", "Peak KB", "Live KB",
+           "Overhead", "Locks/op", "Held %", "Cont %", "VM calls");
+
+    for (t = 0; t < TargetCount; t++)
+    {
+        Workload = NULL;
+        Trace = NULL;
+
+        for (i = 0; i < sizeof(Workloads) / sizeof(Workloads[0]); i++)
+        {
+            if (!strcmp(Targets[t], Workloads[i].Name))
+                Workload = &Workloads[i];
+        }
+
+        if (!Workload)
+        {
+            Trace = LoadTrace(Targets[t]);
+            if (!Trace)
+            {
+                Result = FALSE;
+                continue;
+            }
+
+            if (Trace->Ignored)
+                printf("%s: %u operations on unknown blocks\n", Targets[t], Trace->Ignored);
+            Workload = &TraceWorkload;
+        }
+
+        for (Front = 0; Front < 2; Front++)
+        {
+            if (!FrontEnds[Front]) continue;
+
+            for (LastCount = 0, j = 0; j < ThreadCountCount; j++)
+            {
+                /* A trace does not use more threads than it had */
+                Count = Trace ? min(ThreadCounts[j], Trace->ThreadCount) : ThreadCounts[j];
+                if (Count == LastCount) continue;
+                LastCount = Count;
+
+                Result &= RunBench(Trace ? strrchr(Targets[t], '/') ? strrchr(Targets[t], '/') + 1 : Targets[t]
+                                         : Workload->Name,
+                                   Workload, Trace, Front == 1, Count);
+            }
+        }
+
+        if (Trace) FreeTrace(Trace);
+    }
+
+    return Result ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+/*
+ * PROJECT:     ReactOS heap benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Stand-in for the RTL private header when building the
+ *              lib/rtl heap for the host
+ */
+
+#ifndef _HEAPBENCH_RTL_H
+#define _HEAPBENCH_RTL_H
+
+/* The heap only needs the 64-bit heap entry layout from these */
+#if defined(_LP64) && !defined(_WIN64)
+#define _WIN64
+#define _M_AMD64
+#endif
+
+#include <typedefs.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define C_ASSERT(expr) extern char (*c_assert(void)) [(expr) ? 1 : -1]
+#define FORCEINLINE static __inline __attribute__((always_inline))
+#define UNREFERENCED_PARAMETER(P) ((void)(P))
+
+#define RtlFillMemory(Destination, Length, Fill) memset(Destination, Fill, Length)
+
+#ifndef min
+#define min(a, b)  (((a) < (b)) ? (a) : (b))
+#endif
+
+#ifndef max
+#define max(a, b)  (((a) > (b)) ? (a) : (b))
+#endif
+
+#define ROUND_DOWN(n, align) (((ULONG_PTR)(n)) & ~((align) - 1l))
+#define ROUND_UP(n, align) ROUND_DOWN(((ULONG_PTR)(n)) + (align) - 1, (align))
+
+#define PAGE_SIZE 0x1000
+#define PAGE_SHIFT 12
+
+#define CONST const
+
+typedef ULONGLONG *PULONGLONG;
+
+#define KernelMode 0
+#define UserMode 1
+
+/* STATUS CODES ***************************************************************/
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002)
+#define STATUS_INVALID_HANDLE           ((NTSTATUS)0xC0000008)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000D)
+#define STATUS_NO_MEMORY                ((NTSTATUS)0xC0000017)
+#define STATUS_CONFLICTING_ADDRESSES    ((NTSTATUS)0xC0000018)
+#define STATUS_MEMORY_NOT_ALLOCATED     ((NTSTATUS)0xC00000A0)
+#define STATUS_INFO_LENGTH_MISMATCH     ((NTSTATUS)0xC0000004)
+#define STATUS_UNABLE_TO_FREE_VM        ((NTSTATUS)0xC000001A)
+#define STATUS_BUFFER_TOO_SMALL         ((NTSTATUS)0xC0000023)
+#define STATUS_FREE_VM_NOT_AT_BASE      ((NTSTATUS)0xC000009F)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BB)
+
+/* VIRTUAL MEMORY *************************************************************/
+
+#define MEM_COMMIT                      0x00001000
+#define MEM_RESERVE                     0x00002000
+#define MEM_DECOMMIT                    0x00004000
+#define MEM_RELEASE                     0x00008000
+#define MEM_FREE                        0x00010000
+#define MEM_PRIVATE                     0x00020000
+#define MEM_TOP_DOWN                    0x00100000
+
+#define PAGE_NOACCESS                   0x01
+#define PAGE_READONLY                   0x02
+#define PAGE_READWRITE                  0x04
+#define PAGE_EXECUTE_READWRITE          0x40
+
+#define NtCurrentProcess() ((HANDLE)(LONG_PTR)-1)
+
+typedef struct _MEMORY_BASIC_INFORMATION
+{
+    PVOID BaseAddress;
+    PVOID AllocationBase;
+    ULONG AllocationProtect;
+    SIZE_T RegionSize;
+    ULONG State;
+    ULONG Protect;
+    ULONG Type;
+} MEMORY_BASIC_INFORMATION, *PMEMORY_BASIC_INFORMATION;
+
+typedef enum _MEMORY_INFORMATION_CLASS
+{
+    MemoryBasicInformation
+} MEMORY_INFORMATION_CLASS;
+
+typedef struct _SYSTEM_BASIC_INFORMATION
+{
+    ULONG Reserved;
+    ULONG TimerResolution;
+    ULONG PageSize;
+    ULONG NumberOfPhysicalPages;
+    ULONG LowestPhysicalPageNumber;
+    ULONG HighestPhysicalPageNumber;
+    ULONG AllocationGranularity;
+    ULONG_PTR MinimumUserModeAddress;
+    ULONG_PTR MaximumUserModeAddress;
+    ULONG_PTR ActiveProcessorsAffinityMask;
+    CCHAR NumberOfProcessors;
+} SYSTEM_BASIC_INFORMATION, *PSYSTEM_BASIC_INFORMATION;
+
+typedef enum _SYSTEM_INFORMATION_CLASS
+{
+    SystemBasicInformation
+} SYSTEM_INFORMATION_CLASS;
+
+NTSTATUS NTAPI
+ZwAllocateVirtualMemory(HANDLE ProcessHandle, PVOID *BaseAddress, ULONG_PTR ZeroBits,
+                        PSIZE_T RegionSize, ULONG AllocationType, ULONG Protect);
+
+NTSTATUS NTAPI
+ZwFreeVirtualMemory(HANDLE ProcessHandle, PVOID *BaseAddress,
+                    PSIZE_T RegionSize, ULONG FreeType);
+
+NTSTATUS NTAPI
+ZwQueryVirtualMemory(HANDLE ProcessHandle, PVOID BaseAddress,
+                     MEMORY_INFORMATION_CLASS MemoryInformationClass,
+                     PVOID MemoryInformation, SIZE_T MemoryInformationLength,
+                     PSIZE_T ReturnLength);
+
+NTSTATUS NTAPI
+ZwQuerySystemInformation(SYSTEM_INFORMATION_CLASS SystemInformationClass,
+                         PVOID SystemInformation, ULONG Length, PULONG ResultLength);
+
+/* EXCEPTIONS *****************************************************************/
+
+#define EXCEPTION_MAXIMUM_PARAMETERS 15
+#define EXCEPTION_EXECUTE_HANDLER 1
+
+typedef struct _EXCEPTION_RECORD
+{
+    NTSTATUS ExceptionCode;
+    ULONG ExceptionFlags;
+    struct _EXCEPTION_RECORD *ExceptionRecord;
+    PVOID ExceptionAddress;
+    ULONG NumberParameters;
+    ULONG_PTR ExceptionInformation[EXCEPTION_MAXIMUM_PARAMETERS];
+} EXCEPTION_RECORD, *PEXCEPTION_RECORD;
+
+/* Nothing raises in the benchmark, RtlRaiseException stops it */
+#define _SEH2_TRY {
+#define _SEH2_EXCEPT(Filter) } if (0) {
+#define _SEH2_END }
+#define _SEH2_YIELD(Statement) Statement
+
+VOID NTAPI RtlRaiseException(PEXCEPTION_RECORD ExceptionRecord);
+
+/* PROCESS AND THREAD *********************************************************/
+
+#define FLG_HEAP_ENABLE_TAIL_CHECK      0x00000010
+#define FLG_HEAP_ENABLE_FREE_CHECK      0x00000020
+#define FLG_HEAP_VALIDATE_PARAMETERS    0x00000040
+#define FLG_HEAP_VALIDATE_ALL           0x00000080
+#define FLG_USER_STACK_TRACE_DB         0x00001000
+#define FLG_HEAP_DISABLE_COALESCING     0x00200000
+
+typedef struct _PEB
+{
+    ULONG NumberOfProcessors;
+    ULONG NtGlobalFlag;
+    PVOID ProcessHeap;
+    ULONG NumberOfHeaps;
+    ULONG MaximumNumberOfHeaps;
+    PVOID *ProcessHeaps;
+    SIZE_T HeapSegmentReserve;
+    SIZE_T HeapSegmentCommit;
+    SIZE_T HeapDeCommitTotalFreeThreshold;
+    SIZE_T HeapDeCommitFreeBlockThreshold;
+} PEB, *PPEB;
+
+typedef struct _TEB
+{
+    USHORT HeapVirtualAffinity;
+} TEB, *PTEB;
+
+extern PEB HeapBenchPeb;
+extern __thread TEB HeapBenchTeb;
+
+#define NtCurrentPeb() (&HeapBenchPeb)
+#define RtlGetCurrentPeb() (&HeapBenchPeb)
+#define NtCurrentTeb() (&HeapBenchTeb)
+#define RtlpGetMode() UserMode
+#define RtlGetNtGlobalFlags() (HeapBenchPeb.NtGlobalFlag)
+
+VOID NTAPI RtlSetLastWin32ErrorAndNtStatusFromNtStatus(NTSTATUS Status);
+
+/* INTERLOCKED ****************************************************************/
+
+#define InterlockedIncrement(Addend) __sync_add_and_fetch((Addend), 1)
+#define InterlockedDecrement(Addend) __sync_sub_and_fetch((Addend), 1)
+#define InterlockedExchangeAdd(Addend, Value) __sync_fetch_and_add((Addend), (Value))
+#define InterlockedCompareExchange(Destination, Exchange, Comperand) \
+    __sync_val_compare_and_swap((Destination), (Comperand), (Exchange))
+#define InterlockedCompareExchangePointer(Destination, Exchange, Comperand) \
+    __sync_val_compare_and_swap((PVOID *)(Destination), (PVOID)(Comperand), (PVOID)(Exchange))
+#define InterlockedExchangePointer(Target, Value) \
+    __atomic_exchange_n((PVOID *)(Target), (PVOID)(Value), __ATOMIC_SEQ_CST)
+
+/* HEAP ***********************************************************************/
+
+#define HEAP_NO_SERIALIZE                   0x00000001
+#define HEAP_GROWABLE                       0x00000002
+#define HEAP_GENERATE_EXCEPTIONS            0x00000004
+#define HEAP_ZERO_MEMORY                    0x00000008
+#define HEAP_REALLOC_IN_PLACE_ONLY          0x00000010
+#define HEAP_TAIL_CHECKING_ENABLED          0x00000020
+#define HEAP_FREE_CHECKING_ENABLED          0x00000040
+#define HEAP_DISABLE_COALESCE_ON_FREE       0x00000080
+#define HEAP_SETTABLE_USER_VALUE            0x00000100
+#define HEAP_SETTABLE_USER_FLAG1            0x00000200
+#define HEAP_SETTABLE_USER_FLAG2            0x00000400
+#define HEAP_SETTABLE_USER_FLAG3            0x00000800
+#define HEAP_SETTABLE_USER_FLAGS            0x00000E00
+#define HEAP_CLASS_MASK                     0x0000F000
+#define HEAP_CREATE_ALIGN_16                0x00010000
+#define HEAP_CREATE_ENABLE_TRACING          0x00020000
+#define HEAP_CREATE_ENABLE_EXECUTE          0x00040000
+#define HEAP_FLAG_PAGE_ALLOCS               0x01000000
+#define HEAP_PROTECTION_ENABLED             0x02000000
+#define HEAP_BREAK_WHEN_OUT_OF_VM           0x04000000
+#define HEAP_NO_ALIGNMENT                   0x08000000
+#define HEAP_CAPTURE_STACK_BACKTRACES       0x08000000
+#define HEAP_SKIP_VALIDATION_CHECKS         0x10000000
+#define HEAP_VALIDATE_ALL_ENABLED           0x20000000
+#define HEAP_VALIDATE_PARAMETERS_ENABLED    0x40000000
+#define HEAP_LOCK_USER_ALLOCATED            0x80000000
+
+#define HEAP_CREATE_VALID_MASK 0x0007F0FF
+
+#define HEAP_MAXIMUM_TAG                    0x0FFF
+#define HEAP_TAG_SHIFT                      16
+
+typedef NTSTATUS
+(NTAPI *PRTL_HEAP_COMMIT_ROUTINE)(PVOID Base, PVOID *CommitAddress, PSIZE_T CommitSize);
+
+typedef struct _RTL_HEAP_PARAMETERS
+{
+    ULONG Length;
+    SIZE_T SegmentReserve;
+    SIZE_T SegmentCommit;
+    SIZE_T DeCommitFreeBlockThreshold;
+    SIZE_T DeCommitTotalFreeThreshold;
+    SIZE_T MaximumAllocationSize;
+    SIZE_T VirtualMemoryThreshold;
+    SIZE_T InitialCommit;
+    SIZE_T InitialReserve;
+    PRTL_HEAP_COMMIT_ROUTINE CommitRoutine;
+    SIZE_T Reserved[2];
+} RTL_HEAP_PARAMETERS, *PRTL_HEAP_PARAMETERS;
+
+typedef enum _HEAP_INFORMATION_CLASS
+{
+    HeapCompatibilityInformation,
+    HeapEnableTerminationOnCorruption
+} HEAP_INFORMATION_CLASS;
+
+/* Only used by the unimplemented parts of the heap */
+typedef struct _RTL_HEAP_USAGE *PRTL_HEAP_USAGE;
+typedef struct _RTL_HEAP_TAG_INFO *PRTL_HEAP_TAG_INFO;
+typedef NTSTATUS (NTAPI *PHEAP_ENUMERATION_ROUTINE)(PVOID HeapHandle, PVOID UserParam);
+typedef struct _RTL_CRITICAL_SECTION *PRTL_CRITICAL_SECTION;
+typedef struct _RTL_CRITICAL_SECTION RTL_CRITICAL_SECTION;
+
+/* The heap lock also counts how often and how long it is held */
+typedef struct _HEAP_LOCK
+{
+    pthread_mutex_t Mutex;
+    ULONG Recursion;
+    ULONGLONG AcquireTime;
+    ULONGLONG Acquires;
+    ULONGLONG Contentions;
+    ULONGLONG HoldTime;         // ns
+} HEAP_LOCK, *PHEAP_LOCK;
+
+NTSTATUS NTAPI RtlInitializeHeapLock(PHEAP_LOCK *Lock);
+NTSTATUS NTAPI RtlDeleteHeapLock(PHEAP_LOCK Lock);
+NTSTATUS NTAPI RtlEnterHeapLock(PHEAP_LOCK Lock, BOOLEAN Exclusive);
+BOOLEAN NTAPI RtlTryEnterHeapLock(PHEAP_LOCK Lock, BOOLEAN Exclusive);
+NTSTATUS NTAPI RtlLeaveHeapLock(PHEAP_LOCK Lock);
+
+VOID NTAPI RtlpSetHeapParameters(PRTL_HEAP_PARAMETERS Parameters);
+
+PVOID NTAPI RtlCreateHeap(ULONG Flags, PVOID Addr, SIZE_T TotalSize, SIZE_T CommitSize,
+                          PVOID Lock, PRTL_HEAP_PARAMETERS Parameters);
+PVOID NTAPI RtlDestroyHeap(PVOID HeapHandle);
+PVOID NTAPI RtlAllocateHeap(PVOID HeapHandle, ULONG Flags, SIZE_T Size);
+BOOLEAN NTAPI RtlFreeHeap(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress);
+PVOID NTAPI RtlReAllocateHeap(PVOID HeapHandle, ULONG Flags, PVOID Ptr, SIZE_T Size);
+SIZE_T NTAPI RtlSizeHeap(PVOID HeapHandle, ULONG Flags, PVOID MemoryPointer);
+BOOLEAN NTAPI RtlValidateHeap(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress);
+BOOLEAN NTAPI RtlGetUserInfoHeap(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress,
+                                 PVOID *UserValue, PULONG UserFlags);
+BOOLEAN NTAPI RtlSetUserValueHeap(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress, PVOID UserValue);
+BOOLEAN NTAPI RtlSetUserFlagsHeap(PVOID HeapHandle, ULONG Flags, PVOID BaseAddress,
+                                  ULONG UserFlagsReset, ULONG UserFlagsSet);
+NTSTATUS NTAPI RtlSetHeapInformation(PVOID HeapHandle, HEAP_INFORMATION_CLASS HeapInformationClass,
+                                     PVOID HeapInformation, SIZE_T HeapInformationLength);
+
+SIZE_T NTAPI RtlCompareMemory(const VOID *Source1, const VOID *Source2, SIZE_T Length);
+SIZE_T NTAPI RtlCompareMemoryUlong(PVOID Source, SIZE_T Length, ULONG Pattern);
+VOID NTAPI RtlFillMemoryUlong(PVOID Destination, SIZE_T Length, ULONG Fill);
+
+#endif /* _HEAPBENCH_RTL_H */
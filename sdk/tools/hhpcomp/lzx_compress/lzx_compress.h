@@ -38,5 +38,8 @@ void  lzx_reset(lzx_data *lzxd);
 
 int lzx_compress_block(lzx_data *lzxd, int block_size, int subdivide);
 
+/* pads the output to 16 bits, for a stream that ends in a partial frame */
+void lzx_align_output(lzx_data *lzxd);
+
 int lzx_finish(struct lzx_data *lzxd, struct lzx_results *lzxr);
 
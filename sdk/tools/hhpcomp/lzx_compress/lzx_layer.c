@@ -832,7 +832,7 @@ static void lzx_write_bits(lzx_data *lzxd, int nbits, uint32_t bits)
   lzxd->bits_in_buf = cur_bits;
 }
 
-static void lzx_align_output(lzx_data *lzxd)
+void lzx_align_output(lzx_data *lzxd)
 {
   if (lzxd->bits_in_buf) {
     lzx_write_bits(lzxd, 16 - lzxd->bits_in_buf, 0);
@@ -1242,6 +1242,7 @@ int lzx_finish(struct lzx_data *lzxd, struct lzx_results *lzxr)
   }
   lz_release(lzxd->lzi);
   free(lzxd->lzi);
+  free(lzxd->block_codes);
   free(lzxd->prev_main_treelengths);
   free(lzxd->main_tree);
   free(lzxd->main_freq_table);
@@ -0,0 +1,611 @@
+/*
+ * PROJECT:     ReactOS hive cell allocator benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Replays the cell traffic of a registry-heavy installation
+ *              against the FreeDisplay lists and the free cell index, and
+ *              times subkey lookups in a large key with and without the
+ *              subkey index. Hive files given on the command line are also
+ *              loaded both into allocated bins and as mapped flat hives.
+ */
+
+#include "mkhive.h"
+#include <ctype.h>
+#include <time.h>
+
+#define DEFAULT_KEYS    20000
+#define SUBKEY_COUNT    20000
+#define LOOKUP_COUNT    200000
+
+typedef struct _BENCH_KEY
+{
+    HCELL_INDEX Node;           // HCELL_NIL once the key is deleted
+    HCELL_INDEX SubKeyList;
+    HCELL_INDEX ValueList;
+    ULONG SubKeyCount;
+    ULONG ValueCount;
+    ULONG Parent;
+} BENCH_KEY, *PBENCH_KEY;
+
+typedef struct _BENCH_RUN
+{
+    HHIVE Hive;
+    PBENCH_KEY Keys;
+    ULONG KeyCount;
+    ULONG Seed;
+    ULONG Operations;
+} BENCH_RUN, *PBENCH_RUN;
+
+/* STUBS **********************************************************************/
+
+PVOID
+NTAPI
+CmpAllocate(
+    IN SIZE_T Size,
+    IN BOOLEAN Paged,
+    IN ULONG Tag)
+{
+    return (PVOID)malloc((size_t)Size);
+}
+
+VOID
+NTAPI
+CmpFree(
+    IN PVOID Ptr,
+    IN ULONG Quota)
+{
+    free(Ptr);
+}
+
+/* BENCHMARK ******************************************************************/
+
+static double
+Now(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static ULONG
+Random(PBENCH_RUN Run, ULONG Range)
+{
+    Run->Seed = Run->Seed * 1103515245 + 12345;
+    return (Run->Seed >> 8) % Range;
+}
+
+/* Sizes roughly follow the data of the setup INF files */
+static ULONG
+RandomDataSize(PBENCH_RUN Run)
+{
+    ULONG Kind = Random(Run, 100);
+
+    if (Kind < 40)
+        return 4;
+    if (Kind < 85)
+        return 8 + Random(Run, 248);
+    if (Kind < 98)
+        return 256 + Random(Run, 1792);
+    return 2048 + Random(Run, 14336);
+}
+
+static HCELL_INDEX
+AllocateCell(PBENCH_RUN Run, ULONG Size)
+{
+    HCELL_INDEX Cell;
+
+    Cell = HvAllocateCell(&Run->Hive, Size, Stable, HCELL_NIL);
+    if (Cell == HCELL_NIL)
+    {
+        printf("Cannot allocate %u bytes\n", Size);
+        exit(1);
+    }
+
+    Run->Operations++;
+    return Cell;
+}
+
+static VOID
+FreeCell(PBENCH_RUN Run, HCELL_INDEX Cell)
+{
+    HvFreeCell(&Run->Hive, Cell);
+    Run->Operations++;
+}
+
+static HCELL_INDEX
+GrowList(PBENCH_RUN Run, HCELL_INDEX List, ULONG Size)
+{
+    if (List == HCELL_NIL)
+        return AllocateCell(Run, Size);
+
+    Run->Operations++;
+    List = HvReallocateCell(&Run->Hive, List, Size);
+    if (List == HCELL_NIL)
+    {
+        printf("Cannot reallocate %u bytes\n", Size);
+        exit(1);
+    }
+
+    return List;
+}
+
+/* A value is a value cell holding the index of its data cell, if it has one */
+static VOID
+SetValue(PBENCH_RUN Run, PBENCH_KEY Key)
+{
+    HCELL_INDEX Value;
+    PHCELL_INDEX Data;
+    ULONG Size;
+
+    Value = AllocateCell(Run, 24 + 2 * Random(Run, 24));
+    Data = HvGetCell(&Run->Hive, Value);
+    *Data = HCELL_NIL;
+
+    Size = RandomDataSize(Run);
+    if (Size > sizeof(ULONG))
+    {
+        HCELL_INDEX DataCell = AllocateCell(Run, Size);
+        *(PHCELL_INDEX)HvGetCell(&Run->Hive, Value) = DataCell;
+    }
+
+    Key->ValueList = GrowList(Run, Key->ValueList, (Key->ValueCount + 1) * sizeof(HCELL_INDEX));
+    ((PHCELL_INDEX)HvGetCell(&Run->Hive, Key->ValueList))[Key->ValueCount++] = Value;
+}
+
+static VOID
+OverwriteValue(PBENCH_RUN Run, PBENCH_KEY Key)
+{
+    HCELL_INDEX Value;
+    PHCELL_INDEX Data;
+    ULONG Size;
+
+    Value = ((PHCELL_INDEX)HvGetCell(&Run->Hive, Key->ValueList))[Random(Run, Key->ValueCount)];
+    Data = HvGetCell(&Run->Hive, Value);
+    if (*Data != HCELL_NIL)
+        FreeCell(Run, *Data);
+    *Data = HCELL_NIL;
+
+    Size = RandomDataSize(Run);
+    if (Size > sizeof(ULONG))
+    {
+        HCELL_INDEX DataCell = AllocateCell(Run, Size);
+        *(PHCELL_INDEX)HvGetCell(&Run->Hive, Value) = DataCell;
+    }
+}
+
+static VOID
+CreateKey(PBENCH_RUN Run)
+{
+    PBENCH_KEY Key, Parent;
+    ULONG i, Count;
+
+    /* Installers mostly add keys below the ones they just created */
+    Key = &Run->Keys[Run->KeyCount];
+    Key->Parent = Run->KeyCount - 1 - Random(Run, min(Run->KeyCount, 64));
+    while (Run->Keys[Key->Parent].Node == HCELL_NIL)
+        Key->Parent = Run->Keys[Key->Parent].Parent;
+    Parent = &Run->Keys[Key->Parent];
+    Run->KeyCount++;
+
+    Key->Node = AllocateCell(Run, 76 + 2 * Random(Run, 20));
+    Key->SubKeyList = HCELL_NIL;
+    Key->ValueList = HCELL_NIL;
+    Key->SubKeyCount = 0;
+    Key->ValueCount = 0;
+
+    Parent->SubKeyList = GrowList(Run, Parent->SubKeyList,
+                                  (Parent->SubKeyCount + 1) * 2 * sizeof(HCELL_INDEX));
+    ((PHCELL_INDEX)HvGetCell(&Run->Hive, Parent->SubKeyList))[2 * Parent->SubKeyCount++] = Key->Node;
+
+    Count = Random(Run, 8);
+    for (i = 0; i < Count; i++)
+        SetValue(Run, Key);
+}
+
+/* Subkeys of a deleted key stay in the hive, only the key's own cells go */
+static VOID
+DeleteKey(PBENCH_RUN Run, PBENCH_KEY Key)
+{
+    PBENCH_KEY Parent = &Run->Keys[Key->Parent];
+    PHCELL_INDEX List, Data;
+    ULONG i;
+
+    for (i = 0; i < Key->ValueCount; i++)
+    {
+        List = HvGetCell(&Run->Hive, Key->ValueList);
+        Data = HvGetCell(&Run->Hive, List[i]);
+        if (*Data != HCELL_NIL)
+            FreeCell(Run, *Data);
+        FreeCell(Run, List[i]);
+    }
+
+    if (Key->ValueList != HCELL_NIL)
+        FreeCell(Run, Key->ValueList);
+    if (Key->SubKeyList != HCELL_NIL)
+        FreeCell(Run, Key->SubKeyList);
+
+    if (Parent->Node != HCELL_NIL)
+    {
+        List = HvGetCell(&Run->Hive, Parent->SubKeyList);
+        for (i = 0; List[2 * i] != Key->Node; i++);
+        List[2 * i] = List[2 * --Parent->SubKeyCount];
+    }
+
+    FreeCell(Run, Key->Node);
+    Key->Node = HCELL_NIL;
+}
+
+static PBENCH_KEY
+RandomKey(PBENCH_RUN Run)
+{
+    PBENCH_KEY Key;
+
+    do
+    {
+        /* The root key is never deleted */
+        Key = &Run->Keys[1 + Random(Run, Run->KeyCount - 1)];
+    }
+    while (Key->Node == HCELL_NIL);
+
+    return Key;
+}
+
+static VOID
+Replay(PBENCH_RUN Run, ULONG KeyCount)
+{
+    PBENCH_KEY Key;
+    ULONG i;
+
+    /* The root key */
+    Run->Keys[0].Node = AllocateCell(Run, 80);
+    Run->Keys[0].SubKeyList = HCELL_NIL;
+    Run->Keys[0].ValueList = HCELL_NIL;
+    Run->Keys[0].SubKeyCount = 0;
+    Run->Keys[0].ValueCount = 0;
+    Run->Keys[0].Parent = 0;
+    Run->KeyCount = 1;
+
+    /* Installation: keys and values, with some of them rewritten or removed later on */
+    while (Run->KeyCount < KeyCount)
+    {
+        CreateKey(Run);
+
+        if (Run->KeyCount > 16 && Random(Run, 100) < 30)
+        {
+            Key = RandomKey(Run);
+            if (Key->ValueCount)
+                OverwriteValue(Run, Key);
+        }
+
+        if (Run->KeyCount > 16 && Random(Run, 100) < 5)
+            DeleteKey(Run, RandomKey(Run));
+    }
+
+    /* Upgrade: a third of the keys are replaced by new ones */
+    for (i = 0; i < KeyCount / 3; i++)
+        DeleteKey(Run, RandomKey(Run));
+    for (i = 0; i < KeyCount / 3; i++)
+        CreateKey(Run);
+}
+
+static BOOL
+RunAllocator(const char *Name, ULONG HiveFlags, ULONG KeyCount)
+{
+    BENCH_RUN Run;
+    ULONG BlockIndex, Offset, Used, Free;
+    double Start, Time;
+    NTSTATUS Status;
+    PHCELL Cell;
+    PHBIN Bin;
+
+    memset(&Run, 0, sizeof(Run));
+    Run.Seed = 1;
+    Run.Keys = malloc((KeyCount + KeyCount / 3) * sizeof(BENCH_KEY));
+    if (!Run.Keys)
+    {
+        printf("%-16s out of memory\n", Name);
+        return FALSE;
+    }
+
+    Status = HvInitialize(&Run.Hive, HINIT_CREATE, HiveFlags, HFILE_TYPE_PRIMARY, NULL,
+                          CmpAllocate, CmpFree, NULL, NULL, NULL, NULL, 1, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("%-16s HvInitialize failed: 0x%08x\n", Name, Status);
+        free(Run.Keys);
+        return FALSE;
+    }
+
+    Start = Now();
+    Replay(&Run, KeyCount);
+    Time = Now() - Start;
+
+    /* Walk the bins to see how well the allocator packed the cells */
+    Used = Free = 0;
+    for (BlockIndex = 0; BlockIndex < Run.Hive.Storage[Stable].Length; BlockIndex += Bin->Size / HBLOCK_SIZE)
+    {
+        Bin = (PHBIN)Run.Hive.Storage[Stable].BlockList[BlockIndex].BinAddress;
+        for (Offset = sizeof(HBIN); Offset < Bin->Size; Offset += abs(Cell->Size))
+        {
+            Cell = (PHCELL)((ULONG_PTR)Bin + Offset);
+            if (Cell->Size > 0)
+                Free += Cell->Size;
+            else
+                Used -= Cell->Size;
+        }
+    }
+
+    printf("%-16s %9.3f %12.0f %10u %10u %10u\n",
+           Name,
+           Time,
+           Time > 0 ? Run.Operations / Time : 0.0,
+           Run.Hive.Storage[Stable].Length * HBLOCK_SIZE / 1024,
+           Used / 1024,
+           Free / 1024);
+
+    HvFree(&Run.Hive);
+    free(Run.Keys);
+    return TRUE;
+}
+
+/* GUID-like names, as found below CLSID */
+static VOID
+MakeSubKeyName(ULONG Number, BOOLEAN Lower, PWCHAR Name, PUNICODE_STRING String)
+{
+    char Buffer[40];
+    ULONG Hash, i;
+
+    Hash = Number * 2654435761U;
+    sprintf(Buffer, "{%08X-%04X-11D0-%04X-00A0C91E%04X}",
+            Hash, Number & 0xFFFF, (Hash >> 7) & 0xFFFF, Number >> 16);
+
+    for (i = 0; Buffer[i]; i++)
+        Name[i] = (WCHAR)(Lower ? tolower(Buffer[i]) : Buffer[i]);
+
+    String->Buffer = Name;
+    String->Length = String->MaximumLength = (USHORT)(i * sizeof(WCHAR));
+}
+
+static HCELL_INDEX
+CreateSubKey(PHHIVE Hive, HCELL_INDEX Parent, PUNICODE_STRING Name)
+{
+    PCM_KEY_NODE Node;
+    HCELL_INDEX Cell;
+
+    Cell = HvAllocateCell(Hive, FIELD_OFFSET(CM_KEY_NODE, Name) + CmpNameSize(Hive, Name),
+                          Stable, HCELL_NIL);
+    if (Cell == HCELL_NIL)
+        return HCELL_NIL;
+
+    Node = HvGetCell(Hive, Cell);
+    memset(Node, 0, FIELD_OFFSET(CM_KEY_NODE, Name));
+    Node->Signature = CM_KEY_NODE_SIGNATURE;
+    Node->Parent = Parent;
+    Node->SubKeyLists[Stable] = HCELL_NIL;
+    Node->SubKeyLists[Volatile] = HCELL_NIL;
+    Node->ValueList.List = HCELL_NIL;
+    Node->Security = HCELL_NIL;
+    Node->Class = HCELL_NIL;
+    Node->NameLength = CmpCopyName(Hive, Node->Name, Name);
+    if (Node->NameLength < Name->Length)
+        Node->Flags |= KEY_COMP_NAME;
+
+    if (!CmpAddSubKey(Hive, Parent, Cell))
+        return HCELL_NIL;
+
+    return Cell;
+}
+
+/* Looks up existing keys in a different case and some missing ones */
+static ULONG
+Lookup(PHHIVE Hive, HCELL_INDEX Parent, PHCELL_INDEX Cells, ULONG Count)
+{
+    PCM_KEY_NODE Node = HvGetCell(Hive, Parent);
+    UNICODE_STRING Name;
+    WCHAR Buffer[40];
+    ULONG Seed = 7, Number, Errors = 0, i;
+
+    for (i = 0; i < LOOKUP_COUNT; i++)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        Number = (Seed >> 8) % (Count + Count / 8);
+        MakeSubKeyName(Number, TRUE, Buffer, &Name);
+        if (CmpFindSubKeyByName(Hive, Node, &Name) != (Number < Count ? Cells[Number] : HCELL_NIL))
+            Errors++;
+    }
+
+    return Errors;
+}
+
+static BOOL
+RunLookups(const char *Name, ULONG HiveFlags)
+{
+    HHIVE Hive;
+    UNICODE_STRING KeyName;
+    WCHAR Buffer[40];
+    PHCELL_INDEX Cells;
+    HCELL_INDEX Root;
+    ULONG Errors, i;
+    double Start, Time, TimeAfterDelete;
+    NTSTATUS Status;
+
+    Cells = malloc(SUBKEY_COUNT * sizeof(HCELL_INDEX));
+    if (!Cells)
+    {
+        printf("%-16s out of memory\n", Name);
+        return FALSE;
+    }
+
+    Status = HvInitialize(&Hive, HINIT_CREATE, HiveFlags, HFILE_TYPE_PRIMARY, NULL,
+                          CmpAllocate, CmpFree, NULL, NULL, NULL, NULL, 1, NULL);
+    if (!NT_SUCCESS(Status) || !CmCreateRootNode(&Hive, L"CLSID"))
+    {
+        printf("%-16s cannot create the hive\n", Name);
+        free(Cells);
+        return FALSE;
+    }
+
+    Root = Hive.BaseBlock->RootCell;
+    for (i = 0; i < SUBKEY_COUNT; i++)
+    {
+        MakeSubKeyName(i, FALSE, Buffer, &KeyName);
+        Cells[i] = CreateSubKey(&Hive, Root, &KeyName);
+        if (Cells[i] == HCELL_NIL)
+        {
+            printf("%-16s cannot create the subkeys\n", Name);
+            HvFree(&Hive);
+            free(Cells);
+            return FALSE;
+        }
+    }
+
+    Start = Now();
+    Errors = Lookup(&Hive, Root, Cells, SUBKEY_COUNT);
+    Time = Now() - Start;
+
+    /* Remove the upper half, the index has to follow */
+    for (i = SUBKEY_COUNT / 2; i < SUBKEY_COUNT; i++)
+    {
+        HvMarkCellDirty(&Hive, Cells[i], FALSE);
+        if (!CmpRemoveSubKey(&Hive, Root, Cells[i]))
+            Errors++;
+    }
+
+    Start = Now();
+    Errors += Lookup(&Hive, Root, Cells, SUBKEY_COUNT / 2);
+    TimeAfterDelete = Now() - Start;
+
+    printf("%-16s %12.0f %12.0f %8u\n",
+           Name,
+           Time > 0 ? LOOKUP_COUNT / Time : 0.0,
+           TimeAfterDelete > 0 ? LOOKUP_COUNT / TimeAfterDelete : 0.0,
+           Errors);
+
+    HvFree(&Hive);
+    free(Cells);
+    return Errors == 0;
+}
+
+/* Touches every key, value and value data cell of the hive */
+static volatile UCHAR DataSum;
+
+static ULONG
+WalkKey(PHHIVE Hive, HCELL_INDEX Cell, PULONG Values)
+{
+    PCM_KEY_NODE Node = HvGetCell(Hive, Cell);
+    PCM_KEY_VALUE Value;
+    PHCELL_INDEX List;
+    ULONG Keys = 1, i;
+
+    if (Node->ValueList.Count)
+    {
+        List = HvGetCell(Hive, Node->ValueList.List);
+        for (i = 0; i < Node->ValueList.Count; i++)
+        {
+            Value = HvGetCell(Hive, List[i]);
+            if (!(Value->DataLength & CM_KEY_VALUE_SPECIAL_SIZE) && Value->DataLength)
+                DataSum += *(PUCHAR)HvGetCell(Hive, Value->Data);
+            (*Values)++;
+        }
+    }
+
+    for (i = 0; i < Node->SubKeyCounts[Stable]; i++)
+        Keys += WalkKey(Hive, CmpFindSubKeyByNumber(Hive, Node, i), Values);
+
+    return Keys;
+}
+
+static BOOL
+RunLoad(const char *FileName)
+{
+    CMHIVE CmHive;
+    HHIVE Hive;
+    FILE *File;
+    PVOID Data;
+    long Size;
+    ULONG Keys, Values = 0, FlatKeys, FlatValues = 0;
+    double Start, Time, FlatTime;
+    NTSTATUS Status;
+
+    /* Map it and use the cells in place, this also checks the file size */
+    Start = Now();
+    if (!ImportBinaryHive(FileName, &CmHive))
+        return FALSE;
+    FlatKeys = WalkKey(&CmHive.Hive, CmHive.Hive.BaseBlock->RootCell, &FlatValues);
+    UnloadBinaryHive(&CmHive);
+    FlatTime = Now() - Start;
+
+    /* Read the file and copy it into freshly allocated bins */
+    Start = Now();
+    File = fopen(FileName, "rb");
+    if (File == NULL || fseek(File, 0, SEEK_END) != 0 || (Size = ftell(File)) <= 0 ||
+        fseek(File, 0, SEEK_SET) != 0 || (Data = malloc(Size)) == NULL)
+    {
+        printf("%-24s cannot be read\n", FileName);
+        if (File)
+            fclose(File);
+        return FALSE;
+    }
+    if (fread(Data, 1, Size, File) != (size_t)Size)
+    {
+        printf("%-24s cannot be read\n", FileName);
+        free(Data);
+        fclose(File);
+        return FALSE;
+    }
+    fclose(File);
+
+    Status = HvInitialize(&Hive, HINIT_MEMORY, 0, HFILE_TYPE_PRIMARY, Data,
+                          CmpAllocate, CmpFree, NULL, NULL, NULL, NULL, 1, NULL);
+    free(Data);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("%-24s is not a valid hive\n", FileName);
+        return FALSE;
+    }
+    Keys = WalkKey(&Hive, Hive.BaseBlock->RootCell, &Values);
+    HvFree(&Hive);
+    Time = Now() - Start;
+
+    printf("%-24s %8u %8u %10.4f %10.4f\n", FileName, Keys, Values, Time, FlatTime);
+
+    if (Keys != FlatKeys || Values != FlatValues)
+    {
+        printf("%-24s flat walk found %u keys and %u values\n", FileName, FlatKeys, FlatValues);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    ULONG KeyCount = DEFAULT_KEYS;
+    BOOL Result = TRUE;
+    int i;
+
+    if (argc > 1)
+        KeyCount = strtoul(argv[1], NULL, 0);
+    if (KeyCount < 32)
+        KeyCount = 32;
+
+    printf("Replaying %u keys\n", KeyCount);
+    printf("%-16s %9s %12s %10s %10s %10s\n", "Allocator", "Seconds", "Cell ops/s", "Hive KB", "Used KB", "Free KB");
+
+    Result &= RunAllocator("FreeDisplay", HIVE_NO_FREE_CELL_INDEX, KeyCount);
+    Result &= RunAllocator("Free cell index", 0, KeyCount);
+
+    printf("\nLooking up %u names in a key with %u subkeys\n", LOOKUP_COUNT, SUBKEY_COUNT);
+    printf("%-16s %12s %12s %8s\n", "Lookup", "Lookups/s", "Half gone", "Errors");
+
+    Result &= RunLookups("Leaf search", 0);
+    Result &= RunLookups("Subkey index", HIVE_SUBKEY_INDEX);
+
+    if (argc > 2)
+    {
+        printf("\nLoading and walking hives\n");
+        printf("%-24s %8s %8s %10s %10s\n", "Hive", "Keys", "Values", "Bins s", "Mapped s");
+
+        for (i = 2; i < argc; i++)
+            Result &= RunLoad(argv[i]);
+    }
+
+    return Result ? 0 : 1;
+}
@@ -0,0 +1,1369 @@
+/*
+ * PROJECT:     ReactOS offline hive checker
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Verifies every bin, cell, key index, value list and security
+ *              cell of a hive file, the bins being split across threads,
+ *              and optionally writes a compacted copy of the hive in which
+ *              the children of a key follow their parent.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "mkhive.h"
+
+#ifdef _WIN32
+#include <process.h>
+#include <intrin.h>
+/* We only want to include host headers, so we declare them manually */
+__declspec(dllimport) unsigned long __stdcall WaitForSingleObject(void *hHandle, unsigned long dwMilliseconds);
+__declspec(dllimport) int __stdcall CloseHandle(void *hObject);
+#define INFINITE 0xFFFFFFFF
+#define AtomicIncrement(p)  _InterlockedIncrement((volatile long *)(p))
+#define AtomicOr(p, v)      ((ULONG)_InterlockedOr((volatile long *)(p), (long)(v)))
+#else
+#include <pthread.h>
+#include <unistd.h>
+#define AtomicIncrement(p)  __sync_add_and_fetch((p), 1)
+#define AtomicOr(p, v)      __sync_fetch_and_or((p), (v))
+#endif
+
+#define MAX_THREADS         64
+#define MAX_MESSAGES        32
+#define MAX_KEY_NAME        255     // characters
+#define MAX_KEY_DEPTH       512
+#define CELL_UNIT           8       // cells are aligned on 8 bytes
+
+#define CellUnit(c)         ((c) / CELL_UNIT)
+#define CellBit(b, c)       ((b)[CellUnit(c) / 32] & (1 << (CellUnit(c) % 32)))
+
+typedef struct _HIVE_CHECK
+{
+    PHBASE_BLOCK BaseBlock;
+    PUCHAR Bins;
+    ULONG Length;
+    PULONG BinOffsets;
+    ULONG BinCount;
+    PULONG CellBits;            // allocated cells, by the offset of their header
+    PULONG RefBits;             // cells owned by a key, or listed for security cells
+    PLONG SecurityRefs;         // keys using each security cell
+    volatile LONG Messages;
+} HIVE_CHECK, *PHIVE_CHECK;
+
+typedef struct _CHECK_THREAD *PCHECK_THREAD;
+typedef VOID (*PCHECK_ROUTINE)(PCHECK_THREAD Thread);
+
+typedef struct _CHECK_THREAD
+{
+    PHIVE_CHECK Check;
+    PCHECK_ROUTINE Routine;
+    ULONG FirstBin;
+    ULONG LastBin;
+    ULONG Errors;
+    ULONG UsedCells;
+    ULONG UsedBytes;
+    ULONG FreeBytes;
+    ULONG Keys;
+    ULONG Values;
+    ULONG SecurityCells;
+#ifdef _WIN32
+    uintptr_t Handle;
+#else
+    pthread_t Handle;
+#endif
+    BOOL Started;
+} CHECK_THREAD;
+
+typedef enum _COMPACT_KIND
+{
+    CompactRaw,
+    CompactKey,
+    CompactIndex,
+    CompactList,                // value lists and big data segment lists
+    CompactValue,
+    CompactBigData,
+    CompactSecurity
+} COMPACT_KIND;
+
+typedef struct _COMPACT_CELL
+{
+    HCELL_INDEX Cell;
+    ULONG Size;
+    COMPACT_KIND Kind;
+} COMPACT_CELL, *PCOMPACT_CELL;
+
+typedef struct _HIVE_COMPACT
+{
+    PHIVE_CHECK Check;
+    CMHIVE CmHive;
+    PHCELL_INDEX Map;           // new cell of each old cell, by header offset
+    PCOMPACT_CELL Cells;        // old cells in their new order
+    ULONG Count;
+} HIVE_COMPACT, *PHIVE_COMPACT;
+
+/* STUBS **********************************************************************/
+
+PVOID
+NTAPI
+CmpAllocate(
+    IN SIZE_T Size,
+    IN BOOLEAN Paged,
+    IN ULONG Tag)
+{
+    return (PVOID)malloc((size_t)Size);
+}
+
+VOID
+NTAPI
+CmpFree(
+    IN PVOID Ptr,
+    IN ULONG Quota)
+{
+    free(Ptr);
+}
+
+static BOOLEAN
+NTAPI
+CmpFileRead(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    OUT PVOID Buffer,
+    IN SIZE_T BufferLength)
+{
+    /* The compacted hive is created from scratch */
+    return FALSE;
+}
+
+static BOOLEAN
+NTAPI
+CmpFileWrite(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    IN PVOID Buffer,
+    IN SIZE_T BufferLength)
+{
+    PCMHIVE CmHive = (PCMHIVE)RegistryHive;
+    FILE *File = CmHive->FileHandles[HFILE_TYPE_PRIMARY];
+    if (fseek(File, *FileOffset, SEEK_SET) != 0)
+        return FALSE;
+
+    return (fwrite(Buffer, 1, BufferLength, File) == BufferLength);
+}
+
+static BOOLEAN
+NTAPI
+CmpFileSetSize(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN ULONG FileSize,
+    IN ULONG OldFileSize)
+{
+    return FALSE;
+}
+
+static BOOLEAN
+NTAPI
+CmpFileFlush(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    PLARGE_INTEGER FileOffset,
+    ULONG Length)
+{
+    PCMHIVE CmHive = (PCMHIVE)RegistryHive;
+    FILE *File = CmHive->FileHandles[HFILE_TYPE_PRIMARY];
+    return (fflush(File) == 0);
+}
+
+/* HELPERS ********************************************************************/
+
+static double
+Now(void)
+{
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+#endif
+}
+
+static ULONG
+GetProcessorCount(void)
+{
+    LONG Count;
+
+#ifdef _WIN32
+    Count = getenv("NUMBER_OF_PROCESSORS") ? atol(getenv("NUMBER_OF_PROCESSORS")) : 1;
+#else
+    Count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (Count < 1)
+        return 1;
+    if (Count > MAX_THREADS)
+        return MAX_THREADS;
+    return Count;
+}
+
+static VOID
+ReportError(PCHECK_THREAD Thread, HCELL_INDEX Cell, const char *Format, ...)
+{
+    va_list Args;
+    LONG Message;
+
+    Thread->Errors++;
+
+    /* Only the first errors are worth reading */
+    Message = AtomicIncrement(&Thread->Check->Messages);
+    if (Message > MAX_MESSAGES)
+        return;
+
+    printf("    Cell 0x%08x: ", (unsigned)Cell);
+    va_start(Args, Format);
+    vprintf(Format, Args);
+    va_end(Args);
+    printf("\n");
+    if (Message == MAX_MESSAGES)
+        printf("    Further errors are not shown\n");
+}
+
+static ULONG
+GetCellSize(PHIVE_CHECK Check, HCELL_INDEX Cell)
+{
+    return -((PHCELL)(Check->Bins + Cell))->Size - sizeof(HCELL);
+}
+
+/* Returns the data of an allocated stable cell holding at least Size bytes */
+static PVOID
+GetCell(PHIVE_CHECK Check, HCELL_INDEX Cell, ULONG Size)
+{
+    if (Cell >= Check->Length || Cell % CELL_UNIT != 0 || !CellBit(Check->CellBits, Cell))
+        return NULL;
+
+    if (GetCellSize(Check, Cell) < Size)
+        return NULL;
+
+    return Check->Bins + Cell + sizeof(HCELL);
+}
+
+/* Claims a cell for its owner, no cell may have two of them */
+static BOOL
+MarkCell(PCHECK_THREAD Thread, HCELL_INDEX Cell)
+{
+    ULONG Mask = 1 << (CellUnit(Cell) % 32);
+
+    if (AtomicOr(&Thread->Check->RefBits[CellUnit(Cell) / 32], Mask) & Mask)
+    {
+        ReportError(Thread, Cell, "cell is used more than once");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static PCM_KEY_NODE
+GetKeyNode(PHIVE_CHECK Check, HCELL_INDEX Cell)
+{
+    PCM_KEY_NODE Node = GetCell(Check, Cell, FIELD_OFFSET(CM_KEY_NODE, Name));
+
+    if (Node == NULL || Node->Signature != CM_KEY_NODE_SIGNATURE)
+        return NULL;
+
+    return Node;
+}
+
+/* Expands the name of a key node into Buffer, which holds MAX_KEY_NAME + 1 characters */
+static BOOL
+GetKeyName(PHIVE_CHECK Check, HCELL_INDEX Cell, PCM_KEY_NODE Node, PWCHAR Buffer, PUNICODE_STRING Name)
+{
+    ULONG Length;
+
+    if (FIELD_OFFSET(CM_KEY_NODE, Name) + Node->NameLength > GetCellSize(Check, Cell))
+        return FALSE;
+
+    if (Node->Flags & KEY_COMP_NAME)
+    {
+        Length = Node->NameLength;
+        if (Length > MAX_KEY_NAME)
+            return FALSE;
+        CmpCopyCompressedName(Buffer, Length * sizeof(WCHAR), Node->Name, Node->NameLength);
+    }
+    else
+    {
+        Length = Node->NameLength / sizeof(WCHAR);
+        if (Length > MAX_KEY_NAME)
+            return FALSE;
+        memcpy(Buffer, Node->Name, Length * sizeof(WCHAR));
+    }
+
+    Buffer[Length] = UNICODE_NULL;
+    Name->Buffer = Buffer;
+    Name->Length = Name->MaximumLength = (USHORT)(Length * sizeof(WCHAR));
+    return TRUE;
+}
+
+/* Only called on indexes that passed the checks */
+static HCELL_INDEX
+GetSubKeyByNumber(PHIVE_CHECK Check, PCM_KEY_NODE Node, ULONG Number)
+{
+    PCM_KEY_INDEX Index, Leaf = NULL;
+    ULONG i;
+
+    Index = GetCell(Check, Node->SubKeyLists[Stable], 0);
+    if (Index->Signature == CM_KEY_INDEX_ROOT)
+    {
+        for (i = 0; i < Index->Count; i++)
+        {
+            Leaf = GetCell(Check, Index->List[i], 0);
+            if (Number < Leaf->Count)
+                break;
+            Number -= Leaf->Count;
+        }
+        Index = Leaf;
+    }
+
+    if (Index->Signature == CM_KEY_INDEX_LEAF)
+        return Index->List[Number];
+    return ((PCM_KEY_FAST_INDEX)Index)->List[Number].Cell;
+}
+
+/* CHECKS *********************************************************************/
+
+/*
+ * Walks the cells of the thread's bins, they have to fill each bin exactly.
+ * Bins start on block boundaries, so no two threads share a word of CellBits.
+ */
+static VOID
+ScanBins(PCHECK_THREAD Thread)
+{
+    PHIVE_CHECK Check = Thread->Check;
+    ULONG i, Offset, End, Size;
+    PHCELL Cell;
+
+    for (i = Thread->FirstBin; i < Thread->LastBin; i++)
+    {
+        Offset = Check->BinOffsets[i];
+        End = Offset + ((PHBIN)(Check->Bins + Offset))->Size;
+
+        for (Offset += sizeof(HBIN); Offset < End; Offset += Size)
+        {
+            Cell = (PHCELL)(Check->Bins + Offset);
+            Size = abs(Cell->Size);
+            if (Size < 2 * sizeof(HCELL) || Size % CELL_UNIT != 0 || Size > End - Offset)
+            {
+                ReportError(Thread, Offset, "cell size %d does not fit in its bin", (int)Cell->Size);
+                break;
+            }
+
+            if (Cell->Size < 0)
+            {
+                Check->CellBits[CellUnit(Offset) / 32] |= 1 << (CellUnit(Offset) % 32);
+                Thread->UsedCells++;
+                Thread->UsedBytes += Size;
+            }
+            else
+            {
+                Thread->FreeBytes += Size;
+            }
+        }
+    }
+}
+
+static VOID
+CheckBigData(PCHECK_THREAD Thread, HCELL_INDEX ValueCell, PCM_KEY_VALUE Value)
+{
+    PHIVE_CHECK Check = Thread->Check;
+    PCM_BIG_DATA BigData;
+    PHCELL_INDEX List;
+    ULONG Length = Value->DataLength, i;
+
+    BigData = GetCell(Check, Value->Data, sizeof(CM_BIG_DATA));
+    if (BigData == NULL || BigData->Signature != CM_BIG_DATA_SIGNATURE ||
+        BigData->Count == 0 ||
+        (ULONG)BigData->Count * CM_KEY_VALUE_BIG < Length ||
+        (ULONG)(BigData->Count - 1) * CM_KEY_VALUE_BIG >= Length)
+    {
+        ReportError(Thread, ValueCell, "bad big data cell 0x%08x", (unsigned)Value->Data);
+        return;
+    }
+    MarkCell(Thread, Value->Data);
+
+    List = GetCell(Check, BigData->List, BigData->Count * sizeof(HCELL_INDEX));
+    if (List == NULL)
+    {
+        ReportError(Thread, Value->Data, "bad segment list 0x%08x", (unsigned)BigData->List);
+        return;
+    }
+    MarkCell(Thread, BigData->List);
+
+    for (i = 0; i < BigData->Count; i++, Length -= CM_KEY_VALUE_BIG)
+    {
+        if (GetCell(Check, List[i], min(Length, CM_KEY_VALUE_BIG)) == NULL)
+        {
+            ReportError(Thread, BigData->List, "bad data segment 0x%08x", (unsigned)List[i]);
+            continue;
+        }
+        MarkCell(Thread, List[i]);
+    }
+}
+
+static VOID
+CheckValues(PCHECK_THREAD Thread, HCELL_INDEX KeyCell, PCM_KEY_NODE Node)
+{
+    PHIVE_CHECK Check = Thread->Check;
+    PCM_KEY_VALUE Value;
+    PHCELL_INDEX List;
+    ULONG Count = Node->ValueList.Count, Length, i;
+
+    if (Count == 0)
+        return;
+
+    List = GetCell(Check, Node->ValueList.List, Count * sizeof(HCELL_INDEX));
+    if (List == NULL)
+    {
+        ReportError(Thread, KeyCell, "bad value list 0x%08x for %u values",
+                    (unsigned)Node->ValueList.List, Count);
+        return;
+    }
+    MarkCell(Thread, Node->ValueList.List);
+
+    for (i = 0; i < Count; i++)
+    {
+        Value = GetCell(Check, List[i], FIELD_OFFSET(CM_KEY_VALUE, Name));
+        if (Value == NULL || Value->Signature != CM_KEY_VALUE_SIGNATURE)
+        {
+            ReportError(Thread, KeyCell, "bad value cell 0x%08x", (unsigned)List[i]);
+            continue;
+        }
+        if (!MarkCell(Thread, List[i]))
+            continue;
+        Thread->Values++;
+
+        if (FIELD_OFFSET(CM_KEY_VALUE, Name) + Value->NameLength > GetCellSize(Check, List[i]))
+            ReportError(Thread, List[i], "value name does not fit in the cell");
+
+        if (CmpIsKeyValueSmall(&Length, Value->DataLength))
+        {
+            if (Length > sizeof(HCELL_INDEX))
+                ReportError(Thread, List[i], "inline data of %u bytes", Length);
+        }
+        else if (Length == 0)
+        {
+            continue;
+        }
+        else if (Check->BaseBlock->Minor >= HSYS_WHISTLER_BETA1 && Length > CM_KEY_VALUE_BIG)
+        {
+            CheckBigData(Thread, List[i], Value);
+        }
+        else if (GetCell(Check, Value->Data, Length) == NULL)
+        {
+            ReportError(Thread, List[i], "bad data cell 0x%08x for %u bytes",
+                        (unsigned)Value->Data, Length);
+        }
+        else
+        {
+            MarkCell(Thread, Value->Data);
+        }
+    }
+}
+
+/* Checks the subkeys of one leaf, their names have to go on ascending across the leaves */
+static VOID
+CheckLeaf(PCHECK_THREAD Thread, HCELL_INDEX KeyCell, HCELL_INDEX LeafCell, PCM_KEY_INDEX Leaf,
+          PULONG Found, PUNICODE_STRING Previous, PWCHAR Buffers[2])
+{
+    PHIVE_CHECK Check = Thread->Check;
+    PCM_KEY_FAST_INDEX FastLeaf = (PCM_KEY_FAST_INDEX)Leaf;
+    UNICODE_STRING Name;
+    PCM_KEY_NODE Child;
+    HCELL_INDEX ChildCell;
+    ULONG EntrySize, i, j;
+
+    if (Leaf->Signature == CM_KEY_INDEX_LEAF)
+        EntrySize = sizeof(HCELL_INDEX);
+    else if (Leaf->Signature == CM_KEY_FAST_LEAF || Leaf->Signature == CM_KEY_HASH_LEAF)
+        EntrySize = sizeof(CM_INDEX);
+    else
+    {
+        ReportError(Thread, LeafCell, "bad index signature 0x%04x", Leaf->Signature);
+        return;
+    }
+
+    if (FIELD_OFFSET(CM_KEY_INDEX, List) + Leaf->Count * EntrySize > GetCellSize(Check, LeafCell))
+    {
+        ReportError(Thread, LeafCell, "%u index entries do not fit in the cell", Leaf->Count);
+        return;
+    }
+
+    for (i = 0; i < Leaf->Count; i++)
+    {
+        ChildCell = (EntrySize == sizeof(HCELL_INDEX)) ? Leaf->List[i] : FastLeaf->List[i].Cell;
+        Child = GetKeyNode(Check, ChildCell);
+        if (Child == NULL)
+        {
+            ReportError(Thread, LeafCell, "bad subkey 0x%08x", (unsigned)ChildCell);
+            continue;
+        }
+        if (!MarkCell(Thread, ChildCell))
+            continue;
+        (*Found)++;
+
+        if (Child->Parent != KeyCell)
+            ReportError(Thread, ChildCell, "parent is 0x%08x instead of 0x%08x",
+                        (unsigned)Child->Parent, (unsigned)KeyCell);
+
+        /* The name itself is reported by the check of the subkey */
+        if (!GetKeyName(Check, ChildCell, Child, Buffers[*Found % 2], &Name))
+            continue;
+
+        if (Previous->Buffer && RtlCompareUnicodeString(Previous, &Name, TRUE) >= 0)
+            ReportError(Thread, LeafCell, "subkey 0x%08x is out of order", (unsigned)ChildCell);
+        *Previous = Name;
+
+        /* Lookups skip the subkeys whose hint or hash does not match */
+        if (Leaf->Signature == CM_KEY_FAST_LEAF)
+        {
+            for (j = 0; j < 4 && FastLeaf->List[i].NameHint[j]; j++)
+            {
+                if (j >= Name.Length / sizeof(WCHAR) ||
+                    RtlUpcaseUnicodeChar(FastLeaf->List[i].NameHint[j]) != RtlUpcaseUnicodeChar(Name.Buffer[j]))
+                {
+                    ReportError(Thread, LeafCell, "name hint of subkey 0x%08x does not match", (unsigned)ChildCell);
+                    break;
+                }
+            }
+        }
+        else if (Leaf->Signature == CM_KEY_HASH_LEAF &&
+                 FastLeaf->List[i].HashKey != CmpComputeHashKey(0, &Name, FALSE))
+        {
+            ReportError(Thread, LeafCell, "hash of subkey 0x%08x does not match", (unsigned)ChildCell);
+        }
+    }
+}
+
+static VOID
+CheckSubKeys(PCHECK_THREAD Thread, HCELL_INDEX KeyCell, PCM_KEY_NODE Node)
+{
+    PHIVE_CHECK Check = Thread->Check;
+    WCHAR NameBuffers[2][MAX_KEY_NAME + 1];
+    PWCHAR Buffers[2] = { NameBuffers[0], NameBuffers[1] };
+    UNICODE_STRING Previous = { 0, 0, NULL };
+    PCM_KEY_INDEX Index, Leaf;
+    HCELL_INDEX IndexCell = Node->SubKeyLists[Stable];
+    ULONG Found = 0, i;
+
+    if (Node->SubKeyCounts[Stable] == 0)
+        return;
+
+    Index = GetCell(Check, IndexCell, FIELD_OFFSET(CM_KEY_INDEX, List));
+    if (Index == NULL)
+    {
+        ReportError(Thread, KeyCell, "bad subkey index 0x%08x", (unsigned)IndexCell);
+        return;
+    }
+    if (!MarkCell(Thread, IndexCell))
+        return;
+
+    if (Index->Signature == CM_KEY_INDEX_ROOT)
+    {
+        if (FIELD_OFFSET(CM_KEY_INDEX, List) + Index->Count * sizeof(HCELL_INDEX) > GetCellSize(Check, IndexCell))
+        {
+            ReportError(Thread, IndexCell, "%u index entries do not fit in the cell", Index->Count);
+            return;
+        }
+
+        for (i = 0; i < Index->Count; i++)
+        {
+            Leaf = GetCell(Check, Index->List[i], FIELD_OFFSET(CM_KEY_INDEX, List));
+            if (Leaf == NULL || Leaf->Signature == CM_KEY_INDEX_ROOT)
+            {
+                ReportError(Thread, IndexCell, "bad index leaf 0x%08x", (unsigned)Index->List[i]);
+                continue;
+            }
+            if (MarkCell(Thread, Index->List[i]))
+                CheckLeaf(Thread, KeyCell, Index->List[i], Leaf, &Found, &Previous, Buffers);
+        }
+    }
+    else
+    {
+        CheckLeaf(Thread, KeyCell, IndexCell, Index, &Found, &Previous, Buffers);
+    }
+
+    if (Found != Node->SubKeyCounts[Stable])
+        ReportError(Thread, KeyCell, "%u subkeys in the index, %u in the key node",
+                    Found, Node->SubKeyCounts[Stable]);
+}
+
+static VOID
+CheckKey(PCHECK_THREAD Thread, HCELL_INDEX Cell, PCM_KEY_NODE Node)
+{
+    PHIVE_CHECK Check = Thread->Check;
+    PCM_KEY_SECURITY Security;
+    WCHAR Buffer[MAX_KEY_NAME + 1];
+    UNICODE_STRING Name;
+
+    Thread->Keys++;
+
+    if (GetCellSize(Check, Cell) < FIELD_OFFSET(CM_KEY_NODE, Name))
+    {
+        ReportError(Thread, Cell, "key node is too small");
+        return;
+    }
+
+    if (!GetKeyName(Check, Cell, Node, Buffer, &Name))
+        ReportError(Thread, Cell, "key name of %u bytes is too long", Node->NameLength);
+
+    if (Cell == Check->BaseBlock->RootCell)
+    {
+        if (!(Node->Flags & KEY_HIVE_ENTRY))
+            ReportError(Thread, Cell, "root key is not flagged as hive entry");
+    }
+    else if (GetKeyNode(Check, Node->Parent) == NULL)
+    {
+        ReportError(Thread, Cell, "bad parent 0x%08x", (unsigned)Node->Parent);
+    }
+
+    /* Security cells are shared, their references are counted instead */
+    Security = GetCell(Check, Node->Security, FIELD_OFFSET(CM_KEY_SECURITY, Descriptor));
+    if (Security == NULL || Security->Signature != CM_KEY_SECURITY_SIGNATURE)
+        ReportError(Thread, Cell, "bad security cell 0x%08x", (unsigned)Node->Security);
+    else
+        AtomicIncrement(&Check->SecurityRefs[CellUnit(Node->Security)]);
+
+    if (Node->ClassLength)
+    {
+        if (GetCell(Check, Node->Class, Node->ClassLength) == NULL)
+            ReportError(Thread, Cell, "bad class cell 0x%08x", (unsigned)Node->Class);
+        else
+            MarkCell(Thread, Node->Class);
+    }
+
+    CheckValues(Thread, Cell, Node);
+    CheckSubKeys(Thread, Cell, Node);
+}
+
+/* Checks every key node in the thread's bins, with the cells it owns */
+static VOID
+CheckKeys(PCHECK_THREAD Thread)
+{
+    PHIVE_CHECK Check = Thread->Check;
+    ULONG i, Offset, End, Size;
+    PUSHORT Signature;
+    PHCELL Cell;
+
+    for (i = Thread->FirstBin; i < Thread->LastBin; i++)
+    {
+        Offset = Check->BinOffsets[i];
+        End = Offset + ((PHBIN)(Check->Bins + Offset))->Size;
+
+        for (Offset += sizeof(HBIN); Offset < End; Offset += Size)
+        {
+            Cell = (PHCELL)(Check->Bins + Offset);
+            Size = abs(Cell->Size);
+            if (Size < 2 * sizeof(HCELL) || Size % CELL_UNIT != 0 || Size > End - Offset)
+                break;
+            if (Cell->Size > 0)
+                continue;
+
+            Signature = (PUSHORT)(Cell + 1);
+            if (*Signature == CM_KEY_NODE_SIGNATURE)
+                CheckKey(Thread, Offset, (PCM_KEY_NODE)Signature);
+            else if (*Signature == CM_KEY_SECURITY_SIGNATURE)
+                Thread->SecurityCells++;
+        }
+    }
+}
+
+#ifdef _WIN32
+static unsigned __stdcall CheckThread(void *Parameter)
+#else
+static void *CheckThread(void *Parameter)
+#endif
+{
+    PCHECK_THREAD Thread = (PCHECK_THREAD)Parameter;
+
+    Thread->Routine(Thread);
+    return 0;
+}
+
+/* Runs the routine on every range of bins, on the calling thread if no other can be started */
+static VOID
+RunThreads(PCHECK_THREAD Threads, ULONG Count, PCHECK_ROUTINE Routine)
+{
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Threads[i].Routine = Routine;
+#ifdef _WIN32
+        Threads[i].Handle = _beginthreadex(NULL, 0, CheckThread, &Threads[i], 0, NULL);
+        Threads[i].Started = (Threads[i].Handle != 0);
+#else
+        Threads[i].Started = (pthread_create(&Threads[i].Handle, NULL, CheckThread, &Threads[i]) == 0);
+#endif
+        if (!Threads[i].Started)
+            Routine(&Threads[i]);
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        if (!Threads[i].Started)
+            continue;
+#ifdef _WIN32
+        WaitForSingleObject((void *)Threads[i].Handle, INFINITE);
+        CloseHandle((void *)Threads[i].Handle);
+#else
+        pthread_join(Threads[i].Handle, NULL);
+#endif
+    }
+}
+
+/* Every security cell has to be on the list and be used by as many keys as it says */
+static VOID
+CheckSecurityList(PCHECK_THREAD Thread, ULONG SecurityCells)
+{
+    PHIVE_CHECK Check = Thread->Check;
+    PCM_KEY_NODE Root = GetKeyNode(Check, Check->BaseBlock->RootCell);
+    PCM_KEY_SECURITY Security, Next;
+    HCELL_INDEX Cell, First;
+    ULONG Listed = 0;
+
+    First = Cell = Root->Security;
+    Security = GetCell(Check, Cell, FIELD_OFFSET(CM_KEY_SECURITY, Descriptor));
+    if (Security == NULL || Security->Signature != CM_KEY_SECURITY_SIGNATURE)
+        return;
+
+    do
+    {
+        if (!MarkCell(Thread, Cell))
+            break;
+        Listed++;
+
+        if (FIELD_OFFSET(CM_KEY_SECURITY, Descriptor) + Security->DescriptorLength > GetCellSize(Check, Cell))
+            ReportError(Thread, Cell, "security descriptor does not fit in the cell");
+
+        /*
+         * A count that is too high only keeps the cell alive, mkhive leaves one
+         * for each volatile key. The compacted copy gets the real count.
+         */
+        if ((LONG)Security->ReferenceCount < Check->SecurityRefs[CellUnit(Cell)])
+            ReportError(Thread, Cell, "reference count is %u, but %d keys use the cell",
+                        Security->ReferenceCount, (int)Check->SecurityRefs[CellUnit(Cell)]);
+        else if ((LONG)Security->ReferenceCount > Check->SecurityRefs[CellUnit(Cell)])
+            printf("    Cell 0x%08x: reference count is %u, only %d keys use the cell\n",
+                   (unsigned)Cell, Security->ReferenceCount, (int)Check->SecurityRefs[CellUnit(Cell)]);
+
+        Next = GetCell(Check, Security->Flink, FIELD_OFFSET(CM_KEY_SECURITY, Descriptor));
+        if (Next == NULL || Next->Signature != CM_KEY_SECURITY_SIGNATURE || Next->Blink != Cell)
+        {
+            ReportError(Thread, Cell, "bad security list link 0x%08x", (unsigned)Security->Flink);
+            break;
+        }
+
+        Cell = Security->Flink;
+        Security = Next;
+    }
+    while (Cell != First);
+
+    if (Listed != SecurityCells)
+        ReportError(Thread, First, "%u security cells, %u of them on the list", SecurityCells, Listed);
+}
+
+/* Only called once the indexes passed the checks */
+static ULONG
+CountKeys(PCHECK_THREAD Thread, HCELL_INDEX Cell, ULONG Depth)
+{
+    PCM_KEY_NODE Node = GetKeyNode(Thread->Check, Cell);
+    ULONG Keys = 1, i;
+
+    if (Depth > MAX_KEY_DEPTH)
+    {
+        ReportError(Thread, Cell, "key is nested more than %u levels deep", MAX_KEY_DEPTH);
+        return Keys;
+    }
+
+    for (i = 0; i < Node->SubKeyCounts[Stable]; i++)
+        Keys += CountKeys(Thread, GetSubKeyByNumber(Thread->Check, Node, i), Depth + 1);
+
+    return Keys;
+}
+
+/* Cells that were neither claimed by a key nor listed are only wasted space */
+static ULONG
+CountLeakedCells(PHIVE_CHECK Check, PULONG Bytes)
+{
+    ULONG Leaked = 0, Word, Bits, i;
+
+    *Bytes = 0;
+    for (Word = 0; Word < CellUnit(Check->Length) / 32; Word++)
+    {
+        Bits = Check->CellBits[Word] & ~Check->RefBits[Word];
+        for (i = 0; Bits; i++, Bits >>= 1)
+        {
+            if (Bits & 1)
+            {
+                Leaked++;
+                *Bytes += GetCellSize(Check, (Word * 32 + i) * CELL_UNIT) + sizeof(HCELL);
+            }
+        }
+    }
+
+    return Leaked;
+}
+
+/* Validates the bin headers and lists the bins, so that they can be split among the threads */
+static BOOL
+ListBins(PHIVE_CHECK Check)
+{
+    ULONG Offset;
+    PHBIN Bin;
+
+    Check->BinOffsets = malloc((Check->Length / HBLOCK_SIZE) * sizeof(ULONG));
+    if (Check->BinOffsets == NULL)
+        return FALSE;
+
+    for (Offset = 0; Offset < Check->Length; Offset += Bin->Size)
+    {
+        Bin = (PHBIN)(Check->Bins + Offset);
+        if (Bin->Signature != HV_BIN_SIGNATURE || Bin->FileOffset != Offset ||
+            Bin->Size < HBLOCK_SIZE || Bin->Size % HBLOCK_SIZE != 0 ||
+            Bin->Size > Check->Length - Offset)
+        {
+            printf("    Bad bin at offset 0x%08x\n", (unsigned)Offset);
+            return FALSE;
+        }
+        Check->BinOffsets[Check->BinCount++] = Offset;
+    }
+
+    return TRUE;
+}
+
+/* COMPACTION *****************************************************************/
+
+static HCELL_INDEX
+TranslateCell(PHIVE_COMPACT Compact, HCELL_INDEX Cell)
+{
+    return Compact->Map[CellUnit(Cell)];
+}
+
+static BOOL
+PlaceCell(PHIVE_COMPACT Compact, HCELL_INDEX Cell, ULONG Size, COMPACT_KIND Kind)
+{
+    HCELL_INDEX NewCell;
+
+    NewCell = HvAllocateCell(&Compact->CmHive.Hive, Size, Stable, HCELL_NIL);
+    if (NewCell == HCELL_NIL)
+        return FALSE;
+
+    Compact->Map[CellUnit(Cell)] = NewCell;
+    Compact->Cells[Compact->Count].Cell = Cell;
+    Compact->Cells[Compact->Count].Size = Size;
+    Compact->Cells[Compact->Count].Kind = Kind;
+    Compact->Count++;
+    return TRUE;
+}
+
+static BOOL
+PlaceValues(PHIVE_COMPACT Compact, PCM_KEY_NODE Node)
+{
+    PHIVE_CHECK Check = Compact->Check;
+    PCM_KEY_VALUE Value;
+    PCM_BIG_DATA BigData;
+    PHCELL_INDEX List, Segments;
+    ULONG Length, i, j;
+
+    if (Node->ValueList.Count == 0)
+        return TRUE;
+
+    List = GetCell(Check, Node->ValueList.List, 0);
+    if (!PlaceCell(Compact, Node->ValueList.List, Node->ValueList.Count * sizeof(HCELL_INDEX), CompactList))
+        return FALSE;
+
+    /* Each value is followed by its data */
+    for (i = 0; i < Node->ValueList.Count; i++)
+    {
+        Value = GetCell(Check, List[i], 0);
+        if (!PlaceCell(Compact, List[i], FIELD_OFFSET(CM_KEY_VALUE, Name) + Value->NameLength, CompactValue))
+            return FALSE;
+
+        if (CmpIsKeyValueSmall(&Length, Value->DataLength) || Length == 0)
+            continue;
+
+        if (Check->BaseBlock->Minor >= HSYS_WHISTLER_BETA1 && Length > CM_KEY_VALUE_BIG)
+        {
+            BigData = GetCell(Check, Value->Data, 0);
+            Segments = GetCell(Check, BigData->List, 0);
+            if (!PlaceCell(Compact, Value->Data, sizeof(CM_BIG_DATA), CompactBigData) ||
+                !PlaceCell(Compact, BigData->List, BigData->Count * sizeof(HCELL_INDEX), CompactList))
+            {
+                return FALSE;
+            }
+
+            for (j = 0; j < BigData->Count; j++, Length -= CM_KEY_VALUE_BIG)
+            {
+                if (!PlaceCell(Compact, Segments[j], min(Length, CM_KEY_VALUE_BIG), CompactRaw))
+                    return FALSE;
+            }
+        }
+        else if (!PlaceCell(Compact, Value->Data, Length, CompactRaw))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * The key node is already placed. Its class, values and index follow it,
+ * then the nodes of all its subkeys, so that a lookup in the key stays
+ * within a few blocks. The subkeys are laid out the same way afterwards.
+ */
+static BOOL
+PlaceKey(PHIVE_COMPACT Compact, HCELL_INDEX Cell)
+{
+    PHIVE_CHECK Check = Compact->Check;
+    PCM_KEY_NODE Node = GetKeyNode(Check, Cell), Child;
+    PCM_KEY_INDEX Index;
+    HCELL_INDEX ChildCell;
+    ULONG Count = Node->SubKeyCounts[Stable], i;
+
+    if (Node->ClassLength && !PlaceCell(Compact, Node->Class, Node->ClassLength, CompactRaw))
+        return FALSE;
+
+    if (!PlaceValues(Compact, Node))
+        return FALSE;
+
+    if (Count == 0)
+        return TRUE;
+
+    Index = GetCell(Check, Node->SubKeyLists[Stable], 0);
+    if (!PlaceCell(Compact, Node->SubKeyLists[Stable],
+                   FIELD_OFFSET(CM_KEY_INDEX, List) +
+                   Index->Count * (Index->Signature == CM_KEY_FAST_LEAF ||
+                                   Index->Signature == CM_KEY_HASH_LEAF ? sizeof(CM_INDEX) : sizeof(HCELL_INDEX)),
+                   CompactIndex))
+    {
+        return FALSE;
+    }
+
+    if (Index->Signature == CM_KEY_INDEX_ROOT)
+    {
+        for (i = 0; i < Index->Count; i++)
+        {
+            PCM_KEY_INDEX Leaf = GetCell(Check, Index->List[i], 0);
+
+            if (!PlaceCell(Compact, Index->List[i],
+                           FIELD_OFFSET(CM_KEY_INDEX, List) +
+                           Leaf->Count * (Leaf->Signature == CM_KEY_INDEX_LEAF ? sizeof(HCELL_INDEX) : sizeof(CM_INDEX)),
+                           CompactIndex))
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        ChildCell = GetSubKeyByNumber(Check, Node, i);
+        Child = GetKeyNode(Check, ChildCell);
+        if (!PlaceCell(Compact, ChildCell, FIELD_OFFSET(CM_KEY_NODE, Name) + Child->NameLength, CompactKey))
+            return FALSE;
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        if (!PlaceKey(Compact, GetSubKeyByNumber(Check, Node, i)))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Copies an old cell into its new one and translates the cells it refers to */
+static VOID
+CopyCell(PHIVE_COMPACT Compact, PCOMPACT_CELL Entry)
+{
+    PHIVE_CHECK Check = Compact->Check;
+    PCELL_DATA Data;
+    PCM_KEY_FAST_INDEX FastIndex;
+    ULONG Length, i;
+
+    Data = HvGetCell(&Compact->CmHive.Hive, TranslateCell(Compact, Entry->Cell));
+    memcpy(Data, GetCell(Check, Entry->Cell, 0), Entry->Size);
+
+    switch (Entry->Kind)
+    {
+        case CompactKey:
+            /* The parent of the root node does not belong to this hive */
+            if (Entry->Cell != Check->BaseBlock->RootCell)
+                Data->u.KeyNode.Parent = TranslateCell(Compact, Data->u.KeyNode.Parent);
+            if (Data->u.KeyNode.SubKeyCounts[Stable])
+                Data->u.KeyNode.SubKeyLists[Stable] = TranslateCell(Compact, Data->u.KeyNode.SubKeyLists[Stable]);
+            else
+                Data->u.KeyNode.SubKeyLists[Stable] = HCELL_NIL;
+            Data->u.KeyNode.SubKeyCounts[Volatile] = 0;
+            Data->u.KeyNode.SubKeyLists[Volatile] = HCELL_NIL;
+            if (Data->u.KeyNode.ValueList.Count)
+                Data->u.KeyNode.ValueList.List = TranslateCell(Compact, Data->u.KeyNode.ValueList.List);
+            else
+                Data->u.KeyNode.ValueList.List = HCELL_NIL;
+            Data->u.KeyNode.Security = TranslateCell(Compact, Data->u.KeyNode.Security);
+            if (Data->u.KeyNode.ClassLength)
+                Data->u.KeyNode.Class = TranslateCell(Compact, Data->u.KeyNode.Class);
+            else
+                Data->u.KeyNode.Class = HCELL_NIL;
+            break;
+
+        case CompactIndex:
+            if (Data->u.KeyIndex.Signature == CM_KEY_INDEX_ROOT ||
+                Data->u.KeyIndex.Signature == CM_KEY_INDEX_LEAF)
+            {
+                for (i = 0; i < Data->u.KeyIndex.Count; i++)
+                    Data->u.KeyIndex.List[i] = TranslateCell(Compact, Data->u.KeyIndex.List[i]);
+            }
+            else
+            {
+                FastIndex = (PCM_KEY_FAST_INDEX)Data;
+                for (i = 0; i < FastIndex->Count; i++)
+                    FastIndex->List[i].Cell = TranslateCell(Compact, FastIndex->List[i].Cell);
+            }
+            break;
+
+        case CompactList:
+            for (i = 0; i < Entry->Size / sizeof(HCELL_INDEX); i++)
+                Data->u.KeyList[i] = TranslateCell(Compact, Data->u.KeyList[i]);
+            break;
+
+        case CompactValue:
+            if (!CmpIsKeyValueSmall(&Length, Data->u.KeyValue.DataLength))
+            {
+                if (Length)
+                    Data->u.KeyValue.Data = TranslateCell(Compact, Data->u.KeyValue.Data);
+                else
+                    Data->u.KeyValue.Data = HCELL_NIL;
+            }
+            break;
+
+        case CompactBigData:
+            Data->u.ValueData.List = TranslateCell(Compact, Data->u.ValueData.List);
+            break;
+
+        case CompactSecurity:
+            Data->u.KeySecurity.Flink = TranslateCell(Compact, Data->u.KeySecurity.Flink);
+            Data->u.KeySecurity.Blink = TranslateCell(Compact, Data->u.KeySecurity.Blink);
+            Data->u.KeySecurity.ReferenceCount = Check->SecurityRefs[CellUnit(Entry->Cell)];
+            break;
+
+        case CompactRaw:
+            break;
+    }
+}
+
+/*
+ * Rebuilds a checked hive in a new one, leaving out the leaked cells
+ * and the slack of the lists and names.
+ */
+static BOOL
+CompactHive(PHIVE_CHECK Check, ULONG UsedCells, PCSTR OutputName)
+{
+    HIVE_COMPACT Compact;
+    PCM_KEY_NODE Root;
+    PCM_KEY_SECURITY Security;
+    HCELL_INDEX Cell;
+    NTSTATUS Status;
+    BOOL Result = FALSE;
+    ULONG i;
+
+    memset(&Compact, 0, sizeof(Compact));
+    Compact.Check = Check;
+    Compact.Map = malloc(CellUnit(Check->Length) * sizeof(HCELL_INDEX));
+    Compact.Cells = malloc(UsedCells * sizeof(COMPACT_CELL));
+    if (Compact.Map == NULL || Compact.Cells == NULL)
+    {
+        printf("    Out of memory\n");
+        goto Quit;
+    }
+    memset(Compact.Map, 0xFF, CellUnit(Check->Length) * sizeof(HCELL_INDEX));
+
+    Status = HvInitialize(&Compact.CmHive.Hive,
+                          HINIT_CREATE,
+                          HIVE_NOLAZYFLUSH,
+                          HFILE_TYPE_PRIMARY,
+                          NULL,
+                          CmpAllocate,
+                          CmpFree,
+                          CmpFileSetSize,
+                          CmpFileWrite,
+                          CmpFileRead,
+                          CmpFileFlush,
+                          1,
+                          NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("    Error creating the compacted hive (Status 0x%08x)\n", (unsigned)Status);
+        goto Quit;
+    }
+
+    /* The root node comes first, then all the security cells */
+    Cell = Check->BaseBlock->RootCell;
+    Root = GetKeyNode(Check, Cell);
+    if (!PlaceCell(&Compact, Cell, FIELD_OFFSET(CM_KEY_NODE, Name) + Root->NameLength, CompactKey))
+        goto Error;
+
+    Cell = Root->Security;
+    do
+    {
+        Security = GetCell(Check, Cell, 0);
+        if (!PlaceCell(&Compact, Cell,
+                       FIELD_OFFSET(CM_KEY_SECURITY, Descriptor) + Security->DescriptorLength,
+                       CompactSecurity))
+        {
+            goto Error;
+        }
+        Cell = Security->Flink;
+    }
+    while (Cell != Root->Security);
+
+    if (!PlaceKey(&Compact, Check->BaseBlock->RootCell))
+        goto Error;
+
+    for (i = 0; i < Compact.Count; i++)
+        CopyCell(&Compact, &Compact.Cells[i]);
+
+    Compact.CmHive.Hive.BaseBlock->RootCell = TranslateCell(&Compact, Check->BaseBlock->RootCell);
+    Compact.CmHive.Hive.BaseBlock->Minor = Check->BaseBlock->Minor;
+    Compact.CmHive.Hive.Version = Check->BaseBlock->Minor;
+    memcpy(Compact.CmHive.Hive.BaseBlock->FileName, Check->BaseBlock->FileName,
+           sizeof(Check->BaseBlock->FileName));
+
+    Result = ExportBinaryHive(OutputName, &Compact.CmHive);
+    if (Result)
+    {
+        printf("    %u KB compacted into %u KB\n",
+               (unsigned)(Check->Length / 1024),
+               (unsigned)(Compact.CmHive.Hive.Storage[Stable].Length * HBLOCK_SIZE / 1024));
+    }
+    goto Free;
+
+Error:
+    printf("    Error allocating the compacted cells\n");
+Free:
+    HvFree(&Compact.CmHive.Hive);
+Quit:
+    free(Compact.Cells);
+    free(Compact.Map);
+    return Result;
+}
+
+/* MAIN ***********************************************************************/
+
+static BOOL
+CheckHive(PCSTR FileName, ULONG ThreadCount, PCSTR OutputName)
+{
+    HIVE_CHECK Check;
+    CHECK_THREAD Threads[MAX_THREADS], Main;
+    ULONG Words, Share, Bytes, Keys, Leaked, LeakedBytes, i, j;
+    ULONG UsedCells = 0, UsedBytes = 0, FreeBytes = 0, Values = 0, SecurityCells = 0;
+    double Start;
+    BOOL Result = FALSE;
+
+    printf("Checking %s\n", FileName);
+    Start = Now();
+
+    memset(&Check, 0, sizeof(Check));
+    memset(&Main, 0, sizeof(Main));
+    memset(Threads, 0, sizeof(Threads));
+    Main.Check = &Check;
+
+    Check.BaseBlock = MapBinaryHive(FileName);
+    if (Check.BaseBlock == NULL)
+        return FALSE;
+    Check.Bins = (PUCHAR)Check.BaseBlock + HBLOCK_SIZE;
+    Check.Length = Check.BaseBlock->Length;
+
+    Words = CellUnit(Check.Length) / 32;
+    Check.CellBits = calloc(Words, sizeof(ULONG));
+    Check.RefBits = calloc(Words, sizeof(ULONG));
+    Check.SecurityRefs = calloc(CellUnit(Check.Length), sizeof(LONG));
+    if (Check.CellBits == NULL || Check.RefBits == NULL || Check.SecurityRefs == NULL)
+    {
+        printf("    Out of memory\n");
+        goto Quit;
+    }
+
+    if (!ListBins(&Check))
+        goto Quit;
+
+    /* Give each thread about the same number of bytes */
+    ThreadCount = min(ThreadCount, Check.BinCount);
+    Share = Check.Length / ThreadCount;
+    for (i = 0, j = 0; i < ThreadCount; i++)
+    {
+        Threads[i].Check = &Check;
+        Threads[i].FirstBin = j;
+        for (Bytes = 0; j < Check.BinCount && (Bytes < Share || i == ThreadCount - 1); j++)
+            Bytes += ((PHBIN)(Check.Bins + Check.BinOffsets[j]))->Size;
+        Threads[i].LastBin = j;
+    }
+
+    RunThreads(Threads, ThreadCount, ScanBins);
+
+    for (i = 0; i < ThreadCount; i++)
+        Main.Errors += Threads[i].Errors;
+    if (Main.Errors == 0 && GetKeyNode(&Check, Check.BaseBlock->RootCell) == NULL)
+        ReportError(&Main, Check.BaseBlock->RootCell, "bad root key");
+
+    /* The cells are only followed once all of them are known to be sound */
+    if (Main.Errors == 0)
+    {
+        MarkCell(&Main, Check.BaseBlock->RootCell);
+        RunThreads(Threads, ThreadCount, CheckKeys);
+    }
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        Main.Errors += Threads[i].Errors;
+        Main.Keys += Threads[i].Keys;
+        UsedCells += Threads[i].UsedCells;
+        UsedBytes += Threads[i].UsedBytes;
+        FreeBytes += Threads[i].FreeBytes;
+        Values += Threads[i].Values;
+        SecurityCells += Threads[i].SecurityCells;
+    }
+
+    if (Main.Errors == 0)
+        CheckSecurityList(&Main, SecurityCells);
+
+    if (Main.Errors == 0)
+    {
+        Keys = CountKeys(&Main, Check.BaseBlock->RootCell, 0);
+        if (Keys != Main.Keys)
+            ReportError(&Main, Check.BaseBlock->RootCell, "%u of %u keys can be reached from the root",
+                        Keys, Main.Keys);
+    }
+
+    if (Main.Errors)
+    {
+        printf("    %u errors found\n", Main.Errors);
+        goto Quit;
+    }
+
+    Leaked = CountLeakedCells(&Check, &LeakedBytes);
+    printf("    %u keys, %u values, %u security cells, %u KB used, %u KB free\n",
+           Main.Keys, Values, SecurityCells, UsedBytes / 1024, FreeBytes / 1024);
+    if (Leaked)
+        printf("    %u cells (%u KB) are not used by any key\n", Leaked, LeakedBytes / 1024);
+    printf("    Checked in %.3f s on %u threads\n", Now() - Start, ThreadCount);
+
+    Result = TRUE;
+    if (OutputName)
+        Result = CompactHive(&Check, UsedCells, OutputName);
+
+Quit:
+    free(Check.BinOffsets);
+    free(Check.SecurityRefs);
+    free(Check.RefBits);
+    free(Check.CellBits);
+    UnmapBinaryHive(Check.BaseBlock);
+    return Result;
+}
+
+/* Compacts into a temporary file first, the hive is still mapped at this point */
+static BOOL
+CompactInPlace(PCSTR FileName, ULONG ThreadCount)
+{
+    char *TempName;
+    BOOL Result;
+
+    TempName = malloc(strlen(FileName) + sizeof(".tmp"));
+    if (TempName == NULL)
+        return FALSE;
+    strcpy(TempName, FileName);
+    strcat(TempName, ".tmp");
+
+    Result = CheckHive(FileName, ThreadCount, TempName);
+    if (Result)
+    {
+        remove(FileName);
+        if (rename(TempName, FileName) != 0)
+        {
+            printf("    Error renaming %s\n", TempName);
+            Result = FALSE;
+        }
+    }
+    else
+    {
+        remove(TempName);
+    }
+
+    /* Make sure that what was written is a sound hive */
+    if (Result)
+        Result = CheckHive(FileName, ThreadCount, NULL);
+
+    free(TempName);
+    return Result;
+}
+
+static void
+usage(void)
+{
+    printf("Usage: hivecheck [-j threads] [-c | -o output] hive...\n\n");
+    printf("  -j threads - number of threads checking the bins, defaults to one per processor\n");
+    printf("  -c         - compact each hive in place once it is checked\n");
+    printf("  -o output  - write a compacted copy of the hive to output\n");
+}
+
+int main(int argc, char *argv[])
+{
+    ULONG ThreadCount = GetProcessorCount();
+    PCSTR OutputName = NULL;
+    BOOL InPlace = FALSE, Result = TRUE;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            ThreadCount = strtoul(argv[++i], NULL, 0);
+            if (ThreadCount < 1)
+                ThreadCount = 1;
+            if (ThreadCount > MAX_THREADS)
+                ThreadCount = MAX_THREADS;
+        }
+        else if (!strcmp(argv[i], "-c"))
+        {
+            InPlace = TRUE;
+        }
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            OutputName = argv[++i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (i == argc || (OutputName && (InPlace || i + 1 != argc)))
+    {
+        usage();
+        return 1;
+    }
+
+    for (; i < argc; i++)
+    {
+        if (InPlace)
+            Result &= CompactInPlace(argv[i], ThreadCount);
+        else
+            Result &= CheckHive(argv[i], ThreadCount, OutputName);
+    }
+
+    return Result ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+/*
+ * PROJECT:     ReactOS memory routine benchmark
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Times the CRT memcpy, memmove and memset over a range of sizes
+ *              and alignments next to the host C library, and checks their
+ *              results against it, overlapping buffers included.
+ */
+
+#include <typedefs.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_SECONDS     0.05
+#define BUFFER_SIZE     (8 << 20)
+
+/* The amd64 routines use the Windows calling convention */
+#ifdef MEMBENCH_ASM
+#define MSABI __attribute__((ms_abi))
+#else
+#define MSABI
+#endif
+
+typedef void *(*PCOPY_ROUTINE)(void *Dest, const void *Src, size_t Count);
+typedef void *(*PSET_ROUTINE)(void *Dest, int Value, size_t Count);
+typedef void *(MSABI *PCOPY_ROUTINE_MS)(void *Dest, const void *Src, size_t Count);
+typedef void *(MSABI *PSET_ROUTINE_MS)(void *Dest, int Value, size_t Count);
+
+void *GenericMemcpy(void *Dest, const void *Src, size_t Count);
+void *GenericMemmove(void *Dest, const void *Src, size_t Count);
+void *GenericMemset(void *Dest, int Value, size_t Count);
+
+#ifdef MEMBENCH_ASM
+void *MSABI Amd64Memcpy(void *Dest, const void *Src, size_t Count);
+void *MSABI Amd64Memmove(void *Dest, const void *Src, size_t Count);
+void *MSABI Amd64Memset(void *Dest, int Value, size_t Count);
+#endif
+
+typedef struct _IMPL_INFO
+{
+    const char *Name;
+    BOOL MsAbi;
+    PCOPY_ROUTINE Copy;
+    PCOPY_ROUTINE Move;
+    PSET_ROUTINE Set;
+    PCOPY_ROUTINE_MS CopyMs;
+    PCOPY_ROUTINE_MS MoveMs;
+    PSET_ROUTINE_MS SetMs;
+} IMPL_INFO, *PIMPL_INFO;
+
+typedef enum _BENCH_OP
+{
+    OpCopy,
+    OpMove,
+    OpSet
+} BENCH_OP;
+
+static const IMPL_INFO Impls[] =
+{
+    { "libc", FALSE, memcpy, memmove, memset },
+    { "generic", FALSE, GenericMemcpy, GenericMemmove, GenericMemset },
+#ifdef MEMBENCH_ASM
+    { "amd64", TRUE, NULL, NULL, NULL, Amd64Memcpy, Amd64Memmove, Amd64Memset },
+#endif
+};
+
+#define IMPL_COUNT (sizeof(Impls) / sizeof(Impls[0]))
+
+static const char *OpNames[] = { "memcpy", "memmove", "memset" };
+
+static ULONG Seed = 0x12345678;
+static unsigned char *Buffer, *Pristine, *Expected;
+
+/* HELPERS ********************************************************************/
+
+static double
+Now(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec + Time.tv_nsec / 1e9;
+}
+
+static ULONG
+Random(void)
+{
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    return Seed;
+}
+
+static void *
+CallCopy(const IMPL_INFO *Impl, BENCH_OP Op, void *Dest, const void *Src, size_t Count)
+{
+    if (Impl->MsAbi)
+        return (Op == OpCopy) ? Impl->CopyMs(Dest, Src, Count) : Impl->MoveMs(Dest, Src, Count);
+    return (Op == OpCopy) ? Impl->Copy(Dest, Src, Count) : Impl->Move(Dest, Src, Count);
+}
+
+static void *
+CallSet(const IMPL_INFO *Impl, void *Dest, int Value, size_t Count)
+{
+    if (Impl->MsAbi)
+        return Impl->SetMs(Dest, Value, Count);
+    return Impl->Set(Dest, Value, Count);
+}
+
+/* CHECKS *********************************************************************/
+
+/*
+ * Copies Size bytes between two places in a window of random data, and
+ * compares the whole window with what the host memmove makes of it. Both
+ * CRT routines handle overlapping buffers, memcpy included.
+ */
+static BOOL
+CheckCopy(const IMPL_INFO *Impl, BENCH_OP Op, size_t Size, size_t SrcOffset, ptrdiff_t Distance, size_t Window)
+{
+    size_t DestOffset = SrcOffset + Distance;
+    void *Result;
+
+    memcpy(Expected, Pristine, Window);
+    memmove(Expected + DestOffset, Expected + SrcOffset, Size);
+
+    memcpy(Buffer, Pristine, Window);
+    Result = CallCopy(Impl, Op, Buffer + DestOffset, Buffer + SrcOffset, Size);
+
+    if (Result != Buffer + DestOffset || memcmp(Buffer, Expected, Window))
+    {
+        printf("%s %s: size %lu, source offset %lu, distance %ld failed\n",
+               Impl->Name, OpNames[Op], (unsigned long)Size,
+               (unsigned long)SrcOffset, (long)Distance);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BOOL
+CheckSet(const IMPL_INFO *Impl, size_t Size, size_t Offset, int Value, size_t Window)
+{
+    void *Result;
+
+    memcpy(Expected, Pristine, Window);
+    memset(Expected + Offset, Value, Size);
+
+    memcpy(Buffer, Pristine, Window);
+    Result = CallSet(Impl, Buffer + Offset, Value, Size);
+
+    if (Result != Buffer + Offset || memcmp(Buffer, Expected, Window))
+    {
+        printf("%s memset: size %lu, offset %lu, value %#x failed\n",
+               Impl->Name, (unsigned long)Size, (unsigned long)Offset, Value);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BOOL
+CheckSize(const IMPL_INFO *Impl, size_t Size, size_t MaxAlign)
+{
+    static const int Values[] = { 0, 0xA5, 0x17F };
+    ptrdiff_t Distances[64];
+    size_t Base, Window, Align, Count = 0, i;
+    BENCH_OP Op;
+
+    /* Apart, at every relative alignment */
+    for (i = 0; i < 16; i++)
+    {
+        Distances[Count++] = -(ptrdiff_t)(Size + 16 + i);
+        Distances[Count++] = Size + i;
+    }
+
+    /* And overlapping by a little or a lot, either way */
+    for (i = 1; i <= 16; i++)
+    {
+        Distances[Count++] = -(ptrdiff_t)i;
+        Distances[Count++] = i;
+    }
+
+    /* The source sits in the middle with room on both sides */
+    Base = (Size + 64 + 15) & ~(size_t)15;
+    Window = 2 * Base + Size + 64;
+    for (i = 0; i < Window; i++)
+        Pristine[i] = (unsigned char)Random();
+
+    for (Align = 0; Align < MaxAlign; Align++)
+    {
+        for (Op = OpCopy; Op <= OpMove; Op++)
+        {
+            for (i = 0; i < Count; i++)
+            {
+                if (!CheckCopy(Impl, Op, Size, Base + Align, Distances[i], Window))
+                    return FALSE;
+            }
+        }
+
+        for (i = 0; i < sizeof(Values) / sizeof(Values[0]); i++)
+        {
+            if (!CheckSet(Impl, Size, Base + Align, Values[i], Window))
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL
+CheckImpl(const IMPL_INFO *Impl)
+{
+    static const size_t LargeSizes[] =
+    {
+        511, 512, 513, 1023, 1024, 2047, 2048, 2049, 4095, 4097, 65536 + 13
+    };
+    size_t Size, i;
+
+    for (Size = 0; Size <= 300; Size++)
+    {
+        if (!CheckSize(Impl, Size, 16))
+            return FALSE;
+    }
+
+    for (i = 0; i < sizeof(LargeSizes) / sizeof(LargeSizes[0]); i++)
+    {
+        if (!CheckSize(Impl, LargeSizes[i], 4))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* TIMING *********************************************************************/
+
+/*
+ * Returns the nanoseconds per call. memmove copies to 64 bytes above the
+ * source, so that anything longer overlaps and is copied backward.
+ */
+static double
+TimeOp(const IMPL_INFO *Impl, BENCH_OP Op, size_t Size, size_t DestAlign, size_t SrcAlign)
+{
+    unsigned char *Src = Buffer + SrcAlign;
+    unsigned char *Dest = Buffer + (BUFFER_SIZE / 2) + DestAlign;
+    ULONG Calls = 0, i;
+    double Start, Elapsed;
+
+    if (Op == OpMove)
+        Dest = Buffer + 64 + DestAlign;
+
+    Start = Now();
+    do
+    {
+        for (i = 0; i < 8; i++, Calls++)
+        {
+            if (Op == OpSet)
+                CallSet(Impl, Dest, (int)Calls, Size);
+            else
+                CallCopy(Impl, Op, Dest, Src, Size);
+        }
+        Elapsed = Now() - Start;
+    }
+    while (Elapsed < MIN_SECONDS);
+
+    return Elapsed * 1e9 / Calls;
+}
+
+static VOID
+Usage(void)
+{
+    printf("Usage: membench [-c]\n"
+           "\n"
+           "Prints the nanoseconds per call for each routine, size and alignment\n"
+           "of the destination and source. -c only checks the results.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t Sizes[] =
+    {
+        8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 16384, 65536, 262144, 1048576
+    };
+    static const size_t Aligns[][2] = { { 0, 0 }, { 7, 7 }, { 0, 5 } };
+    BOOL Success = TRUE, CheckOnly = FALSE;
+    size_t SizeIndex, AlignIndex, k;
+    BENCH_OP Op;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "-c"))
+        {
+            CheckOnly = TRUE;
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (i < argc)
+    {
+        Usage();
+        return 1;
+    }
+
+    Buffer = aligned_alloc(4096, BUFFER_SIZE);
+    Pristine = aligned_alloc(4096, BUFFER_SIZE);
+    Expected = aligned_alloc(4096, BUFFER_SIZE);
+    if (!Buffer || !Pristine || !Expected)
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    /* The host library is the reference */
+    for (k = 1; k < IMPL_COUNT; k++)
+        Success &= CheckImpl(&Impls[k]);
+
+    if (CheckOnly)
+        return Success ? 0 : 1;
+
+    memset(Buffer, 0x5A, BUFFER_SIZE);
+
+    printf("%-8s %8s %-9s", "Function", "Size", "Dest/Src");
+    for (k = 0; k < IMPL_COUNT; k++)
+        printf(" %10s", Impls[k].Name);
+    printf("\n");
+
+    for (Op = OpCopy; Op <= OpSet; Op++)
+    {
+        for (SizeIndex = 0; SizeIndex < sizeof(Sizes) / sizeof(Sizes[0]); SizeIndex++)
+        {
+            for (AlignIndex = 0; AlignIndex < sizeof(Aligns) / sizeof(Aligns[0]); AlignIndex++)
+            {
+                /* memset has no source */
+                if (Op == OpSet && Aligns[AlignIndex][0] != Aligns[AlignIndex][1])
+                    continue;
+
+                printf("%-8s %8lu %4lu/%-4lu", OpNames[Op], (unsigned long)Sizes[SizeIndex],
+                       (unsigned long)Aligns[AlignIndex][0], (unsigned long)Aligns[AlignIndex][1]);
+
+                for (k = 0; k < IMPL_COUNT; k++)
+                {
+                    printf(" %10.1f", TimeOp(&Impls[k], Op, Sizes[SizeIndex],
+                                             Aligns[AlignIndex][0], Aligns[AlignIndex][1]));
+                    fflush(stdout);
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    return Success ? 0 : 1;
+}
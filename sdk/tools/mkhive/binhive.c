@@ -20,7 +20,7 @@
  * COPYRIGHT:       See COPYING in the top level directory
  * PROJECT:         ReactOS hive maker
  * FILE:            tools/mkhive/binhive.c
- * PURPOSE:         Binary hive export code
+ * PURPOSE:         Binary hive import and export code
  * PROGRAMMER:      Herv Poussineau
  */
 
@@ -28,6 +28,10 @@
 
 #include <stdio.h>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
 #include "mkhive.h"
 
 BOOL
@@ -56,4 +60,125 @@ ExportBinaryHive(
     return ret;
 }
 
+/*
+ * Maps a hive file copy-on-write, after checking that it holds all the bins
+ * its base block claims. Flat hives are read-only; the few fields cmlib
+ * touches while preparing the hive only change the private copy of their
+ * pages. The cells themselves are not verified.
+ */
+PHBASE_BLOCK
+MapBinaryHive(
+    IN PCSTR FileName)
+{
+    HBASE_BLOCK BaseBlock;
+    FILE *File;
+    LONGLONG FileSize;
+    SIZE_T Size;
+    PVOID Data;
+
+    File = fopen(FileName, "rb");
+    if (File == NULL)
+    {
+        printf("    Error opening file %s\n", FileName);
+        return NULL;
+    }
+
+    if (fread(&BaseBlock, sizeof(BaseBlock), 1, File) != 1 ||
+        fseek(File, 0, SEEK_END) != 0 ||
+        (FileSize = ftell(File)) < 0 ||
+        !HvpVerifyHiveHeader(&BaseBlock) ||
+        BaseBlock.Length == 0 ||
+        BaseBlock.Length % HBLOCK_SIZE != 0 ||
+        (ULONGLONG)FileSize < (ULONGLONG)BaseBlock.Length + HBLOCK_SIZE)
+    {
+        printf("    %s is not a valid hive\n", FileName);
+        fclose(File);
+        return NULL;
+    }
+    Size = (SIZE_T)BaseBlock.Length + HBLOCK_SIZE;
+
+#ifdef _WIN32
+    /* No mapping here, a single read still gives a contiguous flat hive */
+    Data = malloc(Size);
+    if (Data != NULL &&
+        (fseek(File, 0, SEEK_SET) != 0 || fread(Data, 1, Size, File) != Size))
+    {
+        free(Data);
+        Data = NULL;
+    }
+#else
+    Data = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(File), 0);
+    if (Data == MAP_FAILED)
+        Data = NULL;
+#endif
+    fclose(File);
+
+    if (Data == NULL)
+        printf("    Error mapping file %s\n", FileName);
+
+    return Data;
+}
+
+VOID
+UnmapBinaryHive(
+    IN PHBASE_BLOCK BaseBlock)
+{
+#ifdef _WIN32
+    free(BaseBlock);
+#else
+    munmap(BaseBlock, (SIZE_T)BaseBlock->Length + HBLOCK_SIZE);
+#endif
+}
+
+/*
+ * Opens a mapped hive file as a flat hive, so the cells are accessed
+ * in place instead of being read into freshly allocated bins.
+ */
+BOOL
+ImportBinaryHive(
+    IN PCSTR FileName,
+    OUT PCMHIVE CmHive)
+{
+    PHBASE_BLOCK BaseBlock;
+    NTSTATUS Status;
+
+    BaseBlock = MapBinaryHive(FileName);
+    if (BaseBlock == NULL)
+        return FALSE;
+
+    RtlZeroMemory(CmHive, sizeof(*CmHive));
+    Status = HvInitialize(&CmHive->Hive,
+                          HINIT_FLAT,
+                          HIVE_SUBKEY_INDEX,
+                          HFILE_TYPE_PRIMARY,
+                          BaseBlock,
+                          CmpAllocate,
+                          CmpFree,
+                          NULL,
+                          NULL,
+                          NULL,
+                          NULL,
+                          1,
+                          NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("    Error loading hive %s (Status 0x%08x)\n", FileName, (unsigned)Status);
+        UnmapBinaryHive(BaseBlock);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID
+UnloadBinaryHive(
+    IN PCMHIVE CmHive)
+{
+    PHBASE_BLOCK BaseBlock = CmHive->Hive.BaseBlock;
+
+    /* Releases the subkey indexes, the flat hive data are not freed */
+    HvFree(&CmHive->Hive);
+    UnmapBinaryHive(BaseBlock);
+}
+
 /* EOF */
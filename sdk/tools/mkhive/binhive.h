@@ -20,7 +20,7 @@
  * COPYRIGHT:       See COPYING in the top level directory
  * PROJECT:         ReactOS hive maker
  * FILE:            tools/mkhive/binhive.h
- * PURPOSE:         Binary hive export code
+ * PURPOSE:         Binary hive import and export code
  * PROGRAMMER:      Herv Poussineau
  */
 
@@ -31,4 +31,21 @@ ExportBinaryHive(
     IN PCSTR FileName,
     IN PCMHIVE Hive);
 
+PHBASE_BLOCK
+MapBinaryHive(
+    IN PCSTR FileName);
+
+VOID
+UnmapBinaryHive(
+    IN PHBASE_BLOCK BaseBlock);
+
+BOOL
+ImportBinaryHive(
+    IN PCSTR FileName,
+    OUT PCMHIVE CmHive);
+
+VOID
+UnloadBinaryHive(
+    IN PCMHIVE CmHive);
+
 /* EOF */
@@ -118,7 +118,7 @@ CmiInitializeHive(
 
     Status = HvInitialize(&Hive->Hive,
                           HINIT_CREATE,
-                          HIVE_NOLAZYFLUSH,
+                          HIVE_NOLAZYFLUSH | HIVE_SUBKEY_INDEX,
                           HFILE_TYPE_PRIMARY,
                           0,
                           CmpAllocate,
@@ -31,6 +31,16 @@
 
 #include "mkhive.h"
 
+#ifdef _WIN32
+#include <process.h>
+/* We only want to include host headers, so we declare them manually */
+__declspec(dllimport) unsigned long __stdcall WaitForSingleObject(void *hHandle, unsigned long dwMilliseconds);
+__declspec(dllimport) int __stdcall CloseHandle(void *hObject);
+#define INFINITE 0xFFFFFFFF
+#else
+#include <pthread.h>
+#endif
+
 #ifdef _MSC_VER
 #include <stdlib.h>
 #define PATH_MAX _MAX_PATH
@@ -48,6 +58,30 @@
 #endif
 
 
+typedef struct _HIVE_FILE
+{
+    PCSTR Name;
+    PCMHIVE Hive;
+    char FileName[PATH_MAX];
+    BOOL Result;
+#ifdef _WIN32
+    uintptr_t Thread;
+#else
+    pthread_t Thread;
+#endif
+    BOOL ThreadStarted;
+} HIVE_FILE, *PHIVE_FILE;
+
+static HIVE_FILE HiveFiles[] =
+{
+    { "default", &DefaultHive },
+    { "sam", &SamHive },
+    { "security", &SecurityHive },
+    { "software", &SoftwareHive },
+    { "system", &SystemHive },
+    { "BCD", &BcdHive },
+};
+
 void usage (void)
 {
     printf ("Usage: mkhive <dstdir> <inffiles>\n\n");
@@ -83,6 +117,65 @@ void convert_path(char *dst, char *src)
     dst[i] = 0;
 }
 
+#ifdef _WIN32
+static unsigned __stdcall ExportHiveThread(void *Parameter)
+#else
+static void *ExportHiveThread(void *Parameter)
+#endif
+{
+    PHIVE_FILE HiveFile = (PHIVE_FILE)Parameter;
+
+    HiveFile->Result = ExportBinaryHive(HiveFile->FileName, HiveFile->Hive);
+    return 0;
+}
+
+/*
+ * The hives do not share any cells, so each of them
+ * is written by its own thread.
+ */
+BOOL ExportHives(char *DestPath)
+{
+    BOOL Result = TRUE;
+    size_t i;
+
+    for (i = 0; i < sizeof(HiveFiles) / sizeof(HiveFiles[0]); i++)
+    {
+        convert_path (HiveFiles[i].FileName, DestPath);
+        strcat (HiveFiles[i].FileName, DIR_SEPARATOR_STRING);
+        strcat (HiveFiles[i].FileName, HiveFiles[i].Name);
+
+#ifdef _WIN32
+        HiveFiles[i].Thread = _beginthreadex(NULL, 0, ExportHiveThread, &HiveFiles[i], 0, NULL);
+        HiveFiles[i].ThreadStarted = (HiveFiles[i].Thread != 0);
+#else
+        HiveFiles[i].ThreadStarted =
+            (pthread_create(&HiveFiles[i].Thread, NULL, ExportHiveThread, &HiveFiles[i]) == 0);
+#endif
+
+        /* Write the hive ourselves if no thread can be started */
+        if (!HiveFiles[i].ThreadStarted)
+            ExportHiveThread(&HiveFiles[i]);
+    }
+
+    for (i = 0; i < sizeof(HiveFiles) / sizeof(HiveFiles[0]); i++)
+    {
+        if (HiveFiles[i].ThreadStarted)
+        {
+#ifdef _WIN32
+            WaitForSingleObject((void *)HiveFiles[i].Thread, INFINITE);
+            CloseHandle((void *)HiveFiles[i].Thread);
+#else
+            pthread_join(HiveFiles[i].Thread, NULL);
+#endif
+        }
+
+        if (!HiveFiles[i].Result)
+            Result = FALSE;
+    }
+
+    return Result;
+}
+
 int main (int argc, char *argv[])
 {
     char FileName[PATH_MAX];
@@ -107,50 +200,7 @@ int main (int argc, char *argv[])
         }
     }
 
-    convert_path (FileName, argv[1]);
-    strcat (FileName, DIR_SEPARATOR_STRING);
-    strcat (FileName, "default");
-    if (!ExportBinaryHive (FileName, &DefaultHive))
-    {
-        return 1;
-    }
-
-    convert_path (FileName, argv[1]);
-    strcat (FileName, DIR_SEPARATOR_STRING);
-    strcat (FileName, "sam");
-    if (!ExportBinaryHive (FileName, &SamHive))
-    {
-        return 1;
-    }
-
-    convert_path (FileName, argv[1]);
-    strcat (FileName, DIR_SEPARATOR_STRING);
-    strcat (FileName, "security");
-    if (!ExportBinaryHive (FileName, &SecurityHive))
-    {
-        return 1;
-    }
-
-    convert_path (FileName, argv[1]);
-    strcat (FileName, DIR_SEPARATOR_STRING);
-    strcat (FileName, "software");
-    if (!ExportBinaryHive (FileName, &SoftwareHive))
-    {
-        return 1;
-    }
-
-    convert_path (FileName, argv[1]);
-    strcat (FileName, DIR_SEPARATOR_STRING);
-    strcat (FileName, "system");
-    if (!ExportBinaryHive (FileName, &SystemHive))
-    {
-        return 1;
-    }
-
-    convert_path (FileName, argv[1]);
-    strcat (FileName, DIR_SEPARATOR_STRING);
-    strcat (FileName, "BCD");
-    if (!ExportBinaryHive (FileName, &BcdHive))
+    if (!ExportHives (argv[1]))
     {
         return 1;
     }
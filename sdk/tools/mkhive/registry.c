@@ -348,6 +348,131 @@ CreateInMemoryStructure(
 
 LIST_ENTRY CmiReparsePointsHead;
 
+/*
+ * Cache of the keys already opened from the root, by path. The INF files
+ * set many values in the same keys, so most lookups either hit the key of
+ * the previous line or one of its parents, and we only need to walk the
+ * remaining part of the path. Keys are never deleted, so the entries only
+ * become stale when a reparse point is added.
+ */
+#define KEY_CACHE_BUCKETS 4096
+
+typedef struct _KEY_CACHE_ENTRY
+{
+    struct _KEY_CACHE_ENTRY *Next;
+    ULONG Hash;
+    PCMHIVE RegistryHive;
+    HCELL_INDEX KeyCellOffset;
+    SIZE_T Length;
+    WCHAR Name[ANYSIZE_ARRAY];
+} KEY_CACHE_ENTRY, *PKEY_CACHE_ENTRY;
+
+static PKEY_CACHE_ENTRY KeyCache[KEY_CACHE_BUCKETS];
+static PKEY_CACHE_ENTRY LastKeyEntry = NULL;
+
+static ULONG
+RegpHashKeyName(
+    IN PCWSTR Name,
+    IN SIZE_T Length)
+{
+    ULONG Hash = 0;
+    SIZE_T i;
+
+    for (i = 0; i < Length; i++)
+        Hash = Hash * 37 + RtlUpcaseUnicodeChar(Name[i]);
+
+    return Hash;
+}
+
+static BOOL
+RegpIsSameKeyName(
+    IN PKEY_CACHE_ENTRY Entry,
+    IN PCWSTR Name,
+    IN SIZE_T Length)
+{
+    SIZE_T i;
+
+    if (Entry->Length != Length)
+        return FALSE;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Entry->Name[i] != Name[i] &&
+            RtlUpcaseUnicodeChar(Entry->Name[i]) != RtlUpcaseUnicodeChar(Name[i]))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static PKEY_CACHE_ENTRY
+RegpLookupKeyCache(
+    IN PCWSTR Name,
+    IN SIZE_T Length)
+{
+    PKEY_CACHE_ENTRY Entry;
+    ULONG Hash;
+
+    /* Consecutive INF lines usually name the same key */
+    if (LastKeyEntry && RegpIsSameKeyName(LastKeyEntry, Name, Length))
+        return LastKeyEntry;
+
+    Hash = RegpHashKeyName(Name, Length);
+    for (Entry = KeyCache[Hash % KEY_CACHE_BUCKETS]; Entry; Entry = Entry->Next)
+    {
+        if (Entry->Hash == Hash && RegpIsSameKeyName(Entry, Name, Length))
+            return Entry;
+    }
+
+    return NULL;
+}
+
+static PKEY_CACHE_ENTRY
+RegpInsertKeyCache(
+    IN PCWSTR Name,
+    IN SIZE_T Length,
+    IN PCMHIVE RegistryHive,
+    IN HCELL_INDEX KeyCellOffset)
+{
+    PKEY_CACHE_ENTRY Entry;
+
+    Entry = (PKEY_CACHE_ENTRY)malloc(FIELD_OFFSET(KEY_CACHE_ENTRY, Name) +
+                                     Length * sizeof(WCHAR));
+    if (!Entry)
+        return NULL;
+
+    Entry->Hash = RegpHashKeyName(Name, Length);
+    Entry->RegistryHive = RegistryHive;
+    Entry->KeyCellOffset = KeyCellOffset;
+    Entry->Length = Length;
+    memcpy(Entry->Name, Name, Length * sizeof(WCHAR));
+
+    Entry->Next = KeyCache[Entry->Hash % KEY_CACHE_BUCKETS];
+    KeyCache[Entry->Hash % KEY_CACHE_BUCKETS] = Entry;
+    return Entry;
+}
+
+static VOID
+RegpFlushKeyCache(VOID)
+{
+    PKEY_CACHE_ENTRY Entry;
+    ULONG i;
+
+    for (i = 0; i < KEY_CACHE_BUCKETS; i++)
+    {
+        while (KeyCache[i])
+        {
+            Entry = KeyCache[i];
+            KeyCache[i] = Entry->Next;
+            free(Entry);
+        }
+    }
+
+    LastKeyEntry = NULL;
+}
+
 static LONG
 RegpOpenOrCreateKey(
     IN HKEY hParentKey,
@@ -368,6 +493,9 @@ RegpOpenOrCreateKey(
     PLIST_ENTRY Ptr;
     PCM_KEY_NODE SubKeyCell;
     HCELL_INDEX BlockOffset;
+    PKEY_CACHE_ENTRY CacheEntry = NULL;
+    BOOL UseCache = TRUE;
+    SIZE_T Length;
 
     DPRINT("RegpCreateOpenKey('%S')\n", KeyName);
 
@@ -384,11 +512,46 @@ RegpOpenOrCreateKey(
     }
     else
     {
+        /* The cache only knows paths relative to the root key */
+        UseCache = FALSE;
         ParentRegistryHive = HKEY_TO_MEMKEY(hParentKey)->RegistryHive;
         ParentCellOffset = HKEY_TO_MEMKEY(hParentKey)->KeyCellOffset;
     }
 
     LocalKeyName = (PWSTR)KeyName;
+
+    if (UseCache)
+    {
+        /* Start the walk from the longest path prefix we already know */
+        Length = strlenW(KeyName);
+        CacheEntry = RegpLookupKeyCache(KeyName, Length);
+        if (CacheEntry)
+            LocalKeyName = (PWSTR)KeyName + Length;
+
+        while (!CacheEntry && Length > 0)
+        {
+            /* Cut the last path element */
+            do
+            {
+                Length--;
+            } while (Length > 0 && KeyName[Length] != OBJ_NAME_PATH_SEPARATOR);
+
+            if (Length == 0)
+                break;
+
+            CacheEntry = RegpLookupKeyCache(KeyName, Length);
+            if (CacheEntry)
+                LocalKeyName = (PWSTR)KeyName + Length + 1;
+        }
+
+        if (CacheEntry)
+        {
+            LastKeyEntry = CacheEntry;
+            ParentRegistryHive = CacheEntry->RegistryHive;
+            ParentCellOffset = CacheEntry->KeyCellOffset;
+        }
+    }
+
     for (;;)
     {
         End = (PWSTR)strchrW(LocalKeyName, OBJ_NAME_PATH_SEPARATOR);
@@ -449,6 +612,18 @@ RegpOpenOrCreateKey(
             return ERROR_UNSUCCESSFUL;
 
         ParentCellOffset = BlockOffset;
+
+        if (UseCache && ParentCellOffset != HCELL_NIL)
+        {
+            Length = (End ? End : LocalKeyName + strlenW(LocalKeyName)) - KeyName;
+            CacheEntry = RegpInsertKeyCache(KeyName,
+                                            Length,
+                                            ParentRegistryHive,
+                                            ParentCellOffset);
+            if (CacheEntry)
+                LastKeyEntry = CacheEntry;
+        }
+
         if (End)
             LocalKeyName = End + 1;
         else
@@ -821,6 +996,7 @@ ConnectRegistry(
     ReparsePoint->DestinationHive = NewKey->RegistryHive;
     ReparsePoint->DestinationKeyCellOffset = NewKey->KeyCellOffset;
     InsertTailList(&CmiReparsePointsHead, &ReparsePoint->ListEntry);
+    RegpFlushKeyCache();
     return TRUE;
 }
 
@@ -906,6 +1082,7 @@ RegInitializeRegistry(VOID)
     ReparsePoint->DestinationHive = ControlSetKey->RegistryHive;
     ReparsePoint->DestinationKeyCellOffset = ControlSetKey->KeyCellOffset;
     InsertTailList(&CmiReparsePointsHead, &ReparsePoint->ListEntry);
+    RegpFlushKeyCache();
 }
 
 VOID
@@ -913,6 +1090,7 @@ RegShutdownRegistry(VOID)
 {
     /* FIXME: clean up the complete hive */
 
+    RegpFlushKeyCache();
     free(RootKey);
 }
 
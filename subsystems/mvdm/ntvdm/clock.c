@@ -32,16 +32,35 @@
  */
 // #define IPS_DISPLAY
 
-/* Processor speed */
-#define STEPS_PER_CYCLE 1024
+/*
+ * Processor speed: the CPU runs in batches lasting until the next timer
+ * deadline, but never shorter than MIN_STEPS_PER_CYCLE instructions
+ * nor longer than MAX_STEPS_PER_CYCLE instructions.
+ */
+#define MIN_STEPS_PER_CYCLE 1024
+#define MAX_STEPS_PER_CYCLE 65536
+
+/* Maximum number of hardware timers */
+#define MAX_HARDWARE_TIMERS 32
+
+/* Shortest sleep while the CPU is halted, in 100 ns units (1 ms) */
+#define MIN_IDLE_SLEEP 10000ULL
 
 /* VARIABLES ******************************************************************/
 
-static LIST_ENTRY Timers;
+/* Enabled timers, as a binary min-heap ordered by their deadline */
+static PHARDWARE_TIMER Timers[MAX_HARDWARE_TIMERS];
+static ULONG TimerCount = 0;
+
+/* Each created timer has a place in the heap, so enabling one cannot fail */
+static ULONG CreatedTimers = 0;
+
+/* Wakes up a halted CPU when a timer gets enabled */
+static HANDLE WakeEvent = NULL;
+
 static LARGE_INTEGER StartPerfCount, Frequency;
 // static ULONG StartTickCount;
 static LARGE_INTEGER Counter;
-static ULONG CurrentTickCount;
 static ULONGLONG LastCycles = 0ULL;
 static PHARDWARE_TIMER IpsTimer;
 
@@ -71,56 +90,117 @@ static VOID FASTCALL IpsCallback(ULONGLONG ElapsedTime)
     LastCycles = CurrentCycleCount;
 }
 
+static inline ULONGLONG TimerDeadline(PHARDWARE_TIMER Timer)
+{
+    return Timer->LastTick.QuadPart + Timer->Delay;
+}
+
+static inline VOID TimerHeapSet(ULONG Index, PHARDWARE_TIMER Timer)
+{
+    Timers[Index] = Timer;
+    Timer->HeapIndex = Index;
+}
+
+static VOID TimerHeapSiftUp(ULONG Index)
+{
+    PHARDWARE_TIMER Timer = Timers[Index];
+    ULONG Parent;
+
+    while (Index > 0)
+    {
+        Parent = (Index - 1) / 2;
+        if (TimerDeadline(Timers[Parent]) <= TimerDeadline(Timer)) break;
+
+        TimerHeapSet(Index, Timers[Parent]);
+        Index = Parent;
+    }
+
+    TimerHeapSet(Index, Timer);
+}
+
+static VOID TimerHeapSiftDown(ULONG Index)
+{
+    PHARDWARE_TIMER Timer = Timers[Index];
+    ULONG Child;
+
+    while ((Child = 2 * Index + 1) < TimerCount)
+    {
+        /* Pick the earliest of the two children */
+        if ((Child + 1 < TimerCount)
+            && (TimerDeadline(Timers[Child + 1]) < TimerDeadline(Timers[Child])))
+        {
+            Child++;
+        }
+
+        if (TimerDeadline(Timer) <= TimerDeadline(Timers[Child])) break;
+
+        TimerHeapSet(Index, Timers[Child]);
+        Index = Child;
+    }
+
+    TimerHeapSet(Index, Timer);
+}
+
+static VOID TimerHeapUpdate(PHARDWARE_TIMER Timer)
+{
+    /* The deadline of the timer changed, move it to its new place */
+    TimerHeapSiftUp(Timer->HeapIndex);
+    TimerHeapSiftDown(Timer->HeapIndex);
+}
+
+static VOID TimerHeapInsert(PHARDWARE_TIMER Timer)
+{
+    TimerHeapSet(TimerCount, Timer);
+    TimerCount++;
+    TimerHeapSiftUp(Timer->HeapIndex);
+}
+
+static VOID TimerHeapRemove(PHARDWARE_TIMER Timer)
+{
+    ULONG Index = Timer->HeapIndex;
+
+    /* Replace it with the last timer of the heap */
+    TimerCount--;
+    if (Index == TimerCount) return;
+
+    TimerHeapSet(Index, Timers[TimerCount]);
+    TimerHeapUpdate(Timers[Index]);
+}
+
 /* PUBLIC FUNCTIONS ***********************************************************/
 
 VOID ClockUpdate(VOID)
 {
     extern BOOLEAN CpuRunning;
-    UINT i;
-    PLIST_ENTRY Entry;
+    ULONG i, Steps;
+    ULONGLONG Ticks, Remaining;
+    LARGE_INTEGER Timeout;
     PHARDWARE_TIMER Timer;
 
     while (VdmRunning && CpuRunning)
     {
-        /* Get the current counters */
+        /* Get the current counter */
         /// DWORD_PTR oldmask = SetThreadAffinityMask(GetCurrentThread(), 0);
-        CurrentTickCount = GetTickCount();
         NtQueryPerformanceCounter(&Counter, NULL);
         /// SetThreadAffinityMask(GetCurrentThread(), oldmask);
 
-        /* Continue CPU emulation */
-        for (i = 0; VdmRunning && CpuRunning && (i < STEPS_PER_CYCLE); i++)
-        {
-            CpuStep();
-            ++CurrentCycleCount;
-        }
-
-        Entry = Timers.Flink;
-        while (Entry != &Timers)
+        /*
+         * Fire the timers that expired. Each timer fires at most once per
+         * cycle, since its deadline moves past the current counter afterwards.
+         */
+        for (i = TimerCount; (i > 0) && (TimerCount > 0); i--)
         {
-            ULONGLONG Ticks = (ULONGLONG)-1;
-
-            Timer = CONTAINING_RECORD(Entry, HARDWARE_TIMER, Link);
-            Entry = Entry->Flink;
-
+            Timer = Timers[0];
             ASSERT((Timer->EnableCount > 0) && (Timer->Flags & HARDWARE_TIMER_ENABLED));
 
             if (Timer->Delay)
             {
-                if (Timer->Flags & HARDWARE_TIMER_PRECISE)
-                {
-                    /* Use the performance counter for precise timers */
-                    if (Counter.QuadPart <= Timer->LastTick.QuadPart) continue;
-                    Ticks = (Counter.QuadPart - Timer->LastTick.QuadPart) / Timer->Delay;
-                }
-                else
-                {
-                    /* Use the regular tick count for normal timers */
-                    if (CurrentTickCount <= Timer->LastTick.LowPart) continue;
-                    Ticks = (CurrentTickCount - Timer->LastTick.LowPart) / (ULONG)Timer->Delay;
-                }
-
-                if (Ticks == 0) continue;
+                if (TimerDeadline(Timer) > (ULONGLONG)Counter.QuadPart) break;
+                Ticks = (Counter.QuadPart - Timer->LastTick.QuadPart) / Timer->Delay;
+            }
+            else
+            {
+                Ticks = (ULONGLONG)-1;
             }
 
             Timer->Callback(Ticks);
@@ -132,7 +212,50 @@ VOID ClockUpdate(VOID)
             }
 
             /* Update the time of the last timer tick */
-            Timer->LastTick.QuadPart += Ticks * Timer->Delay;
+            if (Timer->Delay) Timer->LastTick.QuadPart += Ticks * Timer->Delay;
+            else Timer->LastTick.QuadPart = Counter.QuadPart + 1;
+
+            if (Timer->Flags & HARDWARE_TIMER_ENABLED) TimerHeapUpdate(Timer);
+        }
+
+        /* Run the CPU until the next deadline */
+        Steps = MAX_STEPS_PER_CYCLE;
+        if (TimerCount > 0)
+        {
+            Remaining = TimerDeadline(Timers[0]);
+            Remaining = (Remaining > (ULONGLONG)Counter.QuadPart)
+                        ? min(Remaining - Counter.QuadPart, (ULONGLONG)Frequency.QuadPart) : 0;
+
+            Remaining = Remaining * CurrentIps / Frequency.QuadPart;
+            Steps = (ULONG)min(max(Remaining, MIN_STEPS_PER_CYCLE), MAX_STEPS_PER_CYCLE);
+        }
+
+        CurrentCycleCount += CpuExecuteBatch(Steps);
+
+        /*
+         * Don't spin while the guest waits for an interrupt. Sleep until the
+         * next deadline, or until a timer gets enabled from another thread
+         * (e.g. for a key press). Some timers fire too often to wait for them,
+         * so sleep at least a little.
+         */
+        if (CpuIsIdle() && VdmRunning && CpuRunning)
+        {
+            NtQueryPerformanceCounter(&Counter, NULL);
+
+            Remaining = (ULONGLONG)Frequency.QuadPart;
+            if (TimerCount > 0)
+            {
+                Remaining = TimerDeadline(Timers[0]);
+                Remaining = (Remaining > (ULONGLONG)Counter.QuadPart)
+                            ? min(Remaining - Counter.QuadPart, (ULONGLONG)Frequency.QuadPart) : 0;
+            }
+
+            if (Remaining > 0)
+            {
+                Timeout.QuadPart = -(LONGLONG)max(Remaining * 10000000ULL / Frequency.QuadPart,
+                                                  MIN_IDLE_SLEEP);
+                NtWaitForSingleObject(WakeEvent, FALSE, &Timeout);
+            }
         }
 
         /* Yield execution to other threads */
@@ -145,9 +268,17 @@ PHARDWARE_TIMER CreateHardwareTimer(ULONG Flags, ULONGLONG Delay, PHARDWARE_TIME
 {
     PHARDWARE_TIMER Timer;
 
+    if (CreatedTimers >= MAX_HARDWARE_TIMERS)
+    {
+        DPRINT1("NTVDM: Too many hardware timers!\n");
+        return NULL;
+    }
+
     Timer = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Timer));
     if (Timer == NULL) return NULL;
 
+    CreatedTimers++;
+
     Timer->Flags = Flags & ~HARDWARE_TIMER_ENABLED;
     Timer->EnableCount = 0;
     Timer->Callback = Callback;
@@ -166,17 +297,15 @@ VOID EnableHardwareTimer(PHARDWARE_TIMER Timer)
     /* Check if the count is above 0 but the timer isn't enabled */
     if ((Timer->EnableCount > 0) && !(Timer->Flags & HARDWARE_TIMER_ENABLED))
     {
-        if (Timer->Flags & HARDWARE_TIMER_PRECISE)
-        {
-            NtQueryPerformanceCounter(&Timer->LastTick, NULL);
-        }
-        else
-        {
-            Timer->LastTick.LowPart = GetTickCount();
-        }
+        ASSERT(TimerCount < CreatedTimers);
+
+        NtQueryPerformanceCounter(&Timer->LastTick, NULL);
 
         Timer->Flags |= HARDWARE_TIMER_ENABLED;
-        InsertTailList(&Timers, &Timer->Link);
+        TimerHeapInsert(Timer);
+
+        /* The CPU may be sleeping past the deadline of this timer */
+        if (WakeEvent != NULL) NtSetEvent(WakeEvent, NULL);
     }
 }
 
@@ -190,35 +319,41 @@ VOID DisableHardwareTimer(PHARDWARE_TIMER Timer)
     {
         /* Disable the timer */
         Timer->Flags &= ~HARDWARE_TIMER_ENABLED;
-        RemoveEntryList(&Timer->Link);
+        TimerHeapRemove(Timer);
     }
 }
 
 VOID SetHardwareTimerDelay(PHARDWARE_TIMER Timer, ULONGLONG NewDelay)
 {
-    if (Timer->Flags & HARDWARE_TIMER_PRECISE)
+    /*
+     * All the timers are driven by the performance counter,
+     * convert the delay from nanoseconds to performance counter ticks.
+     */
+    if (!(Timer->Flags & HARDWARE_TIMER_PRECISE))
     {
-        /* Convert the delay from nanoseconds to performance counter ticks */
-        Timer->Delay = (NewDelay * Frequency.QuadPart + 500000000ULL) / 1000000000ULL;
-    }
-    else
-    {
-        Timer->Delay = NewDelay / 1000000ULL;
+        /* Normal timers only have a resolution of one millisecond */
+        NewDelay -= NewDelay % 1000000ULL;
     }
+
+    Timer->Delay = (NewDelay * Frequency.QuadPart + 500000000ULL) / 1000000000ULL;
+
+    /* The deadline of the timer changed */
+    if (Timer->Flags & HARDWARE_TIMER_ENABLED) TimerHeapUpdate(Timer);
 }
 
 VOID DestroyHardwareTimer(PHARDWARE_TIMER Timer)
 {
     if (Timer)
     {
-        if (Timer->Flags & HARDWARE_TIMER_ENABLED) RemoveEntryList(&Timer->Link);
+        if (Timer->Flags & HARDWARE_TIMER_ENABLED) TimerHeapRemove(Timer);
         RtlFreeHeap(RtlGetProcessHeap(), 0, Timer);
+        CreatedTimers--;
     }
 }
 
 BOOLEAN ClockInitialize(VOID)
 {
-    InitializeListHead(&Timers);
+    TimerCount = 0;
 
     /* Initialize the performance counter (needed for hardware timers) */
     /* Find the starting performance */
@@ -232,6 +367,13 @@ BOOLEAN ClockInitialize(VOID)
     /* Find the starting tick count */
     // StartTickCount = GetTickCount();
 
+    /* Create the event that wakes up a halted CPU */
+    if (!NT_SUCCESS(NtCreateEvent(&WakeEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE)))
+    {
+        wprintf(L"FATAL: Cannot create the clock wake event.\n");
+        return FALSE;
+    }
+
     IpsTimer = CreateHardwareTimer(HARDWARE_TIMER_ENABLED, HZ_TO_NS(10), IpsCallback);
     if (IpsTimer == NULL)
     {
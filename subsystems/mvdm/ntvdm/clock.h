@@ -23,7 +23,7 @@ typedef VOID (FASTCALL *PHARDWARE_TIMER_PROC)(ULONGLONG ElapsedTime);
 
 typedef struct _HARDWARE_TIMER
 {
-    LIST_ENTRY Link;
+    ULONG HeapIndex;
     ULONG Flags;
     LONG EnableCount;
     ULONGLONG Delay;
@@ -39,6 +39,12 @@
 FAST486_STATE EmulatorContext;
 BOOLEAN CpuRunning = FALSE;
 
+static PULONG Tlb = NULL;
+
+#ifndef FAST486_NO_BLOCK_CACHE
+static PFAST486_BLOCK_CACHE BlockCache = NULL;
+#endif
+
 /* No more than 'MaxCpuCallLevel' recursive CPU calls are allowed */
 static const INT MaxCpuCallLevel = 32;
 static INT CpuCallLevel = 0; // == 0: CPU stopped; >= 1: CPU running or halted
@@ -114,6 +120,43 @@ VOID CpuStep(VOID)
     Fast486StepInto(&EmulatorContext);
 }
 
+ULONG CpuExecuteBatch(ULONG MaxSteps)
+{
+    ULONG SavedBudget = EmulatorContext.BatchBudget;
+    _SEH2_VOLATILE BOOLEAN Unwound = TRUE;
+    ULONG Steps = 0;
+
+    _SEH2_TRY
+    {
+        /*
+         * Execute up to MaxSteps instructions. The batch ends earlier
+         * if the CPU halts or if CpuUnsimulate is called meanwhile.
+         */
+        Steps = Fast486ExecuteBatch(&EmulatorContext, MaxSteps);
+        Unwound = FALSE;
+    }
+    _SEH2_FINALLY
+    {
+        /*
+         * The batch may be nested in another one. If an exception unwound it,
+         * give the outer batch its budget back. If the VDM or the CPU was
+         * stopped meanwhile, the outer batch must end too.
+         */
+        if (Unwound) EmulatorContext.BatchBudget = SavedBudget;
+        if (!VdmRunning || !CpuRunning) EmulatorContext.BatchBudget = 0;
+    }
+    _SEH2_END;
+
+    return Steps;
+}
+
+BOOLEAN CpuIsIdle(VOID)
+{
+    /* The CPU is halted and no interrupt can wake it up yet */
+    return EmulatorContext.Halted
+           && !(EmulatorContext.Flags.If && EmulatorContext.IntSignaled);
+}
+
 LONG CpuExceptionFilter(IN PEXCEPTION_POINTERS ExceptionInfo)
 {
     /* Get the exception record */
@@ -204,6 +247,9 @@ VOID CpuUnsimulate(VOID)
 {
     /* Stop simulation */
     CpuRunning = FALSE;
+
+    /* Leave the current batch of instructions as soon as possible */
+    Fast486StopBatch(&EmulatorContext);
 }
 
 static VOID WINAPI CpuUnsimulateBop(LPWORD Stack)
@@ -222,6 +268,10 @@ BOOLEAN CpuInitialize(VOID)
         // return FALSE;
     // }
 
+    /* Allocate the TLB, it only speeds up paging so we can live without it */
+    Tlb = RtlAllocateHeap(RtlGetProcessHeap(), 0, FAST486_NUM_TLB_ENTRIES * sizeof(ULONG));
+    if (Tlb == NULL) DPRINT1("Failed to allocate the CPU TLB\n");
+
     /* Initialize the CPU */
     Fast486Initialize(&EmulatorContext,
                       EmulatorReadMemory,
@@ -231,7 +281,20 @@ BOOLEAN CpuInitialize(VOID)
                       EmulatorBiosOperation,
                       EmulatorIntAcknowledge,
                       EmulatorFpu,
-                      NULL /* TODO: Use a TLB */);
+                      Tlb);
+
+#ifndef FAST486_NO_BLOCK_CACHE
+    /* Allocate the decoded block cache */
+    BlockCache = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*BlockCache));
+    if (BlockCache != NULL)
+    {
+        Fast486SetBlockCache(&EmulatorContext, BlockCache);
+    }
+    else
+    {
+        DPRINT1("Failed to allocate the CPU block cache, using the plain interpreter\n");
+    }
+#endif
 
     /* Initialize the software callback system and register the emulator BOPs */
     // RegisterBop(BOP_DEBUGGER  , EmulatorDebugBreakBop);
@@ -243,6 +306,24 @@ BOOLEAN CpuInitialize(VOID)
 VOID CpuCleanup(VOID)
 {
     // Fast486Cleanup();
+
+#ifndef FAST486_NO_BLOCK_CACHE
+    /* Free the decoded block cache */
+    if (BlockCache != NULL)
+    {
+        Fast486SetBlockCache(&EmulatorContext, NULL);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, BlockCache);
+        BlockCache = NULL;
+    }
+#endif
+
+    /* Free the TLB */
+    if (Tlb != NULL)
+    {
+        EmulatorContext.Tlb = NULL;
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Tlb);
+        Tlb = NULL;
+    }
 }
 
 /* EOF */
@@ -65,6 +65,8 @@ VOID EmulatorException(BYTE ExceptionNumber, LPWORD Stack);
 
 VOID CpuExecute(WORD Segment, WORD Offset);
 VOID CpuStep(VOID);
+ULONG CpuExecuteBatch(ULONG MaxSteps);
+BOOLEAN CpuIsIdle(VOID);
 VOID CpuSimulate(VOID);
 VOID CpuUnsimulate(VOID);
 #if 0
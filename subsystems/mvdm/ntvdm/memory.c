@@ -38,6 +38,7 @@ typedef struct _MEM_HOOK
 
 static LIST_ENTRY HookList;
 static PMEM_HOOK PageTable[TOTAL_PAGES] = { NULL };
+static PVOID DirectPages[TOTAL_PAGES] = { NULL };
 static BOOLEAN A20Line = FALSE;
 
 /* PRIVATE FUNCTIONS **********************************************************/
@@ -134,6 +135,29 @@ WritePage(PMEM_HOOK Hook, ULONG Address, PVOID Buffer, ULONG Size)
     }
 }
 
+/*
+ * Rebuilds the map of pages the CPU may access directly, without going
+ * through EmulatorReadMemory / EmulatorWriteMemory. Hooked pages are left
+ * out, and the map follows the wrap-around when the A20 line is disabled.
+ */
+static VOID
+MemUpdateDirectPages(VOID)
+{
+    ULONG i, Page;
+
+    for (i = 0; i < TOTAL_PAGES; i++)
+    {
+        /* If the A20 line is disabled, mask bit 20 */
+        Page = A20Line ? i : (i & ~(1 << (20 - 12)));
+
+        /*
+         * NOTE: In the non-standalone build the first page is at host address
+         * NULL, so it always goes through the slow path. This is fine.
+         */
+        DirectPages[i] = (PageTable[Page] == NULL) ? REAL_TO_PHYS(Page << 12) : NULL;
+    }
+}
+
 /* PUBLIC FUNCTIONS ***********************************************************/
 
 VOID FASTCALL EmulatorReadMemory(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
@@ -271,7 +295,10 @@ VOID FASTCALL EmulatorCopyMemory(PFAST486_STATE State, ULONG DestAddress, ULONG
 
 VOID EmulatorSetA20(BOOLEAN Enabled)
 {
+    if (A20Line == Enabled) return;
+
     A20Line = Enabled;
+    MemUpdateDirectPages();
 }
 
 BOOLEAN EmulatorGetA20(VOID)
@@ -343,6 +370,9 @@ MemInstallFastMemoryHook(PVOID Address,
     /* Add the hook entry to the page table */
     for (i = FirstPage; i <= LastPage; i++) PageTable[i] = Hook;
 
+    /* The hooked pages cannot be accessed directly anymore */
+    MemUpdateDirectPages();
+
     return TRUE;
 }
 
@@ -371,6 +401,7 @@ MemRemoveFastMemoryHook(PVOID Address, ULONG Size)
         PageTable[i] = NULL;
     }
 
+    MemUpdateDirectPages();
     return TRUE;
 }
 
@@ -539,6 +570,9 @@ VDDInstallMemoryHook(IN HANDLE hVdd,
     /* Add the hook entry to the page table */
     for (i = FirstPage; i <= LastPage; i++) PageTable[i] = Hook;
 
+    /* The hooked pages cannot be accessed directly anymore */
+    MemUpdateDirectPages();
+
     return TRUE;
 }
 
@@ -595,6 +629,7 @@ VDDDeInstallMemoryHook(IN HANDLE hVdd,
         PageTable[i] = NULL;
     }
 
+    MemUpdateDirectPages();
     return TRUE;
 }
 
@@ -773,6 +808,11 @@ MemInitialize(VOID)
      * retrieve the exact CS:IP where the problem happens.
      */
     RtlFillMemory(BaseAddress, MAX_ADDRESS, 0xCC);
+
+    /* Let the CPU access the unhooked memory directly */
+    MemUpdateDirectPages();
+    Fast486SetMemoryMap(&EmulatorContext, DirectPages, TOTAL_PAGES);
+
     return TRUE;
 }
 
@@ -783,6 +823,9 @@ MemCleanup(VOID)
     SIZE_T MemorySize = MAX_ADDRESS;
     PLIST_ENTRY Pointer;
 
+    /* The CPU must not touch the memory directly anymore */
+    Fast486SetMemoryMap(&EmulatorContext, NULL, 0);
+
     while (!IsListEmpty(&HookList))
     {
         Pointer = RemoveHeadList(&HookList);
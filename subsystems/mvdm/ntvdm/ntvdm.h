@@ -36,6 +36,7 @@
 DWORD WINAPI SetLastConsoleEventActive(VOID);
 
 #define NTOS_MODE_USER
+#include <ndk/exfuncs.h>
 #include <ndk/kefuncs.h>
 #include <ndk/mmfuncs.h>
 #include <ndk/obfuncs.h>